@@ -26,7 +26,8 @@
 CLICK_DECLS
 
 RecordTimestamp::RecordTimestamp() :
-    _offset(-1), _dynamic(false), _net_order(false), _timestamps(), _np(0) {
+    _offset(-1), _dynamic(false), _net_order(false), _ring(false),
+    _ring_mask(0), _next(0), _timestamps(), _np(0) {
 }
 
 RecordTimestamp::~RecordTimestamp() {
@@ -41,12 +42,23 @@ int RecordTimestamp::configure(Vector<String> &conf, ErrorHandler *errh) {
             .read("OFFSET", _offset)
             .read("DYNAMIC", _dynamic)
             .read("NET_ORDER", _net_order)
+            .read("RING", _ring)
             .complete() < 0)
         return -1;
 
     if (n == 0)
         n = 65536;
-    _timestamps.reserve(n);
+    if (_ring) {
+        if (_dynamic)
+            return errh->error("RING and DYNAMIC are incompatible");
+        uint64_t size = 1;
+        while (size < n)
+            size <<= 1;
+        _ring_mask = size - 1;
+        _timestamps.resize(size, Timestamp::uninitialized_t());
+        _numbers.resize(size, ~(uint64_t) 0);
+    } else
+        _timestamps.reserve(n);
 
     if (e && (_np = static_cast<NumberPacket *>(e->cast("NumberPacket"))) == 0)
         return errh->error("COUNTER must be a valid NumberPacket element");
@@ -62,7 +74,12 @@ int RecordTimestamp::configure(Vector<String> &conf, ErrorHandler *errh) {
 inline void
 RecordTimestamp::rmaction(Packet *p) {
     uint64_t i;
-    if (_offset >= 0) {
+    if (_ring) {
+        i = _offset >= 0 ? get_numberpacket(p, _offset, _net_order) : _next++;
+        uint64_t slot = i & _ring_mask;
+        _timestamps.unchecked_at(slot) = Timestamp::now_steady();
+        _numbers.unchecked_at(slot) = i;
+    } else if (_offset >= 0) {
         i = get_numberpacket(p, _offset, _net_order);
         assert(i < ULLONG_MAX);
         while (i >= (unsigned)_timestamps.size()) {
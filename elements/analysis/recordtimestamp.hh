@@ -55,6 +55,14 @@ Otherwise, user can set it. Defaults to false.
 
 Only samples one packet every N packets. Defaults to 1 (all packets)
 
+=item RING
+
+If true, the vector is a ring of N slots (rounded up to a power of two): the
+timestamp of packet number I goes to slot I modulo N, overwriting any older
+one, so the test can run indefinitely in fixed memory. A timestamp that was
+overwritten before being read is reported as missing, and TimestampDiff
+sends the packet to its second output. Defaults to false.
+
 =a
 
 NumberPacket, TimestampDiff
@@ -92,14 +100,24 @@ private:
     int _offset;
     bool _dynamic;
     bool _net_order;
+    bool _ring;
+    uint64_t _ring_mask;
+    uint64_t _next;
     Vector<Timestamp> _timestamps;
+    // In RING mode, the packet number stored in each slot
+    Vector<uint64_t> _numbers;
     NumberPacket *_np;
 };
 
 const Timestamp read_timestamp = Timestamp::make_sec(1);
 
 inline Timestamp RecordTimestamp::get(uint64_t i) {
-    if (i >= (unsigned)_timestamps.size()) {
+    if (_ring) {
+        uint64_t slot = i & _ring_mask;
+        if (_numbers.unchecked_at(slot) != i)
+            return Timestamp::uninitialized_t();
+        i = slot;
+    } else if (i >= (unsigned)_timestamps.size()) {
         click_chatter("%p{element}: Index %d is out of range !", this, i);
         return Timestamp::uninitialized_t();
     }
@@ -0,0 +1,101 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * sketchcardinality.{cc,hh} -- estimates the number of distinct keys with
+ * HyperLogLog
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "sketchcardinality.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+CLICK_DECLS
+
+SketchCardinality::SketchCardinality()
+    : _precision(12)
+{
+}
+
+int
+SketchCardinality::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String key = "aggregate";
+    if (Args(conf, this, errh)
+	.read("KEY", WordArg(), key)
+	.read("PRECISION", _precision)
+	.complete() < 0)
+	return -1;
+    if (_precision < 4 || _precision > 18)
+	return errh->error("PRECISION must be between 4 and 18");
+    return set_key(key, errh);
+}
+
+int
+SketchCardinality::initialize(ErrorHandler *)
+{
+    _sketches.initialize(get_passing_threads(), HyperLogLogSketch(_precision));
+    return 0;
+}
+
+inline void
+SketchCardinality::count(Packet *p)
+{
+    IPFlowID key = IPFlowID::uninitialized_t();
+    if (packet_key(p, key))
+	local_sketch(_sketches).add(sketch_hash(key));
+}
+
+Packet *
+SketchCardinality::simple_action(Packet *p)
+{
+    count(p);
+    return p;
+}
+
+#if HAVE_BATCH
+PacketBatch *
+SketchCardinality::simple_action_batch(PacketBatch *batch)
+{
+    FOR_EACH_PACKET(batch, p)
+	count(p);
+    return batch;
+}
+#endif
+
+String
+SketchCardinality::read_handler(Element *e, void *)
+{
+    SketchCardinality *sc = static_cast<SketchCardinality *>(e);
+    HyperLogLogSketch s(sc->_precision);
+    for (unsigned i = 0; i < sc->_sketches.weight(); i++)
+	if (const HyperLogLogSketch *t = sc->thread_sketch(sc->_sketches, i))
+	    s.merge(*t);
+    return String((uint64_t) (s.estimate() + 0.5));
+}
+
+int
+SketchCardinality::write_handler(const String &, Element *e, void *, ErrorHandler *)
+{
+    static_cast<SketchCardinality *>(e)->reset_sketches();
+    return 0;
+}
+
+void
+SketchCardinality::add_handlers()
+{
+    add_read_handler("cardinality", read_handler);
+    add_write_handler("reset", write_handler, 0, Handler::f_button);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel SketchElement)
+EXPORT_ELEMENT(SketchCardinality)
@@ -0,0 +1,84 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_SKETCHCARDINALITY_HH
+#define CLICK_SKETCHCARDINALITY_HH
+#include "sketchelement.hh"
+#include <click/multithread.hh>
+CLICK_DECLS
+
+/*
+=c
+
+SketchCardinality([I<keywords> KEY, PRECISION])
+
+=s aggregates
+
+estimates the number of distinct keys with HyperLogLog
+
+=d
+
+SketchCardinality estimates how many distinct keys it has seen with a
+HyperLogLog sketch of 2<sup>PRECISION</sup> bytes per thread. The relative
+standard error is 1.04 / 2<sup>PRECISION/2</sup>, 1.6% by default. Small
+cardinalities are nearly exact.
+
+Packets are emitted unchanged.
+
+Keyword arguments are:
+
+=over 8
+
+=item KEY
+
+The key packets are counted by: C<aggregate>, C<flow>, C<src> or C<dst>, as
+for SketchCounter. Default is C<aggregate>.
+
+=item PRECISION
+
+Unsigned, between 4 and 18. Default is 12.
+
+=back
+
+=h cardinality read-only
+
+Returns the estimated number of distinct keys, over all threads.
+
+=h reset write-only
+
+Clears the sketches.
+
+=n
+
+Only available in user-level processes.
+
+=a
+
+SketchCounter, SketchTopK, AggregateIPFlows */
+
+class SketchCardinality : public SketchElement { public:
+
+    SketchCardinality() CLICK_COLD;
+
+    const char *class_name() const		{ return "SketchCardinality"; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    inline void count(Packet *p);
+    Packet *simple_action(Packet *p);
+#if HAVE_BATCH
+    PacketBatch *simple_action_batch(PacketBatch *batch);
+#endif
+
+  private:
+
+    unsigned _precision;
+    per_thread_omem<ThreadSketch<HyperLogLogSketch> > _sketches;
+
+    static String read_handler(Element *e, void *thunk) CLICK_COLD;
+    static int write_handler(const String &str, Element *e, void *thunk, ErrorHandler *errh) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,128 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * sketchcounter.{cc,hh} -- estimates packet counts per key in a Count-Min
+ * sketch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "sketchcounter.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+CLICK_DECLS
+
+SketchCounter::SketchCounter()
+    : _width(4096), _depth(4)
+{
+}
+
+int
+SketchCounter::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String key = "aggregate";
+    if (Args(conf, this, errh)
+	.read("KEY", WordArg(), key)
+	.read("WIDTH", _width)
+	.read("DEPTH", _depth)
+	.read("BYTES", _bytes)
+	.complete() < 0)
+	return -1;
+    if (_width == 0 || _depth == 0 || _depth > 16)
+	return errh->error("WIDTH must be positive and DEPTH between 1 and 16");
+    return set_key(key, errh);
+}
+
+int
+SketchCounter::initialize(ErrorHandler *)
+{
+    _sketches.initialize(get_passing_threads(), CountMinSketch(_width, _depth));
+    return 0;
+}
+
+inline void
+SketchCounter::count(Packet *p)
+{
+    IPFlowID key = IPFlowID::uninitialized_t();
+    if (packet_key(p, key))
+	local_sketch(_sketches).add(sketch_hash(key), packet_amount(p));
+}
+
+Packet *
+SketchCounter::simple_action(Packet *p)
+{
+    count(p);
+    return p;
+}
+
+#if HAVE_BATCH
+PacketBatch *
+SketchCounter::simple_action_batch(PacketBatch *batch)
+{
+    FOR_EACH_PACKET(batch, p)
+	count(p);
+    return batch;
+}
+#endif
+
+void
+SketchCounter::merged(CountMinSketch &s) const
+{
+    s = CountMinSketch(_width, _depth);
+    for (unsigned i = 0; i < _sketches.weight(); i++)
+	if (const CountMinSketch *t = thread_sketch(_sketches, i))
+	    s.merge(*t);
+}
+
+String
+SketchCounter::read_handler(Element *e, void *)
+{
+    SketchCounter *sc = static_cast<SketchCounter *>(e);
+    uint64_t total = 0;
+    for (unsigned i = 0; i < sc->_sketches.weight(); i++)
+	if (const CountMinSketch *t = sc->thread_sketch(sc->_sketches, i))
+	    total += t->total();
+    return String(total);
+}
+
+int
+SketchCounter::estimate_handler(int, String &str, Element *e, const Handler *, ErrorHandler *errh)
+{
+    SketchCounter *sc = static_cast<SketchCounter *>(e);
+    IPFlowID key = IPFlowID::uninitialized_t();
+    if (!sc->parse_key(str, key))
+	return errh->error("bad key %<%s%>", str.c_str());
+    // The merged sketch is tighter than the sum of per-thread estimates
+    CountMinSketch s;
+    sc->merged(s);
+    str = String(s.estimate(sketch_hash(key)));
+    return 0;
+}
+
+int
+SketchCounter::write_handler(const String &, Element *e, void *, ErrorHandler *)
+{
+    static_cast<SketchCounter *>(e)->reset_sketches();
+    return 0;
+}
+
+void
+SketchCounter::add_handlers()
+{
+    add_read_handler("count", read_handler, h_count);
+    set_handler("estimate", Handler::f_read | Handler::f_read_param, estimate_handler, h_estimate);
+    add_write_handler("reset", write_handler, h_reset, Handler::f_button);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel SketchElement)
+EXPORT_ELEMENT(SketchCounter)
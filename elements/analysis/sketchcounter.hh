@@ -0,0 +1,106 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_SKETCHCOUNTER_HH
+#define CLICK_SKETCHCOUNTER_HH
+#include "sketchelement.hh"
+#include <click/multithread.hh>
+CLICK_DECLS
+
+/*
+=c
+
+SketchCounter([I<keywords> KEY, WIDTH, DEPTH, BYTES])
+
+=s aggregates
+
+estimates packet counts per key in a Count-Min sketch
+
+=d
+
+SketchCounter counts the packets of each key in a Count-Min sketch, whose
+memory does not depend on the number of keys. Each thread has its own
+sketch; handlers read their sum. Estimates are never below the true count,
+and exceed it by more than 2.7 * count / WIDTH with probability at most
+e<sup>-DEPTH</sup>.
+
+Packets are emitted unchanged.
+
+Keyword arguments are:
+
+=over 8
+
+=item KEY
+
+The key packets are counted by: C<aggregate>, the aggregate annotation;
+C<flow>, the IP addresses and TCP or UDP ports (other packets only use their
+addresses); C<src> or C<dst>, the source or destination IP address. Default
+is C<aggregate>. Non-IP packets have no C<flow>, C<src> or C<dst> key and are
+not counted.
+
+=item WIDTH
+
+Unsigned. Counters per row, rounded up to a power of two. Default is 4096.
+
+=item DEPTH
+
+Unsigned. Number of rows, at most 16. Default is 4.
+
+=item BYTES
+
+Boolean. If true, count bytes rather than packets. Default is false.
+
+=back
+
+=h count read-only
+
+Returns the total count.
+
+=h estimate read-only
+
+Takes a key as parameter: an aggregate, an IP address, or for C<flow> keys,
+"SADDR SPORT DADDR DPORT". Returns the estimated count of that key.
+
+=h reset write-only
+
+Clears all counts.
+
+=n
+
+Only available in user-level processes.
+
+=a
+
+SketchTopK, SketchCardinality, SketchHeavyHitters, AggregateCounter */
+
+class SketchCounter : public SketchElement { public:
+
+    SketchCounter() CLICK_COLD;
+
+    const char *class_name() const		{ return "SketchCounter"; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    inline void count(Packet *p);
+    Packet *simple_action(Packet *p);
+#if HAVE_BATCH
+    PacketBatch *simple_action_batch(PacketBatch *batch);
+#endif
+
+  private:
+
+    unsigned _width;
+    unsigned _depth;
+    per_thread_omem<ThreadSketch<CountMinSketch> > _sketches;
+
+    void merged(CountMinSketch &s) const;
+
+    enum { h_count, h_estimate, h_reset };
+    static String read_handler(Element *e, void *thunk) CLICK_COLD;
+    static int estimate_handler(int op, String &str, Element *e, const Handler *h, ErrorHandler *errh) CLICK_COLD;
+    static int write_handler(const String &str, Element *e, void *thunk, ErrorHandler *errh) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
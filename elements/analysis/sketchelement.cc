@@ -0,0 +1,104 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * sketchelement.{cc,hh} -- base of the sketch elements
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "sketchelement.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+CLICK_DECLS
+
+SketchElement::SketchElement()
+    : _key(key_aggregate), _bytes(false), _reset_gen(0)
+{
+}
+
+int
+SketchElement::set_key(const String &str, ErrorHandler *errh)
+{
+    String s = str.lower();
+    if (s == "aggregate")
+	_key = key_aggregate;
+    else if (s == "flow")
+	_key = key_flow;
+    else if (s == "src")
+	_key = key_src;
+    else if (s == "dst")
+	_key = key_dst;
+    else
+	return errh->error("bad KEY %<%s%>, expected %<aggregate%>, %<flow%>, %<src%> or %<dst%>", str.c_str());
+    return 0;
+}
+
+void
+SketchElement::unparse_key(StringAccum &sa, const IPFlowID &key) const
+{
+    switch (_key) {
+    case key_aggregate:
+	sa << ntohl(key.saddr().addr());
+	break;
+    case key_src:
+	sa << key.saddr();
+	break;
+    case key_dst:
+	sa << key.daddr();
+	break;
+    default:
+	sa << key.saddr() << ' ' << ntohs(key.sport()) << ' '
+	   << key.daddr() << ' ' << ntohs(key.dport());
+	break;
+    }
+}
+
+bool
+SketchElement::parse_key(const String &str, IPFlowID &key) const
+{
+    IPAddress a, b;
+    uint32_t agg;
+    uint16_t sport, dport;
+    switch (_key) {
+    case key_aggregate:
+	if (!IntArg().parse(str.trim_space(), agg))
+	    return false;
+	key = IPFlowID(IPAddress(htonl(agg)), 0, IPAddress(), 0);
+	return true;
+    case key_src:
+	if (!IPAddressArg().parse(str.trim_space(), a))
+	    return false;
+	key = IPFlowID(a, 0, IPAddress(), 0);
+	return true;
+    case key_dst:
+	if (!IPAddressArg().parse(str.trim_space(), b))
+	    return false;
+	key = IPFlowID(IPAddress(), 0, b, 0);
+	return true;
+    default: {
+	Vector<String> words;
+	cp_spacevec(str, words);
+	if (words.size() != 4
+	    || !IPAddressArg().parse(words[0], a)
+	    || !IntArg().parse(words[1], sport)
+	    || !IPAddressArg().parse(words[2], b)
+	    || !IntArg().parse(words[3], dport))
+	    return false;
+	key = IPFlowID(a, htons(sport), b, htons(dport));
+	return true;
+    }
+    }
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel)
+ELEMENT_PROVIDES(SketchElement)
@@ -0,0 +1,117 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_SKETCHELEMENT_HH
+#define CLICK_SKETCHELEMENT_HH
+#include <click/batchelement.hh>
+#include <click/sketch.hh>
+#include <click/multithread.hh>
+#include <click/packet_anno.hh>
+#include <clicknet/ip.h>
+CLICK_DECLS
+class StringAccum;
+
+/*
+ * Base of the elements that count packets in per-thread sketches
+ * (SketchCounter, SketchTopK, SketchCardinality and SketchHeavyHitters).
+ * It reads the KEY and BYTES keywords, extracts the key of each packet and
+ * prints and parses keys for handlers.
+ *
+ * Keys are IPFlowIDs. An aggregate annotation is kept in the source address,
+ * a source or destination address alone in its own field.
+ *
+ * Only a thread updates its own sketch. A reset handler bumps a generation,
+ * and each thread clears its sketch before its next update; handlers that
+ * read treat the sketches not cleared yet as empty.
+ */
+class SketchElement : public BatchElement { public:
+
+    SketchElement() CLICK_COLD;
+
+    const char *port_count() const		{ return PORTS_1_1; }
+    const char *processing() const		{ return AGNOSTIC; }
+
+  protected:
+
+    enum { key_aggregate, key_flow, key_src, key_dst };
+    int _key;
+    bool _bytes;
+    volatile uint32_t _reset_gen;
+
+    /** @brief A thread's sketch, with the last reset generation it applied. */
+    template <typename T> struct ThreadSketch {
+	T sketch;
+	uint32_t reset_gen;
+	ThreadSketch()
+	    : reset_gen(0) {
+	}
+	ThreadSketch(const T &s)
+	    : sketch(s), reset_gen(0) {
+	}
+    };
+
+    /** @brief Return the current thread's sketch for update, clearing it
+     * first if a reset was requested since its last update. */
+    template <typename T>
+    inline T &local_sketch(per_thread_omem<ThreadSketch<T> > &s) const {
+	ThreadSketch<T> &ts = *s;
+	if (unlikely(ts.reset_gen != _reset_gen)) {
+	    ts.reset_gen = _reset_gen;
+	    ts.sketch.clear();
+	}
+	return ts.sketch;
+    }
+    /** @brief Return the sketch of the @a i-th thread of @a s, or null if
+     * it has not applied the last reset yet and so is logically empty. */
+    template <typename T>
+    inline const T *thread_sketch(const per_thread_omem<ThreadSketch<T> > &s,
+				  unsigned i) const {
+	const ThreadSketch<T> &ts = s.get_value(i);
+	return ts.reset_gen == _reset_gen ? &ts.sketch : 0;
+    }
+    /** @brief Request that every thread clear its sketch. */
+    void reset_sketches() {
+	++_reset_gen;
+    }
+
+    /** @brief Parse the KEY keyword value @a str. */
+    int set_key(const String &str, ErrorHandler *errh);
+
+    /** @brief Set @a key to the key of @a p. Returns false if @a p has no
+     * such key, like a non-IP packet with KEY flow. */
+    inline bool packet_key(Packet *p, IPFlowID &key) const;
+    /** @brief Return the amount @a p adds to its key. */
+    inline uint32_t packet_amount(Packet *p) const {
+	return _bytes ? p->length() : 1;
+    }
+
+    void unparse_key(StringAccum &sa, const IPFlowID &key) const;
+    /** @brief Parse a key written as the KEY type prints it. For flows,
+     * "SADDR SPORT DADDR DPORT". */
+    bool parse_key(const String &str, IPFlowID &key) const;
+
+};
+
+inline bool
+SketchElement::packet_key(Packet *p, IPFlowID &key) const
+{
+    if (_key == key_aggregate) {
+	// AGGREGATE_ANNO is in host byte order
+	key = IPFlowID(IPAddress(htonl(AGGREGATE_ANNO(p))), 0, IPAddress(), 0);
+	return true;
+    }
+    if (!p->has_network_header())
+	return false;
+    const click_ip *iph = p->ip_header();
+    if (_key == key_src)
+	key = IPFlowID(iph->ip_src, 0, IPAddress(), 0);
+    else if (_key == key_dst)
+	key = IPFlowID(IPAddress(), 0, iph->ip_dst, 0);
+    else if (p->has_transport_header() && IP_FIRSTFRAG(iph)
+	     && (iph->ip_p == IP_PROTO_TCP || iph->ip_p == IP_PROTO_UDP))
+	key = IPFlowID(p);
+    else
+	key = IPFlowID(iph->ip_src, 0, iph->ip_dst, 0);
+    return true;
+}
+
+CLICK_ENDDECLS
+#endif
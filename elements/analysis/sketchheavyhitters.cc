@@ -0,0 +1,211 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * sketchheavyhitters.{cc,hh} -- detects keys whose count exceeds a threshold
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "sketchheavyhitters.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/hashtable.hh>
+CLICK_DECLS
+
+SketchHeavyHitters::SketchHeavyHitters()
+    : _threshold(0), _promote(0), _capacity(256), _width(4096), _depth(4)
+{
+}
+
+int
+SketchHeavyHitters::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String key = "aggregate";
+    _promote = 0;
+    if (Args(conf, this, errh)
+	.read_mp("THRESHOLD", _threshold)
+	.read("KEY", WordArg(), key)
+	.read("PROMOTE", _promote)
+	.read("CAPACITY", _capacity)
+	.read("WIDTH", _width)
+	.read("DEPTH", _depth)
+	.read("BYTES", _bytes)
+	.complete() < 0)
+	return -1;
+    if (_threshold == 0 || _capacity == 0)
+	return errh->error("THRESHOLD and CAPACITY must be positive");
+    if (_width == 0 || _depth == 0 || _depth > 16)
+	return errh->error("WIDTH must be positive and DEPTH between 1 and 16");
+    return set_key(key, errh);
+}
+
+int
+SketchHeavyHitters::initialize(ErrorHandler *)
+{
+    Bitvector threads = get_passing_threads();
+    if (_promote == 0) {
+	int n = threads.weight();
+	_promote = _threshold / (n > 0 ? n : 1);
+	if (_promote == 0)
+	    _promote = 1;
+    }
+    State s;
+    s.light = CountMinSketch(_width, _depth);
+    s.heavy = SpaceSavingSketch(_capacity);
+    _state.initialize(threads, s);
+    return 0;
+}
+
+inline void
+SketchHeavyHitters::count(Packet *p)
+{
+    IPFlowID key = IPFlowID::uninitialized_t();
+    if (!packet_key(p, key))
+	return;
+    uint64_t hash = sketch_hash(key);
+    uint32_t n = packet_amount(p);
+    State &s = local_sketch(_state);
+    if (SpaceSavingSketch::Entry *e = s.heavy.find(key, hash)) {
+	s.heavy.increase(e, n);
+	return;
+    }
+    uint64_t est = s.light.add(hash, n);
+    if (likely(est < _promote))
+	return;
+    if (!s.heavy.full())
+	s.heavy.insert(key, hash, est, est);
+    else if (est > s.heavy.min_count()) {
+	const SpaceSavingSketch::Entry &min = s.heavy.min_entry();
+	s.light.add(min.hash, min.count - min.error);
+	s.heavy.replace_min(key, hash, est, est);
+    }
+}
+
+Packet *
+SketchHeavyHitters::simple_action(Packet *p)
+{
+    count(p);
+    return p;
+}
+
+#if HAVE_BATCH
+PacketBatch *
+SketchHeavyHitters::simple_action_batch(PacketBatch *batch)
+{
+    FOR_EACH_PACKET(batch, p)
+	count(p);
+    return batch;
+}
+#endif
+
+void
+SketchHeavyHitters::heavy_hitters(Vector<SpaceSavingSketch::Entry> &v) const
+{
+    HashTable<IPFlowID, int> seen;
+    v.clear();
+    for (unsigned i = 0; i < _state.weight(); i++) {
+	const State *si = thread_sketch(_state, i);
+	if (!si)
+	    continue;
+	Vector<SpaceSavingSketch::Entry> top;
+	si->heavy.top(top);
+	for (int j = 0; j < top.size(); ++j) {
+	    if (!seen.set(top[j].key, 0))
+		continue;
+	    SpaceSavingSketch::Entry e = top[j];
+	    e.count = 0;
+	    for (unsigned t = 0; t < _state.weight(); t++) {
+		const State *s = thread_sketch(_state, t);
+		if (!s)
+		    continue;
+		if (const SpaceSavingSketch::Entry *te = s->heavy.find(e.key, e.hash))
+		    e.count += te->count;
+		else
+		    e.count += s->light.estimate(e.hash);
+	    }
+	    if (e.count >= _threshold)
+		v.push_back(e);
+	}
+    }
+    SpaceSavingSketch::sort(v);
+}
+
+String
+SketchHeavyHitters::read_handler(Element *e, void *thunk)
+{
+    SketchHeavyHitters *hh = static_cast<SketchHeavyHitters *>(e);
+    switch ((intptr_t) thunk) {
+    case h_heavy_hitters: {
+	Vector<SpaceSavingSketch::Entry> v;
+	hh->heavy_hitters(v);
+	StringAccum sa;
+	for (int i = 0; i < v.size(); ++i) {
+	    hh->unparse_key(sa, v[i].key);
+	    sa << ' ' << v[i].count << '\n';
+	}
+	return sa.take_string();
+    }
+    case h_count: {
+	// Candidates stop counting in the sketch
+	uint64_t total = 0;
+	for (unsigned i = 0; i < hh->_state.weight(); i++) {
+	    const State *s = hh->thread_sketch(hh->_state, i);
+	    if (!s)
+		continue;
+	    total += s->light.total();
+	    Vector<SpaceSavingSketch::Entry> top;
+	    s->heavy.top(top);
+	    for (int j = 0; j < top.size(); ++j)
+		total += top[j].count - top[j].error;
+	}
+	return String(total);
+    }
+    case h_threshold:
+	return String(hh->_threshold);
+    default:
+	return String();
+    }
+}
+
+int
+SketchHeavyHitters::write_handler(const String &str, Element *e, void *thunk, ErrorHandler *errh)
+{
+    SketchHeavyHitters *hh = static_cast<SketchHeavyHitters *>(e);
+    switch ((intptr_t) thunk) {
+    case h_threshold: {
+	uint64_t threshold;
+	if (!IntArg().parse(str.trim_space(), threshold) || threshold == 0)
+	    return errh->error("syntax error");
+	hh->_threshold = threshold;
+	return 0;
+    }
+    case h_reset:
+	hh->reset_sketches();
+	return 0;
+    default:
+	return -1;
+    }
+}
+
+void
+SketchHeavyHitters::add_handlers()
+{
+    add_read_handler("heavy_hitters", read_handler, h_heavy_hitters);
+    add_read_handler("count", read_handler, h_count);
+    add_read_handler("threshold", read_handler, h_threshold);
+    add_write_handler("threshold", write_handler, h_threshold);
+    add_write_handler("reset", write_handler, h_reset, Handler::f_button);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel SketchElement)
+EXPORT_ELEMENT(SketchHeavyHitters)
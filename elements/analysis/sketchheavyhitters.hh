@@ -0,0 +1,143 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_SKETCHHEAVYHITTERS_HH
+#define CLICK_SKETCHHEAVYHITTERS_HH
+#include "sketchelement.hh"
+#include <click/multithread.hh>
+CLICK_DECLS
+
+/*
+=c
+
+SketchHeavyHitters(THRESHOLD, [I<keywords> KEY, PROMOTE, CAPACITY, WIDTH, DEPTH, BYTES])
+
+=s aggregates
+
+detects keys whose count exceeds a threshold
+
+=d
+
+SketchHeavyHitters reports the keys whose count reaches THRESHOLD, in fixed
+memory, with two levels per thread. Keys are first counted in a Count-Min
+sketch. Once the estimate of a key reaches PROMOTE, the key moves to a table
+of CAPACITY candidates, where it is counted exactly from then on. When the
+table is full, a new candidate replaces the candidate of smallest count if
+its estimate is larger; the replaced candidate's count goes back to the
+sketch.
+
+The C<heavy_hitters> handler sums the count of each candidate over all
+threads, taking the sketch estimate for threads where it is not a
+candidate. Counts are never below the true count.
+
+Packets are emitted unchanged.
+
+Keyword arguments are:
+
+=over 8
+
+=item THRESHOLD
+
+Unsigned. Report keys whose count reaches THRESHOLD. Required.
+
+=item KEY
+
+The key packets are counted by: C<aggregate>, C<flow>, C<src> or C<dst>, as
+for SketchCounter. Default is C<aggregate>.
+
+=item PROMOTE
+
+Unsigned. Sketch estimate at which a key becomes a candidate. Default is
+THRESHOLD divided by the number of threads that traverse the element.
+
+=item CAPACITY
+
+Unsigned. Number of candidates per thread. Default is 256.
+
+=item WIDTH, DEPTH
+
+Geometry of the Count-Min sketch, as for SketchCounter. Defaults are 4096
+and 4.
+
+=item BYTES
+
+Boolean. If true, count bytes rather than packets. Default is false.
+
+=back
+
+=h heavy_hitters read-only
+
+Returns the keys whose count reaches THRESHOLD by decreasing count, one per
+line: the key and its count, separated by a space.
+
+=h count read-only
+
+Returns the total count.
+
+=h threshold read/write
+
+Returns or sets THRESHOLD.
+
+=h reset write-only
+
+Clears the sketches and candidates.
+
+=n
+
+Only available in user-level processes.
+
+=e
+
+Detect the destinations that received more than 1000000 packets since the
+last report, every second:
+
+  ... -> hh :: SketchHeavyHitters(1000000, KEY dst) -> ...
+  Script(wait 1s, print hh.heavy_hitters, write hh.reset, loop);
+
+=a
+
+SketchCounter, SketchTopK, SketchCardinality */
+
+class SketchHeavyHitters : public SketchElement { public:
+
+    SketchHeavyHitters() CLICK_COLD;
+
+    const char *class_name() const		{ return "SketchHeavyHitters"; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    inline void count(Packet *p);
+    Packet *simple_action(Packet *p);
+#if HAVE_BATCH
+    PacketBatch *simple_action_batch(PacketBatch *batch);
+#endif
+
+  private:
+
+    // A candidate's error is the sketch estimate it was promoted with
+    struct State {
+	CountMinSketch light;
+	SpaceSavingSketch heavy;
+	void clear() {
+	    light.clear();
+	    heavy.clear();
+	}
+    };
+
+    uint64_t _threshold;
+    uint64_t _promote;
+    unsigned _capacity;
+    unsigned _width;
+    unsigned _depth;
+    per_thread_omem<ThreadSketch<State> > _state;
+
+    void heavy_hitters(Vector<SpaceSavingSketch::Entry> &v) const;
+
+    enum { h_heavy_hitters, h_count, h_threshold, h_reset };
+    static String read_handler(Element *e, void *thunk) CLICK_COLD;
+    static int write_handler(const String &str, Element *e, void *thunk, ErrorHandler *errh) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,113 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * sketchtopk.{cc,hh} -- tracks the most frequent keys with Space-Saving
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "sketchtopk.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+CLICK_DECLS
+
+SketchTopK::SketchTopK()
+    : _k(64)
+{
+}
+
+int
+SketchTopK::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String key = "aggregate";
+    if (Args(conf, this, errh)
+	.read("KEY", WordArg(), key)
+	.read("K", _k)
+	.read("BYTES", _bytes)
+	.complete() < 0)
+	return -1;
+    if (_k == 0)
+	return errh->error("K must be positive");
+    return set_key(key, errh);
+}
+
+int
+SketchTopK::initialize(ErrorHandler *)
+{
+    _sketches.initialize(get_passing_threads(), SpaceSavingSketch(_k));
+    return 0;
+}
+
+inline void
+SketchTopK::count(Packet *p)
+{
+    IPFlowID key = IPFlowID::uninitialized_t();
+    if (packet_key(p, key))
+	local_sketch(_sketches).add(key, sketch_hash(key), packet_amount(p));
+}
+
+Packet *
+SketchTopK::simple_action(Packet *p)
+{
+    count(p);
+    return p;
+}
+
+#if HAVE_BATCH
+PacketBatch *
+SketchTopK::simple_action_batch(PacketBatch *batch)
+{
+    FOR_EACH_PACKET(batch, p)
+	count(p);
+    return batch;
+}
+#endif
+
+int
+SketchTopK::topk_handler(int, String &str, Element *e, const Handler *, ErrorHandler *errh)
+{
+    SketchTopK *tk = static_cast<SketchTopK *>(e);
+    unsigned n = tk->_k;
+    if (str && !IntArg().parse(str.trim_space(), n))
+	return errh->error("syntax error");
+    SpaceSavingSketch s(tk->_k);
+    for (unsigned i = 0; i < tk->_sketches.weight(); i++)
+	if (const SpaceSavingSketch *t = tk->thread_sketch(tk->_sketches, i))
+	    s.merge(*t);
+    Vector<SpaceSavingSketch::Entry> top;
+    s.top(top);
+    StringAccum sa;
+    for (int i = 0; i < top.size() && (unsigned) i < n; ++i) {
+	tk->unparse_key(sa, top[i].key);
+	sa << ' ' << top[i].count << ' ' << top[i].error << '\n';
+    }
+    str = sa.take_string();
+    return 0;
+}
+
+int
+SketchTopK::write_handler(const String &, Element *e, void *, ErrorHandler *)
+{
+    static_cast<SketchTopK *>(e)->reset_sketches();
+    return 0;
+}
+
+void
+SketchTopK::add_handlers()
+{
+    set_handler("topk", Handler::f_read | Handler::f_read_param, topk_handler);
+    add_write_handler("reset", write_handler, 0, Handler::f_button);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel SketchElement)
+EXPORT_ELEMENT(SketchTopK)
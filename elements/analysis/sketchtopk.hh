@@ -0,0 +1,92 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_SKETCHTOPK_HH
+#define CLICK_SKETCHTOPK_HH
+#include "sketchelement.hh"
+#include <click/multithread.hh>
+CLICK_DECLS
+
+/*
+=c
+
+SketchTopK([I<keywords> KEY, K, BYTES])
+
+=s aggregates
+
+tracks the most frequent keys with Space-Saving
+
+=d
+
+SketchTopK tracks the K most frequent keys of the packets it sees with the
+Space-Saving algorithm, in memory proportional to K. Each thread has its own
+summary; the C<topk> handler merges them.
+
+A reported count exceeds the true count by at most the reported error. Any
+key whose true count exceeds the total count divided by K is reported.
+
+Packets are emitted unchanged.
+
+Keyword arguments are:
+
+=over 8
+
+=item KEY
+
+The key packets are counted by: C<aggregate>, C<flow>, C<src> or C<dst>, as
+for SketchCounter. Default is C<aggregate>.
+
+=item K
+
+Unsigned. Number of keys tracked by each thread. Default is 64.
+
+=item BYTES
+
+Boolean. If true, count bytes rather than packets. Default is false.
+
+=back
+
+=h topk read-only
+
+Returns the tracked keys by decreasing count, one per line: the key, its
+count and its error, separated by spaces. Takes an optional parameter, the
+maximum number of keys to return.
+
+=h reset write-only
+
+Clears the summaries.
+
+=n
+
+Only available in user-level processes.
+
+=a
+
+SketchCounter, SketchHeavyHitters, AggregateCounter */
+
+class SketchTopK : public SketchElement { public:
+
+    SketchTopK() CLICK_COLD;
+
+    const char *class_name() const		{ return "SketchTopK"; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    inline void count(Packet *p);
+    Packet *simple_action(Packet *p);
+#if HAVE_BATCH
+    PacketBatch *simple_action_batch(PacketBatch *batch);
+#endif
+
+  private:
+
+    unsigned _k;
+    per_thread_omem<ThreadSketch<SpaceSavingSketch> > _sketches;
+
+    static int topk_handler(int op, String &str, Element *e, const Handler *h, ErrorHandler *errh) CLICK_COLD;
+    static int write_handler(const String &str, Element *e, void *thunk, ErrorHandler *errh) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
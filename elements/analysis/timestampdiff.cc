@@ -40,7 +40,8 @@
 CLICK_DECLS
 
 TimestampDiff::TimestampDiff() :
-    _delays(), _offset(40), _limit(0), _net_order(false), _max_delay_ms(1000), _verbose(true)
+    _delays(), _offset(40), _limit(0), _net_order(false), _max_delay_ms(1000), _verbose(true),
+    _histogram(false), _precision(8), _last_delay(0), _timer(this)
 {
     _nd = 0;
 }
@@ -60,6 +61,9 @@ int TimestampDiff::configure(Vector<String> &conf, ErrorHandler *errh)
             .read_or_set("VERBOSE", _verbose, false)
             .read_or_set("TC_OFFSET", _tc_offset, -1)
             .read_or_set("TC_MASK", _tc_mask, 0xff)
+            .read("HISTOGRAM", _histogram)
+            .read("PRECISION", _precision)
+            .read("INTERVAL", _interval)
             .complete() < 0)
         return -1;
 
@@ -68,6 +72,11 @@ int TimestampDiff::configure(Vector<String> &conf, ErrorHandler *errh)
 
     _net_order = _rt->has_net_order();
 
+    if (_precision < 2 || _precision > 16)
+        return errh->error("PRECISION must be between 2 and 16");
+    if (_interval && !_histogram)
+        return errh->error("INTERVAL requires HISTOGRAM");
+
     if (_limit) {
         _delays.resize(_limit, {0,0});
     }
@@ -77,6 +86,16 @@ int TimestampDiff::configure(Vector<String> &conf, ErrorHandler *errh)
 
 int TimestampDiff::initialize(ErrorHandler *errh)
 {
+    if (_histogram) {
+        _hists.initialize(get_passing_threads(), HDRHistogram(_precision));
+        _snapshot = _last_interval = HDRHistogram(_precision);
+        if (_interval) {
+            _timer.initialize(this);
+            _timer.schedule_after(_interval);
+        }
+        return 0;
+    }
+
     if (get_passing_threads().weight() > 1 && !_limit) {
         return errh->error("TimestampDiff is only thread safe if N is set");
     }
@@ -105,7 +124,8 @@ enum {
     TSD_LAST_SEEN,
     TSD_CURRENT_INDEX,
     TSD_DUMP_HANDLER,
-    TSD_DUMP_LIST_HANDLER
+    TSD_DUMP_LIST_HANDLER,
+    TSD_INTERVAL_HANDLER
 };
 
 int TimestampDiff::handler(int operation, String &data, Element *e,
@@ -141,12 +161,19 @@ int TimestampDiff::handler(int operation, String &data, Element *e,
         begin = atoi(data.c_str());
         const uint32_t current_vector_length = static_cast<const uint32_t>(tsd->_nd.value());
 
-        if (begin >= current_vector_length) {
+        if (begin >= current_vector_length && !tsd->_histogram) {
                data = 0;
                return 1;
         }
     }
 
+    if (tsd->_histogram) {
+        if (opt == TSD_AVG_TC_HANDLER)
+            return errh->error("avg_tc is not available in HISTOGRAM mode");
+        data = tsd->histogram_handler(opt, perc);
+        return 0;
+    }
+
     switch (opt) {
         case TSD_MIN_HANDLER:
             tsd->min_mean_max(min, mean, max, begin);
@@ -237,6 +264,7 @@ void TimestampDiff::add_handlers()
     set_handler("last", Handler::f_read, handler, TSD_LAST_SEEN, 0);
     set_handler("dump", Handler::f_read, handler, TSD_DUMP_HANDLER, 0);
     set_handler("dump_list", Handler::f_read, handler, TSD_DUMP_LIST_HANDLER, 0);
+    set_handler("interval", Handler::f_read, handler, TSD_INTERVAL_HANDLER, 0);
 }
 
 inline int TimestampDiff::smaction(Packet *p)
@@ -264,6 +292,12 @@ inline int TimestampDiff::smaction(Packet *p)
             );
         }
     }
+    else if (_histogram) {
+        // Lock-free: each thread records into its own histogram
+        uint64_t delay = diff.usecval();
+        _hists->record(delay);
+        _last_delay = delay;
+    }
     else {
         uint32_t next_index = _nd.fetch_and_add(1);
         unsigned char tc = 0;
@@ -293,6 +327,19 @@ TimestampDiff::push_batch(int, PacketBatch *batch)
 }
 #endif
 
+void
+TimestampDiff::run_timer(Timer *)
+{
+    HDRHistogram now = merged_histogram();
+    HDRHistogram interval = now;
+    interval.subtract(_snapshot);
+    _snapshot_lock.acquire();
+    _snapshot = now;
+    _last_interval = interval;
+    _snapshot_lock.release();
+    _timer.reschedule_after(_interval);
+}
+
 RecordTimestamp* TimestampDiff::get_recordtimestamp_instance()
 {
     return _rt;
@@ -392,6 +439,77 @@ TimestampDiff::last_value_seen()
     return _delays[last_vector_index].delay;
 }
 
+HDRHistogram
+TimestampDiff::merged_histogram() const
+{
+    HDRHistogram h(_precision);
+    for (unsigned i = 0; i < _hists.weight(); i++)
+        h.merge(_hists.get_value(i));
+    return h;
+}
+
+String
+TimestampDiff::histogram_handler(int opt, double perc)
+{
+    static const double percs[] = {1, 5, 10, 25, 50, 75, 90, 95, 99};
+
+    if (opt == TSD_INTERVAL_HANDLER) {
+        _snapshot_lock.acquire();
+        HDRHistogram h = _last_interval;
+        _snapshot_lock.release();
+        StringAccum s;
+        s << h.count() << ' ' << h.min() << ' ' << h.mean() << ' ' << h.max()
+          << ' ' << h.percentile(50) << ' ' << h.percentile(90)
+          << ' ' << h.percentile(99) << ' ' << h.percentile(99.9);
+        return s.take_string();
+    }
+
+    HDRHistogram h = merged_histogram();
+    switch (opt) {
+        case TSD_MIN_HANDLER:
+        case TSD_PERC_00_HANDLER:
+            return String(h.min());
+        case TSD_AVG_HANDLER:
+            return String(h.mean());
+        case TSD_MAX_HANDLER:
+        case TSD_PERC_100_HANDLER:
+            return String(h.max());
+        case TSD_STD_HANDLER:
+            return String(sqrt(h.variance()));
+        case TSD_PERC_01_HANDLER:
+        case TSD_PERC_05_HANDLER:
+        case TSD_PERC_10_HANDLER:
+        case TSD_PERC_25_HANDLER:
+        case TSD_MED_HANDLER:
+        case TSD_PERC_75_HANDLER:
+        case TSD_PERC_90_HANDLER:
+        case TSD_PERC_95_HANDLER:
+        case TSD_PERC_99_HANDLER:
+            return String(h.percentile(percs[opt - TSD_PERC_01_HANDLER]));
+        case TSD_PERC_HANDLER:
+            return String(h.percentile(perc));
+        case TSD_LAST_SEEN:
+            return String(_last_delay);
+        case TSD_CURRENT_INDEX:
+            return String((int64_t) h.count() - 1);
+        case TSD_DUMP_HANDLER:
+        case TSD_DUMP_LIST_HANDLER: {
+            // One line per non-empty bucket
+            StringAccum s;
+            for (int i = 0; i < h.nbuckets(); ++i)
+                if (h.bucket_count(i)) {
+                    if (opt == TSD_DUMP_HANDLER)
+                        s << h.bucket_low(i) << ": " << h.bucket_count(i) << "\n";
+                    else
+                        s << h.bucket_low(i) << ' ' << h.bucket_count(i) << "\n";
+                }
+            return s.take_string();
+        }
+        default:
+            return String("Unknown read handler for TimestampDiff");
+    }
+}
+
 CLICK_ENDDECLS
 ELEMENT_REQUIRES(userlevel)
 EXPORT_ELEMENT(TimestampDiff)
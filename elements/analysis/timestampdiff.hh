@@ -3,6 +3,10 @@
 
 #include <click/vector.hh>
 #include <click/batchelement.hh>
+#include <click/hdrhistogram.hh>
+#include <click/multithread.hh>
+#include <click/sync.hh>
+#include <click/timer.hh>
 
 CLICK_DECLS
 
@@ -49,6 +53,33 @@ Size of the reservoir. Defaults to 0.
 Integer. Maximum delay in milliseconds. If a packet exhibits such a delay (or greater),
 the user is notified. Defaults to 1000 ms (1 sec).
 
+=item HISTOGRAM
+
+Boolean. If true, delays are not stored one by one but counted in one
+log-linear histogram per thread (see HDRHistogram), using a fixed amount of
+memory however long the test runs. Recording takes no lock, so N is not
+needed with multiple threads. Statistics handlers then read the merged
+histograms in constant time, ignore their start index argument, and
+percentiles are exact within the histogram's precision. avg_tc is not
+available. Defaults to false.
+
+=item PRECISION
+
+Integer. Number of significant bits kept by the histograms, from 2 to 16.
+Delays are known within 2^(1-PRECISION) relatively. Defaults to 8 (0.8%).
+
+=item INTERVAL
+
+Timestamp. In HISTOGRAM mode, take a snapshot of the delays of the last
+INTERVAL every INTERVAL, read with the C<interval> handler. Defaults to 0
+(no snapshots).
+
+=h interval read-only
+
+In HISTOGRAM mode with INTERVAL set, returns the delay statistics of the last
+complete interval, as "COUNT MIN AVERAGE MAX P50 P90 P99 P99.9", in
+microseconds.
+
 =a
 
 RecordTimestamp, NumberPacket
@@ -75,6 +106,8 @@ public:
     void push_batch(int, PacketBatch *);
 #endif
 
+    void run_timer(Timer *);
+
 private:
 
     Vector<DiffRecord> _delays;
@@ -90,6 +123,17 @@ private:
     int _tc_offset;
     unsigned char _tc_mask;
 
+    // HISTOGRAM mode
+    bool _histogram;
+    unsigned _precision;
+    per_thread_omem<HDRHistogram> _hists;
+    unsigned _last_delay;
+    Timestamp _interval;
+    Timer _timer;
+    Spinlock _snapshot_lock;
+    HDRHistogram _snapshot;
+    HDRHistogram _last_interval;
+
     inline int smaction(Packet *p);
 
     RecordTimestamp *get_recordtimestamp_instance();
@@ -106,6 +150,9 @@ private:
     double standard_deviation(const double mean, uint32_t begin = 0);
     double percentile(const double percent, uint32_t begin = 0);
     unsigned last_value_seen();
+
+    HDRHistogram merged_histogram() const;
+    String histogram_handler(int opt, double perc);
 };
 
 CLICK_ENDDECLS
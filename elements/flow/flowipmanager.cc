@@ -27,7 +27,8 @@
 
 CLICK_DECLS
 
-FlowIPManager::FlowIPManager() : _verbose(1), _flags(0), _timer(this), _task(this), _cache(true)
+FlowIPManager::FlowIPManager() : _verbose(1), _flags(0), _timer(this), _task(this),
+    _ticks_due(0), _expired_tick(0), _expired_last(0), _expire_stall(0), _cache(true)
 {
 }
 
@@ -44,6 +45,7 @@ FlowIPManager::configure(Vector<String> &conf, ErrorHandler *errh)
         .read_or_set_p("CAPACITY", _table_size, 65536)
         .read_or_set("RESERVE",_reserve, 0)
         .read_or_set("TIMEOUT", _timeout, 60)
+        .read_or_set("EXPIRE_BUDGET", _expire_budget, 100)
 #if RTE_VERSION > RTE_VERSION_NUM(18,8,0,0)
         .read_or_set("LF", lf, false)
 #endif
@@ -85,7 +87,8 @@ int FlowIPManager::solve_initialize(ErrorHandler *errh)
     hash_params.hash_func_init_val = 0;
     hash_params.extra_flag = _flags;
 
-    _flow_state_size_full = sizeof(FlowControlBlock) + _reserve;
+    //FCBs start on a cache line, as the layout assumes
+    _flow_state_size_full = (sizeof(FlowControlBlock) + _reserve + CLICK_CACHE_LINE_SIZE - 1) & ~(CLICK_CACHE_LINE_SIZE - 1);
 
     if (_verbose)
      errh->message("Per-flow size is %d", _reserve);
@@ -117,29 +120,74 @@ const auto setter = [](FlowControlBlock* prev, FlowControlBlock* next)
     *((FlowControlBlock**)&prev->data_32[2]) = next;
 };
 
-bool FlowIPManager::run_task(Task* t)
+/**
+ * Free the expired flows of a chunk of the wheel, and put the others back in
+ * the wheel according to their last packet. rte_hash has no bulk deletion,
+ * but the FCBs of the whole chunk are read before any key is freed.
+ *
+ * @return false if the time budget is exhausted
+ */
+inline bool
+FlowIPManager::expire(FlowControlBlock** fcbs, int n, const Timestamp& recent,
+                      const Timestamp& deadline)
 {
-    Timestamp recent = Timestamp::recent_steady();
-    _timer_wheel.run_timers([this,recent](FlowControlBlock* prev) -> FlowControlBlock*{
-        FlowControlBlock* next = *((FlowControlBlock**)&prev->data_32[2]);
-        int old = (recent - prev->lastseen).sec();
+    int32_t pos[TimerWheel<FlowControlBlock>::EXPIRE_BATCH];
+    int k = 0;
+
+    for (int i = 0; i < n; i++) {
+        FlowControlBlock* fcb = fcbs[i];
+        int old = (recent - fcb->lastseen).sec();
         if (old > _timeout) {
             if (unlikely(_verbose > 1))
-                click_chatter("Release %p as it is expired since %d", prev, old);
-        //expire
-            rte_hash_free_key_with_position(hash, prev->data_32[0]);
+                click_chatter("Release %p as it is expired since %d", fcb, old);
+            pos[k++] = fcb->data_32[0];
         } else {
-            //click_chatter("Cascade %p", prev);
             //No need for lock as we'll be the only one to enqueue there
-            _timer_wheel.schedule_after(prev, _timeout - (recent - prev->lastseen).sec(),setter);
+            _timer_wheel.schedule_after(fcb, _timeout - old, setter);
         }
-        return next;
-    });
+    }
+    for (int i = 0; i < k; i++)
+        rte_hash_free_key_with_position(hash, pos[i]);
+    _expired_tick += k;
+
+    return _expire_budget == 0 || Timestamp::now_steady() < deadline;
+}
+
+bool FlowIPManager::run_task(Task* t)
+{
+    Timestamp start = Timestamp::now_steady();
+    Timestamp deadline = start + Timestamp::make_usec(_expire_budget);
+    Timestamp recent = Timestamp::recent_steady();
+
+    while (_ticks_due > 0) {
+        bool left = _timer_wheel.run_timers_batch(
+            [](FlowControlBlock* fcb) -> FlowControlBlock* {
+                return *((FlowControlBlock**)&fcb->data_32[2]);
+            },
+            [this, &recent, &deadline](FlowControlBlock** fcbs, int n) -> bool {
+                return expire(fcbs, n, recent, deadline);
+            });
+        if (left)
+            break;
+        _ticks_due--;
+        _expired_last = _expired_tick;
+        _expired_tick = 0;
+        if (_expire_budget && Timestamp::now_steady() >= deadline)
+            break;
+    }
+
+    uint32_t stall = (Timestamp::now_steady() - start).usecval();
+    if (stall > _expire_stall)
+        _expire_stall = stall;
+
+    if (_ticks_due > 0)
+        t->fast_reschedule();
     return true;
 }
 
 void FlowIPManager::run_timer(Timer* t)
 {
+    _ticks_due++;
     _task.reschedule();
     t->reschedule_after(Timestamp::make_sec(1));
 }
@@ -150,9 +198,10 @@ void FlowIPManager::cleanup(CleanupStage stage)
         rte_hash_free(hash);
 }
 
-void FlowIPManager::process(Packet* p, BatchBuilder& b, const Timestamp& recent)
+void FlowIPManager::process(Packet* p, BatchBuilder& b, const Timestamp& recent,
+                            IPFlow5ID* fids, int32_t* ret, int i, int n)
 {
-    IPFlow5ID fid = IPFlow5ID(p);
+    IPFlow5ID& fid = fids[i];
 
     if (_cache && fid == b.last_id) {
         b.append(p);
@@ -161,22 +210,21 @@ void FlowIPManager::process(Packet* p, BatchBuilder& b, const Timestamp& recent)
 
     rte_hash*& table = hash;
     FlowControlBlock* fcb;
-    int ret = rte_hash_lookup(table, &fid);
 
-    if (ret < 0) { // new flow
+    if (ret[i] < 0) { // new flow
 
-        ret = rte_hash_add_key(table, &fid);
-        if (ret < 0) {
+        ret[i] = rte_hash_add_key(table, &fid);
+        if (ret[i] < 0) {
             if (unlikely(_verbose > 0)) {
-                click_chatter("Cannot add key (have %d items. Error %d)!", rte_hash_count(table), ret);
+                click_chatter("Cannot add key (have %d items. Error %d)!", rte_hash_count(table), ret[i]);
             }
             p->kill();
             return;
         }
         if (unlikely(_verbose > 1))
-            click_chatter("New flow %d", ret);
-        fcb = (FlowControlBlock*)((unsigned char*)fcbs + (_flow_state_size_full * ret));
-        fcb->data_32[0] = ret;
+            click_chatter("New flow %d", ret[i]);
+        fcb = (FlowControlBlock*)((unsigned char*)fcbs + (_flow_state_size_full * ret[i]));
+        fcb->data_32[0] = ret[i];
         if (_timeout) {
             if (_flags) {
                 _timer_wheel.schedule_after_mp(fcb, _timeout, setter);
@@ -184,13 +232,19 @@ void FlowIPManager::process(Packet* p, BatchBuilder& b, const Timestamp& recent)
                 _timer_wheel.schedule_after(fcb, _timeout, setter);
             }
         }
+        //Later packets of the same new flow in this bulk were looked up before
+        //the insertion, give them the position so they do not insert again
+        for (int j = i + 1; j < n; j++) {
+            if (ret[j] < 0 && fids[j] == fid)
+                ret[j] = ret[i];
+        }
     } else {
         if (unlikely(_verbose > 1))
-            click_chatter("Existing flow %d", ret);
-        fcb = (FlowControlBlock*)((unsigned char*)fcbs + (_flow_state_size_full * ret));
+            click_chatter("Existing flow %d", ret[i]);
+        fcb = (FlowControlBlock*)((unsigned char*)fcbs + (_flow_state_size_full * ret[i]));
     }
 
-    if (b.last == ret) {
+    if (b.last == ret[i]) {
         b.append(p);
     } else {
         PacketBatch* batch;
@@ -202,7 +256,7 @@ void FlowIPManager::process(Packet* p, BatchBuilder& b, const Timestamp& recent)
         fcb_stack = fcb;
         b.init();
         b.append(p);
-        b.last = ret;
+        b.last = ret[i];
         if (_cache)
             b.last_id = fid;
 
@@ -213,8 +267,29 @@ void FlowIPManager::push_batch(int, PacketBatch* batch)
 {
     BatchBuilder b;
     Timestamp recent = Timestamp::recent_steady();
-    FOR_EACH_PACKET_SAFE(batch, p) {
-        process(p, b, recent);
+    Packet* next = batch->first();
+
+    while (next) {
+        //Extract the keys of up to a full bulk of packets, then let the
+        //cuckoo table prefetch and pipeline all the buckets at once
+        Packet* pkts[RTE_HASH_LOOKUP_BULK_MAX];
+        IPFlow5ID fids[RTE_HASH_LOOKUP_BULK_MAX];
+        const void* keys[RTE_HASH_LOOKUP_BULK_MAX];
+        int32_t ret[RTE_HASH_LOOKUP_BULK_MAX];
+        int n = 0;
+        do {
+            pkts[n] = next;
+            fids[n] = IPFlow5ID(next);
+            keys[n] = &fids[n];
+            next = next->next();
+            n++;
+        } while (next && n < RTE_HASH_LOOKUP_BULK_MAX);
+
+        rte_hash_lookup_bulk(hash, keys, n, ret);
+
+        for (int i = 0; i < n; i++) {
+            process(pkts[i], b, recent, fids, ret, i, n);
+        }
     }
 
     batch = b.finish();
@@ -224,7 +299,7 @@ void FlowIPManager::push_batch(int, PacketBatch* batch)
     }
 }
 
-enum {h_count};
+enum {h_count, h_expired, h_expire_stall};
 String FlowIPManager::read_handler(Element* e, void* thunk)
 {
     FlowIPManager* fc = static_cast<FlowIPManager*>(e);
@@ -233,6 +308,10 @@ String FlowIPManager::read_handler(Element* e, void* thunk)
     switch ((intptr_t)thunk) {
     case h_count:
         return String(rte_hash_count(table));
+    case h_expired:
+        return String(fc->_expired_last);
+    case h_expire_stall:
+        return String(fc->_expire_stall);
     default:
         return "<error>";
     }
@@ -241,6 +320,9 @@ String FlowIPManager::read_handler(Element* e, void* thunk)
 void FlowIPManager::add_handlers()
 {
     add_read_handler("count", read_handler, h_count);
+    add_read_handler("expired", read_handler, h_expired);
+    add_read_handler("expire_stall", read_handler, h_expire_stall);
+    add_read_handler("fcb_layout", read_fcb_layout, 0);
 }
 
 CLICK_ENDDECLS
@@ -16,7 +16,7 @@ struct rte_hash;
 
 
 /**
- * FlowIPManager(CAPACITY [, RESERVE])
+ * FlowIPManager(CAPACITY [, RESERVE, TIMEOUT, EXPIRE_BUDGET])
  *
  * =s flow
  *  FCB packet classifier - cuckoo shared-by-all-threads
@@ -25,10 +25,31 @@ struct rte_hash;
  *
  * Initialize the FCB stack for every packets passing by.
  * The classification is done using a unique cuckoo hash table.
+ * Flows of a batch are resolved with a single bulk lookup, only
+ * the misses are inserted one by one.
  *
- * This element does not find automatically the FCB layout for FlowElement,
- * neither set the offsets for placement in the FCB automatically. Look at
- * the middleclick branch for alternatives.
+ * Flows idle for more than TIMEOUT seconds (default 60, 0 disables) are
+ * removed by chunks, spending at most EXPIRE_BUDGET microseconds (default
+ * 100, 0 means no limit) per run of the expiry task.
+ *
+ * The FCB layout is found automatically: the per-flow data of the flow
+ * elements reachable downstream is placed after RESERVE bytes, aligned,
+ * sharing space between parallel paths and so that a flow spans as few
+ * cache lines as possible. Each FCB starts on a cache line.
+ *
+ * =h count read-only
+ * Number of flows in the table.
+ *
+ * =h expired read-only
+ * Number of flows removed during the last completed second of the
+ * timer wheel.
+ *
+ * =h expire_stall read-only
+ * Longest time in microseconds spent in a single run of the expiry task.
+ *
+ * =h fcb_layout read-only
+ * Offset and size of the per-flow data of each flow element, and the bytes
+ * used in each cache line of an FCB.
  *
  * =a FlowIPManger
  *
@@ -70,11 +91,19 @@ class FlowIPManager: public VirtualFlowManager, public Router::InitFuture {
         int _timeout;
         Timer _timer; //Timer to launch the wheel
         Task _task;
+        int _expire_budget;
+        int _ticks_due; //Seconds of the wheel not expired yet
+        uint32_t _expired_tick;
+        uint32_t _expired_last;
+        uint32_t _expire_stall;
 
         bool _cache;
 
         static String read_handler(Element* e, void* thunk);
-        inline void process(Packet* p, BatchBuilder& b, const Timestamp& recent);
+        inline void process(Packet* p, BatchBuilder& b, const Timestamp& recent,
+                            IPFlow5ID* fids, int32_t* ret, int i, int n);
+        inline bool expire(FlowControlBlock** fcbs, int n, const Timestamp& recent,
+                           const Timestamp& deadline);
         TimerWheel<FlowControlBlock> _timer_wheel;
 };
 
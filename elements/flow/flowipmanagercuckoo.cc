@@ -0,0 +1,303 @@
+/*
+ * flowipmanagercuckoo.{cc,hh} - Flow classification for the flow subsystem
+ * using the in-tree cuckoo table
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/glue.hh>
+#include <click/args.hh>
+#include <click/ipflowid.hh>
+#include <click/routervisitor.hh>
+#include <click/error.hh>
+#include "flowipmanagercuckoo.hh"
+
+CLICK_DECLS
+
+FlowIPManagerCuckoo::FlowIPManagerCuckoo() : _verbose(1), _mt(false), _timer(this), _task(this),
+    _ticks_due(0), _expired_tick(0), _expired_last(0), _expire_stall(0), _cache(true)
+{
+}
+
+FlowIPManagerCuckoo::~FlowIPManagerCuckoo()
+{
+}
+
+int
+FlowIPManagerCuckoo::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    if (Args(conf, this, errh)
+        .read_or_set_p("CAPACITY", _table_size, 65536)
+        .read_or_set("RESERVE",_reserve, 0)
+        .read_or_set("TIMEOUT", _timeout, 60)
+        .read_or_set("EXPIRE_BUDGET", _expire_budget, 100)
+        .read_or_set("CACHE", _cache, true)
+        .read_or_set("MT", _mt, false)
+        .read_or_set("VERBOSE", _verbose, 1)
+        .complete() < 0)
+        return -1;
+
+    find_children(_verbose);
+
+    router()->get_root_init_future()->postOnce(&_fcb_builded_init_future);
+    _fcb_builded_init_future.post(this);
+
+    if (!is_pow2(_table_size)) {
+        _table_size = next_pow2(_table_size);
+        click_chatter("Real capacity will be %d",_table_size);
+    }
+
+    //Position of the flow in data_32[0], timer wheel link in data_32[2]
+    _reserve += sizeof(uint32_t) * 2 + sizeof(FlowControlBlock*);
+    //Table entries start on a cache line, the FCB follows the key
+    _fcb_line_offset = (CuckooTable<IPFlow5ID>::key_space() + sizeof(FlowControlBlock)) % CLICK_CACHE_LINE_SIZE;
+
+    return 0;
+}
+
+int FlowIPManagerCuckoo::solve_initialize(ErrorHandler *errh)
+{
+    _flow_state_size_full = sizeof(FlowControlBlock) + _reserve;
+
+    if (_verbose)
+        errh->message("Per-flow size is %d", _reserve);
+
+    if (_table.initialize(_table_size, _flow_state_size_full, _mt) != 0)
+        return errh->error("Could not init flow table !");
+
+    if (_verbose > 1)
+        errh->message("Flow entries are %d bytes", _table.stride());
+
+    if (_timeout > 0) {
+        _timer_wheel.initialize(_timeout);
+
+        _timer.initialize(this);
+        _timer.schedule_after(Timestamp::make_sec(1));
+        _task.initialize(this, false);
+    }
+
+    return 0;
+}
+
+// The timer wheel link lives in the flow data; memcpy avoids type punning
+static const auto setter = [](FlowControlBlock* prev, FlowControlBlock* next)
+{
+    memcpy(&prev->data_32[2], &next, sizeof(next));
+};
+
+/**
+ * Remove the expired flows of a chunk of the wheel at once, and put the
+ * others back in the wheel according to their last packet.
+ *
+ * @return false if the time budget is exhausted
+ */
+inline bool
+FlowIPManagerCuckoo::expire(FlowControlBlock** fcbs, int n, const Timestamp& recent,
+                            const Timestamp& deadline)
+{
+    uint32_t pos[TimerWheel<FlowControlBlock>::EXPIRE_BATCH];
+    int k = 0;
+
+    for (int i = 0; i < n; i++) {
+        FlowControlBlock* fcb = fcbs[i];
+        int old = (recent - fcb->lastseen).sec();
+        if (old > _timeout) {
+            if (unlikely(_verbose > 1))
+                click_chatter("Release %p as it is expired since %d", fcb, old);
+            pos[k++] = fcb->data_32[0];
+        } else if (_mt) {
+            _timer_wheel.schedule_after_mp(fcb, _timeout - old, setter);
+        } else {
+            _timer_wheel.schedule_after(fcb, _timeout - old, setter);
+        }
+    }
+    if (k > 0) {
+        _table.remove_positions(pos, k);
+        _expired_tick += k;
+    }
+
+    return _expire_budget == 0 || Timestamp::now_steady() < deadline;
+}
+
+bool FlowIPManagerCuckoo::run_task(Task* t)
+{
+    Timestamp start = Timestamp::now_steady();
+    Timestamp deadline = start + Timestamp::make_usec(_expire_budget);
+    Timestamp recent = Timestamp::recent_steady();
+
+    while (_ticks_due > 0) {
+        bool left = _timer_wheel.run_timers_batch(
+            [](FlowControlBlock* fcb) -> FlowControlBlock* {
+                FlowControlBlock* next;
+                memcpy(&next, &fcb->data_32[2], sizeof(next));
+                return next;
+            },
+            [this, &recent, &deadline](FlowControlBlock** fcbs, int n) -> bool {
+                return expire(fcbs, n, recent, deadline);
+            });
+        if (left)
+            break;
+        _ticks_due--;
+        _expired_last = _expired_tick;
+        _expired_tick = 0;
+        if (_expire_budget && Timestamp::now_steady() >= deadline)
+            break;
+    }
+
+    uint32_t stall = (Timestamp::now_steady() - start).usecval();
+    if (stall > _expire_stall)
+        _expire_stall = stall;
+
+    if (_ticks_due > 0)
+        t->fast_reschedule();
+    return true;
+}
+
+void FlowIPManagerCuckoo::run_timer(Timer* t)
+{
+    _ticks_due++;
+    _task.reschedule();
+    t->reschedule_after(Timestamp::make_sec(1));
+}
+
+void FlowIPManagerCuckoo::process(Packet* p, BatchBuilder& b, const Timestamp& recent,
+                                  IPFlow5ID* fids, int32_t* ret, int i, int n)
+{
+    IPFlow5ID& fid = fids[i];
+
+    if (_cache && fid == b.last_id) {
+        b.append(p);
+        return;
+    }
+
+    FlowControlBlock* fcb;
+
+    if (ret[i] < 0) {
+        bool is_new;
+        ret[i] = _table.insert(fid, is_new);
+        if (ret[i] < 0) {
+            if (unlikely(_verbose > 0)) {
+                click_chatter("Cannot add key (have %d items)!", _table.count());
+            }
+            p->kill();
+            return;
+        }
+        fcb = get_fcb(ret[i]);
+        //Another thread may have inserted the flow since the bulk lookup
+        if (is_new) {
+            if (unlikely(_verbose > 1))
+                click_chatter("New flow %d", ret[i]);
+            bzero((void*)fcb, _flow_state_size_full);
+            fcb->data_32[0] = ret[i];
+            if (_timeout > 0) {
+                if (_mt) {
+                    _timer_wheel.schedule_after_mp(fcb, _timeout, setter);
+                } else {
+                    _timer_wheel.schedule_after(fcb, _timeout, setter);
+                }
+            }
+        }
+        for (int j = i + 1; j < n; j++) {
+            if (ret[j] < 0 && fids[j] == fid)
+                ret[j] = ret[i];
+        }
+    } else {
+        if (unlikely(_verbose > 1))
+            click_chatter("Existing flow %d", ret[i]);
+        fcb = get_fcb(ret[i]);
+    }
+
+    if (b.last == ret[i]) {
+        b.append(p);
+    } else {
+        PacketBatch* batch;
+        batch = b.finish();
+        if (batch) {
+            fcb_stack->lastseen = recent;
+            output_push_batch(0, batch);
+        }
+        fcb_stack = fcb;
+        b.init();
+        b.append(p);
+        b.last = ret[i];
+        if (_cache)
+            b.last_id = fid;
+    }
+}
+
+void FlowIPManagerCuckoo::push_batch(int, PacketBatch* batch)
+{
+    BatchBuilder b;
+    Timestamp recent = Timestamp::recent_steady();
+    Packet* next = batch->first();
+
+    while (next) {
+        Packet* pkts[CuckooTable<IPFlow5ID>::BULK_MAX];
+        IPFlow5ID fids[CuckooTable<IPFlow5ID>::BULK_MAX];
+        const IPFlow5ID* keys[CuckooTable<IPFlow5ID>::BULK_MAX];
+        int32_t ret[CuckooTable<IPFlow5ID>::BULK_MAX];
+        int n = 0;
+        do {
+            pkts[n] = next;
+            fids[n] = IPFlow5ID(next);
+            keys[n] = &fids[n];
+            next = next->next();
+            n++;
+        } while (next && n < CuckooTable<IPFlow5ID>::BULK_MAX);
+
+        _table.find_bulk(keys, n, ret);
+
+        for (int i = 0; i < n; i++) {
+            process(pkts[i], b, recent, fids, ret, i, n);
+        }
+    }
+
+    batch = b.finish();
+    if (batch) {
+        fcb_stack->lastseen = recent;
+        output_push_batch(0, batch);
+    }
+}
+
+enum {h_count, h_capacity, h_expired, h_expire_stall};
+String FlowIPManagerCuckoo::read_handler(Element* e, void* thunk)
+{
+    FlowIPManagerCuckoo* fc = static_cast<FlowIPManagerCuckoo*>(e);
+
+    switch ((intptr_t)thunk) {
+    case h_count:
+        return String(fc->_table.count());
+    case h_capacity:
+        return String(fc->_table.capacity());
+    case h_expired:
+        return String(fc->_expired_last);
+    case h_expire_stall:
+        return String(fc->_expire_stall);
+    default:
+        return "<error>";
+    }
+};
+
+void FlowIPManagerCuckoo::add_handlers()
+{
+    add_read_handler("count", read_handler, h_count);
+    add_read_handler("capacity", read_handler, h_capacity);
+    add_read_handler("expired", read_handler, h_expired);
+    add_read_handler("expire_stall", read_handler, h_expire_stall);
+    add_read_handler("fcb_layout", read_fcb_layout, 0);
+}
+
+CLICK_ENDDECLS
+
+ELEMENT_REQUIRES(flow)
+EXPORT_ELEMENT(FlowIPManagerCuckoo)
+ELEMENT_MT_SAFE(FlowIPManagerCuckoo)
@@ -0,0 +1,144 @@
+#ifndef CLICK_FLOWIPMANAGERCUCKOO_HH
+#define CLICK_FLOWIPMANAGERCUCKOO_HH
+#include <click/config.h>
+#include <click/string.hh>
+#include <click/timer.hh>
+#include <click/vector.hh>
+#include <click/multithread.hh>
+#include <click/pair.hh>
+#include <click/flow/flowelement.hh>
+#include <click/flow/common.hh>
+#include <click/batchbuilder.hh>
+#include <click/timerwheel.hh>
+#include <click/cuckootable.hh>
+CLICK_DECLS
+
+/**
+ * FlowIPManagerCuckoo(CAPACITY [, RESERVE, TIMEOUT, EXPIRE_BUDGET, CACHE, MT, VERBOSE])
+ *
+ * =s flow
+ *  FCB packet classifier - in-tree cuckoo, does not need DPDK
+ *
+ * =d
+ *
+ * Initialize the FCB stack for every packets passing by.
+ * The classification is done using a bucketized cuckoo hash table
+ * (CuckooTable) that stores the FCB inline after the flow key, so a hit
+ * costs one cache miss for the bucket and one for both the key and the FCB.
+ * Flows of a batch are resolved with a single bulk lookup.
+ *
+ * Keyword arguments are:
+ *
+ * =over 8
+ *
+ * =item CAPACITY
+ *
+ * Integer. Maximal number of flows. Default is 65536.
+ *
+ * =item RESERVE
+ *
+ * Integer. Bytes of FCB space to reserve. Default is 0.
+ *
+ * =item TIMEOUT
+ *
+ * Integer. Idle time in seconds after which a flow is removed. 0 disables
+ * the timeout. Default is 60.
+ *
+ * =item EXPIRE_BUDGET
+ *
+ * Integer. Maximal time in microseconds spent expiring flows per run of
+ * the expiry task. Flows are expired by chunks, the rest of a second worth
+ * of flows is left for the next run so a burst of expirations does not
+ * stall the data path. 0 means no limit. Default is 100.
+ *
+ * =item CACHE
+ *
+ * Boolean. Do not look up a packet that has the same flow ID as the
+ * previous one. Default is true.
+ *
+ * =item MT
+ *
+ * Boolean. Allow multiple threads to insert flows concurrently. Lookups
+ * never lock. Default is false.
+ *
+ * =back
+ *
+ * The FCB layout is found automatically: the per-flow data of the flow
+ * elements reachable downstream is placed after RESERVE bytes, aligned,
+ * sharing space between parallel paths and so that a flow spans as few
+ * cache lines as possible. Each FCB starts on a cache line.
+ *
+ * =h count read-only
+ * Number of flows in the table.
+ *
+ * =h capacity read-only
+ * Maximal number of flows.
+ *
+ * =h expired read-only
+ * Number of flows removed during the last completed second of the
+ * timer wheel.
+ *
+ * =h expire_stall read-only
+ * Longest time in microseconds spent in a single run of the expiry task.
+ *
+ * =h fcb_layout read-only
+ * Offset and size of the per-flow data of each flow element, and the bytes
+ * used in each cache line of an FCB.
+ *
+ * =a FlowIPManager, FlowIPManagerMP
+ *
+ */
+class FlowIPManagerCuckoo: public VirtualFlowManager, public Router::InitFuture {
+    public:
+        FlowIPManagerCuckoo() CLICK_COLD;
+        ~FlowIPManagerCuckoo() CLICK_COLD;
+
+        const char *class_name() const { return "FlowIPManagerCuckoo"; }
+        const char *port_count() const { return "1/1"; }
+
+        const char *processing() const { return PUSH; }
+        int configure_phase() const { return CONFIGURE_PHASE_PRIVILEGED + 1; }
+        bool stopClassifier() { return true; };
+
+
+        int configure(Vector<String> &, ErrorHandler *) override CLICK_COLD;
+        int solve_initialize(ErrorHandler *errh) override CLICK_COLD;
+
+        void push_batch(int, PacketBatch* batch) override;
+        void run_timer(Timer*) override;
+        bool run_task(Task* t) override;
+
+        void add_handlers() override CLICK_COLD;
+
+    protected:
+        CuckooTable<IPFlow5ID> _table;
+
+        int _table_size;
+        int _flow_state_size_full;
+        int _verbose;
+        bool _mt;
+
+        int _timeout;
+        Timer _timer; //Timer to launch the wheel
+        Task _task;
+        int _expire_budget;
+        int _ticks_due; //Seconds of the wheel not expired yet
+        uint32_t _expired_tick;
+        uint32_t _expired_last;
+        uint32_t _expire_stall;
+
+        bool _cache;
+
+        static String read_handler(Element* e, void* thunk);
+        inline void process(Packet* p, BatchBuilder& b, const Timestamp& recent,
+                            IPFlow5ID* fids, int32_t* ret, int i, int n);
+        inline bool expire(FlowControlBlock** fcbs, int n, const Timestamp& recent,
+                           const Timestamp& deadline);
+        inline FlowControlBlock* get_fcb(int pos) {
+            return (FlowControlBlock*)_table.value(pos);
+        }
+        TimerWheel<FlowControlBlock> _timer_wheel;
+};
+
+CLICK_ENDDECLS
+#endif
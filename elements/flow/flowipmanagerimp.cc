@@ -64,7 +64,8 @@ int FlowIPManagerIMP::solve_initialize(ErrorHandler *errh)
     hash_params.hash_func_init_val = 0;
     hash_params.extra_flag = _flags;
 
-    _flow_state_size_full = sizeof(FlowControlBlock) + _reserve;
+    //FCBs start on a cache line, as the layout assumes
+    _flow_state_size_full = (sizeof(FlowControlBlock) + _reserve + CLICK_CACHE_LINE_SIZE - 1) & ~(CLICK_CACHE_LINE_SIZE - 1);
 
     _tables = CLICK_ALIGNED_NEW(gtable, passing.size());
     CLICK_ASSERT_ALIGNED(_tables);
@@ -144,31 +145,30 @@ void FlowIPManagerIMP::cleanup(CleanupStage stage)
     delete _tables;
 }
 
-void FlowIPManagerIMP::process(Packet* p, BatchBuilder& b, const Timestamp& recent)
+void FlowIPManagerIMP::process(Packet* p, BatchBuilder& b, const Timestamp& recent,
+                               gtable& tab, IPFlow5ID* fids, int32_t* ret, int i, int n)
 {
-    IPFlow5ID fid = IPFlow5ID(p);
+    IPFlow5ID& fid = fids[i];
 
     if (_cache && fid == b.last_id) {
         b.append(p);
         return;
     }
-    auto& tab = _tables[click_current_cpu_id()];
     rte_hash* table = tab.hash;
 
     FlowControlBlock* fcb;
 
-    int ret = rte_hash_lookup(table, &fid);
-    if (ret < 0) { //new flow
-        ret = rte_hash_add_key(table, &fid);
-        if (ret < 0) {
+    if (ret[i] < 0) { //new flow
+        ret[i] = rte_hash_add_key(table, &fid);
+        if (ret[i] < 0) {
                     if (unlikely(_verbose > 0)) {
-                        click_chatter("Cannot add key (have %d items. Error %d)!", rte_hash_count(table), ret);
+                        click_chatter("Cannot add key (have %d items. Error %d)!", rte_hash_count(table), ret[i]);
             }
             p->kill();
             return;
         }
-        fcb = (FlowControlBlock*)((unsigned char*)tab.fcbs + (_flow_state_size_full * ret));
-        fcb->data_32[0] = ret;
+        fcb = (FlowControlBlock*)((unsigned char*)tab.fcbs + (_flow_state_size_full * ret[i]));
+        fcb->data_32[0] = ret[i];
         if (_timeout > 0) {
             if (_flags) {
                 _timer_wheel.schedule_after_mp(fcb, _timeout, setter);
@@ -176,11 +176,16 @@ void FlowIPManagerIMP::process(Packet* p, BatchBuilder& b, const Timestamp& rece
                 _timer_wheel.schedule_after(fcb, _timeout, setter);
             }
         }
+        //Same new flow later in the bulk : it was a miss too, do not insert twice
+        for (int j = i + 1; j < n; j++) {
+            if (ret[j] < 0 && fids[j] == fid)
+                ret[j] = ret[i];
+        }
     } else {
-        fcb = (FlowControlBlock*)((unsigned char*)tab.fcbs + (_flow_state_size_full * ret));
+        fcb = (FlowControlBlock*)((unsigned char*)tab.fcbs + (_flow_state_size_full * ret[i]));
     }
 
-    if (b.last == ret) {
+    if (b.last == ret[i]) {
         b.append(p);
     } else {
         PacketBatch* batch;
@@ -192,7 +197,7 @@ void FlowIPManagerIMP::process(Packet* p, BatchBuilder& b, const Timestamp& rece
         fcb_stack = fcb;
         b.init();
         b.append(p);
-        b.last = ret;
+        b.last = ret[i];
         if (_cache)
             b.last_id = fid;
     }
@@ -202,8 +207,28 @@ void FlowIPManagerIMP::push_batch(int, PacketBatch* batch)
 {
     BatchBuilder b;
     Timestamp recent = Timestamp::recent_steady();
-    FOR_EACH_PACKET_SAFE(batch, p) {
-        process(p, b, recent);
+    auto& tab = _tables[click_current_cpu_id()];
+    Packet* next = batch->first();
+
+    while (next) {
+        Packet* pkts[RTE_HASH_LOOKUP_BULK_MAX];
+        IPFlow5ID fids[RTE_HASH_LOOKUP_BULK_MAX];
+        const void* keys[RTE_HASH_LOOKUP_BULK_MAX];
+        int32_t ret[RTE_HASH_LOOKUP_BULK_MAX];
+        int n = 0;
+        do {
+            pkts[n] = next;
+            fids[n] = IPFlow5ID(next);
+            keys[n] = &fids[n];
+            next = next->next();
+            n++;
+        } while (next && n < RTE_HASH_LOOKUP_BULK_MAX);
+
+        rte_hash_lookup_bulk(tab.hash, keys, n, ret);
+
+        for (int i = 0; i < n; i++) {
+            process(pkts[i], b, recent, tab, fids, ret, i, n);
+        }
     }
 
     batch = b.finish();
@@ -229,7 +254,7 @@ String FlowIPManagerIMP::read_handler(Element* e, void* thunk)
 
 void FlowIPManagerIMP::add_handlers()
 {
-
+    add_read_handler("fcb_layout", read_fcb_layout, 0);
 }
 
 CLICK_ENDDECLS
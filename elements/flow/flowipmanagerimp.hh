@@ -27,9 +27,14 @@ struct rte_hash;
  * Initialize the FCB stack for every packets passing by.
  * The classification is done using a per-core cuckoo hash table.
  *
- * This element does not find automatically the FCB layout for FlowElement,
- * neither set the offsets for placement in the FCB automatically. Look at
- * the middleclick branch for alternatives.
+ * The FCB layout is found automatically: the per-flow data of the flow
+ * elements reachable downstream is placed after RESERVE bytes, aligned,
+ * sharing space between parallel paths and so that a flow spans as few
+ * cache lines as possible. Each FCB starts on a cache line.
+ *
+ * =h fcb_layout read-only
+ * Offset and size of the per-flow data of each flow element, and the bytes
+ * used in each cache line of an FCB.
  *
  * =a FlowIPManger
  *
@@ -80,7 +85,8 @@ class FlowIPManagerIMP: public VirtualFlowManager, public Router::InitFuture {
         bool _cache;
 
         static String read_handler(Element* e, void* thunk);
-        inline void process(Packet* p, BatchBuilder& b, const Timestamp& recent);
+        inline void process(Packet* p, BatchBuilder& b, const Timestamp& recent,
+                            gtable& tab, IPFlow5ID* fids, int32_t* ret, int i, int n);
         TimerWheel<FlowControlBlock> _timer_wheel;
 };
 
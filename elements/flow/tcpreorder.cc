@@ -2,13 +2,15 @@
 #include <click/router.hh>
 #include <click/args.hh>
 #include <click/error.hh>
+#include <click/timestamp.hh>
 #include <clicknet/tcp.h>
 #include <clicknet/ip.h>
 #include "tcpreorder.hh"
 
 CLICK_DECLS
 
-TCPReorder::TCPReorder() : _mergeSort(false),_notimeout(false),_verbose(false)
+TCPReorder::TCPReorder() : _capacity(128), _budget(16 << 20), _timeout(2000),
+    _notimeout(false), _verbose(false)
 {
 }
 
@@ -20,12 +22,17 @@ int
 TCPReorder::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     if(Args(conf, this, errh)
-    .read_p("MERGESORT", _mergeSort)
+    .read_p_with("MERGESORT", AnyArg())
     .read_p("NOTIMEOUT",_notimeout)
     .read_p("VERBOSE",_verbose)
+    .read("CAPACITY", _capacity)
+    .read("BUDGET", _budget)
+    .read("TIMEOUT", _timeout)
     .complete() < 0)
         return -1;
 
+    if (_capacity == 0)
+        return errh->error("CAPACITY must be positive");
     return 0;
 }
 
@@ -47,6 +54,34 @@ TCPReorder::solve_initialize(ErrorHandler *errh) {
     return 0;
 }
 
+int
+TCPReorder::initialize(ErrorHandler *)
+{
+    int nthreads = get_passing_threads().weight();
+    _thread_budget = _budget / (nthreads > 0 ? nthreads : 1);
+    return 0;
+}
+
+void
+TCPReorder::cleanup(CleanupStage)
+{
+    for (unsigned i = 0; i < _state.weight(); i++) {
+        ThreadState &s = _state.get_value(i);
+        while (TCPReorderBuffer* buf = s.head) {
+            for (int j = 0; j < buf->count; j++)
+                buf->pkts[buf->start + j]->kill();
+            buf->count = 0;
+            s.head = buf->next;
+            delete[] (char*) buf;
+        }
+        while (TCPReorderBuffer* buf = s.free) {
+            s.free = buf->next;
+            delete[] (char*) buf;
+        }
+        s.tail = 0;
+    }
+}
+
 void*
 TCPReorder::cast(const char *n) {
    if (strcmp("TCPHelper", n) == 0) {
@@ -55,150 +90,203 @@ TCPReorder::cast(const char *n) {
    return FlowSpaceElement<fcb_tcpreorder>::cast(n);
 }
 
-void TCPReorder::flushListFrom(fcb_tcpreorder *tcpreorder, Packet* toKeep,
-    Packet *toRemove)
+/* The sequence numbers and packet pointers of a buffer follow it in one
+   allocation. */
+TCPReorderBuffer*
+TCPReorder::allocBuffer(ThreadState &s)
 {
-    // toKeep will be the last packet in the list
-    if(toKeep != NULL)
-        toKeep->set_next(NULL);
-
-    if(toRemove == NULL)
-        return;
+    TCPReorderBuffer* buf = s.free;
+    if (buf) {
+        s.free = buf->next;
+    } else {
+        char* mem = new char[sizeof(TCPReorderBuffer) + _capacity * (sizeof(tcp_seq_t) + sizeof(Packet*))];
+        if (!mem)
+            return 0;
+        buf = reinterpret_cast<TCPReorderBuffer*>(mem);
+        buf->pkts = reinterpret_cast<Packet**>(buf + 1);
+        buf->seqs = reinterpret_cast<tcp_seq_t*>(buf->pkts + _capacity);
+    }
+    buf->start = 0;
+    buf->count = 0;
+    buf->bytes = 0;
+    buf->next = 0;
+    buf->prev = s.tail;
+    if (s.tail)
+        s.tail->next = buf;
+    else
+        s.head = buf;
+    s.tail = buf;
+    return buf;
+}
 
-    // Update the head if the list is going to be empty
-    if(tcpreorder->packetList == toRemove)
-        tcpreorder->packetList = NULL;
+void
+TCPReorder::unlinkBuffer(ThreadState &s, TCPReorderBuffer* buf)
+{
+    if (buf->prev)
+        buf->prev->next = buf->next;
+    else
+        s.head = buf->next;
+    if (buf->next)
+        buf->next->prev = buf->prev;
+    else
+        s.tail = buf->prev;
+}
 
-    Packet* next = NULL;
+void
+TCPReorder::freeBuffer(ThreadState &s, TCPReorderBuffer* buf)
+{
+    unlinkBuffer(s, buf);
+    buf->next = s.free;
+    s.free = buf;
+}
 
-    while(toRemove != NULL)
-    {
-        next = toRemove->next();
+void
+TCPReorder::releaseBuffer(ThreadState &s, fcb_tcpreorder* tcpreorder)
+{
+    TCPReorderBuffer* buf = tcpreorder->buffer;
+    if (!buf)
+        return;
+    SFCB_STACK( //Packets in the buffer have no reference
+    for (int i = 0; i < buf->count; i++)
+        buf->pkts[buf->start + i]->kill();
+    );
+    s.bytes -= buf->bytes;
+    s.waiting -= buf->count;
+    freeBuffer(s, buf);
+    tcpreorder->buffer = 0;
+}
 
-        // Kill packet
-        toRemove->kill();
+void
+TCPReorder::expireBuffers(ThreadState &s, int64_t now)
+{
+    // Bound the work done for a single batch
+    for (int n = 0; n < 4 && s.head && now - s.head->touched > _timeout; n++) {
+        TCPReorderBuffer* buf = s.head;
+        // The gap of the current flow is handled by push_flow
+        if (buf->fcb == fcb_stack)
+            break;
+        fcb_tcpreorder* owner = fcb_data_for(buf->fcb);
+        s.stats[s_timeouts]++;
+        if (owner->buffer == buf) {
+            int count = buf->count;
+            releaseBuffer(s, owner);
+            // Waiting packets held a reference to the flow
+            buf->fcb->release(count);
+        } else { //The flow was removed and its FCB reused
+            fcb_tcpreorder tmp;
+            tmp.buffer = buf;
+            releaseBuffer(s, &tmp);
+        }
     }
 }
 
-void TCPReorder::push_flow(int port, fcb_tcpreorder* tcpreorder, PacketBatch *batch)
+#if HAVE_DYNAMIC_FLOW_RELEASE_FNT
+void
+TCPReorder::releaseFlow(FlowControlBlock* fcb, void* thunk)
 {
-    //click_chatter("Flow %p, uc %d",tcpreorder,fcb_stack->count());
-    // Ensure that the pointer in the FCB is set
-    if (!checkFirstPacket(tcpreorder, batch)) {
-        //click_chatter("Waited %u, uc %d",tcpreorder->expectedPacketSeq,fcb_stack->count());
-        return;
+    TCPReorder* e = static_cast<TCPReorder*>(thunk);
+    fcb_tcpreorder* tcpreorder = e->fcb_data_for(fcb);
+    e->releaseBuffer(*e->_state, tcpreorder);
+    if (tcpreorder->previous_fnt)
+        tcpreorder->previous_fnt(fcb, tcpreorder->previous_thunk);
+}
+#endif
+
+void TCPReorder::push_flow(int, fcb_tcpreorder* tcpreorder, PacketBatch *batch)
+{
+    ThreadState &s = *_state;
+    int64_t now = 0;
+
+    if (unlikely(s.head)) {
+        now = Timestamp::recent_steady().msecval();
+        expireBuffers(s, now);
     }
 
-    bool had_awaiting = tcpreorder->packetList != 0;
+    if (!checkFirstPacket(s, tcpreorder, batch)) {
+        return;
+    }
 
-    //Fast path, if no waiting packets and send everything which is in order
-    if (likely(!had_awaiting)) {
-        int count = 0;
-        Packet* last;
+    //Fast path, if no waiting packets and everything is in order
+    if (likely(!tcpreorder->buffer)) {
+        tcp_seq_t expected = tcpreorder->expectedPacketSeq;
+        tcp_seq_t lastSent = tcpreorder->lastSent;
+        bool inorder = true;
         FOR_EACH_PACKET(batch, packet)
         {
             tcp_seq_t currentSeq = getSequenceNumber(packet);
             // We check if the current packet is the expected one (if not, there is a gap)
-            if(currentSeq != tcpreorder->expectedPacketSeq)
-            {
-
-                if (count != 0) {
-                    PacketBatch* second;
-                    batch->cut(last, count, second);
-                    output_push_batch(0,batch);
-                    batch = second;
-                }
-                goto unordered;
+            if (currentSeq != expected) {
+                inorder = false;
+                break;
             }
-
             // Compute the sequence number of the next packet
-            tcpreorder->expectedPacketSeq = getNextSequenceNumber(packet);
-            tcpreorder->lastSent = currentSeq;
-            ++count;
-            last = packet;
+            expected = getNextSequenceNumber(packet);
+            lastSent = currentSeq;
         }
 
-        //If we are here, everything is in order
-        output_push_batch(0,batch);
-        //click_chatter("Pushed ordered batch flow %p uc %d",tcpreorder, fcb_stack->count());
-        return;
-
+        if (likely(inorder)) {
+            tcpreorder->expectedPacketSeq = expected;
+            tcpreorder->lastSent = lastSent;
+            output_push_batch(0,batch);
+            return;
+        }
     }
-    unordered:
+
     if (unlikely(_verbose))
         click_chatter("Flow is now unordered... Awaiting %lu, have %lu", tcpreorder->expectedPacketSeq, getSequenceNumber(batch->first()));
-
-    int num = batch->count();
-    // Complexity: O(k) (k elements in the batch)
-    FOR_EACH_PACKET_SAFE(batch, packet)
-    {
+    if (!now)
+        now = Timestamp::recent_steady().msecval();
+
+    int held = tcpreorder->buffer ? tcpreorder->buffer->count : 0;
+    OutBatch out;
+    Packet* next;
+    for (Packet* packet = batch->first(); packet; packet = next) {
+        next = packet->next();
         if (unlikely(isRst(packet))) {
             if (_verbose)
-                click_chatter("Resetting the flow (have %d packets)!");
-            killList(tcpreorder);
+                click_chatter("Resetting the flow (have %d packets)!", tcpreorder->buffer ? tcpreorder->buffer->count : 0);
+            releaseBuffer(s, tcpreorder);
             tcpreorder->expectedPacketSeq = 0;
-            Packet* next = packet->next();
-            while(next) {
+            while (next) {
                 Packet* tmp = next;
                 next = next->next();
                 tmp->kill();
             }
-            checked_output_push_batch(0,PacketBatch::make_from_packet(packet));
-            return;
+            out.append(packet);
+            break;
         }
-        //click_chatter("TCPReorder : processing Packet %p seq %d flow %p",packet,getSequenceNumber(packet),tcpreorder);
 
-        if(!checkRetransmission(tcpreorder, packet, false)) {
-            //click_chatter("Packet is retransmit!");
-            num --;
+        if (!checkRetransmission(tcpreorder, packet, false)) {
             continue;
         }
 
-        if(_mergeSort)
-        {
-            // Add the packet at the beginning of the list (unsorted) (O(1))
-            packet->set_next(tcpreorder->packetList);
-            tcpreorder->packetList = packet;
-        }
-        else
-        {
-            if (!putPacketInList(tcpreorder, packet)) {
-                num--;
-                continue;
-            }
+        tcp_seq_t currentSeq = getSequenceNumber(packet);
+        if (currentSeq == tcpreorder->expectedPacketSeq) {
+            tcpreorder->expectedPacketSeq = getNextSequenceNumber(packet);
+            tcpreorder->lastSent = currentSeq;
+            out.append(packet);
+            // The packet may fill a gap
+            if (tcpreorder->buffer)
+                sendEligiblePackets(s, tcpreorder, out, now);
+        } else {
+            putPacketInBuffer(s, tcpreorder, packet, now);
         }
     }
 
-
-    tcpreorder->packetListLength += num;
-    int before = tcpreorder->packetListLength;
-    if(_mergeSort)
-    {
-        // Sort the list of waiting packets (O((n + k) * log(n + k)))
-        tcpreorder->packetList = sortList(tcpreorder->packetList);
+    // Give up on a gap that did not move for too long, the packet is probably lost
+    TCPReorderBuffer* buf = tcpreorder->buffer;
+    if (buf && now - buf->since > _timeout) {
+        if (_verbose)
+            click_chatter("Gap timeout, skipping from %lu to %lu", tcpreorder->expectedPacketSeq, buf->seqs[buf->start]);
+        s.stats[s_timeouts]++;
+        tcpreorder->expectedPacketSeq = buf->seqs[buf->start];
+        sendEligiblePackets(s, tcpreorder, out, now);
     }
-    //click_chatter("flow %p uc %d, num %d",tcpreorder, fcb_stack->count(),num);
-
-    PacketBatch* inorderBatch = sendEligiblePackets(tcpreorder,had_awaiting);
 
+    fcb_update((tcpreorder->buffer ? tcpreorder->buffer->count : 0) - held);
 
-    if (tcpreorder->packetList) {
-        assert(tcpreorder->packetListLength);
-    }
-    /*
-    Packet* p = tcpreorder->packetList;
-    int c = 0;
-    while (p != 0) {
-        c++;
-        p = p->next();
-    }
-    assert(tcpreorder->packetListLength == c);
-    click_chatter("reorder acquire, %d in list, awaiting %lu",tcpreorder->packetListLength,tcpreorder->expectedPacketSeq);
-    */
-    fcb_update((before - tcpreorder->packetListLength) - num);
-    if (inorderBatch) {
-        //click_chatter("Hole is filled, flushing %d", inorderBatch->count() );
-        output_push_batch(0,inorderBatch);
+    if (out.count) {
+        output_push_batch(0, PacketBatch::make_from_simple_list(out.head, out.tail, out.count));
     }
 }
 
@@ -241,156 +329,129 @@ bool TCPReorder::checkRetransmission(struct fcb_tcpreorder *tcpreorder, Packet*
 }
 
 
-/**
- * @pre packetListLength is correct
- * @post it is still correct
- */
-PacketBatch* TCPReorder::sendEligiblePackets(struct fcb_tcpreorder *tcpreorder, bool had_awaiting)
+void TCPReorder::sendEligiblePackets(ThreadState &s, struct fcb_tcpreorder *tcpreorder, OutBatch &out, int64_t now)
 {
-    Packet* packet = tcpreorder->packetList;
-    Packet* last = 0;
-    PacketBatch* batch = NULL;
-    int count = 0;
-    while(packet != NULL)
-    {
-        tcp_seq_t currentSeq = getSequenceNumber(packet);
-
-        // Check if the previous packet overlaps with the current one
-        // (the expected sequence number is greater than the one of the packet
-        // meaning that the new packet shares the begin of its content with
-        // the end of the previous packet)
-        // This case occurs when there was a gap in the list because a packet
-        // had been lost, and the source retransmits the packets with the
-        // content split differently.
-        // Thus, the previous packets that were after the gap are not
-        // correctly aligned and must be dropped as the source will retransmit
-        // them with the new alignment.
-        if(SEQ_LT(currentSeq, tcpreorder->expectedPacketSeq))
-        {
-            click_chatter("Warning: received a retransmission with a different split (current %lu, expected %lu, last %lu)",currentSeq, tcpreorder->expectedPacketSeq, (last?getSequenceNumber(last):0));
-            Packet* to_delete = packet;
-            int num = 0;
-            SFCB_STACK( //Do not drop reference as they are from the waiting list packets that are unreferenced
-            while(to_delete) {
-                packet = to_delete->next();
-                to_delete->kill();
-                to_delete = packet;
-                num++;
-            });
-            packet = 0;
-            fcb_acquire(num); //Compensate for the future update
-            tcpreorder->packetListLength -= num;
-
-            // Check before exiting that we did not have a batch to send
-            goto send_batch;
-        }
-
-        // We check if the current packet is the expected one (if not, there is a gap)
-        if(currentSeq != tcpreorder->expectedPacketSeq)
-        {
+    TCPReorderBuffer* buf = tcpreorder->buffer;
+    int sent = 0;
+
+    while (buf->count) {
+        tcp_seq_t currentSeq = buf->seqs[buf->start];
+        Packet* packet = buf->pkts[buf->start];
+
+        // The waiting packet starts before the expected sequence number: this
+        // occurs when there was a gap in the list because a packet had been
+        // lost, and the source retransmitted the data split differently. The
+        // data of the waiting packet was already sent, at least in part.
+        if (SEQ_LT(currentSeq, tcpreorder->expectedPacketSeq)) {
             if (_verbose)
-                click_chatter("Not the expected packet, have %d expected %d, last sent is %d. Count is %d. Uc %d",currentSeq,tcpreorder->expectedPacketSeq,tcpreorder->lastSent, count,fcb_stack->count());
-            //The packet 
-//            if (getNextSequenceNumber(
-            tcpreorder->packetList = packet;
-            // Check before exiting that we did not have a batch to send
-            // TODO : Send pro-active retransmit if option
-            goto send_batch;
+                click_chatter("Received a retransmission with a different split (current %lu, expected %lu)", currentSeq, tcpreorder->expectedPacketSeq);
+            SFCB_STACK(packet->kill());
+        } else if (currentSeq == tcpreorder->expectedPacketSeq) {
+            tcpreorder->expectedPacketSeq = getNextSequenceNumber(packet);
+            tcpreorder->lastSent = currentSeq;
+            out.append(packet);
+        } else {
+            break;
         }
 
-        // Compute the sequence number of the next packet
-        tcpreorder->expectedPacketSeq = getNextSequenceNumber(packet);
-
-        // Store the sequence number of the last packet sent
-        tcpreorder->lastSent = currentSeq;
-
-        // Send packet
-        if(batch == NULL)
-            batch = PacketBatch::start_head(packet);
-        count++;
-
-        // Free memory and remove node from the list
-        last = packet;
-        packet = packet->next();
-    }
-    tcpreorder->packetList = 0;
-
-    if (unlikely(last && !_notimeout)) { //End of flow, everything will be sent and we manage the flow ourself, remove timeout
-        click_ip *ip = (click_ip *) last->data();
-        unsigned hlen = ip->ip_hl << 2;
-        click_tcp *th = (click_tcp *) (((char *)ip) + hlen);
-        //click_chatter("Last packet, releasing timeout");
+        buf->bytes -= packet->length();
+        s.bytes -= packet->length();
+        s.waiting--;
+        buf->start++;
+        buf->count--;
+        sent++;
     }
 
-  send_batch:
-  if (!tcpreorder->packetList && had_awaiting) {
-      //We don't have awaiting packets anymore, remove the fct
-      //click_chatter("We are now in order, removing release fct");
-  } else if (tcpreorder->packetList && !had_awaiting) {
-      //Set release fnt
-      if (_verbose)
-          click_chatter("Out of order, setting release fct");
-  }
-    assert(tcpreorder->expectedPacketSeq);
-    tcpreorder->packetList = packet;
-    tcpreorder->packetListLength -= count;
-    // We now send the batch we just built
-    if(batch != NULL) {
-        assert(count > 0);
-        batch->set_count(count);
-        batch->set_tail(last);
-        last->set_next(0);
-        flow_assert(batch->find_count() == count);
-
-        return batch;
+    if (buf->count == 0) {
+        freeBuffer(s, buf);
+        tcpreorder->buffer = 0;
+    } else if (sent) {
+        // The gap moved, restart its timeout
+        buf->since = now;
     }
-    return 0;
 }
 
-bool TCPReorder::putPacketInList(struct fcb_tcpreorder* tcpreorder, Packet* packetToAdd)
+bool TCPReorder::putPacketInBuffer(ThreadState &s, struct fcb_tcpreorder* tcpreorder, Packet* packetToAdd, int64_t now)
 {
-    Packet* last = NULL;
-    Packet* packetNode = tcpreorder->packetList;
-    auto pSeq = getSequenceNumber(packetToAdd);
-    // Browse the list until we find a packet with a greater sequence number than the
-    // packet to add in the list
-    while(packetNode != NULL
-        && (SEQ_LT(getSequenceNumber(packetNode), pSeq)))
-    {
-        last = packetNode;
-        packetNode = packetNode->next();
-    }
-
-    if (packetNode && (getSequenceNumber(packetNode) == pSeq)) {
-        packetToAdd -> kill();
-        return false;
+    TCPReorderBuffer* buf = tcpreorder->buffer;
+    uint32_t len = packetToAdd->length();
+
+    if (s.bytes + len > _thread_budget || (buf && buf->count == (int)_capacity))
+        goto pressure;
+
+    if (!buf) {
+        if (!(buf = allocBuffer(s)))
+            goto pressure;
+        buf->fcb = fcb_stack;
+        buf->since = now;
+        tcpreorder->buffer = buf;
+        s.stats[s_gaps]++;
+#if HAVE_DYNAMIC_FLOW_RELEASE_FNT
+        if (!tcpreorder->releaseSet) {
+            fcb_set_release_fnt(tcpreorder, &releaseFlow);
+            tcpreorder->releaseSet = true;
+        }
+#endif
+    } else if (buf != s.tail) {
+        // Move the buffer to the end of the list of recently used buffers
+        unlinkBuffer(s, buf);
+        buf->next = 0;
+        buf->prev = s.tail;
+        s.tail->next = buf;
+        s.tail = buf;
     }
+    buf->touched = now;
 
-    //SEQ_LT(getAckNumber(packetNode), getAckNumber(packetToAdd)))
-
-    // Check if we need to add the node as the head of the list
-    if(last == NULL)
-        tcpreorder->packetList = packetToAdd; // If so, the list points to the node to add
-    else
-        last->set_next(packetToAdd); // If not, the previous node in the list now points to the node to add
+    {
+        tcp_seq_t seq = getSequenceNumber(packetToAdd);
+        tcp_seq_t* seqs = buf->seqs + buf->start;
+        int pos;
+
+        // Packets usually extend the waiting data, otherwise look for the
+        // first waiting packet that does not precede the new one
+        if (buf->count == 0 || SEQ_GT(seq, seqs[buf->count - 1])) {
+            pos = buf->count;
+        } else {
+            int lo = 0, hi = buf->count - 1;
+            while (lo < hi) {
+                int mid = (lo + hi) / 2;
+                if (SEQ_LT(seqs[mid], seq))
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            pos = lo;
+            if (seqs[pos] == seq) {
+                packetToAdd->kill();
+                return false;
+            }
+        }
 
-     // The node to add points to the first node with a greater sequence number
-    packetToAdd->set_next(packetNode);
+        if (buf->start + buf->count == (int)_capacity) {
+            memmove(buf->seqs, seqs, buf->count * sizeof(tcp_seq_t));
+            memmove(buf->pkts, buf->pkts + buf->start, buf->count * sizeof(Packet*));
+            buf->start = 0;
+            seqs = buf->seqs;
+        }
+        Packet** pkts = buf->pkts + buf->start;
+        memmove(seqs + pos + 1, seqs + pos, (buf->count - pos) * sizeof(tcp_seq_t));
+        memmove(pkts + pos + 1, pkts + pos, (buf->count - pos) * sizeof(Packet*));
+        seqs[pos] = seq;
+        pkts[pos] = packetToAdd;
+        buf->count++;
+        buf->bytes += len;
+        s.bytes += len;
+        s.waiting++;
+    }
     return true;
-}
 
-void TCPReorder::killList(struct fcb_tcpreorder* tcpreorder) {
-        SFCB_STACK( //Packet in the list have no reference
-            FOR_EACH_PACKET_SAFE(tcpreorder->packetList,p) {
-                click_chatter("WARNING : Non-free TCPReorder flow bucket");
-                p->kill();
-            }
-        );
-        tcpreorder->packetList = 0;
-        tcpreorder->packetListLength = 0;
+  pressure:
+    s.stats[s_pressure_drops]++;
+    packetToAdd->kill();
+    return false;
 }
 
-bool TCPReorder::checkFirstPacket(struct fcb_tcpreorder* tcpreorder, PacketBatch* batch)
+bool TCPReorder::checkFirstPacket(ThreadState &s, struct fcb_tcpreorder* tcpreorder, PacketBatch* batch)
 {
     Packet* packet = batch->first();
     const click_tcp *tcph = packet->tcp_header();
@@ -425,16 +486,19 @@ bool TCPReorder::checkFirstPacket(struct fcb_tcpreorder* tcpreorder, PacketBatch
             fcb_acquire_timeout(2000);
         }
 
-        // Ensure that the list of waiting packets is free
+        // Ensure that the reorder buffer is free
         // (SYN should always be the first packet)
-        killList(tcpreorder);
+        if (tcpreorder->buffer) {
+            fcb_update(-tcpreorder->buffer->count);
+            releaseBuffer(s, tcpreorder);
+        }
     } else {
         if (!tcpreorder->expectedPacketSeq) {
             //click_chatter("The flow does not start with a syn! We should send a RST sometime !"); //No, this is the role of the tcp ctx
             if (isRst(batch->first())) { //Let the RST pass for a bad SYN
                 if (_verbose)
                     click_chatter("Resetting the flow !");
-                killList(tcpreorder);
+                releaseBuffer(s, tcpreorder);
                 tcpreorder->expectedPacketSeq = 0;
 
                 if (batch->count() == 1) {
@@ -453,132 +517,26 @@ bool TCPReorder::checkFirstPacket(struct fcb_tcpreorder* tcpreorder, PacketBatch
     return true;
 }
 
-/*
- * This method is based on the work of Simon Tatham
- * which is copyright 2001 Simon Tatham, under MIT license.
- * http://www.chiark.greenend.org.uk/~sgtatham/algorithms/listsort.html
- *
- * Permission is hereby granted, free of charge, to any person
- * obtaining a copy of this software and associated documentation
- * files (the "Software"), to deal in the Software without
- * restriction, including without limitation the rights to use,
- * copy, modify, merge, publish, distribute, sublicense, and/or
- * sell copies of the Software, and to permit persons to whom the
- * Software is furnished to do so, subject to the following
- * conditions:
- *
- * The above copyright notice and this permission notice shall be
- * included in all copies or substantial portions of the Software.
- *
- * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
- * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
- * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
- * NONINFRINGEMENT.  IN NO EVENT SHALL SIMON TATHAM BE LIABLE FOR
- * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
- * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
- * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
- * SOFTWARE.
- */
-Packet* TCPReorder::sortList(Packet *list)
+String
+TCPReorder::read_handler(Element *e, void *thunk)
 {
-    Packet *p, *q, *e, *tail;
-    int insize, nmerges, psize, qsize, i;
-
-    /*
-    * Silly special case: if `list' was passed in as NULL, return
-    * NULL immediately.
-    */
-   if(!list)
-    return NULL;
-
-    insize = 1;
-
-    while(true)
-    {
-        p = list;
-        list = NULL;
-        tail = NULL;
-
-        nmerges = 0;  /* count number of merges we do in this pass */
-
-        while(p)
-        {
-            nmerges++;  /* there exists a merge to be done */
-            /* step `insize' places along from p */
-            q = p;
-            psize = 0;
-            for(i = 0; i < insize; i++)
-            {
-                psize++;
-                q = q->next();
-                if(!q)
-                    break;
-            }
-
-            /* if q hasn't fallen off end, we have two lists to merge */
-            qsize = insize;
-
-            /* now we have two lists; merge them */
-            while(psize > 0 || (qsize > 0 && q))
-            {
-                /* decide whether next element of merge comes from p or q */
-                if(psize == 0)
-                {
-                    /* p is empty; e must come from q. */
-                    e = q;
-                    q = q->next();
-                    qsize--;
-                }
-                else if(qsize == 0 || !q)
-                {
-                    /* q is empty; e must come from p. */
-                    e = p;
-                    p = p->next();
-                    psize--;
-                }
-                else if(SEQ_LT(getSequenceNumber(p), getSequenceNumber(q)))
-                {
-                    /* First element of p is lower (or same);
-                     * e must come from p. */
-                    e = p;
-                    p = p->next();
-                    psize--;
-                } /* else if (getSequenceNumber(p) == getSequenceNumber(q)
-                        && SEQ_LT(getAckNumber(p), getAckNumber(q))) {
-                    //TODO
-                    assert(false);
-                    p->kill();
-                }*/
-                else
-                {
-                    /* First element of q is lower; e must come from q. */
-                    e = q;
-                    q = q->next();
-                    qsize--;
-                }
-
-                /* add the next element to the merged list */
-                if(tail)
-                    tail->set_next(e);
-                else
-                    list = e;
-
-                tail = e;
-            }
-
-            /* now p has stepped `insize' places along, and q has too */
-            p = q;
-        }
-
-        tail->set_next(NULL);
-
-        /* If we have done only one merge, we're finished. */
-        if(nmerges <= 1)   /* allow for nmerges==0, the empty list case */
-            return list;
-
-        /* Otherwise repeat, merging lists twice the size */
-        insize *= 2;
+    TCPReorder *r = static_cast<TCPReorder *>(e);
+    int which = (intptr_t) thunk;
+    uint32_t total = 0;
+    for (unsigned i = 0; i < r->_state.weight(); i++) {
+        const ThreadState &s = r->_state.get_value(i);
+        total += (which == s_nstats ? s.waiting : s.stats[which]);
     }
+    return String(total);
+}
+
+void
+TCPReorder::add_handlers()
+{
+    add_read_handler("gaps", read_handler, s_gaps);
+    add_read_handler("timeouts", read_handler, s_timeouts);
+    add_read_handler("pressure_drops", read_handler, s_pressure_drops);
+    add_read_handler("waiting", read_handler, s_nstats);
 }
 
 CLICK_ENDDECLS
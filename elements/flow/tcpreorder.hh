@@ -10,43 +10,37 @@
 #include <click/tcphelper.hh>
 #include <click/flow/flowelement.hh>
 
-#define TCPREORDER_POOL_SIZE 100
-
+struct TCPReorderBuffer;
 
 /**
  * Structure used by the TCPReorder element
  */
 struct fcb_tcpreorder : public FlowReleaseChain
 {
-    Packet* packetList;
-    uint16_t packetListLength;
+    TCPReorderBuffer* buffer; //Waiting packets, null while the flow is in order
     tcp_seq_t expectedPacketSeq;
     tcp_seq_t lastSent;
+#if HAVE_DYNAMIC_FLOW_RELEASE_FNT
+    bool releaseSet;
+#endif
+};
 
-    fcb_tcpreorder()
-    {
-        /*packetList = NULL;
-        expectedPacketSeq = 0;
-        lastSent = 0;
-        pool = NULL;*/
-    }
-
-    ~fcb_tcpreorder()
-    {
-        //TODO : call this on release
-        /*Packet* next = NULL;
-
-        while(packetList != NULL)
-        {
-            next = packetList->next();
-
-            // Kill packet
-            packetList->kill();
-
-            // Put back node in memory pool
-            packetList = next;
-        }*/
-    }
+/**
+ * Waiting packets of a flow, sorted by sequence number. The packets are
+ * in pkts[start, start + count), and their sequence numbers in seqs.
+ */
+struct TCPReorderBuffer
+{
+    TCPReorderBuffer* prev; //Buffers of a thread, least recently used first
+    TCPReorderBuffer* next;
+    FlowControlBlock* fcb;
+    int64_t touched; //Last use, in msec
+    int64_t since; //Start of the wait for the missing data, in msec
+    int start;
+    int count;
+    uint32_t bytes;
+    tcp_seq_t* seqs;
+    Packet** pkts;
 };
 
 
@@ -55,7 +49,7 @@ CLICK_DECLS
 /*
 =c
 
-TCPReorder(FLOWDIRECTION [, MERGESORT])
+TCPReorder(FLOWDIRECTION [, I<keywords>])
 
 =s middlebox
 
@@ -75,22 +69,57 @@ This element reorders TCP packets before sending them on its first output. It ca
 of the stack of the middlebox. The second output is optional and is used to push retransmitted
 packets. If the second output is not used, retransmitted packets are dropped.
 
+In-order packets pass through without being buffered. When a gap appears, the flow gets a
+reorder buffer that keeps its waiting packets sorted by sequence number: a packet is appended
+in constant time when it extends the flow, and otherwise placed by binary search. When the gap
+is filled, the run of packets that became in order leaves as one batch, with the packets of
+the input batch that followed it.
+
+Each thread has its own buffers, so the packets of a flow must arrive on the same thread.
+Buffers whose flow has seen no packet for TIMEOUT are freed with their packets when other
+packets arrive on the thread, so a flow that expires while waiting does not leak them.
+
 =item FLOWDIRECTION
 
 ID of the path for the connection (0 or 1). The return path must have the other ID.
 Thus, each direction of a TCP connection has a different ID.
 
+=item CAPACITY
+
+Maximum number of packets waiting in one flow. Further out-of-order packets of the flow are
+dropped. Default is 128.
+
+=item BUDGET
+
+Maximum number of bytes of packets waiting in all flows, shared evenly between the threads.
+Out-of-order packets that do not fit are dropped. Default is 16777216 (16MB).
+
+=item TIMEOUT
+
+Time in milliseconds after which a gap is given up on. When a packet of a flow arrives and the
+flow has waited for the same missing data for more than TIMEOUT, that data is skipped and the
+waiting packets are sent. Default is 2000.
+
 =item MERGESORT
 
-Only used with batching. Adds each packet of the batch at the beginning of the list and reorders
-the list using merge sort instead of adding each packet of the batch directly to the right position.
+Ignored, for compatibility. The reorder buffer is always kept sorted.
+
+=h gaps read-only
 
-Complexity to process a batch with this option: O((n + k) * log (n + k))
-Complexity to process a batch without this option: O(k * (n + k))
+Number of times a flow went out of order and started waiting for missing data.
 
-Where k is the number of packets in the batch and n is the number of packets in the waiting list
+=h timeouts read-only
 
-Default value: true.
+Number of gaps given up on after TIMEOUT, and of buffers freed because their flow was idle.
+
+=h pressure_drops read-only
+
+Number of out-of-order packets dropped because their flow's buffer was full, or BUDGET was
+reached.
+
+=h waiting read-only
+
+Number of packets currently waiting in the buffers.
 
 =a TCPIn, TCPOut, TCPRetransmitter */
 
@@ -116,48 +145,71 @@ public:
 
     int configure(Vector<String>&, ErrorHandler*) override CLICK_COLD;
     int solve_initialize(ErrorHandler *errh) override CLICK_COLD;
+    int initialize(ErrorHandler *errh) override CLICK_COLD;
+    void cleanup(CleanupStage) override CLICK_COLD;
+    void add_handlers() override CLICK_COLD;
 
     void push_flow(int, fcb_tcpreorder* fcb, PacketBatch *batch) override;
 
 private:
-    /**
-     * @brief Put a packet in the list of waiting packets
-     * @param fcb A pointer to the FCB of the flow
-     * @param packet The packet to add
-     */
-    bool putPacketInList(struct fcb_tcpreorder *fcb, Packet* packet);
+    enum { s_gaps, s_timeouts, s_pressure_drops, s_nstats };
 
-    void killList(struct fcb_tcpreorder* tcpreorder);
+    struct ThreadState {
+        TCPReorderBuffer* free;
+        TCPReorderBuffer* head; //Buffers in use, least recently used first
+        TCPReorderBuffer* tail;
+        uint32_t bytes;
+        uint32_t waiting;
+        uint32_t stats[s_nstats];
+
+        ThreadState() : free(0), head(0), tail(0), bytes(0), waiting(0) {
+            memset(stats, 0, sizeof(stats));
+        }
+    };
 
     /**
-     * @brief Send the in-order packets from the list of waiting packets
-     * @param fcb A pointer to the FCB of the flow
+     * Batch of packets to send, built in order
      */
-    PacketBatch* sendEligiblePackets(struct fcb_tcpreorder *fcb, bool had_awaiting);
+    struct OutBatch {
+        Packet* head;
+        Packet* tail;
+        int count;
+
+        OutBatch() : head(0), tail(0), count(0) {
+        }
+
+        inline void append(Packet* p) {
+            if (tail)
+                tail->set_next(p);
+            else
+                head = p;
+            tail = p;
+            count++;
+        }
+    };
 
     /**
-     * @brief Check if the packet is the first one of the flow and acts consequently.
-     * In particular, it flushes the list of waiting packets and sets the sequence number of the
-     * next expected packet
+     * @brief Put a packet in the reorder buffer of its flow
      * @param fcb A pointer to the FCB of the flow
-     * @param packet The packet to check
+     * @param packet The packet to add
+     * @return False if the packet was dropped
      */
-    bool checkFirstPacket(struct fcb_tcpreorder *fcb, PacketBatch* batch);
+    bool putPacketInBuffer(ThreadState &s, struct fcb_tcpreorder *fcb, Packet* packet, int64_t now);
 
     /**
-     * @brief Flush the list of waiting packets
+     * @brief Move the packets that became in order from the reorder buffer to @a out
      * @param fcb A pointer to the FCB of the flow
      */
-    void flushList(struct fcb_tcpreorder *fcb);
+    void sendEligiblePackets(ThreadState &s, struct fcb_tcpreorder *fcb, OutBatch &out, int64_t now);
 
     /**
-     * @brief Flush the list of waiting packets after a given packet
+     * @brief Check if the packet is the first one of the flow and acts consequently.
+     * In particular, it flushes the reorder buffer and sets the sequence number of the
+     * next expected packet
      * @param fcb A pointer to the FCB of the flow
-     * @param toKeep Pointer to the last element that will be kept in the list
-     * @param toRemove Pointer to the first element that will be removed
+     * @param packet The packet to check
      */
-    void flushListFrom(struct fcb_tcpreorder *fcb, Packet *toKeep,
-        Packet *toRemove);
+    bool checkFirstPacket(ThreadState &s, struct fcb_tcpreorder *fcb, PacketBatch* batch);
 
     /**
      * @brief Check if a given packet is a retransmission
@@ -167,17 +219,30 @@ private:
      */
     bool checkRetransmission(struct fcb_tcpreorder *fcb, Packet* packet, bool always_retransmit);
 
-public:
-
+    TCPReorderBuffer* allocBuffer(ThreadState &s);
     /**
-     * @brief Sort the list of waiting packets using merge sort
-     * @param list A pointer to the head of the list of waiting packets
-     * @return A pointer to the new head of the list of waiting packets
+     * @brief Kill the waiting packets of a flow and give its buffer back
      */
-    static Packet* sortList(Packet *list);
+    void releaseBuffer(ThreadState &s, struct fcb_tcpreorder *fcb);
+    void unlinkBuffer(ThreadState &s, TCPReorderBuffer* buf);
+    void freeBuffer(ThreadState &s, TCPReorderBuffer* buf);
+    /**
+     * @brief Free the buffers of flows idle for more than the timeout
+     */
+    void expireBuffers(ThreadState &s, int64_t now);
+#if HAVE_DYNAMIC_FLOW_RELEASE_FNT
+    static void releaseFlow(FlowControlBlock* fcb, void* thunk);
+#endif
+
+    static String read_handler(Element *e, void *thunk) CLICK_COLD;
+
 private:
 
-    bool _mergeSort;
+    per_thread<ThreadState> _state;
+    uint32_t _capacity;
+    uint32_t _budget;
+    uint32_t _thread_budget;
+    int _timeout;
     bool _notimeout;
     bool _verbose;
 };
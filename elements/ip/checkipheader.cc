@@ -24,6 +24,7 @@
 #include <click/config.h>
 #include "checkipheader.hh"
 #include <clicknet/ip.h>
+#include <click/ipchecksum.hh>
 #include <click/glue.hh>
 #include <click/args.hh>
 #include <click/straccum.hh>
@@ -80,7 +81,7 @@ CheckIPHeader::InterfacesArg::parse(const String &str, Vector<IPAddress> &result
     return false;
 }
 
-CheckIPHeader::CheckIPHeader() : _checksum(true), _reason_drops(0)
+CheckIPHeader::CheckIPHeader() : _checksum(true), _rx_checksum(false), _reason_drops(0)
 {
     _count = 0;
     _drops = 0;
@@ -108,6 +109,7 @@ CheckIPHeader::configure(Vector<String> &conf, ErrorHandler *errh)
         .read("VERBOSE", verbose)
         .read("DETAILS", details)
         .read("CHECKSUM", _checksum)
+        .read("RX_CHECKSUM", _rx_checksum)
         .consume() < 0)
         return -1;
 
@@ -184,16 +186,20 @@ inline CheckIPHeader::Reason CheckIPHeader::valid(Packet* p) {
         return BAD_IP_LEN;
 
     if (_checksum) {
-        int val;
+        // trust the NIC's verdict if asked to and it checked this header
+        int val = _rx_checksum ? IPChecksum::rx_ip_status(p, ip) : IPChecksum::UNKNOWN;
+        if (val != IPChecksum::UNKNOWN)
+            val = (val == IPChecksum::GOOD ? 0 : 1);
+        else
     #if HAVE_FAST_CHECKSUM && FAST_CHECKSUM_ALIGNED
         if (_aligned)
             val = ip_fast_csum((unsigned char *)ip, ip->ip_hl);
         else
-            val = click_in_cksum((const unsigned char *)ip, hlen);
+            val = IPChecksum::header_sum(ip, hlen);
     #elif HAVE_FAST_CHECKSUM
         val = ip_fast_csum((unsigned char *)ip, ip->ip_hl);
     #else
-        val = click_in_cksum((const unsigned char *)ip, hlen);
+        val = IPChecksum::header_sum(ip, hlen);
     #endif
         if (val != 0)
             return BAD_CHECKSUM;
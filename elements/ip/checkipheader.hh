@@ -45,6 +45,14 @@ Keyword arguments are:
 Boolean. If true, then check each packet's checksum for validity; if false, do
 not check the checksum. Default is true.
 
+=item RX_CHECKSUM
+
+Boolean. If true, trust the verdict of the NIC on the header checksum of
+packets received by a FromDPDKDevice with RX_CHECKSUM, instead of computing
+it. The verdict is only used while the IP header is where the NIC found it,
+but it is about the packet as received: only set RX_CHECKSUM if no element
+between the device and CheckIPHeader modifies the packet. Default is false.
+
 =item OFFSET
 
 Unsigned integer. Byte position at which the IP header begins. Default is 0.
@@ -140,6 +148,7 @@ class CheckIPHeader : public SimpleElement<CheckIPHeader> {
         Vector<IPAddress> _bad_src;   // array of illegal IP src addresses
 
         bool _checksum;
+        bool _rx_checksum;
     #if HAVE_FAST_CHECKSUM && FAST_CHECKSUM_ALIGNED
         bool _aligned;
     #endif
@@ -489,10 +489,6 @@ DirectIPLookup::Table::remove_route(const IPRoute& route, IPRoute* old_route, Er
 
 DirectIPLookup::DirectIPLookup()
 {
-#if HAVE_BATCH
-	// TODO: Remove this when push_batch() will actually be implemented
-	in_batch_mode = BATCH_MODE_NO;
-#endif
 }
 
 DirectIPLookup::~DirectIPLookup()
@@ -542,6 +538,30 @@ DirectIPLookup::lookup_route(IPAddress dest, IPAddress &gw) const
     return _t._vport[vport_i].port;
 }
 
+void
+DirectIPLookup::lookup_route_batch(const IPAddress* addrs, int n, int* ports, IPAddress* gws) const
+{
+    uint32_t ip_addr[LOOKUP_BATCH_MAX];
+    uint16_t vport_i[LOOKUP_BATCH_MAX];
+
+    // Issue all the first-level loads before any of them is needed
+    for (int i = 0; i < n; i++) {
+        ip_addr[i] = ntohl(addrs[i].addr());
+        __builtin_prefetch(&_t._tbl_0_23[ip_addr[i] >> 8]);
+    }
+    for (int i = 0; i < n; i++) {
+        vport_i[i] = _t._tbl_0_23[ip_addr[i] >> 8];
+        if (vport_i[i] & 0x8000)
+            __builtin_prefetch(&_t._tbl_24_31[((vport_i[i] & 0x7fff) << 8) | (ip_addr[i] & 0xff)]);
+    }
+    for (int i = 0; i < n; i++) {
+        if (vport_i[i] & 0x8000)
+            vport_i[i] = _t._tbl_24_31[((vport_i[i] & 0x7fff) << 8) | (ip_addr[i] & 0xff)];
+        gws[i] = _t._vport[vport_i[i]].gw;
+        ports[i] = _t._vport[vport_i[i]].port;
+    }
+}
+
 int
 DirectIPLookup::add_route(const IPRoute& route, bool allow_replace, IPRoute* old_route, ErrorHandler *errh)
 {
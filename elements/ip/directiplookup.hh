@@ -102,6 +102,7 @@ class DirectIPLookup : public IPRouteTable { public:
     int add_route(const IPRoute&, bool, IPRoute*, ErrorHandler *);
     int remove_route(const IPRoute&, IPRoute*, ErrorHandler *);
     int lookup_route(IPAddress, IPAddress&) const;
+    void lookup_route_batch(const IPAddress*, int, int*, IPAddress*) const;
     String dump_routes();
 
     static int flush_handler(const String &, Element *, void *, ErrorHandler *);
@@ -20,6 +20,7 @@
 #include "ipclassifier.hh"
 #include <click/glue.hh>
 #include <click/error.hh>
+#include <click/args.hh>
 #include <click/confparse.hh>
 #include <click/router.hh>
 CLICK_DECLS
@@ -35,6 +36,11 @@ IPClassifier::~IPClassifier()
 int
 IPClassifier::configure(Vector<String> &conf, ErrorHandler *errh)
 {
+    if (Args(this, errh).bind(conf)
+        .read("JIT", _jit)
+        .consume() < 0)
+        return -1;
+
     if (conf.size() != noutputs())
 	return errh->error("need %d arguments, one per output port", noutputs());
 
@@ -48,11 +54,41 @@ IPClassifier::configure(Vector<String> &conf, ErrorHandler *errh)
     return r;
 }
 
+// Configuration argument holding pattern number @a pattern, skipping
+// keyword arguments
+static uintptr_t
+pattern_argno(Element *e, uintptr_t pattern)
+{
+    Vector<String> conf;
+    cp_argvec(e->configuration(), conf);
+    String keyword, rest;
+    for (int i = 0; i < conf.size(); i++)
+	if (!(cp_keyword(conf[i], &keyword, &rest) && keyword == "JIT")
+	    && pattern-- == 0)
+	    return i;
+    return conf.size();
+}
+
+String
+IPClassifier::read_pattern_handler(Element *e, void *user_data)
+{
+    uintptr_t argno = pattern_argno(e, (uintptr_t) user_data);
+    return read_positional_handler(e, (void *) argno);
+}
+
+int
+IPClassifier::write_pattern_handler(const String &str, Element *e,
+				    void *user_data, ErrorHandler *errh)
+{
+    uintptr_t argno = pattern_argno(e, (uintptr_t) user_data);
+    return reconfigure_positional_handler(str, e, (void *) argno, errh);
+}
+
 void IPClassifier::add_handlers() {
     IPFilter::add_handlers();
     for (uintptr_t i = 0; i != (uintptr_t) noutputs(); ++i) {
-	add_read_handler("pattern" + String(i), read_positional_handler, (void*) i);
-	add_write_handler("pattern" + String(i), reconfigure_positional_handler, (void*) i);
+	add_read_handler("pattern" + String(i), read_pattern_handler, (void*) i);
+	add_write_handler("pattern" + String(i), write_pattern_handler, (void*) i);
     }
 }
 
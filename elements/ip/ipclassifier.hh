@@ -5,7 +5,7 @@ CLICK_DECLS
 
 /*
 =c
-IPClassifier(PATTERN_1, ..., PATTERN_N)
+IPClassifier([JIT,] PATTERN_1, ..., PATTERN_N)
 
 =s ip
 classifies IP packets by contents
@@ -172,6 +172,9 @@ will ever match a pattern. Usually, this is because an earlier pattern is
 more general, or because your pattern is contradictory ('src port www and
 src port ftp').
 
+The JIT keyword argument compiles the patterns into native code, as for
+IPFilter. It defaults to true.
+
 =n
 
 Valid IP port names: 'echo', 'discard', 'daytime', 'chargen', 'ftp-data',
@@ -228,6 +231,9 @@ is using to classify packets. At each step in the program, four bytes
 of packet data are ANDed with a mask and compared against four bytes of
 classifier pattern.
 
+=h jit read-only
+Returns true if the program is compiled into native code.
+
 =h pattern0 rw
 Returns or sets the element's pattern 0. There are as many C<pattern>
 handlers as there are output ports.
@@ -246,6 +252,12 @@ class IPClassifier : public IPFilter { public:
   int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
   void add_handlers() CLICK_COLD;
 
+  private:
+
+  static String read_pattern_handler(Element *e, void *user_data);
+  static int write_pattern_handler(const String &str, Element *e,
+				   void *user_data, ErrorHandler *errh);
+
 };
 
 CLICK_ENDDECLS
@@ -161,7 +161,7 @@ IPFilter::static_cleanup()
     delete dbs[1];
 }
 
-IPFilter::IPFilter() : _caching(false), _cache()
+IPFilter::IPFilter() : _caching(false), _cache(), _jit(true)
 {
 }
 
@@ -1325,6 +1325,7 @@ IPFilter::configure(Vector<String> &conf, ErrorHandler *errh)
     // Consume key-value argument before parsing the rules
     if (Args(this, errh).bind(conf)
         .read("CACHING", _caching)
+        .read("JIT", _jit)
         .consume() < 0)
         return -1;
 
@@ -1336,7 +1337,14 @@ IPFilter::configure(Vector<String> &conf, ErrorHandler *errh)
     parse_program(zprog, conf, noutputs(), this, errh);
 
     if (!errh->nerrors()) {
+        Classification::Wordwise::JITProgram jitprog;
+        if (_jit && zprog.output_everything() < 0)
+            jitprog.compile(zprog, offset_net, offset_transp);
         _zprog = zprog;
+        // Pushing threads may still run the previous code: keep it until
+        // the next reconfiguration
+        _jitprog.swap(jitprog);
+        _jit_retired.swap(jitprog);
         return 0;
     }
 
@@ -1352,6 +1360,9 @@ IPFilter::read_handler(Element *e, void *thunk)
         case H_PROGRAM: {
             return ipf->_zprog.unparse();
         }
+        case H_JIT: {
+            return String(ipf->_jitprog.compiled());
+        }
         case H_CACHE_HITS: {
             if (!ipf->_caching){
                 return "-1";
@@ -1400,6 +1411,7 @@ void
 IPFilter::add_handlers()
 {
     add_read_handler("program", read_handler, H_PROGRAM);
+    add_read_handler("jit", read_handler, H_JIT);
     add_read_handler("cache_hits_count", read_handler, H_CACHE_HITS);
     add_read_handler("cache_misses_count", read_handler, H_CACHE_MISSES);
     add_read_handler("cache_total_count", read_handler, H_CACHE_TOTAL);
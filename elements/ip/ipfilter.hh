@@ -9,7 +9,7 @@ CLICK_DECLS
 /*
 =c
 
-IPFilter([CACHING,] ACTION_1 PATTERN_1, ..., ACTION_N PATTERN_N)
+IPFilter([CACHING, JIT,] ACTION_1 PATTERN_1, ..., ACTION_N PATTERN_N)
 
 =s ip
 
@@ -45,6 +45,14 @@ Arguments:
 
 Boolean. Enables or disables caching. Defaults to false (i.e., no caching).
 
+=item JIT
+
+Boolean. If true, compile the filters into native code when the configuration
+is read, and at every live reconfiguration. Packets shorter than the
+program's safe length are still interpreted. Only available on x86-64
+user-level builds; elsewhere IPFilter silently interprets its program.
+Defaults to true.
+
 =n
 
 Every IPFilter element has an equivalent corresponding IPClassifier element
@@ -116,6 +124,9 @@ is using to classify packets. At each step in the program, four bytes
 of packet data are ANDed with a mask and compared against four bytes of
 classifier pattern.
 
+=h jit read-only
+Returns true if the program is compiled into native code.
+
 =h cache_hits_count read-only
 If CACHING is enabled, the IPFilter element stores the last rule in a cache.
 This handler returns the number of cache hits (i.e., number of input packets
@@ -321,11 +332,14 @@ class IPFilter : public BatchElement { public:
     IPFilterProgram _zprog;
     bool _caching;
     IPFilterCache _cache;
+    bool _jit;
+    Classification::Wordwise::JITProgram _jitprog;
+    Classification::Wordwise::JITProgram _jit_retired;
 
     static String read_handler(Element *e, void *thunk);
 
     enum {
-        H_PROGRAM,
+        H_PROGRAM, H_JIT,
         H_CACHE_HITS, H_CACHE_MISSES, H_CACHE_TOTAL,
         H_CACHE_HITS_RATIO, H_CACHE_MISSES_RATIO
     };
@@ -369,6 +383,7 @@ class IPFilter : public BatchElement { public:
     };
 
     static int length_checked_match(const IPFilterProgram &zprog, const Packet *p, int packet_length);
+    inline int cache_port(const Packet *p, int port);
 
 };
 
@@ -390,6 +405,17 @@ IPFilter::Primitive::negation_is_simple() const
         return _type == TYPE_HOST || (_type & TYPE_FIELD) || _type == TYPE_IPFRAG;
 }
 
+inline int
+IPFilter::cache_port(const Packet *p, int port)
+{
+    if (_caching) {
+        IPFlow5ID new_flow_id(p);
+        _cache.last_flow_id = &new_flow_id;
+        _cache.last_port = port;
+    }
+    return port;
+}
+
 inline int
 IPFilter::match(const IPFilterProgram &zprog, const Packet *p)
 {
@@ -433,6 +459,11 @@ IPFilter::match(const IPFilterProgram &zprog, const Packet *p)
     const unsigned char *neth_data = p->network_header();
     const unsigned char *transph_data = p->transport_header();
 
+    if (&zprog == &_zprog && _jitprog.compiled()) {
+        int port = _jitprog.match(p->mac_header() - 2, neth_data, transph_data);
+        return cache_port(p, port);
+    }
+
     const uint32_t *pr = zprog.begin();
     const uint32_t *pp;
     uint32_t data;
@@ -468,14 +499,8 @@ IPFilter::match(const IPFilterProgram &zprog, const Packet *p)
         }
         off = pr[1];
         gotit:
-        if (off <= 0) {
-            if (_caching) {
-                IPFlow5ID new_flow_id(p);
-                _cache.last_flow_id = &new_flow_id;
-                _cache.last_port = -off;
-            }
-            return -off;
-        }
+        if (off <= 0)
+            return cache_port(p, -off);
         pr += off;
     }
 }
@@ -24,6 +24,7 @@
 #include <click/ipaddress.hh>
 #include <click/args.hh>
 #include <click/bitvector.hh>
+#include <click/packetbatch.hh>
 #include <click/error.hh>
 #include <click/glue.hh>
 #include <click/packet_anno.hh>
@@ -36,10 +37,10 @@ CLICK_DECLS
 #define IP_BYTE_OFF(iph)	((ntohs((iph)->ip_off) & IP_OFFMASK) << 3)
 
 IPReassembler::IPReassembler()
-    : _stat_frags_seen(0), _stat_good_assem(0), _stat_failed_assem(0), _stat_bad_pkts(0)
 {
-    for (int i = 0; i < NMAP; i++)
-	_map[i] = 0;
+#if HAVE_BATCH
+    in_batch_mode = BATCH_MODE_YES;
+#endif
     static_assert(IPREASSEMBLER_ANNO_OFFSET + IPREASSEMBLER_ANNO_SIZE <= Packet::anno_size, "anno too big");
     static_assert(sizeof(ChunkLink) == IPREASSEMBLER_ANNO_SIZE, "sizeof(ChunkLink) is expected to equal IPREASSEMBLER_ANNO_SIZE.");
 }
@@ -51,35 +52,86 @@ IPReassembler::~IPReassembler()
 int
 IPReassembler::configure(Vector<String> &conf, ErrorHandler *errh)
 {
-    _mem_high_thresh = 256 * 1024;
+    _himem = 256 * 1024;
+    _capacity = 1024;
     int mtu_anno = -1;
     if (Args(conf, this, errh)
-	.read("HIMEM", _mem_high_thresh)
+	.read("HIMEM", _himem)
+	.read("CAPACITY", _capacity)
 	.read("MAX_MTU_ANNO", AnnoArg(2), mtu_anno)
 	.complete() < 0)
 	return -1;
+    if (_capacity == 0)
+	return errh->error("CAPACITY must be positive");
     _mtu_anno = mtu_anno;
-    _mem_low_thresh = (_mem_high_thresh >> 2) * 3;
     return 0;
 }
 
 int
 IPReassembler::initialize(ErrorHandler *)
 {
-    _mem_used = 0;
-    _reap_time = 0;
+    int nthreads = get_passing_threads().weight();
+    _mem_high_thresh = _himem / (nthreads > 0 ? nthreads : 1);
+    _mem_low_thresh = (_mem_high_thresh >> 2) * 3;
+    for (unsigned i = 0; i < _state.weight(); i++) {
+	State &s = _state.get_value(i);
+	s.free = 0;
+	s.bucket_mask = 0;
+	memset(s.wheel, 0, sizeof(s.wheel));
+	s.now = 0;
+	s.mem_used = 0;
+	memset(s.stats, 0, sizeof(s.stats));
+	s.failed_head = s.failed_tail = 0;
+	s.nfailed = 0;
+    }
+    return 0;
+}
+
+/* Allocate a thread's tables on its first fragment, so threads that never
+   see one cost nothing. */
+int
+IPReassembler::init_state(State &s)
+{
+    uint32_t nbuckets = 16;
+    while (nbuckets < _capacity)
+	nbuckets <<= 1;
+    s.pool = new Datagram[_capacity];
+    s.buckets = new Datagram *[nbuckets];
+    if (!s.pool || !s.buckets) {
+	delete[] s.pool;
+	delete[] s.buckets;
+	s.pool = 0;
+	s.buckets = 0;
+	return -1;
+    }
+    memset(s.buckets, 0, sizeof(Datagram *) * nbuckets);
+    s.bucket_mask = nbuckets - 1;
+    for (uint32_t i = 0; i < _capacity; i++) {
+	s.pool[i].q = 0;
+	s.pool[i].hnext = i + 1 < _capacity ? &s.pool[i + 1] : 0;
+    }
+    s.free = &s.pool[0];
     return 0;
 }
 
 void
 IPReassembler::cleanup(CleanupStage)
 {
-    for (int i = 0; i < NMAP; i++)
-	while (_map[i]) {
-	    WritablePacket *next = (WritablePacket *)(_map[i]->next());
-	    _map[i]->kill();
-	    _map[i] = next;
+    for (unsigned i = 0; i < _state.weight(); i++) {
+	State &s = _state.get_value(i);
+	if (s.pool)
+	    for (uint32_t j = 0; j < _capacity; j++)
+		if (s.pool[j].q)
+		    s.pool[j].q->kill();
+	while (Packet *p = s.failed_head) {
+	    s.failed_head = p->next();
+	    p->kill();
 	}
+	delete[] s.pool;
+	delete[] s.buckets;
+	s.pool = 0;
+	s.buckets = 0;
+    }
 }
 
 void
@@ -103,28 +155,25 @@ IPReassembler::check(ErrorHandler *errh)
 {
     if (!errh)
 	errh = ErrorHandler::default_handler();
-    uint32_t mem_used = 0;
-    for (int b = 0; b < NMAP; b++)
-	for (WritablePacket *q = _map[b]; q; q = (WritablePacket *)(q->next()))
-	    if (q->has_network_header()) {
+    for (unsigned i = 0; i < _state.weight(); i++) {
+	State &s = _state.get_value(i);
+	if (!s.pool)
+	    continue;
+	uint32_t mem_used = 0;
+	for (uint32_t b = 0; b <= s.bucket_mask; b++)
+	    for (Datagram *d = s.buckets[b]; d; d = d->hnext) {
+		WritablePacket *q = d->q;
+		if (!q->has_network_header()) {
+		    errh->error("buck %d: missing IP header", b);
+		    continue;
+		}
 		const click_ip *qip = q->ip_header();
-		if (bucketno(qip) != b)
+		if ((hashcode(d->src, d->dst, d->id, d->proto) & s.bucket_mask) != b
+		    || !same_segment(d, qip))
 		    check_error(errh, b, q, "in wrong bucket");
 		mem_used += IPH_MEM_USED + q->transport_length();
 		ChunkLink *chunk = &PACKET_CHUNK(q);
 		int off = 0;
-#if VERBOSE_DEBUG
-		check_error(errh, b, q, "");
-		StringAccum sa;
-		while (chunk && (!off || off < q->transport_length())) {
-		    sa << " (" << chunk->off << ',' << chunk->lastoff << ')';
-		    off = chunk->lastoff;
-		    chunk = next_chunk(q, chunk);
-		}
-		errh->message("  %s", sa.c_str());
-		chunk = &PACKET_CHUNK(q);
-		off = 0;
-#endif
 		while (chunk) {
 		    if (chunk->off >= chunk->lastoff
 			|| chunk->lastoff > q->transport_length()
@@ -135,65 +184,143 @@ IPReassembler::check(ErrorHandler *errh)
 		    off = chunk->lastoff;
 		    chunk = next_chunk(q, chunk);
 		}
-	    } else
-		errh->error("buck %d: missing IP header", b);
-    if (mem_used != _mem_used)
-	errh->error("bad mem_used: have %u, claim %u", mem_used, _mem_used);
+	    }
+	if (mem_used != s.mem_used)
+	    errh->error("thread %u: bad mem_used: have %u, claim %u", i, mem_used, s.mem_used);
+    }
     return 0;
 }
 
+String
+IPReassembler::read_stat(Element *e, void *thunk)
+{
+    IPReassembler *r = static_cast<IPReassembler *>(e);
+    int which = (intptr_t) thunk;
+    uint32_t total = 0;
+    for (unsigned i = 0; i < r->_state.weight(); i++)
+	total += r->_state.get_value(i).stats[which];
+    return String(total);
+}
+
 String
 IPReassembler::debug_dump(Element *e, void *)
 {
     IPReassembler *r = (IPReassembler *) e;
     r->check();
+    uint32_t st[s_nstats];
+    memset(st, 0, sizeof(st));
+    for (unsigned i = 0; i < r->_state.weight(); i++)
+	for (int j = 0; j < s_nstats; j++)
+	    st[j] += r->_state.get_value(i).stats[j];
     StringAccum sa;
     sa <<
-	"frags seen total:    " << r->_stat_frags_seen << "\n"
-	"good reassemblies:   " << r->_stat_good_assem << "\n"
-	"failed reassemblies: " << r->_stat_failed_assem << "\n"
-	"bad fragments seen:  " << r->_stat_bad_pkts << "\n"
+	"frags seen total:    " << st[s_frags_seen] << "\n"
+	"good reassemblies:   " << st[s_good_assem] << "\n"
+	"failed reassemblies: " << st[s_timeouts] + st[s_evictions] << "\n"
+	"  timed out:         " << st[s_timeouts] << "\n"
+	"  evicted:           " << st[s_evictions] << "\n"
+	"bad fragments seen:  " << st[s_bad_pkts] << "\n"
+	"late fragments:      " << st[s_late] << "\n"
+	"out of memory:       " << st[s_nomem] << "\n"
 	"cached chunk data:\n";
-    for (int b = 0; b < NMAP; b++)
-	for (WritablePacket *q = r->_map[b]; q; q = (WritablePacket *)(q->next()))
-	    if (const click_ip *qip = q->ip_header()) {
-		sa << ' ' << IPFlowID(qip) << ' ' << ntohs(qip->ip_id);
-		ChunkLink *chunk = &PACKET_CHUNK(q);
-		while (chunk &&
-		       (chunk->lastoff > chunk->off) &&
-		       (chunk->lastoff <= q->transport_length())) {
-		    sa << " (" << chunk->off << ',' << chunk->lastoff << ')';
-		    chunk = next_chunk(q, chunk);
+    for (unsigned i = 0; i < r->_state.weight(); i++) {
+	State &s = r->_state.get_value(i);
+	if (!s.pool)
+	    continue;
+	for (uint32_t b = 0; b <= s.bucket_mask; b++)
+	    for (Datagram *d = s.buckets[b]; d; d = d->hnext)
+		if (const click_ip *qip = d->q->ip_header()) {
+		    WritablePacket *q = d->q;
+		    sa << ' ' << IPFlowID(qip) << ' ' << ntohs(qip->ip_id);
+		    ChunkLink *chunk = &PACKET_CHUNK(q);
+		    while (chunk &&
+			   (chunk->lastoff > chunk->off) &&
+			   (chunk->lastoff <= q->transport_length())) {
+			sa << " (" << chunk->off << ',' << chunk->lastoff << ')';
+			chunk = next_chunk(q, chunk);
+		    }
+		    sa << '\n';
 		}
-		sa << '\n';
-	    }
+    }
     return sa.take_string();
 }
 
-WritablePacket *
-IPReassembler::find_queue(Packet *p, WritablePacket ***store_pprev)
+IPReassembler::Datagram *
+IPReassembler::find_queue(State &s, const click_ip *iph, Datagram ***store_bucket)
 {
-    const click_ip *iph = p->ip_header();
-    int bucket = bucketno(iph);
-    WritablePacket **pprev = &_map[bucket];
-    WritablePacket *q;
-    for (q = *pprev; q; pprev = (WritablePacket **)&q->next(), q = *pprev) {
-	const click_ip *qiph = q->ip_header();
-	if (same_segment(iph, qiph)) {
-	    *store_pprev = pprev;
-	    return q;
-	}
-    }
-    *store_pprev = &_map[bucket];
+    Datagram **bucket = &s.buckets[hashcode(iph->ip_src.s_addr, iph->ip_dst.s_addr, iph->ip_id, iph->ip_p) & s.bucket_mask];
+    *store_bucket = bucket;
+    for (Datagram *d = *bucket; d; d = d->hnext)
+	if (same_segment(d, iph))
+	    return d;
     return 0;
 }
 
+/* Remove d from its bucket and the wheel, and return it to the free list.
+   The caller takes care of d->q. */
+void
+IPReassembler::unlink_queue(State &s, Datagram *d)
+{
+    Datagram **pprev = &s.buckets[hashcode(d->src, d->dst, d->id, d->proto) & s.bucket_mask];
+    while (*pprev != d)
+	pprev = &(*pprev)->hnext;
+    *pprev = d->hnext;
+    *d->wpprev = d->wnext;
+    if (d->wnext)
+	d->wnext->wpprev = d->wpprev;
+    d->q = 0;
+    d->hnext = s.free;
+    s.free = d;
+}
+
+/* Give up on d: its partial packet goes to output 1 at the next flush. */
+void
+IPReassembler::fail_queue(State &s, Datagram *d, int stat)
+{
+    WritablePacket *q = d->q;
+    unlink_queue(s, d);
+    s.mem_used -= IPH_MEM_USED + q->transport_length();
+    ++s.stats[stat];
+    q->set_next(0);
+    if (s.failed_tail)
+	s.failed_tail->set_next(q);
+    else
+	s.failed_head = q;
+    s.failed_tail = q;
+    ++s.nfailed;
+}
+
+void
+IPReassembler::flush_failed(State &s)
+{
+    Packet *head = s.failed_head;
+    if (likely(!head))
+	return;
+#if HAVE_BATCH
+    if (in_batch_mode == BATCH_MODE_YES) {
+	PacketBatch *batch = PacketBatch::make_from_simple_list(head, s.failed_tail, s.nfailed);
+	s.failed_head = s.failed_tail = 0;
+	s.nfailed = 0;
+	checked_output_push_batch(1, batch);
+	return;
+    }
+#endif
+    s.failed_head = s.failed_tail = 0;
+    s.nfailed = 0;
+    while (head) {
+	Packet *next = head->next();
+	head->set_next(0);
+	checked_output_push(1, head);
+	head = next;
+    }
+}
+
 Packet *
-IPReassembler::emit_whole_packet(WritablePacket *q, WritablePacket **q_pprev,
-				 Packet *p_in)
+IPReassembler::emit_whole_packet(State &s, Datagram *d, Packet *p_in)
 {
-    ++_stat_good_assem;
-    *q_pprev = (WritablePacket *)q->next();
+    WritablePacket *q = d->q;
+    ++s.stats[s_good_assem];
+    unlink_queue(s, d);
 
     click_ip *q_iph = q->ip_header();
     q_iph->ip_len = htons(q->network_length());
@@ -206,20 +333,24 @@ IPReassembler::emit_whole_packet(WritablePacket *q, WritablePacket **q_pprev,
     q->set_next(0);
 
     p_in->kill();
-    _mem_used -= IPH_MEM_USED + q->transport_length();
+    s.mem_used -= IPH_MEM_USED + q->transport_length();
     return q;
 }
 
 void
-IPReassembler::make_queue(Packet *p, WritablePacket **q_pprev)
+IPReassembler::make_queue(State &s, Packet *p, Datagram **bucket)
 {
     int p_off = IP_BYTE_OFF(p->ip_header());
     int p_lastoff = p_off + PACKET_DLEN(p);
     WritablePacket *q;
 
+    if (!s.free)
+	reap_overfull(s, true);
+
     if (p_off == 0) {
 	q = p->uniqueify();
 	if (!q) {
+	    ++s.stats[s_nomem];
 	    click_chatter("out of memory");
 	    return;
 	}
@@ -227,6 +358,7 @@ IPReassembler::make_queue(Packet *p, WritablePacket **q_pprev)
 	q = Packet::make(p->headroom() + p->ip_header_offset(), 0, 20 + p_lastoff, 0);
 	if (!q) {
 	    p->kill();
+	    ++s.stats[s_nomem];
 	    click_chatter("out of memory");
 	    return;
 	}
@@ -234,10 +366,11 @@ IPReassembler::make_queue(Packet *p, WritablePacket **q_pprev)
 	memcpy(q->ip_header(), p->ip_header(), 20);
 	// copy data
 	memcpy(q->transport_header() + p_off, p->transport_header(), PACKET_DLEN(p));
+	q->set_timestamp_anno(p->timestamp_anno());
 	p->kill();
     }
 
-    _mem_used += IPH_MEM_USED + p_lastoff;
+    s.mem_used += IPH_MEM_USED + p_lastoff;
 
     click_ip *q_iph = q->ip_header();
     q_iph->ip_off = (q_iph->ip_off & ~htons(IP_OFFMASK)); // leave MF, DF, RF
@@ -249,10 +382,22 @@ IPReassembler::make_queue(Packet *p, WritablePacket **q_pprev)
     PACKET_CHUNK(q).lastoff = p_lastoff;
 
     // link it up
-    q->set_next(*q_pprev);
-    *q_pprev = q;
-
-    check();
+    Datagram *d = s.free;
+    s.free = d->hnext;
+    d->q = q;
+    d->src = q_iph->ip_src.s_addr;
+    d->dst = q_iph->ip_dst.s_addr;
+    d->id = q_iph->ip_id;
+    d->proto = q_iph->ip_p;
+    d->hnext = *bucket;
+    *bucket = d;
+    d->expire = s.now + REAP_TIMEOUT;
+    Datagram **slot = &s.wheel[d->expire & (WHEEL_SLOTS - 1)];
+    d->wnext = *slot;
+    if (d->wnext)
+	d->wnext->wpprev = &d->wnext;
+    d->wpprev = slot;
+    *slot = d;
 }
 
 IPReassembler::ChunkLink *
@@ -265,7 +410,7 @@ IPReassembler::next_chunk(WritablePacket *q, ChunkLink *chunk)
 }
 
 Packet *
-IPReassembler::simple_action(Packet *p)
+IPReassembler::handle(State &s, Packet *p)
 {
     // check common case: not a fragment
     assert(p->has_network_header());
@@ -273,16 +418,22 @@ IPReassembler::simple_action(Packet *p)
     if (!IP_ISFRAG(iph))
 	return p;
 
-    ++_stat_frags_seen;
+    if (unlikely(!s.pool) && init_state(s) < 0) {
+	++s.stats[s_nomem];
+	p->kill();
+	return 0;
+    }
 
-    // reap if necessary
+    ++s.stats[s_frags_seen];
+
+    // expire old datagrams
     int now = p->timestamp_anno().sec();
     if (!now) {
 	p->timestamp_anno().assign_now();
 	now = p->timestamp_anno().sec();
     }
-    if (now >= _reap_time)
-	reap(now);
+    if (now > s.now)
+	advance(s, now);
 
     // calculate packet edges
     int p_off = IP_BYTE_OFF(iph);
@@ -294,7 +445,7 @@ IPReassembler::simple_action(Packet *p)
 	|| ((p_lastoff & 7) != 0 && (iph->ip_off & htons(IP_MF)) != 0)
 	|| PACKET_DLEN(p) < p_lastoff - p_off) {
 	p->kill();
-	++_stat_bad_pkts;
+	++s.stats[s_bad_pkts];
 	return 0;
     }
     p->take(PACKET_DLEN(p) - (p_lastoff - p_off));
@@ -302,17 +453,17 @@ IPReassembler::simple_action(Packet *p)
     // otherwise, we need to keep the packet
 
     // clean up memory if necessary
-    if (_mem_used > _mem_high_thresh)
-	reap_overfull(now);
+    if (s.mem_used > _mem_high_thresh)
+	reap_overfull(s, false);
 
     // get its Packet queue
-    WritablePacket **q_pprev;
-    WritablePacket *q = find_queue(p, &q_pprev);
-    if (!q) {			// make a new queue
-	make_queue(p, q_pprev);
+    Datagram **bucket;
+    Datagram *d = find_queue(s, iph, &bucket);
+    if (!d) {			// make a new queue
+	make_queue(s, p, bucket);
 	return 0;
     }
-    WritablePacket *q_bucket_next = (WritablePacket *)(q->next());
+    WritablePacket *q = d->q;
 
     if (_mtu_anno >= 0 && q->anno_u16(_mtu_anno) < p->network_length())
 	q->set_anno_u16(_mtu_anno, p->network_length());
@@ -321,6 +472,7 @@ IPReassembler::simple_action(Packet *p)
     if (p_lastoff + 8 > q->transport_length()) {
 	// error if packet already completed
 	if (!(q->ip_header()->ip_off & htons(IP_MF))) {
+	    ++s.stats[s_late];
 	    p->kill();
 	    return 0;
 	}
@@ -336,18 +488,19 @@ IPReassembler::simple_action(Packet *p)
 	// request space
 	if (!(q = q->put(want_space))) {
 	    click_chatter("out of memory");
-	    *q_pprev = q_bucket_next;
-	    _mem_used -= IPH_MEM_USED + old_transport_length;
+	    unlink_queue(s, d);
+	    s.mem_used -= IPH_MEM_USED + old_transport_length;
+	    ++s.stats[s_nomem];
 	    p->kill();
 	    return 0;
 	}
 	// get rid of extra space
 	q->take(q->transport_length() - p_lastoff);
 	// hook up packet, and add final chunk
-	*q_pprev = q;
+	d->q = q;
 	ChunkLink *last_chunk = (ChunkLink *)(q->transport_header() + old_transport_length);
 	last_chunk->off = last_chunk->lastoff = p_lastoff;
-	_mem_used += p_lastoff - old_transport_length;
+	s.mem_used += p_lastoff - old_transport_length;
     }
 
     // find chunks before and after p
@@ -376,9 +529,18 @@ IPReassembler::simple_action(Packet *p)
     if (p_off == 0) {
 	uint16_t old_ip_off = q->ip_header()->ip_off;
 	int header_delta = p->ip_header_offset() - q->ip_header_offset() + p->ip_header_length() - q->ip_header_length();
-	if (header_delta > 0)
-	    q = q->push(header_delta);
-	else if (header_delta < 0)
+	if (header_delta > 0) {
+	    int old_transport_length = q->transport_length();
+	    if (!(q = q->push(header_delta))) {
+		click_chatter("out of memory");
+		unlink_queue(s, d);
+		s.mem_used -= IPH_MEM_USED + old_transport_length;
+		++s.stats[s_nomem];
+		p->kill();
+		return 0;
+	    }
+	    d->q = q;
+	} else if (header_delta < 0)
 	    q->pull(-header_delta);
 	q->set_ip_header((click_ip *)(q->data() + p->ip_header_offset()), p->ip_header_length());
         if (p->has_mac_header())
@@ -404,69 +566,81 @@ IPReassembler::simple_action(Packet *p)
     if ((q->ip_header()->ip_off & htons(IP_MF)) == 0
 	&& PACKET_CHUNK(q).off == 0
 	&& PACKET_CHUNK(q).lastoff == q->transport_length())
-	return emit_whole_packet(q, q_pprev, p);
+	return emit_whole_packet(s, d, p);
 
     // Otherwise, done for now
-    //check();
     p->kill();
     return 0;
 }
 
-void
-IPReassembler::reap_overfull(int now)
+Packet *
+IPReassembler::simple_action(Packet *p)
 {
-    check();
-
-    // First throw away fragments at least 10 seconds old, then at least 5
-    // seconds old, then any fragments.
-    for (int delta = 10; delta >= 0; delta -= 5)
-	for (int bucket = 0; bucket < NMAP; bucket++) {
-	    WritablePacket **pprev = &_map[bucket];
-	    for (WritablePacket *q = *pprev; q; q = *pprev)
-		if (!delta || q->timestamp_anno().sec() < now - delta) {
-		    *pprev = (WritablePacket *)q->next();
-		    _mem_used -= IPH_MEM_USED + q->transport_length();
-		    q->set_next(0);
-		    checked_output_push(1, q);
-		    ++_stat_failed_assem;
-		    if (_mem_used <= _mem_low_thresh)
-			return;
-		} else
-		    pprev = (WritablePacket **)&q->next();
-	}
+    State &s = *_state;
+    p = handle(s, p);
+    flush_failed(s);
+    return p;
+}
+
+#if HAVE_BATCH
+PacketBatch *
+IPReassembler::simple_action_batch(PacketBatch *batch)
+{
+    State &s = *_state;
+    auto fnt = [this, &s](Packet *p) { return handle(s, p); };
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE(fnt, batch, [](Packet *){});
+    flush_failed(s);
+    return batch;
+}
+#endif
 
-    click_chatter("IPReassembler: cannot free enough memory!");
+/* Sweep the wheel up to second now, timing out the datagrams whose first
+   fragment arrived REAP_TIMEOUT seconds before. */
+void
+IPReassembler::advance(State &s, int now)
+{
+    if (now - s.now > WHEEL_SLOTS)
+	s.now = now - WHEEL_SLOTS;
+    while (s.now < now) {
+	++s.now;
+	Datagram **slot = &s.wheel[s.now & (WHEEL_SLOTS - 1)];
+	while (*slot)
+	    fail_queue(s, *slot, s_timeouts);
+    }
 }
 
+/* Throw away the oldest datagrams, which sit in the wheel slots that expire
+   first, until memory use falls below the low threshold, or, for capacity,
+   until a datagram is free. */
 void
-IPReassembler::reap(int now)
+IPReassembler::reap_overfull(State &s, bool for_capacity)
 {
-    // look at all queues. If no activity for 30 seconds, kill that queue
-
-    int kill_time = now - REAP_TIMEOUT;
-
-    for (int i = 0; i < NMAP; i++) {
-	WritablePacket **q_pprev = &_map[i];
-	for (WritablePacket *q = *q_pprev; q; ) {
-	    if (q->timestamp_anno().sec() < kill_time) {
-		*q_pprev = (WritablePacket *)q->next();
-		q->set_next(0);
-		_mem_used -= IPH_MEM_USED + q->transport_length();
-		checked_output_push(1, q);
-	    } else
-		q_pprev = (WritablePacket **)&q->next();
-	    q = *q_pprev;
+    for (int t = s.now + 1; t <= s.now + WHEEL_SLOTS; t++) {
+	Datagram **slot = &s.wheel[t & (WHEEL_SLOTS - 1)];
+	while (*slot) {
+	    fail_queue(s, *slot, s_evictions);
+	    if (for_capacity ? s.free != 0 : s.mem_used <= _mem_low_thresh)
+		return;
 	}
     }
 
-    _reap_time = now + REAP_INTERVAL;
+    if (!for_capacity)
+	click_chatter("IPReassembler: cannot free enough memory!");
 }
 
 void
 IPReassembler::add_handlers()
 {
+    add_read_handler("fragments", read_stat, s_frags_seen);
+    add_read_handler("reassembled", read_stat, s_good_assem);
+    add_read_handler("timeouts", read_stat, s_timeouts);
+    add_read_handler("evictions", read_stat, s_evictions);
+    add_read_handler("bad_drops", read_stat, s_bad_pkts);
+    add_read_handler("late_drops", read_stat, s_late);
+    add_read_handler("nomem_drops", read_stat, s_nomem);
     add_read_handler("dump", debug_dump);
 }
 
 CLICK_ENDDECLS
 EXPORT_ELEMENT(IPReassembler)
+ELEMENT_MT_SAFE(IPReassembler)
@@ -1,10 +1,10 @@
 // -*- c-basic-offset: 4 -*-
 #ifndef CLICK_IPREASSEMBLER_HH
 #define CLICK_IPREASSEMBLER_HH
-#include <click/element.hh>
+#include <click/batchelement.hh>
 #include <click/glue.hh>
 #include <clicknet/ip.h>
-#include <click/timer.hh>
+#include <click/sync.hh>
 CLICK_DECLS
 
 /*
@@ -21,14 +21,24 @@ Reassembles fragmented IP packets
 Expects IP packets as input to port 0. If input packets are fragments,
 IPReassembler holds them until it has enough fragments to recreate a complete
 packet. When a complete packet is constructed, it is emitted onto output 0. If
-a set of fragments making a single packet is incomplete and dormant for 30
-seconds, the fragments are generally dropped. If IPReassembler has two
-outputs, however, a single packet containing all the received fragments at
-their proper offsets is pushed onto output 1.
-
-IPReassembler's memory usage is bounded. When memory consumption rises above
-HIMEM bytes, IPReassembler throws away old fragments until memory consumption
-drops below 3/4*HIMEM bytes. Default HIMEM is 256K.
+a set of fragments making a single packet is still incomplete 30 seconds
+after its first fragment arrived, the fragments are generally dropped. If
+IPReassembler has two outputs, however, a single packet containing all the
+received fragments at their proper offsets is pushed onto output 1.
+
+Each thread that pushes packets through IPReassembler has its own fragment
+table, keyed by source, destination, IP ID and protocol, so threads never
+contend. Fragments of one datagram must therefore arrive on the same thread,
+as they do with RSS on the IP addresses. Expiry uses a timing wheel with
+one-second slots, so its cost does not depend on the number of datagrams
+being reassembled. In batch mode, reassembled packets leave in the batch
+that completed them, and incomplete packets leave output 1 in batches too.
+
+IPReassembler's memory usage is bounded. HIMEM is shared evenly between the
+threads. When a thread's memory consumption rises above its share,
+IPReassembler throws away the oldest datagrams until consumption drops below
+3/4 of the share. Each thread also reassembles at most CAPACITY datagrams at
+once; when a new datagram arrives at a full table, the oldest is thrown away.
 
 Output packets have the same MAC header as the fragment that contains
 offset 0.  Other than that, input MAC headers are ignored.
@@ -43,7 +53,13 @@ Keyword arguments are:
 
 =item HIMEM
 
-The upper bound for memory consumption, in bytes. Default is 256K.
+The upper bound for memory consumption, in bytes, across all threads.
+Default is 256K.
+
+=item CAPACITY
+
+The maximum number of datagrams being reassembled at once by each thread.
+Default is 1024.
 
 =item MAX_MTU_ANNO
 
@@ -60,9 +76,46 @@ second output.
 
 IPReassembler destroys its input packets' "next packet" annotations.
 
+=h fragments read-only
+
+Returns the number of fragments seen.
+
+=h reassembled read-only
+
+Returns the number of packets reassembled.
+
+=h timeouts read-only
+
+Returns the number of incomplete datagrams that timed out.
+
+=h evictions read-only
+
+Returns the number of incomplete datagrams thrown away to respect HIMEM or
+CAPACITY.
+
+=h bad_drops read-only
+
+Returns the number of malformed fragments dropped: bad length or offset, or
+a middle fragment whose length is not a multiple of 8.
+
+=h late_drops read-only
+
+Returns the number of fragments dropped because they extend past the end of
+a datagram whose last fragment was already seen.
+
+=h nomem_drops read-only
+
+Returns the number of fragments dropped because a packet could not be
+allocated.
+
+=h dump read-only
+
+Returns the statistics above and the fragments held by each thread. Not
+thread safe; for debugging only.
+
 =a IPFragmenter */
 
-class IPReassembler : public Element { public:
+class IPReassembler : public BatchElement { public:
 
     IPReassembler() CLICK_COLD;
     ~IPReassembler() CLICK_COLD;
@@ -78,6 +131,9 @@ class IPReassembler : public Element { public:
     int check(ErrorHandler * = 0);
 
     Packet *simple_action(Packet *);
+#if HAVE_BATCH
+    PacketBatch *simple_action_batch(PacketBatch *);
+#endif
 
     void add_handlers() CLICK_COLD;
 
@@ -89,51 +145,85 @@ class IPReassembler : public Element { public:
   private:
 
     enum { REAP_TIMEOUT = 30, // seconds
-	   REAP_INTERVAL = 10, // seconds
+	   WHEEL_SLOTS = 64,  // one-second slots, > REAP_TIMEOUT
 	   IPH_MEM_USED = 40 };
 
-    enum { NMAP = 256 };
-    WritablePacket *_map[NMAP];
-
-    int _reap_time;
-
-    uint32_t _stat_frags_seen;
-    uint32_t _stat_good_assem;
-    uint32_t _stat_failed_assem;
-    uint32_t _stat_bad_pkts;
-
-    uint32_t _mem_used;
-    uint32_t _mem_high_thresh;	// defaults to 256K
+    enum { s_frags_seen, s_good_assem, s_timeouts, s_evictions,
+	   s_bad_pkts, s_late, s_nomem, s_nstats };
+
+    // A datagram being reassembled. Lives in a hash bucket, keyed by
+    // (src, dst, id, proto), and in the wheel slot of its expiry second.
+    struct Datagram {
+	WritablePacket *q;
+	Datagram *hnext;		// bucket chain, or free list
+	Datagram *wnext;
+	Datagram **wpprev;
+	uint32_t src;
+	uint32_t dst;
+	uint16_t id;
+	uint8_t proto;
+	int expire;
+    };
+
+    struct State {
+	Datagram *pool;
+	Datagram *free;
+	Datagram **buckets;
+	uint32_t bucket_mask;
+	Datagram *wheel[WHEEL_SLOTS];
+	int now;			// latest second seen; wheel is swept to here
+	uint32_t mem_used;
+	uint32_t stats[s_nstats];
+	Packet *failed_head;		// incomplete packets to emit on output 1
+	Packet *failed_tail;
+	unsigned nfailed;
+	State() : pool(0), buckets(0) {
+	}
+    };
+
+    per_thread<State> _state;
+
+    uint32_t _mem_high_thresh;	// per thread; defaults to 256K / #threads
     uint32_t _mem_low_thresh;	// defaults to 3/4 * _mem_high_thresh
+    uint32_t _himem;
+    uint32_t _capacity;
     int8_t _mtu_anno;
 
-    static inline int bucketno(const click_ip *);
-    static inline bool same_segment(const click_ip *, const click_ip *);
+    static inline uint32_t hashcode(uint32_t src, uint32_t dst, uint16_t id, uint8_t proto);
+    static inline bool same_segment(const Datagram *, const click_ip *);
+    static String read_stat(Element *e, void *);
     static String debug_dump(Element *e, void *);
 
-    WritablePacket *find_queue(Packet *, WritablePacket ***);
-    void make_queue(Packet *, WritablePacket **);
+    int init_state(State &);
+    Datagram *find_queue(State &, const click_ip *, Datagram ***);
+    void make_queue(State &, Packet *, Datagram **);
+    void unlink_queue(State &, Datagram *);
+    void fail_queue(State &, Datagram *, int stat);
     static ChunkLink *next_chunk(WritablePacket *, ChunkLink *);
-    Packet *emit_whole_packet(WritablePacket *, WritablePacket **, Packet *);
-    void reap_overfull(int);
-    void reap(int);
+    Packet *emit_whole_packet(State &, Datagram *, Packet *);
+    Packet *handle(State &, Packet *);
+    void advance(State &, int now);
+    void reap_overfull(State &, bool for_capacity);
+    void flush_failed(State &);
     static void check_error(ErrorHandler *, int, const Packet *, const char *, ...);
 
 };
 
 
-inline int
-IPReassembler::bucketno(const click_ip *h)
+inline uint32_t
+IPReassembler::hashcode(uint32_t src, uint32_t dst, uint16_t id, uint8_t proto)
 {
-    return (h->ip_id % NMAP);
+    uint32_t h = (src * 0x9E3779B1U) ^ dst ^ (id | (proto << 16));
+    h *= 0x85EBCA6BU;
+    return h ^ (h >> 16);
 }
 
 inline bool
-IPReassembler::same_segment(const click_ip *h, const click_ip *h2)
+IPReassembler::same_segment(const Datagram *d, const click_ip *h)
 {
-    return h->ip_id == h2->ip_id && h->ip_p == h2->ip_p
-	&& h->ip_src.s_addr == h2->ip_src.s_addr
-	&& h->ip_dst.s_addr == h2->ip_dst.s_addr;
+    return d->id == h->ip_id && d->proto == h->ip_p
+	&& d->src == h->ip_src.s_addr
+	&& d->dst == h->ip_dst.s_addr;
 }
 
 CLICK_ENDDECLS
@@ -71,7 +71,7 @@ IPMapper::rewrite_flowid(IPRewriterInput *, const IPFlowID &, IPFlowID &,
 //
 
 IPRewriterBase::IPRewriterBase()
-    : _gc_timer(), _set_aggregate(false)
+    : _gc_timer(), _set_aggregate(false), _sharded(false), _nshards(1)
 {
     _gc_interval_sec = default_gc_interval;
 
@@ -79,6 +79,7 @@ IPRewriterBase::IPRewriterBase()
 
     // One heap and map per core
     _map  = new Map[_mem_units_no];
+    _shards = new Shard[_mem_units_no];
     _heap = new IPRewriterHeap*[_mem_units_no];
     _timeouts  = new uint32_t*[_mem_units_no];
     for (unsigned i=0; i<_mem_units_no; i++) {
@@ -102,6 +103,8 @@ IPRewriterBase::~IPRewriterBase()
         delete [] _map;
     }
 
+    delete [] _shards;
+
     if (_timeouts) {
         for (unsigned i=0; i<_mem_units_no; i++) {
             delete _timeouts[i];
@@ -191,6 +194,7 @@ IPRewriterBase::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("REAP_INTERVAL", SecondsArg(), _gc_interval_sec)
 	.read("REAP_TIME", Args::deprecated, SecondsArg(), _gc_interval_sec)
 	.read("SET_AGGREGATE", _set_aggregate)
+	.read("SHARDED", _sharded)
 	.consume() < 0)
 	return -1;
 
@@ -246,9 +250,22 @@ IPRewriterBase::initialize(ErrorHandler *errh)
 	PrefixErrorHandler cerrh(errh, "input spec " + String(i) + ": ");
 	if (_input_specs[i].reply_element->_heap != _heap)
 	    cerrh.error("reply element %<%s%> must share this MAPPING_CAPACITY", i, _input_specs[i].reply_element->name().c_str());
+	if (_sharded && _input_specs[i].reply_element != this
+	    && _input_specs[i].kind != IPRewriterInput::i_drop
+	    && _input_specs[i].kind != IPRewriterInput::i_nochange)
+	    cerrh.error("SHARDED requires replies to be handled by this element");
 	if (_input_specs[i].kind == IPRewriterInput::i_mapper)
 	    _input_specs[i].u.mapper->notify_rewriter(this, &_input_specs[i], &cerrh);
     }
+    if (_sharded) {
+	Bitvector passing = get_passing_threads();
+	if (passing.weight() == 0)
+	    passing = Bitvector(_mem_units_no, true);
+	_nshards = 0;
+	for (unsigned i = 0; i < _mem_units_no; i++)
+	    if (i < (unsigned) passing.size() && passing[i])
+		_shards[i].rank = _nshards++;
+    }
     for (int i = 0; i < _gc_timer.weight(); i ++) {
         Timer& gc_timer = _gc_timer.get_value(i);
         new(&gc_timer) Timer(gc_timer_hook, this); //Reconstruct as Timer does not allow assignment
@@ -297,6 +314,12 @@ IPRewriterBase::store_flow(IPRewriterFlow *flow, int input,
 	return 0;
     }
 
+    Spinlock *lock = 0;
+    if (unlikely(_sharded)) {
+	lock = &_shards[click_current_cpu_id()].lock;
+	lock->acquire();
+    }
+
     IPRewriterEntry *old = map.set(&flow->entry(false));
     assert(!old);
 
@@ -327,6 +350,8 @@ IPRewriterBase::store_flow(IPRewriterFlow *flow, int input,
 	       && heap->size() == heap->capacity() + 1);
 	if (shrink_heap_for_new_flow(flow, now_j)) {
 	    ++_input_specs[input].failures;
+	    if (lock)
+		lock->release();
 	    return 0;
 	}
     }
@@ -335,9 +360,69 @@ IPRewriterBase::store_flow(IPRewriterFlow *flow, int input,
 	map.rehash(map.bucket_count() + 1);
     if (reply_map_ptr != &map && reply_map_ptr->unbalanced())
 	reply_map_ptr->rehash(reply_map_ptr->bucket_count() + 1);
+    if (lock) {
+	shard_register(flow);
+	lock->release();
+    }
     return &flow->entry(false);
 }
 
+void
+IPRewriterBase::shard_register(IPRewriterFlow *flow)
+{
+    ShardOwner owner = { flow, (int) click_current_cpu_id() };
+    for (int d = 0; d < 2; d++) {
+	ShardKey key(flow->entry(d).flowid(), flow->ip_p());
+	Shard &part = _shards[key.hashcode() % _mem_units_no];
+	part.dir_lock.acquire();
+	part.dir.set(key, owner);
+	part.dir_lock.release();
+    }
+}
+
+void
+IPRewriterBase::shard_unregister(IPRewriterFlow *flow)
+{
+    for (int d = 0; d < 2; d++) {
+	ShardKey key(flow->entry(d).flowid(), flow->ip_p());
+	Shard &part = _shards[key.hashcode() % _mem_units_no];
+	part.dir_lock.acquire();
+	HashTable<ShardKey, ShardOwner>::iterator it = part.dir.find(key);
+	// A newer flow may have taken over the key
+	if (it.live() && it.value().flow == flow)
+	    part.dir.erase(it);
+	part.dir_lock.release();
+    }
+}
+
+IPRewriterEntry *
+IPRewriterBase::lookup_flow_remote(const IPFlowID &flowid, int ip_p,
+				   int mapid, int &shard)
+{
+    ShardKey key(flowid, ip_p);
+    Shard &part = _shards[key.hashcode() % _mem_units_no];
+    part.dir_lock.acquire();
+    HashTable<ShardKey, ShardOwner>::iterator it = part.dir.find(key);
+    int owner = it.live() ? it.value().shard : -1;
+    part.dir_lock.release();
+
+    int me = click_current_cpu_id();
+    if (owner < 0 || owner == me)
+	return 0;
+    Map *map = get_shard_map(mapid, owner);
+    if (!map)
+	return 0;
+    // The owner may have destroyed the flow since, so look it up again
+    _shards[owner].lock.acquire();
+    if (IPRewriterEntry *m = map->get(flowid)) {
+	shard = owner;
+	++_shards[me].remote_hits;
+	return m;
+    }
+    _shards[owner].lock.release();
+    return 0;
+}
+
 void
 IPRewriterBase::shift_heap_best_effort(click_jiffies_t now_j)
 {
@@ -374,15 +459,27 @@ IPRewriterBase::shrink_heap(bool clear_all, int thid)
 {
     click_jiffies_t now_j = click_jiffies();
     shift_heap_best_effort(now_j);
+    if (unlikely(_sharded))
+	_shards[thid].lock.acquire();
     Vector<IPRewriterFlow *> &best_effort_heap = _heap[thid]->_heaps[0];
-    while (best_effort_heap.size() && best_effort_heap[0]->expired(now_j))
-	best_effort_heap[0]->destroy(_heap[thid]);
+    while (best_effort_heap.size() && best_effort_heap[0]->expired(now_j)) {
+	IPRewriterFlow *f = best_effort_heap[0];
+	// Keep flows that other threads still use
+	click_jiffies_t remote_expiry = f->_remote_j + _timeouts[thid][0];
+	if (unlikely(_sharded && f->_remote_j
+		     && click_jiffies_less(now_j, remote_expiry)))
+	    f->change_expiry(_heap[thid], false, remote_expiry);
+	else
+	    f->destroy(_heap[thid]);
+    }
 
     int32_t capacity = clear_all ? 0 : _heap[thid]->_capacity;
     while (_heap[thid]->size() > capacity) {
 	IPRewriterFlow *deadf = _heap[thid]->_heaps[_heap[thid]->_heaps[0].empty()][0];
 	deadf->destroy(_heap[thid]);
     }
+    if (unlikely(_sharded))
+	_shards[thid].lock.release();
 }
 
 void
@@ -416,9 +513,20 @@ IPRewriterBase::read_handler(Element *e, void *user_data)
 	sa << count;
 	break;
     }
-    case h_size:
-	sa << rw->_heap[click_current_cpu_id()]->size(); //TODO : In mt context, we must pass the sum as the handler is called by one "random" thread
+    case h_size: {
+	uint32_t size = 0;
+	for (unsigned i = 0; i < rw->_mem_units_no; i++)
+	    size += rw->_heap[i]->size();
+	sa << size;
 	break;
+    }
+    case h_remote_hits: {
+	uint32_t hits = 0;
+	for (unsigned i = 0; i < rw->_mem_units_no; i++)
+	    hits += rw->_shards[i].remote_hits;
+	sa << hits;
+	break;
+    }
     case h_capacity:
 	sa << rw->_heap[click_current_cpu_id()]->_capacity;
 	break;
@@ -512,6 +620,8 @@ IPRewriterBase::add_rewriter_handlers(bool writable_patterns)
     add_read_handler("mapping_failures", read_handler, h_mapping_failures);
     add_read_handler("patterns", read_handler, h_patterns);
     add_read_handler("size", read_handler, h_size);
+    if (_sharded)
+	add_read_handler("remote_hits", read_handler, h_remote_hits);
     add_read_handler("capacity", read_handler, h_capacity);
     add_write_handler("capacity", write_handler, h_capacity);
     add_write_handler("clear", write_handler, h_clear);
@@ -5,6 +5,8 @@
 #include "elements/ip/iprwmapping.hh"
 #include <click/batchelement.hh>
 #include <click/bitvector.hh>
+#include <click/sync.hh>
+#include <click/hashtable.hh>
 
 CLICK_DECLS
 class IPMapper;
@@ -122,6 +124,22 @@ class IPRewriterBase : public BatchElement { public:
 	return likely(mapid == IPRewriterInput::mapid_default) ?
                &_map[click_current_cpu_id()] : 0;
     }
+    /** @brief Return map @a mapid of the thread @a shard. */
+    virtual HashContainer<IPRewriterEntry> *get_shard_map(int mapid, unsigned shard) {
+	return likely(mapid == IPRewriterInput::mapid_default) ?
+               &_map[shard] : 0;
+    }
+
+    /** @brief Return the slice of the pattern variations the current thread
+     * allocates from, and the number of slices. */
+    void shard_part(int &part, int &nparts) const {
+	part = _sharded ? _shards[click_current_cpu_id()].rank : -1;
+	if (likely(part < 0)) {
+	    part = 0;
+	    nparts = 1;
+	} else
+	    nparts = _nshards;
+    }
 
     enum {
 	get_entry_check = -1, get_entry_reply = -2
@@ -154,6 +172,43 @@ class IPRewriterBase : public BatchElement { public:
 
     bool _set_aggregate;
 
+    // In SHARDED mode, a thread holds the lock of its shard while it adds,
+    // removes or updates its flows; other threads hold it while they update
+    // flows they do not own. The directory tells which shard owns a flow. It
+    // is partitioned by hash over the shards, each part under its own lock.
+    struct ShardKey {
+	IPFlowID flowid;
+	int ip_p;
+	ShardKey()
+	    : ip_p(0) {
+	}
+	ShardKey(const IPFlowID &f, int p)
+	    : flowid(f), ip_p(p) {
+	}
+	hashcode_t hashcode() const {
+	    return flowid.hashcode() ^ ip_p;
+	}
+	bool operator==(const ShardKey &x) const {
+	    return flowid == x.flowid && ip_p == x.ip_p;
+	}
+    };
+    struct ShardOwner {
+	IPRewriterFlow *flow;
+	int shard;
+    };
+    struct Shard {
+	Spinlock lock;
+	int rank;		// among the threads using the element, or -1
+	uint32_t remote_hits;	// flows of other shards found by this thread
+	Spinlock dir_lock;
+	HashTable<ShardKey, ShardOwner> dir;
+	Shard() : rank(-1), remote_hits(0) {
+	}
+    };
+    bool _sharded;
+    int _nshards;
+    Shard *_shards;
+
     enum {
 	default_timeout = 300,	   // 5 minutes
 	default_guarantee = 5,	   // 5 seconds
@@ -166,6 +221,17 @@ class IPRewriterBase : public BatchElement { public:
 
     IPRewriterEntry *store_flow(IPRewriterFlow *flow, int input,
 				Map &map, Map *reply_map_ptr = 0);
+    inline IPRewriterEntry *lookup_flow(const IPFlowID &flowid, int ip_p,
+					Map &map, int mapid, int &shard);
+    IPRewriterEntry *lookup_flow_remote(const IPFlowID &flowid, int ip_p,
+					int mapid, int &shard);
+    inline int lock_new_flow();
+    inline bool remote_shard(int shard) const {
+	return shard >= 0 && shard != (int) click_current_cpu_id();
+    }
+    inline void release_flow(IPRewriterEntry *m, int shard);
+    void shard_register(IPRewriterFlow *flow);
+    void shard_unregister(IPRewriterFlow *flow);
     inline void unmap_flow(IPRewriterFlow *flow,
 			   Map &map, Map *reply_map_ptr = 0);
 
@@ -176,7 +242,7 @@ class IPRewriterBase : public BatchElement { public:
 
     enum {			// < 0 because individual patterns are >= 0
 	h_nmappings = -1, h_mapping_failures = -2, h_patterns = -3,
-	h_size = -4, h_capacity = -5, h_clear = -6
+	h_size = -4, h_capacity = -5, h_clear = -6, h_remote_hits = -7
     };
     static String read_handler(Element *e, void *user_data) CLICK_COLD;
     static int write_handler(const String &str, Element *e, void *user_data, ErrorHandler *errh) CLICK_COLD;
@@ -229,7 +295,10 @@ IPRewriterInput::rewrite_flowid(const IPFlowID &flowid,
 	    reply_map = &reply_element->_map[click_current_cpu_id()];
 	else
 	    reply_map = reply_element->get_map(mapid);
-	i = u.pattern->rewrite_flowid(flowid, rewritten_flowid, *reply_map);
+	int part, nparts;
+	reply_element->shard_part(part, nparts);
+	i = u.pattern->rewrite_flowid(flowid, rewritten_flowid, *reply_map,
+				      part, nparts);
 	goto check_for_failure;
     }
     case i_mapper:
@@ -261,5 +330,56 @@ IPRewriterBase::unmap_flow(IPRewriterFlow *flow, Map &map,
 	reply_map_ptr->erase(it);
 }
 
+/** @brief Look up a flow in the current thread's @a map, then in SHARDED
+ * mode in map @a mapid of the thread owning it.
+ *
+ * In SHARDED mode, the lock of the owning shard is held on return if the flow
+ * was found, and the shard's index is stored in @a shard; otherwise @a shard
+ * is -1. The caller must apply the flow, then call release_flow(). */
+inline IPRewriterEntry *
+IPRewriterBase::lookup_flow(const IPFlowID &flowid, int ip_p, Map &map,
+			    int mapid, int &shard)
+{
+    shard = -1;
+    IPRewriterEntry *m = map.get(flowid);
+    if (likely(!_sharded))
+	return m;
+    if (m) {
+	// Only this thread adds or removes flows of its map, so the lookup
+	// needs no lock, but the update does
+	shard = click_current_cpu_id();
+	_shards[shard].lock.acquire();
+	return m;
+    }
+    return lookup_flow_remote(flowid, ip_p, mapid, shard);
+}
+
+/** @brief Lock a flow the current thread just added, as lookup_flow() would
+ * have. Returns the shard to pass to release_flow(). */
+inline int
+IPRewriterBase::lock_new_flow()
+{
+    if (likely(!_sharded))
+	return -1;
+    int shard = click_current_cpu_id();
+    _shards[shard].lock.acquire();
+    return shard;
+}
+
+/** @brief Release the shard of a flow found by lookup_flow().
+ *
+ * Only the owning thread updates the expiry heaps, so a flow used by another
+ * thread is marked as recently used instead; the owner postpones its expiry
+ * accordingly. */
+inline void
+IPRewriterBase::release_flow(IPRewriterEntry *m, int shard)
+{
+    if (likely(shard < 0))
+	return;
+    if (shard != (int) click_current_cpu_id())
+	m->flow()->_remote_j = click_jiffies();
+    _shards[shard].lock.release();
+}
+
 CLICK_ENDDECLS
 #endif
@@ -143,29 +143,41 @@ IPRouteTable::lookup_route(IPAddress, IPAddress&) const
     return -1;			// by default, route lookups fail
 }
 
+void
+IPRouteTable::lookup_route_batch(const IPAddress* addrs, int n, int* ports, IPAddress* gws) const
+{
+    for (int i = 0; i < n; i++)
+	ports[i] = lookup_route(addrs[i], gws[i]);
+}
+
 String
 IPRouteTable::dump_routes()
 {
     return String();
 }
 
+inline int
+IPRouteTable::process_result(Packet *p, int port, IPAddress gw)
+{
+    if (port >= 0) {
+	assert(port < noutputs());
+	if (gw)
+	    p->set_dst_ip_anno(gw);
+	return port;
+    } else {
+	static int complained = 0;
+	if (++complained <= 5)
+	    click_chatter("IPRouteTable: no route for %s", p->dst_ip_anno().unparse().c_str());
+	return -1;
+    }
+}
+
 int
 IPRouteTable::process(int, Packet *p)
 {
-	IPAddress gw;
+    IPAddress gw;
     int port = lookup_route(p->dst_ip_anno(), gw);
-    if (port >= 0) {
-		assert(port < noutputs());
-		if (gw)
-		    p->set_dst_ip_anno(gw);
-		return port;
-    }
-    else {
-		static int complained = 0;
-		if (++complained <= 5)
-		    click_chatter("IPRouteTable: no route for %s", p->dst_ip_anno().unparse().c_str());
-		return -1;
-    }
+    return process_result(p, port, gw);
 }
 
 void
@@ -182,64 +194,31 @@ IPRouteTable::push(int port, Packet *p)
 
 #if HAVE_BATCH
 void
-IPRouteTable::push_batch(int port, PacketBatch *batch)
+IPRouteTable::push_batch(int, PacketBatch *batch)
 {
-	unsigned short outports = noutputs();
-	PacketBatch* out[outports];
-	bzero(out,sizeof(PacketBatch*)*outports);
-	PacketBatch* next = ((batch != NULL)? static_cast<PacketBatch*>(batch->next()) : NULL );
-	PacketBatch* p = batch;
-	PacketBatch* last = NULL;
-	int last_o = -1;
-	int passed = 0;
-	int count  = 0;
-
-	for ( ;p != NULL; p=next,next=(p==0?0:static_cast<PacketBatch*>(p->next())) ) {
-		// The actual job of this element
-		int o = process(port, p);
-
-		if (o < 0 || o>=(outports)) o = (outports - 1);
-
-		if (o == last_o) {
-			passed ++;
-		}
-		else {
-			if ( !last ) {
-				out[o] = p;
-				p->set_count(1);
-				p->set_tail(p);
-			}
-			else {
-				out[last_o]->set_tail(last);
-				out[last_o]->set_count(out[last_o]->count() + passed);
-				if (!out[o]) {
-					out[o] = p;
-					out[o]->set_count(1);
-					out[o]->set_tail(p);
-				}
-				else {
-					out[o]->append_packet(p);
-				}
-				passed = 0;
-			}
-		}
-		last = p;
-		last_o = o;
-		count++;
-	}
-
-	if (passed) {
-		out[last_o]->set_tail(last);
-		out[last_o]->set_count(out[last_o]->count() + passed);
-	}
-
-	int i = 0;
-	for (; i < outports; i++) {
-		if (out[i]) {
-			out[i]->tail()->set_next(NULL);
-			checked_output_push_batch(i, out[i]);
-		}
+    IPAddress dsts[LOOKUP_BATCH_MAX];
+    IPAddress gws[LOOKUP_BATCH_MAX];
+    int ports[LOOKUP_BATCH_MAX];
+    int i = 0, n = 0;
+
+    // Look up a whole chunk of the packets starting at p whenever the
+    // previous chunk is consumed. Packets after p are not relinked yet.
+    auto fnt = [this, &dsts, &gws, &ports, &i, &n](Packet *p) -> int {
+	if (i == n) {
+	    i = 0;
+	    n = 0;
+	    for (Packet *q = p; q && n < LOOKUP_BATCH_MAX; q = q->next())
+		dsts[n++] = q->dst_ip_anno();
+	    lookup_route_batch(dsts, n, ports, gws);
 	}
+	int o = process_result(p, ports[i], gws[i]);
+	i++;
+	if (o < 0)
+	    p->kill();
+	return o;
+    };
+
+    CLASSIFY_EACH_PACKET_IGNORE(noutputs(), fnt, batch, checked_output_push_batch);
 }
 #endif
 
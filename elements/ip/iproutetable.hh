@@ -108,6 +108,15 @@ Looks up the route associated with address C<dst>. Should set C<gw_return> to
 the resulting gateway and return the relevant output port (or negative if
 there is no route). The default implementation returns -1.
 
+=item C<void B<lookup_route_batch>(const IPAddress* dst, int n, int* ports, IPAddress* gws) const>
+
+Looks up the routes of the C<n> addresses in C<dst> at once, storing each
+output port (or negative if there is no route) in C<ports> and each gateway
+in C<gws>. C<n> is at most C<LOOKUP_BATCH_MAX>. Tables should override it to
+interleave the lookups, so that the memory accesses of the different
+addresses overlap. The default implementation calls B<lookup_route> for
+each address.
+
 =item C<String B<dump_routes>()>
 
 Returns a textual description of the current routing table. The default
@@ -132,6 +141,12 @@ The default implementation of B<push> uses B<lookup_route> to perform IP
 routing lookup. Normally, subclasses implement their own B<push> methods,
 avoiding virtual function call overhead.
 
+=item C<void B<push_batch>(int port, PacketBatch *batch)>
+
+The default implementation of B<push_batch> uses B<lookup_route_batch> on
+chunks of C<LOOKUP_BATCH_MAX> packets, and splits the batch per output port
+in a single pass. Packets without a route are dropped, as by B<push>.
+
 =item C<static int B<add_route_handler>(const String &, Element *, void *, ErrorHandler *)>
 
 This write handler callback parses its input as an add-route request
@@ -194,6 +209,8 @@ class IPRouteTable : public BatchElement { public:
     virtual int add_route(const IPRoute& route, bool allow_replace, IPRoute* replaced_route, ErrorHandler* errh);
     virtual int remove_route(const IPRoute& route, IPRoute* removed_route, ErrorHandler* errh);
     virtual int lookup_route(IPAddress addr, IPAddress& gw) const = 0;
+    enum { LOOKUP_BATCH_MAX = 32 };
+    virtual void lookup_route_batch(const IPAddress* addrs, int n, int* ports, IPAddress* gws) const;
     virtual String dump_routes();
 
     void push(int, Packet      *p);
@@ -215,6 +232,7 @@ class IPRouteTable : public BatchElement { public:
     // The actual processing of this element is abstracted from the push operation.
     // This allows both push and push_batch to exploit the same processing.
     int process(int port, Packet *p);
+    inline int process_result(Packet *p, int port, IPAddress gw);
 };
 
 inline StringAccum&
@@ -36,7 +36,7 @@ IPRewriterFlow::IPRewriterFlow(IPRewriterInput *owner, const IPFlowID &flowid,
 			       const IPFlowID &rewritten_flowid,
 			       uint8_t ip_p, bool guaranteed,
 			       click_jiffies_t expiry_j)
-    : _expiry_j(expiry_j), _ip_p(ip_p), _tflags(0),
+    : _expiry_j(expiry_j), _remote_j(0), _ip_p(ip_p), _tflags(0),
       _guaranteed(guaranteed), _reply_anno(0),
       _owner(owner)
 {
@@ -122,7 +122,15 @@ IPRewriterFlow::destroy(IPRewriterHeap *heap)
 		heap_less(), heap_place());
     myheap.pop_back();
     --_owner->count;
-    _owner->owner->destroy_flow(this);
+    IPRewriterBase *rw = _owner->owner;
+    if (unlikely(rw->_sharded)) {
+	Spinlock &lock = rw->_shards[click_current_cpu_id()].lock;
+	lock.acquire();
+	rw->shard_unregister(this);
+	rw->destroy_flow(this);
+	lock.release();
+    } else
+	rw->destroy_flow(this);
 }
 
 void
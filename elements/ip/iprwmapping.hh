@@ -161,6 +161,7 @@ class IPRewriterFlow { public:
     uint16_t _ip_csum_delta;
     uint16_t _udp_csum_delta;
     click_jiffies_t _expiry_j;
+    click_jiffies_t _remote_j;	// last use by a thread not owning the flow
     size_t _place : 32;
     uint8_t _ip_p;
     uint8_t _tflags;
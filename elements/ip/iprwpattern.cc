@@ -219,7 +219,8 @@ IPRewriterPattern::parse_with_ports(const String &conf, IPRewriterInput *input,
 int
 IPRewriterPattern::rewrite_flowid(const IPFlowID &flowid,
 				  IPFlowID &rewritten_flowid,
-				  const HashContainer<IPRewriterEntry> &reply_map)
+				  const HashContainer<IPRewriterEntry> &reply_map,
+				  int part, int nparts)
 {
     rewritten_flowid = flowid;
     if (_saddr)
@@ -235,21 +236,33 @@ IPRewriterPattern::rewrite_flowid(const IPFlowID &flowid,
 	IPFlowID lookup = rewritten_flowid.reverse();
 	uint32_t base = (_is_napt ? ntohs(_sport) : ntohl(_saddr.addr()));
 
+	// Each of the nparts threads of a sharded rewriter only allocates
+	// from its own slice, so their flows never collide
+	uint32_t lo = 0, top = _variation_top;
+	if (nparts > 1) {
+	    uint64_t n = (uint64_t) _variation_top + 1;
+	    lo = n * part / nparts;
+	    uint32_t hi = n * (part + 1) / nparts;
+	    if (hi == lo)
+		return IPRewriterBase::rw_drop;
+	    top = hi - 1;
+	}
+
 	uint32_t val;
 	if (_same_first
-	    && (val = ntohs(flowid.sport()) - base) <= _variation_top) {
+	    && (val = ntohs(flowid.sport()) - base) <= top && val >= lo) {
 	    lookup.set_dport(flowid.sport());
 	    if (!reply_map.find(lookup))
 		goto found_variation;
 	}
 
 	if (_sequential)
-	    val = (_next_variation > _variation_top ? 0 : _next_variation);
+	    val = (_next_variation > top || _next_variation < lo ? lo : _next_variation);
 	else
-	    val = click_random(0, _variation_top);
+	    val = click_random(lo, top);
 
-	for (uint32_t count = 0; count <= _variation_top;
-	     ++count, val = (val == _variation_top ? 0 : val + 1)) {
+	for (uint32_t count = lo; count <= top;
+	     ++count, val = (val == top ? lo : val + 1)) {
 	    if (_is_napt)
 		lookup.set_dport(htons(base + val));
 	    else
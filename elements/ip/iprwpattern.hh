@@ -38,7 +38,8 @@ class IPRewriterPattern { public:
     }
 
     int rewrite_flowid(const IPFlowID &flowid, IPFlowID &rewritten_flowid,
-		       const HashContainer<IPRewriterEntry> &reply_map);
+		       const HashContainer<IPRewriterEntry> &reply_map,
+		       int part = 0, int nparts = 1);
 
     String unparse() const;
 
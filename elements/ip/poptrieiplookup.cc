@@ -0,0 +1,591 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * poptrieiplookup.{cc,hh} -- longest-prefix match in a popcount-compressed
+ * multibit trie, updated through RCU
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "poptrieiplookup.hh"
+#include <click/ipaddress.hh>
+#include <click/straccum.hh>
+#include <click/error.hh>
+CLICK_DECLS
+
+namespace {
+
+/*
+ * Prefixes are sorted by address, then by length. A prefix therefore always
+ * comes before the prefixes it contains, so expanding the prefixes in order
+ * and overwriting the children they cover leaves every child with its
+ * longest match. The prefixes below one node are also contiguous.
+ */
+class PoptrieBuilder { public:
+
+    typedef PoptrieIPLookup P;
+
+    PoptrieBuilder(P::Trie *t, const Vector<P::Prefix> &prefixes)
+	: _t(t), _p(prefixes) {
+    }
+
+    static inline uint32_t slot(uint32_t addr) {
+	return addr >> (32 - P::TOP_BITS);
+    }
+    static inline int child(uint32_t addr, int shift) {
+	return (((uint64_t) addr << 32) >> shift) & 63;
+    }
+
+    void build_top();
+    void build_slot(uint32_t i, int lo, int hi, uint16_t leaf);
+    size_t subtree_size(uint32_t ni) const;
+
+  private:
+
+    P::Trie *_t;
+    const Vector<P::Prefix> &_p;
+
+    void build_node(uint32_t ni, int depth, int lo, int hi, uint16_t inherited);
+
+};
+
+void
+PoptrieBuilder::build_top()
+{
+    Vector<uint16_t> leaf(1 << P::TOP_BITS, 0);
+    for (int k = 0; k < _p.size(); k++)
+	if (_p[k].plen <= P::TOP_BITS) {
+	    uint32_t i = slot(_p[k].addr);
+	    uint32_t end = i + (1 << (P::TOP_BITS - _p[k].plen));
+	    for (; i < end; i++)
+		leaf[i] = _p[k].nexthop;
+	}
+
+    _t->top.resize(1 << P::TOP_BITS);
+    int k = 0;
+    for (uint32_t i = 0; i < (1 << P::TOP_BITS); i++) {
+	int start = k;
+	while (k < _p.size() && slot(_p[k].addr) == i)
+	    k++;
+	build_slot(i, start, k, leaf[i]);
+    }
+}
+
+void
+PoptrieBuilder::build_slot(uint32_t i, int lo, int hi, uint16_t leaf)
+{
+    int k = lo;
+    while (k < hi && _p[k].plen <= P::TOP_BITS)
+	k++;
+    if (k == hi) {
+	_t->top[i] = leaf;
+	return;
+    }
+    uint32_t ni = _t->nodes.size();
+    _t->nodes.push_back(P::Node());
+    _t->top[i] = P::NODE_FLAG | ni;
+    build_node(ni, P::TOP_BITS, lo, hi, leaf);
+}
+
+void
+PoptrieBuilder::build_node(uint32_t ni, int depth, int lo, int hi, uint16_t inherited)
+{
+    int shift = 64 - depth - P::STRIDE;
+    uint16_t leaf[64];
+    uint64_t vector = 0, leafvec = 0;
+
+    for (int c = 0; c < 64; c++)
+	leaf[c] = inherited;
+    for (int k = lo; k < hi; k++) {
+	// Shorter prefixes cover the whole node, they are in inherited
+	if (_p[k].plen <= depth)
+	    continue;
+	int c = child(_p[k].addr, shift);
+	if (_p[k].plen <= depth + P::STRIDE) {
+	    int end = c + (1 << (depth + P::STRIDE - _p[k].plen));
+	    for (; c < end; c++)
+		leaf[c] = _p[k].nexthop;
+	} else
+	    vector |= (uint64_t) 1 << c;
+    }
+
+    uint32_t base0 = _t->leaves.size();
+    int last = -1;
+    for (int c = 0; c < 64; c++)
+	if (!(vector & ((uint64_t) 1 << c)) && leaf[c] != last) {
+	    leafvec |= (uint64_t) 1 << c;
+	    _t->leaves.push_back(leaf[c]);
+	    last = leaf[c];
+	}
+
+    uint32_t base1 = _t->nodes.size();
+    _t->nodes.resize(base1 + __builtin_popcountll(vector));
+    P::Node &n = _t->nodes[ni];
+    n.vector = vector;
+    n.leafvec = leafvec;
+    n.base0 = base0;
+    n.base1 = base1;
+
+    // Children are built depth-first, each one appends its own children
+    int k = lo;
+    uint32_t child_i = base1;
+    for (int c = 0; c < 64; c++) {
+	if (!(vector & ((uint64_t) 1 << c)))
+	    continue;
+	while (k < hi && child(_p[k].addr, shift) < c)
+	    k++;
+	int start = k;
+	while (k < hi && child(_p[k].addr, shift) == c)
+	    k++;
+	build_node(child_i++, depth + P::STRIDE, start, k, leaf[c]);
+    }
+}
+
+size_t
+PoptrieBuilder::subtree_size(uint32_t ni) const
+{
+    const P::Node &n = _t->nodes[ni];
+    size_t size = sizeof(P::Node) + __builtin_popcountll(n.leafvec) * sizeof(uint16_t);
+    for (int j = 0; j < __builtin_popcountll(n.vector); j++)
+	size += subtree_size(n.base1 + j);
+    return size;
+}
+
+static int
+prefix_compar(const void *a, const void *b, void *)
+{
+    const PoptrieIPLookup::Prefix *pa = static_cast<const PoptrieIPLookup::Prefix *>(a);
+    const PoptrieIPLookup::Prefix *pb = static_cast<const PoptrieIPLookup::Prefix *>(b);
+    if (pa->addr != pb->addr)
+	return pa->addr < pb->addr ? -1 : 1;
+    return pa->plen - pb->plen;
+}
+
+}
+
+PoptrieIPLookup::PoptrieIPLookup()
+    : _dirty_lo(1), _dirty_hi(0), _trie(0), _retired(0),
+      _active(false), _defer(false)
+{
+    nexthop_reset();
+}
+
+PoptrieIPLookup::~PoptrieIPLookup()
+{
+}
+
+int
+PoptrieIPLookup::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    int r = IPRouteTable::configure(conf, errh);
+    if (r < 0)
+	return r;
+
+    // Configuration routes were only recorded, sort them once
+    for (HashTable<uint64_t, IPRoute>::const_iterator it = _routes.begin(); it; ++it) {
+	Prefix p;
+	p.addr = ntohl(it.value().addr.addr());
+	p.plen = it.value().prefix_len();
+	p.nexthop = it.value().extra;
+	_prefixes.push_back(p);
+    }
+    click_qsort(_prefixes.begin(), _prefixes.size(), sizeof(Prefix), prefix_compar);
+
+    _active = true;
+    mark_dirty(0, 0);
+    commit();
+    return 0;
+}
+
+void
+PoptrieIPLookup::cleanup(CleanupStage)
+{
+    delete _retired;
+    _retired = 0;
+    delete _trie.read();
+    _trie.initialize(0);
+}
+
+size_t
+PoptrieIPLookup::Trie::memory() const
+{
+    return top.size() * sizeof(uint32_t) + nodes.size() * sizeof(Node)
+	+ leaves.size() * sizeof(uint16_t) + nexthops.size() * sizeof(NextHop);
+}
+
+void
+PoptrieIPLookup::nexthop_reset()
+{
+    _nexthops.clear();
+    _nexthop_refs.clear();
+    _nexthop_index.clear();
+    _nexthop_free.clear();
+    // Next hop 0 discards, for addresses without a route. It is never freed.
+    NextHop discard;
+    discard.port = -1;
+    _nexthops.push_back(discard);
+    _nexthop_refs.push_back(1);
+}
+
+int
+PoptrieIPLookup::nexthop_ref(IPAddress gw, int port)
+{
+    uint64_t key = ((uint64_t) gw.addr() << 32) | (uint32_t) port;
+    HashTable<uint64_t, int>::iterator it = _nexthop_index.find(key);
+    if (it) {
+	_nexthop_refs[it.value()]++;
+	return it.value();
+    }
+
+    int nh;
+    if (_nexthop_free.size()) {
+	nh = _nexthop_free.back();
+	_nexthop_free.pop_back();
+    } else if (_nexthops.size() <= NEXTHOP_MAX) {
+	nh = _nexthops.size();
+	_nexthops.push_back(NextHop());
+	_nexthop_refs.push_back(0);
+    } else
+	return -1;
+    _nexthops[nh].gw = gw;
+    _nexthops[nh].port = port;
+    _nexthop_refs[nh] = 1;
+    _nexthop_index.set(key, nh);
+    return nh;
+}
+
+void
+PoptrieIPLookup::nexthop_unref(int nh)
+{
+    if (--_nexthop_refs[nh] == 0) {
+	_nexthop_index.erase(((uint64_t) _nexthops[nh].gw.addr() << 32) | (uint32_t) _nexthops[nh].port);
+	_nexthop_free.push_back(nh);
+    }
+}
+
+int
+PoptrieIPLookup::prefix_find(uint32_t addr, int plen) const
+{
+    int lo = 0, hi = _prefixes.size();
+    while (lo < hi) {
+	int mid = (lo + hi) >> 1;
+	if (_prefixes[mid].addr < addr
+	    || (_prefixes[mid].addr == addr && _prefixes[mid].plen < plen))
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
+}
+
+/* Vector::insert() and erase() go through Vector's packed storage for plain
+   types, so shift the sorted prefixes by hand. */
+void
+PoptrieIPLookup::prefix_insert(int k, const Prefix &p)
+{
+    _prefixes.push_back(p);
+    memmove(_prefixes.data() + k + 1, _prefixes.data() + k, (_prefixes.size() - 1 - k) * sizeof(Prefix));
+    _prefixes[k] = p;
+}
+
+void
+PoptrieIPLookup::prefix_erase(int k)
+{
+    memmove(_prefixes.data() + k, _prefixes.data() + k + 1, (_prefixes.size() - 1 - k) * sizeof(Prefix));
+    _prefixes.pop_back();
+}
+
+void
+PoptrieIPLookup::mark_dirty(uint32_t addr, int plen)
+{
+    uint32_t lo = PoptrieBuilder::slot(addr);
+    uint32_t hi = plen >= TOP_BITS ? lo : lo + (1 << (TOP_BITS - plen)) - 1;
+    if (_dirty_lo > _dirty_hi) {
+	_dirty_lo = lo;
+	_dirty_hi = hi;
+    } else {
+	_dirty_lo = lo < _dirty_lo ? lo : _dirty_lo;
+	_dirty_hi = hi > _dirty_hi ? hi : _dirty_hi;
+    }
+}
+
+/*
+ * Next hop of the longest route covering a whole top-level slot.
+ */
+uint16_t
+PoptrieIPLookup::slot_leaf(uint32_t slot) const
+{
+    for (int plen = TOP_BITS; plen >= 0; plen--) {
+	uint32_t mask = plen ? 0xFFFFFFFFU << (32 - plen) : 0;
+	HashTable<uint64_t, IPRoute>::const_iterator it =
+	    _routes.find(route_key((slot << (32 - TOP_BITS)) & mask, plen));
+	if (it)
+	    return it.value().extra;
+    }
+    return 0;
+}
+
+PoptrieIPLookup::Trie *
+PoptrieIPLookup::build_full() const
+{
+    Trie *t = new Trie;
+    t->nexthops = _nexthops;
+    PoptrieBuilder(t, _prefixes).build_top();
+    return t;
+}
+
+/*
+ * Copy the live structure and rebuild the dirty slots only. The subtrees
+ * they pointed to stay in the copy as garbage.
+ */
+PoptrieIPLookup::Trie *
+PoptrieIPLookup::build_update(const Trie *old) const
+{
+    Trie *t = new Trie(*old);
+    t->nexthops = _nexthops;
+    PoptrieBuilder b(t, _prefixes);
+    int k = prefix_find(_dirty_lo << (32 - TOP_BITS), 0);
+    for (uint32_t i = _dirty_lo; i <= _dirty_hi; i++) {
+	if (t->top[i] & NODE_FLAG)
+	    t->garbage += b.subtree_size(t->top[i] & ~NODE_FLAG);
+	int start = k;
+	while (k < _prefixes.size() && PoptrieBuilder::slot(_prefixes[k].addr) == i)
+	    k++;
+	b.build_slot(i, start, k, slot_leaf(i));
+    }
+    return t;
+}
+
+/*
+ * Publish a structure reflecting the shadow routes. Once write_begin()
+ * returns, no reader can still hold the structure that was replaced by the
+ * previous commit, so it is freed there.
+ */
+void
+PoptrieIPLookup::commit()
+{
+    if (!_active || _defer || _dirty_lo > _dirty_hi)
+	return;
+
+    Trie *old = _trie.read();
+    Trie *t;
+    if (!old || _dirty_hi - _dirty_lo >= UPDATE_SLOTS_MAX
+	|| old->garbage * 2 >= old->memory())
+	t = build_full();
+    else
+	t = build_update(old);
+    _dirty_lo = 1;
+    _dirty_hi = 0;
+
+    int rcu_current_local;
+    Trie *&slot = _trie.write_begin(rcu_current_local);
+    delete _retired;
+    _retired = slot;
+    slot = t;
+    _trie.write_commit(rcu_current_local);
+}
+
+int
+PoptrieIPLookup::add_route(const IPRoute &route, bool allow_replace, IPRoute *old_route, ErrorHandler *errh)
+{
+    int plen = route.prefix_len();
+    if (plen < 0)
+	return errh->error("%s: mask is not a CIDR prefix", route.unparse_addr().c_str());
+    uint32_t addr = ntohl(route.addr.addr());
+    uint64_t key = route_key(addr, plen);
+
+    HashTable<uint64_t, IPRoute>::iterator it = _routes.find(key);
+    bool existed = it;
+    if (existed) {
+	if (old_route)
+	    *old_route = it.value();
+	if (!allow_replace)
+	    return -EEXIST;
+    }
+
+    int nh = nexthop_ref(route.gw, route.port);
+    if (nh < 0)
+	return errh->error("more than %d next hops", (int) NEXTHOP_MAX);
+    if (existed)
+	nexthop_unref(it.value().extra);
+    IPRoute stored = route;
+    stored.extra = nh;
+    _routes.set(key, stored);
+
+    if (_active) {
+	int k = prefix_find(addr, plen);
+	if (existed)
+	    _prefixes[k].nexthop = nh;
+	else {
+	    Prefix p;
+	    p.addr = addr;
+	    p.plen = plen;
+	    p.nexthop = nh;
+	    prefix_insert(k, p);
+	}
+    }
+    mark_dirty(addr, plen);
+    commit();
+    return 0;
+}
+
+int
+PoptrieIPLookup::remove_route(const IPRoute &route, IPRoute *old_route, ErrorHandler *)
+{
+    int plen = route.prefix_len();
+    uint32_t addr = ntohl(route.addr.addr());
+    HashTable<uint64_t, IPRoute>::iterator it = _routes.find(route_key(addr, plen));
+    if (plen < 0 || !it || !route.match(it.value()))
+	return -ENOENT;
+    if (old_route)
+	*old_route = it.value();
+
+    nexthop_unref(it.value().extra);
+    _routes.erase(it);
+    if (_active)
+	prefix_erase(prefix_find(addr, plen));
+    mark_dirty(addr, plen);
+    commit();
+    return 0;
+}
+
+int
+PoptrieIPLookup::lookup_route(IPAddress addr, IPAddress &gw) const
+{
+    int rcu_current_local;
+    const Trie *t = _trie.read_begin(rcu_current_local);
+    int port = t->lookup(ntohl(addr.addr()), gw);
+    _trie.read_end(rcu_current_local);
+    return port;
+}
+
+void
+PoptrieIPLookup::lookup_route_batch(const IPAddress *addrs, int n, int *ports, IPAddress *gws) const
+{
+    uint32_t addr[LOOKUP_BATCH_MAX];
+    uint32_t cur[LOOKUP_BATCH_MAX];
+    int rcu_current_local;
+    const Trie *t = _trie.read_begin(rcu_current_local);
+    const uint32_t *top = t->top.data();
+    const Node *nodes = t->nodes.data();
+    const uint16_t *leaves = t->leaves.data();
+
+    for (int k = 0; k < n; k++) {
+	addr[k] = ntohl(addrs[k].addr());
+	__builtin_prefetch(&top[addr[k] >> (32 - TOP_BITS)]);
+    }
+    bool more = false;
+    for (int k = 0; k < n; k++) {
+	cur[k] = top[addr[k] >> (32 - TOP_BITS)];
+	if (cur[k] & NODE_FLAG) {
+	    __builtin_prefetch(&nodes[cur[k] & ~NODE_FLAG]);
+	    more = true;
+	}
+    }
+    // Walk all addresses one level at a time, prefetching the next level
+    for (int shift = 64 - TOP_BITS - STRIDE; more; shift -= STRIDE) {
+	more = false;
+	for (int k = 0; k < n; k++) {
+	    if (!(cur[k] & NODE_FLAG))
+		continue;
+	    const Node *nd = &nodes[cur[k] & ~NODE_FLAG];
+	    int c = (((uint64_t) addr[k] << 32) >> shift) & 63;
+	    uint64_t upto = ((uint64_t) 2 << c) - 1;
+	    if (nd->vector & ((uint64_t) 1 << c)) {
+		cur[k] = NODE_FLAG | (nd->base1 + __builtin_popcountll(nd->vector & upto) - 1);
+		__builtin_prefetch(&nodes[cur[k] & ~NODE_FLAG]);
+		more = true;
+	    } else
+		cur[k] = leaves[nd->base0 + __builtin_popcountll(nd->leafvec & upto) - 1];
+	}
+    }
+    for (int k = 0; k < n; k++) {
+	gws[k] = t->nexthops[cur[k]].gw;
+	ports[k] = t->nexthops[cur[k]].port;
+    }
+    _trie.read_end(rcu_current_local);
+}
+
+static int
+iproute_compar(const void *a, const void *b, void *)
+{
+    const IPRoute *ra = static_cast<const IPRoute *>(a);
+    const IPRoute *rb = static_cast<const IPRoute *>(b);
+    uint32_t aa = ntohl(ra->addr.addr()), ab = ntohl(rb->addr.addr());
+    if (aa != ab)
+	return aa < ab ? -1 : 1;
+    return ra->prefix_len() - rb->prefix_len();
+}
+
+String
+PoptrieIPLookup::dump_routes()
+{
+    Vector<IPRoute> v;
+    for (HashTable<uint64_t, IPRoute>::const_iterator it = _routes.begin(); it; ++it)
+	v.push_back(it.value());
+    click_qsort(v.begin(), v.size(), sizeof(IPRoute), iproute_compar);
+    StringAccum sa;
+    for (int i = 0; i < v.size(); i++)
+	v[i].unparse(sa, true) << '\n';
+    return sa.take_string();
+}
+
+int
+PoptrieIPLookup::flush_handler(const String &, Element *e, void *, ErrorHandler *)
+{
+    PoptrieIPLookup *t = static_cast<PoptrieIPLookup *>(e);
+    t->_routes.clear();
+    t->_prefixes.clear();
+    t->nexthop_reset();
+    t->mark_dirty(0, 0);
+    t->commit();
+    return 0;
+}
+
+int
+PoptrieIPLookup::ctrl_handler(const String &conf, Element *e, void *thunk, ErrorHandler *errh)
+{
+    PoptrieIPLookup *t = static_cast<PoptrieIPLookup *>(e);
+    // Apply the whole group to the shadow routes, then publish once
+    t->_defer = true;
+    int r = IPRouteTable::ctrl_handler(conf, e, thunk, errh);
+    t->_defer = false;
+    t->commit();
+    return r;
+}
+
+String
+PoptrieIPLookup::stats_handler(Element *e, void *)
+{
+    PoptrieIPLookup *pt = static_cast<PoptrieIPLookup *>(e);
+    const Trie *t = pt->_trie.read();
+    StringAccum sa;
+    sa << "routes " << pt->_routes.size() << '\n'
+       << "nodes " << t->nodes.size() << '\n'
+       << "leaves " << t->leaves.size() << '\n'
+       << "nexthops " << t->nexthops.size() << '\n'
+       << "bytes " << t->memory() << '\n'
+       << "garbage " << t->garbage << '\n';
+    return sa.take_string();
+}
+
+void
+PoptrieIPLookup::add_handlers()
+{
+    IPRouteTable::add_handlers();
+    add_write_handler("ctrl", ctrl_handler);
+    add_write_handler("flush", flush_handler, 0, Handler::BUTTON);
+    add_read_handler("stats", stats_handler);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(IPRouteTable)
+EXPORT_ELEMENT(PoptrieIPLookup)
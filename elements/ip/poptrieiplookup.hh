@@ -0,0 +1,214 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_POPTRIEIPLOOKUP_HH
+#define CLICK_POPTRIEIPLOOKUP_HH
+#include <click/hashtable.hh>
+#include <click/multithread.hh>
+#include "iproutetable.hh"
+CLICK_DECLS
+
+/*
+=c
+
+PoptrieIPLookup(ADDR1/MASK1 [GW1] OUT1, ADDR2/MASK2 [GW2] OUT2, ...)
+
+=s iproute
+
+IP routing lookup in a popcount-compressed multibit trie
+
+=d
+
+Expects a destination IP address annotation with each packet. Looks up that
+address in its routing table, using longest-prefix-match, sets the destination
+annotation to the corresponding GW (if specified), and emits the packet on the
+indicated OUTput port.
+
+Each argument is a route, specifying a destination and mask, an optional
+gateway IP address, and an output port.  Masks must be CIDR prefixes.
+
+PoptrieIPLookup implements the Poptrie lookup scheme by Asai and Ohara.  The
+first 16 bits of the address index a direct-pointing array, the remaining bits
+are consumed 6 at a time by trie nodes.  Each node holds two 64-bit bitmaps,
+one telling which children are nodes and one telling where a run of identical
+leaves starts, so children and leaves are stored contiguously and are found
+with a population count.  A /24 route is thus resolved in at most three
+dependent memory accesses, and a full Internet table takes a few megabytes,
+small enough to stay in the last-level cache.
+
+The lookup structure is never modified in place.  Route updates are applied to
+a shadow route set, then a copy of the structure is made in which only the
+/16 blocks touched by the updates are rebuilt, and the copy is swapped in with
+fast_rcu; lookups never wait for a writer, even during heavy route churn.
+Subtrees replaced this way are left unused in the copy, the whole structure is
+rebuilt when they take as much space as the live ones.  Use the C<ctrl>
+handler to apply a group of updates with a single copy.
+
+=h table read-only
+
+Outputs a human-readable version of the current routing table.
+
+=h lookup read-only
+
+Reports the OUTput port and GW corresponding to an address.
+
+=h add write-only
+
+Adds a route to the table. Format should be `C<ADDR/MASK [GW] OUT>'.
+Fails if a route for C<ADDR/MASK> already exists.
+
+=h set write-only
+
+Sets a route, whether or not a route for the same prefix already exists.
+
+=h remove write-only
+
+Removes a route from the table. Format should be `C<ADDR/MASK>'.
+
+=h ctrl write-only
+
+Adds or removes a group of routes. Write `C<add>/C<set ADDR/MASK [GW] OUT>' to
+add a route, and `C<remove ADDR/MASK>' to remove a route. You can supply
+multiple commands, one per line; all commands are executed as one atomic
+operation, and the lookup structure is updated once.
+
+=h flush write-only
+
+Clears the entire routing table in a single atomic operation.
+
+=h stats read-only
+
+Number of routes, trie nodes, leaves and next hops, the size in bytes of the
+lookup structure and how many of those bytes are unused.
+
+=n
+
+At most 65535 distinct (GW, OUT) pairs can be used.
+
+=a IPRouteTable, DirectIPLookup, RangeIPLookup, RadixIPLookup
+
+Hirochika Asai and Yasuhiro Ohara.  "Poptrie: A Compressed Trie with
+Population Count for Fast and Scalable Software IP Routing Table Lookup".
+In Proc. ACM SIGCOMM 2015, pp. 57-70.
+
+*/
+
+class PoptrieIPLookup : public IPRouteTable { public:
+
+    PoptrieIPLookup() CLICK_COLD;
+    ~PoptrieIPLookup() CLICK_COLD;
+
+    const char *class_name() const	{ return "PoptrieIPLookup"; }
+    const char *port_count() const	{ return "1/-"; }
+    const char *processing() const	{ return PUSH; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    void cleanup(CleanupStage stage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    int add_route(const IPRoute&, bool, IPRoute*, ErrorHandler *);
+    int remove_route(const IPRoute&, IPRoute*, ErrorHandler *);
+    int lookup_route(IPAddress, IPAddress&) const;
+    void lookup_route_batch(const IPAddress*, int, int*, IPAddress*) const;
+    String dump_routes();
+
+    static int flush_handler(const String &, Element *, void *, ErrorHandler *);
+    static int ctrl_handler(const String &, Element *, void *, ErrorHandler *);
+    static String stats_handler(Element *, void *);
+
+    enum {
+	TOP_BITS = 16,		// bits resolved by the direct-pointing array
+	STRIDE = 6,		// bits resolved by each node, 2^6 = 64 children
+	NEXTHOP_MAX = 65535,
+	UPDATE_SLOTS_MAX = 1024	// above, rebuild everything
+    };
+    static const uint32_t NODE_FLAG = 0x80000000U;
+
+    struct Node {
+	uint64_t vector;	// bit c set: child c is a node
+	uint64_t leafvec;	// bit c set: child c starts a new run of leaves
+	uint32_t base0;		// index of the first leaf
+	uint32_t base1;		// index of the first child node
+    };
+
+    struct NextHop {
+	IPAddress gw;
+	int32_t port;
+    };
+
+    struct Prefix {
+	uint32_t addr;		// host byte order
+	uint16_t nexthop;
+	uint8_t plen;
+    };
+
+    struct Trie {
+	Vector<uint32_t> top;	// leaf index, or NODE_FLAG | node index
+	Vector<Node> nodes;
+	Vector<uint16_t> leaves;
+	Vector<NextHop> nexthops;
+	size_t garbage;		// bytes of nodes and leaves no longer reachable
+
+	Trie() : garbage(0) { }
+	inline int lookup(uint32_t addr, IPAddress &gw) const;
+	size_t memory() const;
+    };
+
+  private:
+
+    // Shadow of the routing table. Routes keep their next hop in extra.
+    HashTable<uint64_t, IPRoute> _routes;
+    Vector<Prefix> _prefixes;	// sorted by address then length
+    Vector<NextHop> _nexthops;
+    Vector<int> _nexthop_refs;
+    HashTable<uint64_t, int> _nexthop_index;
+    Vector<int> _nexthop_free;
+    uint32_t _dirty_lo;		// range of top-level slots to rebuild
+    uint32_t _dirty_hi;
+
+    mutable fast_rcu<Trie *> _trie;
+    Trie *_retired;
+    bool _active;
+    bool _defer;
+
+    static inline uint64_t route_key(uint32_t addr, int plen) {
+	return ((uint64_t) addr << 6) | plen;
+    }
+    int nexthop_ref(IPAddress gw, int port);
+    void nexthop_unref(int nh);
+    void nexthop_reset();
+    int prefix_find(uint32_t addr, int plen) const;
+    void prefix_insert(int k, const Prefix &p);
+    void prefix_erase(int k);
+    void mark_dirty(uint32_t addr, int plen);
+    uint16_t slot_leaf(uint32_t slot) const;
+    Trie *build_full() const;
+    Trie *build_update(const Trie *old) const;
+    void commit();
+
+};
+
+inline int
+PoptrieIPLookup::Trie::lookup(uint32_t addr, IPAddress &gw) const
+{
+    uint32_t t = top[addr >> (32 - TOP_BITS)];
+    if (t & NODE_FLAG) {
+	uint64_t key = (uint64_t) addr << 32;
+	int shift = 64 - TOP_BITS - STRIDE;
+	const Node *n = &nodes[t & ~NODE_FLAG];
+	while (1) {
+	    int c = (key >> shift) & 63;
+	    uint64_t upto = ((uint64_t) 2 << c) - 1;
+	    if (n->vector & ((uint64_t) 1 << c)) {
+		n = &nodes[n->base1 + __builtin_popcountll(n->vector & upto) - 1];
+		shift -= STRIDE;
+	    } else {
+		t = leaves[n->base0 + __builtin_popcountll(n->leafvec & upto) - 1];
+		break;
+	    }
+	}
+    }
+    gw = nexthops[t].gw;
+    return nexthops[t].port;
+}
+
+CLICK_ENDDECLS
+#endif
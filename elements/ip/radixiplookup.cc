@@ -47,6 +47,34 @@ class RadixIPLookup::Radix { public:
 	}
 	return cur;
     }
+
+    // Walk the trie for n addresses at once, one level at a time, so the
+    // children of all the addresses are fetched in parallel.
+    static inline void lookup_batch(const Radix *root, int def, const uint32_t *addrs, int n, int *keys) {
+	const Radix *r[IPRouteTable::LOOKUP_BATCH_MAX];
+	for (int i = 0; i < n; i++) {
+	    r[i] = root;
+	    keys[i] = def;
+	}
+	for (int level = 0; ; level++) {
+	    bool active = false;
+	    for (int i = 0; i < n; i++) {
+		if (!r[i])
+		    continue;
+		int i1 = (addrs[i] >> _bitshift[level]) & (_nbuckets[level] - 1);
+		const Child &c = r[i]->_children[i1];
+		if (c.key)
+		    keys[i] = c.key;
+		r[i] = c.child;
+		if (r[i]) {
+		    __builtin_prefetch(&r[i]->_children[(addrs[i] >> _bitshift[level + 1]) & (_nbuckets[level + 1] - 1)]);
+		    active = true;
+		}
+	    }
+	    if (!active)
+		break;
+	}
+    }
     
 private:
 
@@ -291,6 +319,26 @@ RadixIPLookup::lookup_route(IPAddress addr, IPAddress &gw) const
     }
 }
 
+void
+RadixIPLookup::lookup_route_batch(const IPAddress* addrs, int n, int* ports, IPAddress* gws) const
+{
+    uint32_t a[LOOKUP_BATCH_MAX];
+    int keys[LOOKUP_BATCH_MAX];
+    for (int i = 0; i < n; i++)
+	a[i] = ntohl(addrs[i].addr());
+    Radix::lookup_batch(_radix, _default_key, a, n, keys);
+    for (int i = 0; i < n; i++) {
+	int lookup_key = get_lookup_key(keys[i]);
+	if (lookup_key) {
+	    gws[i] = _lookup[lookup_key - 1].gw;
+	    ports[i] = _lookup[lookup_key - 1].port;
+	} else {
+	    gws[i] = 0;
+	    ports[i] = -1;
+	}
+    }
+}
+
 void
 RadixIPLookup::flush_table()
 {
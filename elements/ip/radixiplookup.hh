@@ -85,6 +85,7 @@ class RadixIPLookup : public IPRouteTable { public:
     int add_route(const IPRoute&, bool, IPRoute*, ErrorHandler *);
     int remove_route(const IPRoute&, IPRoute*, ErrorHandler *);
     int lookup_route(IPAddress, IPAddress&) const;
+    void lookup_route_batch(const IPAddress*, int, int*, IPAddress*) const;
     int find_lookup_key(IPAddress gw, int port);
     String dump_routes();
 
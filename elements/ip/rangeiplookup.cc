@@ -32,10 +32,6 @@ RangeIPLookup::RangeIPLookup()
       _range_t((uint32_t *) CLICK_LALLOC(RANGES_MAX * sizeof(uint32_t))),
       _active(false)
 {
-#if HAVE_BATCH
-    // TODO: Remove this when push_batch() will actually be implemented
-    in_batch_mode = BATCH_MODE_NO;
-#endif
 }
 
 RangeIPLookup::~RangeIPLookup()
@@ -121,6 +117,43 @@ RangeIPLookup::lookup_route(IPAddress dest, IPAddress &gw) const
     return _helper._vport[vport_i].port;
 }
 
+void
+RangeIPLookup::lookup_route_batch(const IPAddress* addrs, int n, int* ports, IPAddress* gws) const
+{
+    uint32_t ip_addr[LOOKUP_BATCH_MAX];
+    uint32_t lowerbound[LOOKUP_BATCH_MAX], upperbound[LOOKUP_BATCH_MAX];
+
+    for (int k = 0; k < n; k++) {
+	ip_addr[k] = ntohl(addrs[k].addr());
+	__builtin_prefetch(&_range_base[ip_addr[k] >> RANGE_SHIFT]);
+	__builtin_prefetch(&_range_len[ip_addr[k] >> RANGE_SHIFT]);
+    }
+    // Prefetch the first probe of every binary search
+    for (int k = 0; k < n; k++) {
+	uint32_t i = ip_addr[k] >> RANGE_SHIFT;
+	lowerbound[k] = _range_base[i];
+	upperbound[k] = lowerbound[k] + _range_len[i];
+	__builtin_prefetch(&_range_t[(upperbound[k] + lowerbound[k]) >> 1]);
+    }
+    for (int k = 0; k < n; k++) {
+	uint32_t i = ip_addr[k] & RANGE_MASK;
+	uint32_t lb = lowerbound[k], ub = upperbound[k], middle;
+	while (ub > lb) {
+	    middle = (ub + lb) >> 1;
+	    if (i < (_range_t[middle] & RANGE_MASK))
+		ub = middle;
+	    else if (i < (_range_t[middle + 1] & RANGE_MASK)) {
+		lb = middle;
+		break;
+	    } else
+		lb = middle + 1;
+	}
+	uint16_t vport_i = _range_t[lb] >> RANGE_SHIFT;
+	gws[k] = _helper._vport[vport_i].gw;
+	ports[k] = _helper._vport[vport_i].port;
+    }
+}
+
 void
 RangeIPLookup::add_handlers()
 {
@@ -23,6 +23,7 @@
 #include "setipchecksum.hh"
 #include <click/glue.hh>
 #include <clicknet/ip.h>
+#include <click/ipchecksum.hh>
 CLICK_DECLS
 
 SetIPChecksum::SetIPChecksum()
@@ -46,7 +47,7 @@ SetIPChecksum::simple_action(Packet *p_in)
 	    && likely((hlen = iph->ip_hl << 2) >= sizeof(click_ip))
 	    && likely(hlen <= plen)) {
 	    iph->ip_sum = 0;
-	    iph->ip_sum = click_in_cksum((unsigned char *) iph, hlen);
+	    iph->ip_sum = IPChecksum::header_sum(iph, hlen);
 	    return p;
 	}
 
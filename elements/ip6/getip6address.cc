@@ -47,5 +47,14 @@ GetIP6Address::simple_action(Packet *p)
   return p;
 }
 
+#if HAVE_BATCH
+PacketBatch *
+GetIP6Address::simple_action_batch(PacketBatch *batch)
+{
+  EXECUTE_FOR_EACH_PACKET(GetIP6Address::simple_action, batch);
+  return batch;
+}
+#endif
+
 CLICK_ENDDECLS
 EXPORT_ELEMENT(GetIP6Address)
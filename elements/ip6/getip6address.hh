@@ -1,6 +1,6 @@
 #ifndef CLICK_GETIP6ADDRESS_HH
 #define CLICK_GETIP6ADDRESS_HH
-#include <click/element.hh>
+#include <click/batchelement.hh>
 #include <click/ip6address.hh>
 CLICK_DECLS
 
@@ -22,7 +22,7 @@ CLICK_DECLS
  */
 
 
-class GetIP6Address : public Element {
+class GetIP6Address : public BatchElement {
 
   int _offset;
 
@@ -37,6 +37,9 @@ class GetIP6Address : public Element {
   int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
 
   Packet *simple_action(Packet *);
+#if HAVE_BATCH
+  PacketBatch *simple_action_batch(PacketBatch *);
+#endif
 
 };
 
@@ -24,6 +24,7 @@
 #include <click/args.hh>
 #include <click/error.hh>
 #include <click/glue.hh>
+#include <click/packet_anno.hh>
 #include "ip6routetable.hh"
 CLICK_DECLS
 
@@ -33,7 +34,7 @@ IP6RouteTable::cast(const char *name)
     if (strcmp(name, "IPRouteTable") == 0)
 	return (void *)this;
     else
-	return Element::cast(name);
+	return BatchElement::cast(name);
 }
 
 int
@@ -44,6 +45,14 @@ IP6RouteTable::add_route(IP6Address, IP6Address, IP6Address,
     return errh->error("cannot add routes to this routing table");
 }
 
+int
+IP6RouteTable::set_route(IP6Address dst, IP6Address mask, IP6Address gw,
+			 int port, ErrorHandler *errh)
+{
+    // by default, add_route replaces existing routes
+    return add_route(dst, mask, gw, port, errh);
+}
+
 int
 IP6RouteTable::remove_route(IP6Address, IP6Address, ErrorHandler *errh)
 {
@@ -51,38 +60,120 @@ IP6RouteTable::remove_route(IP6Address, IP6Address, ErrorHandler *errh)
     return errh->error("cannot delete routes from this routing table");
 }
 
+int
+IP6RouteTable::lookup_route(IP6Address, IP6Address &) const
+{
+    return -1;			// by default, route all packets to nowhere
+}
+
+void
+IP6RouteTable::lookup_route_batch(const IP6Address *addrs, int n, int *ports, IP6Address *gws) const
+{
+    for (int i = 0; i < n; i++)
+	ports[i] = lookup_route(addrs[i], gws[i]);
+}
+
 String
 IP6RouteTable::dump_routes()
 {
     return String();
 }
 
-int
-IP6RouteTable::add_route_handler(const String &conf, Element *e, void *, ErrorHandler *errh)
+inline int
+IP6RouteTable::process_result(Packet *p, int port, const IP6Address &gw)
 {
-    IP6RouteTable *r = static_cast<IP6RouteTable *>(e);
+    if (port >= 0) {
+	assert(port < noutputs());
+	if (gw)
+	    SET_DST_IP6_ANNO(p, gw);
+	return port;
+    } else {
+	static int complained = 0;
+	if (++complained <= 5)
+	    click_chatter("IP6RouteTable: no route for %s", DST_IP6_ANNO(p).unparse().c_str());
+	return -1;
+    }
+}
+
+void
+IP6RouteTable::push(int, Packet *p)
+{
+    IP6Address gw;
+    int port = process_result(p, lookup_route(DST_IP6_ANNO(p), gw), gw);
+    if (port < 0)
+	p->kill();
+    else
+	output(port).push(p);
+}
+
+#if HAVE_BATCH
+void
+IP6RouteTable::push_batch(int, PacketBatch *batch)
+{
+    IP6Address dsts[LOOKUP_BATCH_MAX];
+    IP6Address gws[LOOKUP_BATCH_MAX];
+    int ports[LOOKUP_BATCH_MAX];
+    int i = 0, n = 0;
+
+    // Look up a whole chunk of the packets starting at p whenever the
+    // previous chunk is consumed. Packets after p are not relinked yet.
+    auto fnt = [this, &dsts, &gws, &ports, &i, &n](Packet *p) -> int {
+	if (i == n) {
+	    i = 0;
+	    n = 0;
+	    for (Packet *q = p; q && n < LOOKUP_BATCH_MAX; q = q->next())
+		dsts[n++] = DST_IP6_ANNO(q);
+	    lookup_route_batch(dsts, n, ports, gws);
+	}
+	int o = process_result(p, ports[i], gws[i]);
+	i++;
+	if (o < 0)
+	    p->kill();
+	return o;
+    };
+
+    CLASSIFY_EACH_PACKET_IGNORE(noutputs(), fnt, batch, checked_output_push_batch);
+}
+#endif
 
+int
+IP6RouteTable::parse_route(const String &conf, IP6Address &dst, IP6Address &mask,
+			   IP6Address &gw, int &port, ErrorHandler *errh)
+{
     Vector<String> words;
     cp_spacevec(conf, words);
 
-    IP6Address dst, mask, gw;
-    int port, ok;
-
+    int ok;
+    gw = IP6Address();
     if (words.size() == 2)
-        ok = Args(words, r, errh)
+        ok = Args(words, this, errh)
 	    .read_mp("PREFIX", IP6PrefixArg(true), dst, mask)
 	    .read_mp("PORT", port)
 	    .complete();
     else
-        ok = Args(words, r, errh)
+        ok = Args(words, this, errh)
 	    .read_mp("PREFIX", IP6PrefixArg(true), dst, mask)
 	    .read_mp("GATEWAY", gw)
 	    .read_mp("PORT", port)
 	    .complete();
 
-    if (ok >= 0 && (port < 0 || port >= r->noutputs()))
+    if (ok >= 0 && (port < 0 || port >= noutputs()))
         ok = errh->error("output port out of range");
-    if (ok >= 0)
+    return ok;
+}
+
+int
+IP6RouteTable::add_route_handler(const String &conf, Element *e, void *thunk, ErrorHandler *errh)
+{
+    IP6RouteTable *r = static_cast<IP6RouteTable *>(e);
+
+    IP6Address dst, mask, gw;
+    int port;
+
+    int ok = r->parse_route(conf, dst, mask, gw, port, errh);
+    if (ok >= 0 && thunk)
+        ok = r->set_route(dst, mask, gw, port, errh);
+    else if (ok >= 0)
         ok = r->add_route(dst, mask, gw, port, errh);
     return ok;
 }
@@ -108,16 +199,31 @@ IP6RouteTable::remove_route_handler(const String &conf, Element *e, void *, Erro
 }
 
 int
-IP6RouteTable::ctrl_handler(const String &conf_in, Element *e, void *thunk, ErrorHandler *errh)
-{
-    String conf = conf_in;
-    String first_word = cp_shift_spacevec(conf);
-    if (first_word == "add")
-	return add_route_handler(conf, e, thunk, errh);
-    else if (first_word == "remove")
-	return remove_route_handler(conf, e, thunk, errh);
-    else
-	return errh->error("bad command, should be `add' or `remove'");
+IP6RouteTable::ctrl_handler(const String &conf_in, Element *e, void *, ErrorHandler *errh)
+{
+    // One command per line; stops at the first failing command
+    String conf_all = cp_uncomment(conf_in);
+    const char *s = conf_all.begin(), *end = conf_all.end();
+    while (s < end) {
+	const char *nl = find(s, end, '\n');
+	String conf = conf_all.substring(s, nl);
+	s = nl + 1;
+	String first_word = cp_shift_spacevec(conf);
+	int r;
+	if (!first_word)
+	    continue;
+	else if (first_word == "add")
+	    r = add_route_handler(conf, e, (void *) 0, errh);
+	else if (first_word == "set")
+	    r = add_route_handler(conf, e, (void *) 1, errh);
+	else if (first_word == "remove")
+	    r = remove_route_handler(conf, e, 0, errh);
+	else
+	    r = errh->error("bad command, should be `add', `set' or `remove'");
+	if (r < 0)
+	    return r;
+    }
+    return 0;
 }
 
 String
@@ -127,5 +233,22 @@ IP6RouteTable::table_handler(Element *e, void *)
     return r->dump_routes();
 }
 
+int
+IP6RouteTable::lookup_handler(int, String &s, Element *e, const Handler *, ErrorHandler *errh)
+{
+    IP6RouteTable *table = static_cast<IP6RouteTable *>(e);
+    IP6Address a;
+    if (IP6AddressArg().parse(s, a, table)) {
+	IP6Address gw;
+	int port = table->lookup_route(a, gw);
+	if (gw)
+	    s = String(port) + " " + gw.unparse();
+	else
+	    s = String(port);
+	return 0;
+    } else
+	return errh->error("expected IPv6 address");
+}
+
 CLICK_ENDDECLS
 ELEMENT_PROVIDES(IP6RouteTable)
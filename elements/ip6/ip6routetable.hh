@@ -2,21 +2,45 @@
 #ifndef CLICK_IP6ROUTETABLE_HH
 #define CLICK_IP6ROUTETABLE_HH
 #include <click/glue.hh>
-#include <click/element.hh>
+#include <click/batchelement.hh>
+#include <click/ip6address.hh>
 CLICK_DECLS
 
-class IP6RouteTable : public Element { public:
+class IP6RouteTable : public BatchElement { public:
 
     void* cast(const char*);
 
     virtual int add_route(IP6Address, IP6Address, IP6Address, int, ErrorHandler *);
+    virtual int set_route(IP6Address, IP6Address, IP6Address, int, ErrorHandler *);
     virtual int remove_route(IP6Address, IP6Address, ErrorHandler *);
+    virtual int lookup_route(IP6Address, IP6Address &) const;
     virtual String dump_routes();
 
+    /** @brief Look up several addresses at once.
+     *
+     * Fills ports[i] and gws[i] for each of the n addresses, n is at most
+     * LOOKUP_BATCH_MAX. The default calls lookup_route() for each address;
+     * tables override it to overlap the memory accesses of the lookups. */
+    enum { LOOKUP_BATCH_MAX = 32 };
+    virtual void lookup_route_batch(const IP6Address *, int, int *, IP6Address *) const;
+
+    void push(int port, Packet *p);
+#if HAVE_BATCH
+    void push_batch(int port, PacketBatch *batch);
+#endif
+
+    /** @brief Parse a `ADDR/MASK [GW] OUT' route argument. */
+    int parse_route(const String &, IP6Address &, IP6Address &, IP6Address &, int &, ErrorHandler *);
+
     static int add_route_handler(const String&, Element*, void*, ErrorHandler*);
     static int remove_route_handler(const String&, Element*, void*, ErrorHandler*);
     static int ctrl_handler(const String&, Element*, void*, ErrorHandler*);
     static String table_handler(Element*, void*);
+    static int lookup_handler(int operation, String&, Element*, const Handler*, ErrorHandler*);
+
+  private:
+
+    inline int process_result(Packet *p, int port, const IP6Address &gw);
 
 };
 
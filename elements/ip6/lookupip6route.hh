@@ -37,6 +37,10 @@ CLICK_DECLS
  *   rt[2] -> ... -> ToDevice(eth1);
  *   ...
  *
+ * LookupIP6Route scans its whole table for each packet. Use PoptrieIP6Lookup
+ * for more than a few dozen routes.
+ *
+ * =a PoptrieIP6Lookup
  */
 
 class LookupIP6Route : public IP6RouteTable {
@@ -56,6 +60,7 @@ public:
 
   int add_route(IP6Address, IP6Address, IP6Address, int, ErrorHandler *);
   int remove_route(IP6Address, IP6Address, ErrorHandler *);
+  int lookup_route(IP6Address, IP6Address &) const;
   String dump_routes()				{ return _t.dump(); };
 
 private:
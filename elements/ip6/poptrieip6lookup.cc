@@ -0,0 +1,630 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * poptrieip6lookup.{cc,hh} -- IPv6 longest-prefix match in a
+ * popcount-compressed multibit trie, updated through RCU
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "poptrieip6lookup.hh"
+#include <click/ip6address.hh>
+#include <click/straccum.hh>
+#include <click/error.hh>
+CLICK_DECLS
+
+namespace {
+
+/*
+ * Same construction as PoptrieIPLookup's. Prefixes are sorted by address,
+ * then by length, so a prefix comes before the prefixes it contains and the
+ * prefixes below one node are contiguous.
+ */
+class Poptrie6Builder { public:
+
+    typedef PoptrieIP6Lookup P;
+
+    Poptrie6Builder(P::Trie *t, const Vector<P::Prefix> &prefixes)
+	: _t(t), _p(prefixes) {
+    }
+
+    static inline uint32_t slot(uint64_t hi) {
+	return hi >> (64 - P::TOP_BITS);
+    }
+
+    void build_top();
+    void build_slot(uint32_t i, int lo, int hi, uint16_t leaf);
+    size_t subtree_size(uint32_t ni) const;
+
+  private:
+
+    P::Trie *_t;
+    const Vector<P::Prefix> &_p;
+
+    inline int child(int k, int depth) const {
+	return P::chunk(_p[k].hi, _p[k].lo, depth);
+    }
+    void build_node(uint32_t ni, int depth, int lo, int hi, uint16_t inherited);
+
+};
+
+void
+Poptrie6Builder::build_top()
+{
+    Vector<uint16_t> leaf(1 << P::TOP_BITS, 0);
+    for (int k = 0; k < _p.size(); k++)
+	if (_p[k].plen <= P::TOP_BITS) {
+	    uint32_t i = slot(_p[k].hi);
+	    uint32_t end = i + (1 << (P::TOP_BITS - _p[k].plen));
+	    for (; i < end; i++)
+		leaf[i] = _p[k].nexthop;
+	}
+
+    _t->top.resize(1 << P::TOP_BITS);
+    int k = 0;
+    for (uint32_t i = 0; i < (1 << P::TOP_BITS); i++) {
+	int start = k;
+	while (k < _p.size() && slot(_p[k].hi) == i)
+	    k++;
+	build_slot(i, start, k, leaf[i]);
+    }
+}
+
+void
+Poptrie6Builder::build_slot(uint32_t i, int lo, int hi, uint16_t leaf)
+{
+    int k = lo;
+    while (k < hi && _p[k].plen <= P::TOP_BITS)
+	k++;
+    if (k == hi) {
+	_t->top[i] = leaf;
+	return;
+    }
+    uint32_t ni = _t->nodes.size();
+    _t->nodes.push_back(P::Node());
+    _t->top[i] = P::NODE_FLAG | ni;
+    build_node(ni, P::TOP_BITS, lo, hi, leaf);
+}
+
+void
+Poptrie6Builder::build_node(uint32_t ni, int depth, int lo, int hi, uint16_t inherited)
+{
+    uint16_t leaf[64];
+    uint64_t vector = 0, leafvec = 0;
+
+    for (int c = 0; c < 64; c++)
+	leaf[c] = inherited;
+    for (int k = lo; k < hi; k++) {
+	// Shorter prefixes cover the whole node, they are in inherited
+	if (_p[k].plen <= depth)
+	    continue;
+	int c = child(k, depth);
+	if (_p[k].plen <= depth + P::STRIDE) {
+	    int end = c + (1 << (depth + P::STRIDE - _p[k].plen));
+	    for (; c < end; c++)
+		leaf[c] = _p[k].nexthop;
+	} else
+	    vector |= (uint64_t) 1 << c;
+    }
+
+    uint32_t base0 = _t->leaves.size();
+    int last = -1;
+    for (int c = 0; c < 64; c++)
+	if (!(vector & ((uint64_t) 1 << c)) && leaf[c] != last) {
+	    leafvec |= (uint64_t) 1 << c;
+	    _t->leaves.push_back(leaf[c]);
+	    last = leaf[c];
+	}
+
+    uint32_t base1 = _t->nodes.size();
+    _t->nodes.resize(base1 + __builtin_popcountll(vector));
+    P::Node &n = _t->nodes[ni];
+    n.vector = vector;
+    n.leafvec = leafvec;
+    n.base0 = base0;
+    n.base1 = base1;
+
+    // Children are built depth-first, each one appends its own children
+    int k = lo;
+    uint32_t child_i = base1;
+    for (int c = 0; c < 64; c++) {
+	if (!(vector & ((uint64_t) 1 << c)))
+	    continue;
+	while (k < hi && child(k, depth) < c)
+	    k++;
+	int start = k;
+	while (k < hi && child(k, depth) == c)
+	    k++;
+	build_node(child_i++, depth + P::STRIDE, start, k, leaf[c]);
+    }
+}
+
+size_t
+Poptrie6Builder::subtree_size(uint32_t ni) const
+{
+    const P::Node &n = _t->nodes[ni];
+    size_t size = sizeof(P::Node) + __builtin_popcountll(n.leafvec) * sizeof(uint16_t);
+    for (int j = 0; j < __builtin_popcountll(n.vector); j++)
+	size += subtree_size(n.base1 + j);
+    return size;
+}
+
+static inline int
+prefix_cmp(uint64_t ahi, uint64_t alo, int aplen, const PoptrieIP6Lookup::Prefix &b)
+{
+    if (ahi != b.hi)
+	return ahi < b.hi ? -1 : 1;
+    if (alo != b.lo)
+	return alo < b.lo ? -1 : 1;
+    return aplen - b.plen;
+}
+
+static int
+prefix_compar(const void *a, const void *b, void *)
+{
+    const PoptrieIP6Lookup::Prefix *pa = static_cast<const PoptrieIP6Lookup::Prefix *>(a);
+    return prefix_cmp(pa->hi, pa->lo, pa->plen, *static_cast<const PoptrieIP6Lookup::Prefix *>(b));
+}
+
+static inline IP6Address
+join(uint64_t hi, uint64_t lo)
+{
+    IP6Address a;
+    uint32_t *d = a.data32();
+    d[0] = htonl(hi >> 32);
+    d[1] = htonl((uint32_t) hi);
+    d[2] = htonl(lo >> 32);
+    d[3] = htonl((uint32_t) lo);
+    return a;
+}
+
+}
+
+PoptrieIP6Lookup::PoptrieIP6Lookup()
+    : _dirty_lo(1), _dirty_hi(0), _trie(0), _retired(0),
+      _active(false), _defer(false)
+{
+    nexthop_reset();
+}
+
+PoptrieIP6Lookup::~PoptrieIP6Lookup()
+{
+}
+
+int
+PoptrieIP6Lookup::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    int r = 0;
+    for (int i = 0; i < conf.size(); i++) {
+	IP6Address dst, mask, gw;
+	int port;
+	if (parse_route(conf[i], dst, mask, gw, port, errh) < 0
+	    || store_route(dst, mask, gw, port, true, errh) < 0)
+	    r = -EINVAL;
+    }
+    if (r < 0)
+	return r;
+
+    // Configuration routes were only recorded, sort them once
+    for (HashTable<Key, Route>::const_iterator it = _routes.begin(); it; ++it) {
+	Prefix p;
+	p.hi = it.key().hi;
+	p.lo = it.key().lo;
+	p.plen = it.key().extra;
+	p.nexthop = it.value().nexthop;
+	_prefixes.push_back(p);
+    }
+    click_qsort(_prefixes.begin(), _prefixes.size(), sizeof(Prefix), prefix_compar);
+
+    _active = true;
+    mark_dirty(0, 0);
+    commit();
+    return 0;
+}
+
+void
+PoptrieIP6Lookup::cleanup(CleanupStage)
+{
+    delete _retired;
+    _retired = 0;
+    delete _trie.read();
+    _trie.initialize(0);
+}
+
+size_t
+PoptrieIP6Lookup::Trie::memory() const
+{
+    return top.size() * sizeof(uint32_t) + nodes.size() * sizeof(Node)
+	+ leaves.size() * sizeof(uint16_t) + nexthops.size() * sizeof(NextHop);
+}
+
+void
+PoptrieIP6Lookup::nexthop_reset()
+{
+    _nexthops.clear();
+    _nexthop_refs.clear();
+    _nexthop_index.clear();
+    _nexthop_free.clear();
+    // Next hop 0 discards, for addresses without a route. It is never freed.
+    NextHop discard;
+    discard.port = -1;
+    _nexthops.push_back(discard);
+    _nexthop_refs.push_back(1);
+}
+
+int
+PoptrieIP6Lookup::nexthop_ref(const IP6Address &gw, int port)
+{
+    uint64_t hi, lo;
+    split(gw, hi, lo);
+    Key key(hi, lo, port);
+    HashTable<Key, int>::iterator it = _nexthop_index.find(key);
+    if (it) {
+	_nexthop_refs[it.value()]++;
+	return it.value();
+    }
+
+    int nh;
+    if (_nexthop_free.size()) {
+	nh = _nexthop_free.back();
+	_nexthop_free.pop_back();
+    } else if (_nexthops.size() <= NEXTHOP_MAX) {
+	nh = _nexthops.size();
+	_nexthops.push_back(NextHop());
+	_nexthop_refs.push_back(0);
+    } else
+	return -1;
+    _nexthops[nh].gw = gw;
+    _nexthops[nh].port = port;
+    _nexthop_refs[nh] = 1;
+    _nexthop_index.set(key, nh);
+    return nh;
+}
+
+void
+PoptrieIP6Lookup::nexthop_unref(int nh)
+{
+    if (--_nexthop_refs[nh] == 0) {
+	uint64_t hi, lo;
+	split(_nexthops[nh].gw, hi, lo);
+	_nexthop_index.erase(Key(hi, lo, _nexthops[nh].port));
+	_nexthop_free.push_back(nh);
+    }
+}
+
+int
+PoptrieIP6Lookup::prefix_find(uint64_t hi, uint64_t lo, int plen) const
+{
+    int l = 0, h = _prefixes.size();
+    while (l < h) {
+	int mid = (l + h) >> 1;
+	if (prefix_cmp(hi, lo, plen, _prefixes[mid]) > 0)
+	    l = mid + 1;
+	else
+	    h = mid;
+    }
+    return l;
+}
+
+/* Vector::insert() and erase() go through Vector's packed storage for plain
+   types, so shift the sorted prefixes by hand. */
+void
+PoptrieIP6Lookup::prefix_insert(int k, const Prefix &p)
+{
+    _prefixes.push_back(p);
+    memmove(_prefixes.data() + k + 1, _prefixes.data() + k, (_prefixes.size() - 1 - k) * sizeof(Prefix));
+    _prefixes[k] = p;
+}
+
+void
+PoptrieIP6Lookup::prefix_erase(int k)
+{
+    memmove(_prefixes.data() + k, _prefixes.data() + k + 1, (_prefixes.size() - 1 - k) * sizeof(Prefix));
+    _prefixes.pop_back();
+}
+
+void
+PoptrieIP6Lookup::mark_dirty(uint64_t hi, int plen)
+{
+    uint32_t lo = Poptrie6Builder::slot(hi);
+    uint32_t h = plen >= TOP_BITS ? lo : lo + (1 << (TOP_BITS - plen)) - 1;
+    if (_dirty_lo > _dirty_hi) {
+	_dirty_lo = lo;
+	_dirty_hi = h;
+    } else {
+	_dirty_lo = lo < _dirty_lo ? lo : _dirty_lo;
+	_dirty_hi = h > _dirty_hi ? h : _dirty_hi;
+    }
+}
+
+/*
+ * Next hop of the longest route covering a whole top-level slot.
+ */
+uint16_t
+PoptrieIP6Lookup::slot_leaf(uint32_t slot) const
+{
+    for (int plen = TOP_BITS; plen >= 0; plen--) {
+	uint64_t mask = plen ? ~(uint64_t) 0 << (64 - plen) : 0;
+	HashTable<Key, Route>::const_iterator it =
+	    _routes.find(Key(((uint64_t) slot << (64 - TOP_BITS)) & mask, 0, plen));
+	if (it)
+	    return it.value().nexthop;
+    }
+    return 0;
+}
+
+PoptrieIP6Lookup::Trie *
+PoptrieIP6Lookup::build_full() const
+{
+    Trie *t = new Trie;
+    t->nexthops = _nexthops;
+    Poptrie6Builder(t, _prefixes).build_top();
+    return t;
+}
+
+/*
+ * Copy the live structure and rebuild the dirty slots only. The subtrees
+ * they pointed to stay in the copy as garbage.
+ */
+PoptrieIP6Lookup::Trie *
+PoptrieIP6Lookup::build_update(const Trie *old) const
+{
+    Trie *t = new Trie(*old);
+    t->nexthops = _nexthops;
+    Poptrie6Builder b(t, _prefixes);
+    int k = prefix_find((uint64_t) _dirty_lo << (64 - TOP_BITS), 0, 0);
+    for (uint32_t i = _dirty_lo; i <= _dirty_hi; i++) {
+	if (t->top[i] & NODE_FLAG)
+	    t->garbage += b.subtree_size(t->top[i] & ~NODE_FLAG);
+	int start = k;
+	while (k < _prefixes.size() && Poptrie6Builder::slot(_prefixes[k].hi) == i)
+	    k++;
+	b.build_slot(i, start, k, slot_leaf(i));
+    }
+    return t;
+}
+
+/*
+ * Publish a structure reflecting the shadow routes. Once write_begin()
+ * returns, no reader can still hold the structure that was replaced by the
+ * previous commit, so it is freed there.
+ */
+void
+PoptrieIP6Lookup::commit()
+{
+    if (!_active || _defer || _dirty_lo > _dirty_hi)
+	return;
+
+    Trie *old = _trie.read();
+    Trie *t;
+    if (!old || _dirty_hi - _dirty_lo >= UPDATE_SLOTS_MAX
+	|| old->garbage * 2 >= old->memory())
+	t = build_full();
+    else
+	t = build_update(old);
+    _dirty_lo = 1;
+    _dirty_hi = 0;
+
+    int rcu_current_local;
+    Trie *&slot = _trie.write_begin(rcu_current_local);
+    delete _retired;
+    _retired = slot;
+    slot = t;
+    _trie.write_commit(rcu_current_local);
+}
+
+int
+PoptrieIP6Lookup::store_route(IP6Address addr, IP6Address mask, IP6Address gw,
+			      int port, bool allow_replace, ErrorHandler *errh)
+{
+    int plen = mask.mask_to_prefix_len();
+    if (plen < 0)
+	return errh->error("%s: mask is not a CIDR prefix", mask.unparse().c_str());
+    addr &= mask;
+    uint64_t hi, lo;
+    split(addr, hi, lo);
+    Key key(hi, lo, plen);
+
+    HashTable<Key, Route>::iterator it = _routes.find(key);
+    bool existed = it;
+    if (existed && !allow_replace)
+	return errh->error("%s/%d: route already exists", addr.unparse().c_str(), plen);
+
+    int nh = nexthop_ref(gw, port);
+    if (nh < 0)
+	return errh->error("more than %d next hops", (int) NEXTHOP_MAX);
+    if (existed)
+	nexthop_unref(it.value().nexthop);
+    Route r;
+    r.gw = gw;
+    r.port = port;
+    r.nexthop = nh;
+    _routes.set(key, r);
+
+    if (_active) {
+	int k = prefix_find(hi, lo, plen);
+	if (existed)
+	    _prefixes[k].nexthop = nh;
+	else {
+	    Prefix p;
+	    p.hi = hi;
+	    p.lo = lo;
+	    p.plen = plen;
+	    p.nexthop = nh;
+	    prefix_insert(k, p);
+	}
+    }
+    mark_dirty(hi, plen);
+    commit();
+    return 0;
+}
+
+int
+PoptrieIP6Lookup::add_route(IP6Address addr, IP6Address mask, IP6Address gw,
+			    int port, ErrorHandler *errh)
+{
+    return store_route(addr, mask, gw, port, false, errh);
+}
+
+int
+PoptrieIP6Lookup::set_route(IP6Address addr, IP6Address mask, IP6Address gw,
+			    int port, ErrorHandler *errh)
+{
+    return store_route(addr, mask, gw, port, true, errh);
+}
+
+int
+PoptrieIP6Lookup::remove_route(IP6Address addr, IP6Address mask, ErrorHandler *errh)
+{
+    int plen = mask.mask_to_prefix_len();
+    addr &= mask;
+    uint64_t hi, lo;
+    split(addr, hi, lo);
+    HashTable<Key, Route>::iterator it = _routes.find(Key(hi, lo, plen));
+    if (plen < 0 || !it)
+	return errh->error("%s/%d: no such route", addr.unparse().c_str(), plen);
+
+    nexthop_unref(it.value().nexthop);
+    _routes.erase(it);
+    if (_active)
+	prefix_erase(prefix_find(hi, lo, plen));
+    mark_dirty(hi, plen);
+    commit();
+    return 0;
+}
+
+int
+PoptrieIP6Lookup::lookup_route(IP6Address addr, IP6Address &gw) const
+{
+    uint64_t hi, lo;
+    split(addr, hi, lo);
+    int rcu_current_local;
+    const Trie *t = _trie.read_begin(rcu_current_local);
+    int port = t->lookup(hi, lo, gw);
+    _trie.read_end(rcu_current_local);
+    return port;
+}
+
+void
+PoptrieIP6Lookup::lookup_route_batch(const IP6Address *addrs, int n, int *ports, IP6Address *gws) const
+{
+    uint64_t hi[LOOKUP_BATCH_MAX], lo[LOOKUP_BATCH_MAX];
+    uint32_t cur[LOOKUP_BATCH_MAX];
+    int rcu_current_local;
+    const Trie *t = _trie.read_begin(rcu_current_local);
+    const uint32_t *top = t->top.data();
+    const Node *nodes = t->nodes.data();
+    const uint16_t *leaves = t->leaves.data();
+
+    for (int k = 0; k < n; k++) {
+	split(addrs[k], hi[k], lo[k]);
+	__builtin_prefetch(&top[hi[k] >> (64 - TOP_BITS)]);
+    }
+    bool more = false;
+    for (int k = 0; k < n; k++) {
+	cur[k] = top[hi[k] >> (64 - TOP_BITS)];
+	if (cur[k] & NODE_FLAG) {
+	    __builtin_prefetch(&nodes[cur[k] & ~NODE_FLAG]);
+	    more = true;
+	}
+    }
+    // Walk all addresses one level at a time, prefetching the next level
+    for (int depth = TOP_BITS; more; depth += STRIDE) {
+	more = false;
+	for (int k = 0; k < n; k++) {
+	    if (!(cur[k] & NODE_FLAG))
+		continue;
+	    const Node *nd = &nodes[cur[k] & ~NODE_FLAG];
+	    int c = chunk(hi[k], lo[k], depth);
+	    uint64_t upto = ((uint64_t) 2 << c) - 1;
+	    if (nd->vector & ((uint64_t) 1 << c)) {
+		cur[k] = NODE_FLAG | (nd->base1 + __builtin_popcountll(nd->vector & upto) - 1);
+		__builtin_prefetch(&nodes[cur[k] & ~NODE_FLAG]);
+		more = true;
+	    } else
+		cur[k] = leaves[nd->base0 + __builtin_popcountll(nd->leafvec & upto) - 1];
+	}
+    }
+    for (int k = 0; k < n; k++) {
+	gws[k] = t->nexthops[cur[k]].gw;
+	ports[k] = t->nexthops[cur[k]].port;
+    }
+    _trie.read_end(rcu_current_local);
+}
+
+String
+PoptrieIP6Lookup::dump_routes()
+{
+    StringAccum sa;
+    for (int i = 0; i < _prefixes.size(); i++) {
+	const Prefix &p = _prefixes[i];
+	const NextHop &nh = _nexthops[p.nexthop];
+	sa << join(p.hi, p.lo) << '/' << (int) p.plen
+	   << '\t' << nh.gw << '\t' << nh.port << '\n';
+    }
+    return sa.take_string();
+}
+
+int
+PoptrieIP6Lookup::flush_handler(const String &, Element *e, void *, ErrorHandler *)
+{
+    PoptrieIP6Lookup *t = static_cast<PoptrieIP6Lookup *>(e);
+    t->_routes.clear();
+    t->_prefixes.clear();
+    t->nexthop_reset();
+    t->mark_dirty(0, 0);
+    t->commit();
+    return 0;
+}
+
+int
+PoptrieIP6Lookup::ctrl_handler(const String &conf, Element *e, void *thunk, ErrorHandler *errh)
+{
+    PoptrieIP6Lookup *t = static_cast<PoptrieIP6Lookup *>(e);
+    // Apply the whole group to the shadow routes, then publish once
+    t->_defer = true;
+    int r = IP6RouteTable::ctrl_handler(conf, e, thunk, errh);
+    t->_defer = false;
+    t->commit();
+    return r;
+}
+
+String
+PoptrieIP6Lookup::stats_handler(Element *e, void *)
+{
+    PoptrieIP6Lookup *pt = static_cast<PoptrieIP6Lookup *>(e);
+    const Trie *t = pt->_trie.read();
+    StringAccum sa;
+    sa << "routes " << pt->_routes.size() << '\n'
+       << "nodes " << t->nodes.size() << '\n'
+       << "leaves " << t->leaves.size() << '\n'
+       << "nexthops " << t->nexthops.size() << '\n'
+       << "bytes " << t->memory() << '\n'
+       << "garbage " << t->garbage << '\n';
+    return sa.take_string();
+}
+
+void
+PoptrieIP6Lookup::add_handlers()
+{
+    add_write_handler("add", add_route_handler, 0);
+    add_write_handler("set", add_route_handler, 1);
+    add_write_handler("remove", remove_route_handler);
+    add_write_handler("ctrl", ctrl_handler);
+    add_write_handler("flush", flush_handler, 0, Handler::BUTTON);
+    add_read_handler("table", table_handler, 0, Handler::f_expensive);
+    add_read_handler("stats", stats_handler);
+    set_handler("lookup", Handler::f_read | Handler::f_read_param, lookup_handler);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(IP6RouteTable)
+EXPORT_ELEMENT(PoptrieIP6Lookup)
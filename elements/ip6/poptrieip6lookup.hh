@@ -0,0 +1,255 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_POPTRIEIP6LOOKUP_HH
+#define CLICK_POPTRIEIP6LOOKUP_HH
+#include <click/hashtable.hh>
+#include <click/multithread.hh>
+#include "ip6routetable.hh"
+CLICK_DECLS
+
+/*
+=c
+
+PoptrieIP6Lookup(ADDR1/MASK1 [GW1] OUT1, ADDR2/MASK2 [GW2] OUT2, ...)
+
+=s ip6
+
+IPv6 routing lookup in a popcount-compressed multibit trie
+
+=d
+
+Input: IPv6 packets. Expects a destination IPv6 address annotation with each
+packet. Looks up that address in its routing table, using
+longest-prefix-match, sets the destination annotation to the corresponding GW
+(if specified), and emits the packet on the indicated OUTput port.
+
+Each argument is a route, specifying a destination and mask, an optional
+gateway IPv6 address, and an output port.  Masks must be CIDR prefixes.
+
+PoptrieIP6Lookup is the IPv6 counterpart of PoptrieIPLookup.  The first 16
+bits of the address index a direct-pointing array, the remaining bits are
+consumed 6 at a time by trie nodes found with a population count.  Routes of
+the global table are /48 or shorter, so they are resolved in at most six
+dependent memory accesses, against a scan of every route for LookupIP6Route.
+Batches of packets are looked up level by level, prefetching the next level
+of every packet of the batch.
+
+Updates are applied to a shadow route set, then a copy of the structure in
+which only the /16 blocks touched by the updates are rebuilt is swapped in
+with fast_rcu, so lookups never wait for a writer.  Use the C<ctrl> handler to
+apply a group of updates with a single copy.
+
+=e
+
+  ... -> GetIP6Address(24) -> rt;
+  rt :: PoptrieIP6Lookup(
+         3ffe:1ce1:2::/48 0,
+         3ffe:1ce1:2:0:200::/80 1,
+         ::/0 3ffe:1ce1:2::2 1);
+
+=h table read-only
+
+Outputs a human-readable version of the current routing table.
+
+=h lookup read-only
+
+Reports the OUTput port and GW corresponding to an address.
+
+=h add write-only
+
+Adds a route to the table. Format should be `C<ADDR/MASK [GW] OUT>'.
+Fails if a route for C<ADDR/MASK> already exists.
+
+=h set write-only
+
+Sets a route, whether or not a route for the same prefix already exists.
+
+=h remove write-only
+
+Removes a route from the table. Format should be `C<ADDR/MASK>'.
+
+=h ctrl write-only
+
+Adds or removes a group of routes. Write `C<add>/C<set ADDR/MASK [GW] OUT>' to
+add a route, and `C<remove ADDR/MASK>' to remove a route, one command per
+line. The lookup structure is updated once, after all the commands.
+
+=h flush write-only
+
+Clears the entire routing table in a single atomic operation.
+
+=h stats read-only
+
+Number of routes, trie nodes, leaves and next hops, the size in bytes of the
+lookup structure and how many of those bytes are unused.
+
+=n
+
+At most 65535 distinct (GW, OUT) pairs can be used.
+
+=a LookupIP6Route, PoptrieIPLookup
+
+*/
+
+class PoptrieIP6Lookup : public IP6RouteTable { public:
+
+    PoptrieIP6Lookup() CLICK_COLD;
+    ~PoptrieIP6Lookup() CLICK_COLD;
+
+    const char *class_name() const	{ return "PoptrieIP6Lookup"; }
+    const char *port_count() const	{ return "1/-"; }
+    const char *processing() const	{ return PUSH; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    void cleanup(CleanupStage stage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    int add_route(IP6Address, IP6Address, IP6Address, int, ErrorHandler *);
+    int set_route(IP6Address, IP6Address, IP6Address, int, ErrorHandler *);
+    int remove_route(IP6Address, IP6Address, ErrorHandler *);
+    int lookup_route(IP6Address, IP6Address &) const;
+    void lookup_route_batch(const IP6Address *, int, int *, IP6Address *) const;
+    String dump_routes();
+
+    static int flush_handler(const String &, Element *, void *, ErrorHandler *);
+    static int ctrl_handler(const String &, Element *, void *, ErrorHandler *);
+    static String stats_handler(Element *, void *);
+
+    enum {
+	TOP_BITS = 16,		// bits resolved by the direct-pointing array
+	STRIDE = 6,		// bits resolved by each node, 2^6 = 64 children
+	NEXTHOP_MAX = 65535,
+	UPDATE_SLOTS_MAX = 1024	// above, rebuild everything
+    };
+    static const uint32_t NODE_FLAG = 0x80000000U;
+
+    struct Node {
+	uint64_t vector;	// bit c set: child c is a node
+	uint64_t leafvec;	// bit c set: child c starts a new run of leaves
+	uint32_t base0;		// index of the first leaf
+	uint32_t base1;		// index of the first child node
+    };
+
+    struct NextHop {
+	IP6Address gw;
+	int32_t port;
+    };
+
+    struct Prefix {
+	uint64_t hi;		// host byte order
+	uint64_t lo;
+	uint16_t nexthop;
+	uint8_t plen;
+    };
+
+    struct Trie {
+	Vector<uint32_t> top;	// leaf index, or NODE_FLAG | node index
+	Vector<Node> nodes;
+	Vector<uint16_t> leaves;
+	Vector<NextHop> nexthops;
+	size_t garbage;		// bytes of nodes and leaves no longer reachable
+
+	Trie() : garbage(0) { }
+	inline int lookup(uint64_t hi, uint64_t lo, IP6Address &gw) const;
+	size_t memory() const;
+    };
+
+    static inline void split(const IP6Address &a, uint64_t &hi, uint64_t &lo) {
+	const uint32_t *d = a.data32();
+	hi = ((uint64_t) ntohl(d[0]) << 32) | ntohl(d[1]);
+	lo = ((uint64_t) ntohl(d[2]) << 32) | ntohl(d[3]);
+    }
+    // STRIDE bits of the address starting at bit depth, zero-padded past 128
+    static inline int chunk(uint64_t hi, uint64_t lo, int depth) {
+	if (depth <= 64 - STRIDE)
+	    return (hi >> (64 - STRIDE - depth)) & 63;
+	else if (depth < 64)
+	    return ((hi << (depth - (64 - STRIDE))) | (lo >> (128 - STRIDE - depth))) & 63;
+	else if (depth <= 128 - STRIDE)
+	    return (lo >> (128 - STRIDE - depth)) & 63;
+	else
+	    return (lo << (depth - (128 - STRIDE))) & 63;
+    }
+
+  private:
+
+    // IP6Address::hashcode() only looks at the low 64 bits, which are zero
+    // in most prefixes
+    struct Key {
+	uint64_t hi;
+	uint64_t lo;
+	int extra;		// prefix length or output port
+
+	Key() : hi(0), lo(0), extra(0) { }
+	Key(uint64_t h, uint64_t l, int e) : hi(h), lo(l), extra(e) { }
+	hashcode_t hashcode() const {
+	    uint64_t x = (hi ^ (lo * 0x9E3779B97F4A7C15ULL)) + extra;
+	    x ^= x >> 31;
+	    x *= 0xBF58476D1CE4E5B9ULL;
+	    return x ^ (x >> 32);
+	}
+	bool operator==(const Key &k) const {
+	    return hi == k.hi && lo == k.lo && extra == k.extra;
+	}
+    };
+
+    struct Route {
+	IP6Address gw;
+	int port;
+	int nexthop;
+    };
+
+    // Shadow of the routing table
+    HashTable<Key, Route> _routes;
+    Vector<Prefix> _prefixes;	// sorted by address then length
+    Vector<NextHop> _nexthops;
+    Vector<int> _nexthop_refs;
+    HashTable<Key, int> _nexthop_index;
+    Vector<int> _nexthop_free;
+    uint32_t _dirty_lo;		// range of top-level slots to rebuild
+    uint32_t _dirty_hi;
+
+    mutable fast_rcu<Trie *> _trie;
+    Trie *_retired;
+    bool _active;
+    bool _defer;
+
+    int nexthop_ref(const IP6Address &gw, int port);
+    void nexthop_unref(int nh);
+    void nexthop_reset();
+    int prefix_find(uint64_t hi, uint64_t lo, int plen) const;
+    void prefix_insert(int k, const Prefix &p);
+    void prefix_erase(int k);
+    void mark_dirty(uint64_t hi, int plen);
+    uint16_t slot_leaf(uint32_t slot) const;
+    int store_route(IP6Address, IP6Address, IP6Address, int, bool, ErrorHandler *);
+    Trie *build_full() const;
+    Trie *build_update(const Trie *old) const;
+    void commit();
+
+};
+
+inline int
+PoptrieIP6Lookup::Trie::lookup(uint64_t hi, uint64_t lo, IP6Address &gw) const
+{
+    uint32_t t = top[hi >> (64 - TOP_BITS)];
+    if (t & NODE_FLAG) {
+	int depth = TOP_BITS;
+	const Node *n = &nodes[t & ~NODE_FLAG];
+	while (1) {
+	    int c = chunk(hi, lo, depth);
+	    uint64_t upto = ((uint64_t) 2 << c) - 1;
+	    if (n->vector & ((uint64_t) 1 << c)) {
+		n = &nodes[n->base1 + __builtin_popcountll(n->vector & upto) - 1];
+		depth += STRIDE;
+	    } else {
+		t = leaves[n->base0 + __builtin_popcountll(n->leafvec & upto) - 1];
+		break;
+	    }
+	}
+    }
+    gw = nexthops[t].gw;
+    return nexthops[t].port;
+}
+
+CLICK_ENDDECLS
+#endif
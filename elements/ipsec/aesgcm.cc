@@ -0,0 +1,238 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * aesgcm.{cc,hh} -- element implements IPsec ESP encryption and
+ * authentication using AES-GCM
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#ifndef HAVE_IPSEC
+# error "Must #define HAVE_IPSEC in config.h"
+#endif
+#include "aesgcm.hh"
+#include "esp.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/glue.hh>
+#include <click/packet_anno.hh>
+CLICK_DECLS
+
+IPsecAESGCM::IPsecAESGCM()
+    : _encrypt(true)
+{
+#if HAVE_BATCH
+    in_batch_mode = BATCH_MODE_YES;
+#endif
+}
+
+IPsecAESGCM::~IPsecAESGCM()
+{
+}
+
+int
+IPsecAESGCM::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    return Args(conf, this, errh).read_mp("ENCRYPT", _encrypt).complete();
+}
+
+int
+IPsecAESGCM::initialize(ErrorHandler *errh)
+{
+    if (!ESPCrypto::have_aesgcm())
+	return errh->error("AES-GCM needs AES-NI and PCLMULQDQ, which %s",
+#if CLICK_ESPCRYPTO_AESNI
+			   "this CPU lacks"
+#else
+			   "Click was compiled without"
+#endif
+			   );
+    _drops = 0;
+    return 0;
+}
+
+inline const IPsecAESGCM::KeyCache::Entry &
+IPsecAESGCM::key(const SADataTuple *sa)
+{
+    KeyCache::Entry &e = _keys->e[((uintptr_t) sa >> 4) % KeyCache::SIZE];
+    if (unlikely(e.sa != sa
+		 || memcmp(e.key, sa->Encryption_key, KEY_SIZE) != 0
+		 || memcmp(e.salt, sa->Authentication_key, 4) != 0)) {
+	e.sa = sa;
+	memcpy(e.key, sa->Encryption_key, KEY_SIZE);
+	memcpy(e.salt, sa->Authentication_key, 4);
+	ESPCrypto::gcm_init(e.gcm, e.key);
+    }
+    return e;
+}
+
+inline void
+IPsecAESGCM::drop(Packet *p)
+{
+    _drops++;
+    p->kill();
+}
+
+/* Check a packet and make it writable, with room for the ICV when
+   encrypting. Returns null if the packet was dropped. */
+inline WritablePacket *
+IPsecAESGCM::prepare(Packet *p)
+{
+    const SADataTuple *sa = (const SADataTuple *) IPSEC_SA_DATA_REFERENCE_ANNO(p);
+    if (!sa) {
+	if (_drops == 0)
+	    click_chatter("%p{element}: no SADataTuple reference annotation", this);
+	drop(p);
+	return 0;
+    }
+    if (p->length() < sizeof(esp_new) + (_encrypt ? 0 : ICV_LEN)) {
+	drop(p);
+	return 0;
+    }
+    if (_encrypt)
+	return p->put(ICV_LEN);
+    return p->uniqueify();
+}
+
+void
+IPsecAESGCM::process(WritablePacket **pkts, int n, bool *ok)
+{
+    ESPCrypto::GCMJob jobs[MAX_JOBS];
+    for (int i = 0; i < n; i++) {
+	WritablePacket *p = pkts[i];
+	SADataTuple *sa = (SADataTuple *) IPSEC_SA_DATA_REFERENCE_ANNO(p);
+	const KeyCache::Entry &e = key(sa);
+	esp_new *esp = reinterpret_cast<esp_new *>(p->data());
+	if (_encrypt) {
+	    // A nonce must never repeat under a key, so the IV is the SA's
+	    // counter, not the random one IPsecESPEncap wrote
+	    uint64_t iv = sa->gcm_iv.fetch_and_add(1);
+	    memcpy(esp->esp_iv, &iv, 8);
+	}
+	jobs[i].key = &e.gcm;
+	memcpy(jobs[i].nonce, e.salt, 4);
+	memcpy(jobs[i].nonce + 4, esp->esp_iv, 8);
+	jobs[i].aad = p->data();
+	jobs[i].aad_len = 8;
+	jobs[i].data = p->data() + sizeof(esp_new);
+	jobs[i].len = p->length() - sizeof(esp_new) - ICV_LEN;
+    }
+
+    if (_encrypt) {
+	ESPCrypto::gcm_encrypt(jobs, n);
+	for (int i = 0; i < n; i++) {
+	    memcpy(pkts[i]->end_data() - ICV_LEN, jobs[i].tag, ICV_LEN);
+	    ok[i] = true;
+	}
+    } else {
+	ESPCrypto::gcm_decrypt(jobs, n);
+	int nbad = 0;
+	for (int i = 0; i < n; i++) {
+	    const uint8_t *icv = pkts[i]->end_data() - ICV_LEN;
+	    uint8_t diff = 0;
+	    for (int b = 0; b < ICV_LEN; b++)
+		diff |= icv[b] ^ jobs[i].tag[b];
+	    if ((ok[i] = (diff == 0)))
+		pkts[i]->take(ICV_LEN);
+	    else
+		jobs[nbad++] = jobs[i];
+	}
+	// Unauthenticated plaintext must never leave the element. The
+	// payload was decrypted in place, so encrypt it again with the same
+	// nonce to restore the ciphertext that was received.
+	if (nbad)
+	    ESPCrypto::gcm_encrypt(jobs, nbad);
+    }
+}
+
+void
+IPsecAESGCM::push(int, Packet *p)
+{
+    WritablePacket *q = prepare(p);
+    if (!q)
+	return;
+    bool ok;
+    process(&q, 1, &ok);
+    if (ok)
+	output(0).push(q);
+    else {
+	_drops++;
+	checked_output_push(1, q);
+    }
+}
+
+#if HAVE_BATCH
+static inline void
+append(PacketBatch *&batch, Packet *p)
+{
+    p->set_next(0);
+    if (batch)
+	batch->append_packet(p);
+    else
+	batch = PacketBatch::make_from_packet(p);
+}
+
+inline void
+IPsecAESGCM::process_batch(WritablePacket **pkts, int n,
+			   PacketBatch *&good, PacketBatch *&bad)
+{
+    bool ok[MAX_JOBS];
+    process(pkts, n, ok);
+    for (int i = 0; i < n; i++)
+	if (ok[i])
+	    append(good, pkts[i]);
+	else {
+	    _drops++;
+	    append(bad, pkts[i]);
+	}
+}
+
+void
+IPsecAESGCM::push_batch(int, PacketBatch *batch)
+{
+    WritablePacket *pkts[MAX_JOBS];
+    PacketBatch *good = 0, *bad = 0;
+    int n = 0;
+
+    Packet *next;
+    for (Packet *p = batch; p; p = next) {
+	next = p->next();
+	if ((pkts[n] = prepare(p)) && ++n == MAX_JOBS) {
+	    process_batch(pkts, n, good, bad);
+	    n = 0;
+	}
+    }
+    if (n)
+	process_batch(pkts, n, good, bad);
+
+    if (good)
+	output_push_batch(0, good);
+    if (bad)
+	checked_output_push_batch(1, bad);
+}
+#endif
+
+String
+IPsecAESGCM::read_handler(Element *e, void *)
+{
+    return String(static_cast<IPsecAESGCM *>(e)->_drops);
+}
+
+void
+IPsecAESGCM::add_handlers()
+{
+    add_read_handler("drops", read_handler, 0);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(IPsecCrypto)
+EXPORT_ELEMENT(IPsecAESGCM)
+ELEMENT_MT_SAFE(IPsecAESGCM)
@@ -0,0 +1,104 @@
+#ifndef CLICK_IPSECAESGCM_HH
+#define CLICK_IPSECAESGCM_HH
+#include <click/batchelement.hh>
+#include <click/atomic.hh>
+#include <click/sync.hh>
+#include "espcrypto.hh"
+#include "sadatatuple.hh"
+CLICK_DECLS
+
+/*
+ * =c
+ * IPsecAESGCM(ENCRYPT)
+ * =s ipsec
+ * encrypt and authenticate ESP packets using AES-GCM
+ * =d
+ *
+ * Encrypts and authenticates, or verifies and decrypts, ESP packets with
+ * AES-128-GCM as in RFC 4106, using the AES-NI and PCLMULQDQ instructions.
+ * If ENCRYPT is true, IPsecAESGCM encrypts the payload that follows the ESP
+ * header, and appends a 16-byte integrity check value. It replaces both
+ * IPsecAuthHMACSHA1(0) and IPsecAES(1) after IPsecESPEncap. If ENCRYPT is
+ * false, IPsecAESGCM checks and removes the integrity check value, then
+ * decrypts the payload. Packets that fail the check are emitted on output
+ * 1 if it exists, and dropped otherwise. They leave exactly as received,
+ * with their payload still encrypted and their integrity check value in
+ * place; unauthenticated plaintext is never emitted.
+ *
+ * The key is the Encryption_key of the security association referenced by
+ * the packet's annotation, as set by RadixIPsecLookup. The 4-byte salt is the
+ * first 4 bytes of its Authentication_key. The nonce is the salt followed by
+ * the 8-byte IV of the ESP header, and the SPI and sequence number are
+ * authenticated. When encrypting, IPsecAESGCM replaces the IV written by
+ * IPsecESPEncap with a per-SA counter, so that no nonce repeats under a
+ * key. Packets too short to hold an ESP header are dropped.
+ *
+ * IPsecAESGCM processes whole batches: the counter blocks of all packets of
+ * a batch are encrypted together, eight at a time, which hides the latency
+ * of the AES rounds even for small packets. Expanded keys are cached per
+ * thread.
+ *
+ * IPsecAESGCM fails to initialize if Click was compiled without AES-NI and
+ * PCLMULQDQ support, or if the CPU lacks them.
+ *
+ * =h drops read-only
+ * Returns the number of packets that failed the integrity check or had no
+ * security association.
+ *
+ * =a IPsecESPEncap, IPsecESPUnencap, IPsecAES, IPsecAuthHMACSHA1
+ */
+
+class IPsecAESGCM : public BatchElement { public:
+
+    IPsecAESGCM() CLICK_COLD;
+    ~IPsecAESGCM() CLICK_COLD;
+
+    const char *class_name() const	{ return "IPsecAESGCM"; }
+    const char *port_count() const	{ return "1/1-2"; }
+    const char *processing() const	{ return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int, Packet *);
+#if HAVE_BATCH
+    void push_batch(int, PacketBatch *);
+#endif
+
+    enum { ICV_LEN = 16, MAX_JOBS = 32 };
+
+  private:
+
+    struct KeyCache {
+	enum { SIZE = 8 };
+	struct Entry {
+	    const SADataTuple *sa;
+	    uint8_t key[KEY_SIZE];
+	    uint8_t salt[4];
+	    ESPCrypto::GCMKey gcm;
+	} e[SIZE];
+	KeyCache() {
+	    memset(e, 0, sizeof(e));
+	}
+    };
+
+    bool _encrypt;
+    atomic_uint32_t _drops;
+    per_thread<KeyCache> _keys;
+
+    inline const KeyCache::Entry &key(const SADataTuple *sa);
+    inline WritablePacket *prepare(Packet *p);
+    void process(WritablePacket **pkts, int n, bool *ok);
+#if HAVE_BATCH
+    inline void process_batch(WritablePacket **pkts, int n,
+			      PacketBatch *&good, PacketBatch *&bad);
+#endif
+    inline void drop(Packet *p);
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
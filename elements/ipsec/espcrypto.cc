@@ -0,0 +1,553 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * espcrypto.{cc,hh} -- batched ESP cipher kernels using AES-NI, PCLMULQDQ
+ * and the SHA extensions
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "espcrypto.hh"
+#if CLICK_ESPCRYPTO_AESNI || CLICK_ESPCRYPTO_SHANI
+# include <immintrin.h>
+#endif
+CLICK_DECLS
+
+namespace ESPCrypto {
+
+static inline uint32_t
+rol32(uint32_t x, int n)
+{
+    return (x << n) | (x >> (32 - n));
+}
+
+static inline uint32_t
+load_be32(const uint8_t *p)
+{
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16)
+	| ((uint32_t) p[2] << 8) | p[3];
+}
+
+static inline void
+store_be32(uint8_t *p, uint32_t x)
+{
+    p[0] = x >> 24;
+    p[1] = x >> 16;
+    p[2] = x >> 8;
+    p[3] = x;
+}
+
+
+/*
+ * SHA1
+ */
+
+static void
+sha1_blocks_portable(uint32_t *state, const uint8_t *data, size_t nblocks)
+{
+    uint32_t w[80];
+    for (; nblocks; --nblocks, data += 64) {
+	for (int i = 0; i < 16; i++)
+	    w[i] = load_be32(data + 4 * i);
+	for (int i = 16; i < 80; i++)
+	    w[i] = rol32(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+	for (int i = 0; i < 80; i++) {
+	    uint32_t f, k;
+	    if (i < 20) {
+		f = (b & c) | (~b & d);
+		k = 0x5A827999;
+	    } else if (i < 40) {
+		f = b ^ c ^ d;
+		k = 0x6ED9EBA1;
+	    } else if (i < 60) {
+		f = (b & c) | (b & d) | (c & d);
+		k = 0x8F1BBCDC;
+	    } else {
+		f = b ^ c ^ d;
+		k = 0xCA62C1D6;
+	    }
+	    uint32_t t = rol32(a, 5) + f + e + k + w[i];
+	    e = d;
+	    d = c;
+	    c = rol32(b, 30);
+	    b = a;
+	    a = t;
+	}
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+    }
+}
+
+#if CLICK_ESPCRYPTO_SHANI
+// Rounds 4g..4g+3. Ex receives the next E from Ey's previous value.
+# define SHA1_ROUNDS(Ex, Ey, M, f)					\
+    Ex = _mm_sha1nexte_epu32(Ex, M);					\
+    Ey = abcd;								\
+    abcd = _mm_sha1rnds4_epu32(abcd, Ex, f)
+# define SHA1_SCHEDULE(Mn, Mx, My, M)					\
+    Mn = _mm_sha1msg2_epu32(Mn, M);					\
+    My = _mm_sha1msg1_epu32(My, M);					\
+    Mx = _mm_xor_si128(Mx, M)
+
+static void
+sha1_blocks_shani(uint32_t *state, const uint8_t *data, size_t nblocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090A0B0C0D0E0FULL);
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) state), 0x1B);
+    __m128i e0 = _mm_set_epi32(state[4], 0, 0, 0), e1;
+    __m128i m0, m1, m2, m3;
+# if __AVX__
+    // The SHA instructions have no VEX encoding; avoid the penalty for
+    // mixing them with dirty upper AVX state.
+    _mm256_zeroupper();
+# endif
+
+    for (; nblocks; --nblocks, data += 64) {
+	__m128i abcd_save = abcd, e0_save = e0;
+
+	m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) data), mask);
+	e0 = _mm_add_epi32(e0, m0);
+	e1 = abcd;
+	abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+	m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 16)), mask);
+	SHA1_ROUNDS(e1, e0, m1, 0);
+	m0 = _mm_sha1msg1_epu32(m0, m1);
+
+	m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 32)), mask);
+	SHA1_ROUNDS(e0, e1, m2, 0);
+	m1 = _mm_sha1msg1_epu32(m1, m2);
+	m0 = _mm_xor_si128(m0, m2);
+
+	m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 48)), mask);
+	SHA1_ROUNDS(e1, e0, m3, 0);
+	SHA1_SCHEDULE(m0, m1, m2, m3);
+
+	SHA1_ROUNDS(e0, e1, m0, 0);	// 16-19
+	SHA1_SCHEDULE(m1, m2, m3, m0);
+	SHA1_ROUNDS(e1, e0, m1, 1);	// 20-23
+	SHA1_SCHEDULE(m2, m3, m0, m1);
+	SHA1_ROUNDS(e0, e1, m2, 1);
+	SHA1_SCHEDULE(m3, m0, m1, m2);
+	SHA1_ROUNDS(e1, e0, m3, 1);
+	SHA1_SCHEDULE(m0, m1, m2, m3);
+	SHA1_ROUNDS(e0, e1, m0, 1);
+	SHA1_SCHEDULE(m1, m2, m3, m0);
+	SHA1_ROUNDS(e1, e0, m1, 1);
+	SHA1_SCHEDULE(m2, m3, m0, m1);
+	SHA1_ROUNDS(e0, e1, m2, 2);	// 40-43
+	SHA1_SCHEDULE(m3, m0, m1, m2);
+	SHA1_ROUNDS(e1, e0, m3, 2);
+	SHA1_SCHEDULE(m0, m1, m2, m3);
+	SHA1_ROUNDS(e0, e1, m0, 2);
+	SHA1_SCHEDULE(m1, m2, m3, m0);
+	SHA1_ROUNDS(e1, e0, m1, 2);
+	SHA1_SCHEDULE(m2, m3, m0, m1);
+	SHA1_ROUNDS(e0, e1, m2, 2);
+	SHA1_SCHEDULE(m3, m0, m1, m2);
+	SHA1_ROUNDS(e1, e0, m3, 3);	// 60-63
+	SHA1_SCHEDULE(m0, m1, m2, m3);
+
+	SHA1_ROUNDS(e0, e1, m0, 3);
+	SHA1_SCHEDULE(m1, m2, m3, m0);
+	SHA1_ROUNDS(e1, e0, m1, 3);
+	m2 = _mm_sha1msg2_epu32(m2, m1);
+	m3 = _mm_xor_si128(m3, m1);
+	SHA1_ROUNDS(e0, e1, m2, 3);
+	m3 = _mm_sha1msg2_epu32(m3, m2);
+	SHA1_ROUNDS(e1, e0, m3, 3);	// 76-79
+
+	e0 = _mm_sha1nexte_epu32(e0, e0_save);
+	abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+
+    _mm_storeu_si128((__m128i *) state, _mm_shuffle_epi32(abcd, 0x1B));
+    state[4] = _mm_extract_epi32(e0, 3);
+}
+
+# undef SHA1_ROUNDS
+# undef SHA1_SCHEDULE
+#endif
+
+bool
+have_shani()
+{
+#if CLICK_ESPCRYPTO_SHANI
+    static int have = -1;
+    if (have < 0)
+	have = __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+    return have;
+#else
+    return false;
+#endif
+}
+
+static inline void
+sha1_blocks(uint32_t *state, const uint8_t *data, size_t nblocks)
+{
+#if CLICK_ESPCRYPTO_SHANI
+    if (likely(have_shani())) {
+	sha1_blocks_shani(state, data, nblocks);
+	return;
+    }
+#endif
+    sha1_blocks_portable(state, data, nblocks);
+}
+
+static const uint32_t sha1_iv[5] = {
+    0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0
+};
+
+/* Hash the last @a len bytes of a message whose first @a prefix bytes are
+   already in @a state. */
+static void
+sha1_finish(uint32_t *state, const uint8_t *data, uint32_t len,
+	    uint64_t prefix, uint8_t *digest)
+{
+    uint32_t full = len / 64;
+    sha1_blocks(state, data, full);
+    uint8_t buf[128];
+    uint32_t rem = len - full * 64;
+    memcpy(buf, data + full * 64, rem);
+    buf[rem] = 0x80;
+    uint32_t nb = rem + 9 <= 64 ? 1 : 2;
+    memset(buf + rem + 1, 0, nb * 64 - rem - 9);
+    uint64_t bits = (prefix + len) * 8;
+    store_be32(buf + nb * 64 - 8, bits >> 32);
+    store_be32(buf + nb * 64 - 4, bits);
+    sha1_blocks(state, buf, nb);
+    for (int i = 0; i < 5; i++)
+	store_be32(digest + 4 * i, state[i]);
+}
+
+void
+sha1(const uint8_t *data, uint32_t len, uint8_t *digest)
+{
+    uint32_t state[5];
+    memcpy(state, sha1_iv, sizeof(state));
+    sha1_finish(state, data, len, 0, digest);
+}
+
+void
+hmac_sha1_init(HMACSHA1Key &k, const uint8_t *key, uint32_t key_len)
+{
+    uint8_t k0[64], pad[64];
+    memset(k0, 0, sizeof(k0));
+    if (key_len > 64)
+	sha1(key, key_len, k0);
+    else
+	memcpy(k0, key, key_len);
+
+    for (int i = 0; i < 64; i++)
+	pad[i] = k0[i] ^ 0x36;
+    memcpy(k.istate, sha1_iv, sizeof(k.istate));
+    sha1_blocks(k.istate, pad, 1);
+    for (int i = 0; i < 64; i++)
+	pad[i] = k0[i] ^ 0x5C;
+    memcpy(k.ostate, sha1_iv, sizeof(k.ostate));
+    sha1_blocks(k.ostate, pad, 1);
+}
+
+void
+hmac_sha1(const HMACSHA1Key &k, const uint8_t *data, uint32_t len, uint8_t *digest)
+{
+    uint32_t state[5];
+    uint8_t inner[20];
+    memcpy(state, k.istate, sizeof(state));
+    sha1_finish(state, data, len, 64, inner);
+    memcpy(state, k.ostate, sizeof(state));
+    sha1_finish(state, inner, sizeof(inner), 64, digest);
+}
+
+
+/*
+ * AES-128-GCM
+ */
+
+#if CLICK_ESPCRYPTO_AESNI
+
+static inline __m128i
+bswap128(__m128i x)
+{
+    return _mm_shuffle_epi8(x, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+					    8, 9, 10, 11, 12, 13, 14, 15));
+}
+
+static inline __m128i
+aes128_expand(__m128i key, __m128i assist)
+{
+    assist = _mm_shuffle_epi32(assist, 0xFF);
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    return _mm_xor_si128(key, assist);
+}
+
+/* Accumulate the carry-less product of a and b, unreduced. */
+static inline void
+clmul_acc(__m128i a, __m128i b, __m128i &lo, __m128i &mid, __m128i &hi)
+{
+    lo = _mm_xor_si128(lo, _mm_clmulepi64_si128(a, b, 0x00));
+    hi = _mm_xor_si128(hi, _mm_clmulepi64_si128(a, b, 0x11));
+    mid = _mm_xor_si128(mid, _mm_clmulepi64_si128(a, b, 0x10));
+    mid = _mm_xor_si128(mid, _mm_clmulepi64_si128(a, b, 0x01));
+}
+
+/* Reduce an accumulated product modulo the GCM polynomial, in the
+   byte-reflected representation (the bits are shifted left by one first). */
+static inline __m128i
+gf_reduce(__m128i lo, __m128i mid, __m128i hi)
+{
+    __m128i t3 = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+    __m128i t6 = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+    __m128i t7 = _mm_srli_epi32(t3, 31);
+    __m128i t8 = _mm_srli_epi32(t6, 31);
+    t3 = _mm_slli_epi32(t3, 1);
+    t6 = _mm_slli_epi32(t6, 1);
+    __m128i t9 = _mm_srli_si128(t7, 12);
+    t8 = _mm_slli_si128(t8, 4);
+    t7 = _mm_slli_si128(t7, 4);
+    t3 = _mm_or_si128(t3, t7);
+    t6 = _mm_or_si128(t6, t8);
+    t6 = _mm_or_si128(t6, t9);
+
+    t7 = _mm_slli_epi32(t3, 31);
+    t8 = _mm_slli_epi32(t3, 30);
+    t9 = _mm_slli_epi32(t3, 25);
+    t7 = _mm_xor_si128(t7, t8);
+    t7 = _mm_xor_si128(t7, t9);
+    t8 = _mm_srli_si128(t7, 4);
+    t7 = _mm_slli_si128(t7, 12);
+    t3 = _mm_xor_si128(t3, t7);
+
+    __m128i t2 = _mm_srli_epi32(t3, 1);
+    __m128i t4 = _mm_srli_epi32(t3, 2);
+    __m128i t5 = _mm_srli_epi32(t3, 7);
+    t2 = _mm_xor_si128(t2, t4);
+    t2 = _mm_xor_si128(t2, t5);
+    t2 = _mm_xor_si128(t2, t8);
+    t3 = _mm_xor_si128(t3, t2);
+    return _mm_xor_si128(t6, t3);
+}
+
+static inline __m128i
+gf_mul(__m128i a, __m128i b)
+{
+    __m128i lo = _mm_setzero_si128(), mid = lo, hi = lo;
+    clmul_acc(a, b, lo, mid, hi);
+    return gf_reduce(lo, mid, hi);
+}
+
+/* Fold @a len bytes into the hash @a y, padding the last block with zeros. */
+static inline __m128i
+ghash_update(__m128i y, const __m128i *hpow, const uint8_t *p, uint32_t len)
+{
+    while (len >= 64) {
+	__m128i lo = _mm_setzero_si128(), mid = lo, hi = lo;
+	clmul_acc(_mm_xor_si128(y, bswap128(_mm_loadu_si128((const __m128i *) p))),
+		  hpow[3], lo, mid, hi);
+	clmul_acc(bswap128(_mm_loadu_si128((const __m128i *) (p + 16))), hpow[2], lo, mid, hi);
+	clmul_acc(bswap128(_mm_loadu_si128((const __m128i *) (p + 32))), hpow[1], lo, mid, hi);
+	clmul_acc(bswap128(_mm_loadu_si128((const __m128i *) (p + 48))), hpow[0], lo, mid, hi);
+	y = gf_reduce(lo, mid, hi);
+	p += 64;
+	len -= 64;
+    }
+    while (len >= 16) {
+	y = gf_mul(_mm_xor_si128(y, bswap128(_mm_loadu_si128((const __m128i *) p))), hpow[0]);
+	p += 16;
+	len -= 16;
+    }
+    if (len) {
+	uint8_t last[16];
+	memcpy(last, p, len);
+	memset(last + len, 0, 16 - len);
+	y = gf_mul(_mm_xor_si128(y, bswap128(_mm_loadu_si128((const __m128i *) last))), hpow[0]);
+    }
+    return y;
+}
+
+/* Store GHASH(aad, data) in the job's tag. */
+static inline void
+gcm_ghash(GCMJob &j)
+{
+    const __m128i *hpow = reinterpret_cast<const __m128i *>(j.key->hpow);
+    __m128i y = _mm_setzero_si128();
+    y = ghash_update(y, hpow, j.aad, j.aad_len);
+    y = ghash_update(y, hpow, j.data, j.len);
+    __m128i lens = _mm_set_epi64x((uint64_t) j.aad_len * 8, (uint64_t) j.len * 8);
+    y = gf_mul(_mm_xor_si128(y, lens), hpow[0]);
+    _mm_storeu_si128((__m128i *) j.tag, bswap128(y));
+}
+
+namespace {
+enum { gcm_lanes = 8 };
+
+/* Counter-mode blocks of any jobs, encrypted eight at a time. */
+struct CTRBlocks {
+    __m128i blk[gcm_lanes];
+    const __m128i *rk[gcm_lanes];
+    uint8_t *dst[gcm_lanes];
+    uint32_t len[gcm_lanes];
+    int n;
+
+    CTRBlocks() : n(0) {
+    }
+
+    inline void add(__m128i ctr, const __m128i *k, uint8_t *d, uint32_t l) {
+	blk[n] = ctr;
+	rk[n] = k;
+	dst[n] = d;
+	len[n] = l;
+	if (++n == gcm_lanes)
+	    flush();
+    }
+
+    inline void flush() {
+	for (int i = 0; i < n; i++)
+	    blk[i] = _mm_xor_si128(blk[i], rk[i][0]);
+	for (int r = 1; r < 10; r++)
+	    for (int i = 0; i < n; i++)
+		blk[i] = _mm_aesenc_si128(blk[i], rk[i][r]);
+	for (int i = 0; i < n; i++) {
+	    blk[i] = _mm_aesenclast_si128(blk[i], rk[i][10]);
+	    if (likely(len[i] == 16))
+		_mm_storeu_si128((__m128i *) dst[i],
+				 _mm_xor_si128(blk[i], _mm_loadu_si128((const __m128i *) dst[i])));
+	    else {
+		uint8_t ks[16];
+		_mm_storeu_si128((__m128i *) ks, blk[i]);
+		for (uint32_t b = 0; b < len[i]; b++)
+		    dst[i][b] ^= ks[b];
+	    }
+	}
+	n = 0;
+    }
+};
+}
+
+/* XOR the keystream into every job's data, and store E(K, J0) in ekj0. */
+static void
+gcm_ctr(GCMJob *jobs, int n)
+{
+    CTRBlocks cb;
+    for (int i = 0; i < n; i++) {
+	GCMJob &j = jobs[i];
+	const __m128i *rk = reinterpret_cast<const __m128i *>(j.key->rk);
+	uint8_t nonce[16];
+	memcpy(nonce, j.nonce, 12);
+	memset(nonce + 12, 0, 4);
+	__m128i base = _mm_loadu_si128((const __m128i *) nonce);
+	memset(j.ekj0, 0, sizeof(j.ekj0));
+	cb.add(_mm_insert_epi32(base, __builtin_bswap32(1), 3), rk, j.ekj0, 16);
+	uint32_t ctr = 2;
+	for (uint32_t off = 0; off < j.len; off += 16, ctr++)
+	    cb.add(_mm_insert_epi32(base, __builtin_bswap32(ctr), 3), rk,
+		   j.data + off, j.len - off < 16 ? j.len - off : 16);
+    }
+    cb.flush();
+}
+
+static inline void
+gcm_finish_tag(GCMJob &j)
+{
+    _mm_storeu_si128((__m128i *) j.tag,
+		     _mm_xor_si128(_mm_loadu_si128((const __m128i *) j.tag),
+				   _mm_loadu_si128((const __m128i *) j.ekj0)));
+}
+
+#endif
+
+bool
+have_aesgcm()
+{
+#if CLICK_ESPCRYPTO_AESNI
+    static int have = -1;
+    if (have < 0)
+	have = __builtin_cpu_supports("aes") && __builtin_cpu_supports("pclmul")
+	    && __builtin_cpu_supports("sse4.1");
+    return have;
+#else
+    return false;
+#endif
+}
+
+void
+gcm_init(GCMKey &k, const uint8_t *key)
+{
+#if CLICK_ESPCRYPTO_AESNI
+    __m128i *rk = reinterpret_cast<__m128i *>(k.rk);
+    rk[0] = _mm_loadu_si128((const __m128i *) key);
+    rk[1] = aes128_expand(rk[0], _mm_aeskeygenassist_si128(rk[0], 0x01));
+    rk[2] = aes128_expand(rk[1], _mm_aeskeygenassist_si128(rk[1], 0x02));
+    rk[3] = aes128_expand(rk[2], _mm_aeskeygenassist_si128(rk[2], 0x04));
+    rk[4] = aes128_expand(rk[3], _mm_aeskeygenassist_si128(rk[3], 0x08));
+    rk[5] = aes128_expand(rk[4], _mm_aeskeygenassist_si128(rk[4], 0x10));
+    rk[6] = aes128_expand(rk[5], _mm_aeskeygenassist_si128(rk[5], 0x20));
+    rk[7] = aes128_expand(rk[6], _mm_aeskeygenassist_si128(rk[6], 0x40));
+    rk[8] = aes128_expand(rk[7], _mm_aeskeygenassist_si128(rk[7], 0x80));
+    rk[9] = aes128_expand(rk[8], _mm_aeskeygenassist_si128(rk[8], 0x1B));
+    rk[10] = aes128_expand(rk[9], _mm_aeskeygenassist_si128(rk[9], 0x36));
+
+    __m128i h = _mm_xor_si128(_mm_setzero_si128(), rk[0]);
+    for (int r = 1; r < 10; r++)
+	h = _mm_aesenc_si128(h, rk[r]);
+    h = _mm_aesenclast_si128(h, rk[10]);
+
+    __m128i *hpow = reinterpret_cast<__m128i *>(k.hpow);
+    hpow[0] = bswap128(h);
+    for (int i = 1; i < 4; i++)
+	hpow[i] = gf_mul(hpow[i - 1], hpow[0]);
+#else
+    (void) k, (void) key;
+    assert(0 && "AES-GCM not compiled in");
+#endif
+}
+
+void
+gcm_encrypt(GCMJob *jobs, int n)
+{
+#if CLICK_ESPCRYPTO_AESNI
+    gcm_ctr(jobs, n);
+    for (int i = 0; i < n; i++) {
+	gcm_ghash(jobs[i]);
+	gcm_finish_tag(jobs[i]);
+    }
+#else
+    (void) jobs, (void) n;
+    assert(0 && "AES-GCM not compiled in");
+#endif
+}
+
+void
+gcm_decrypt(GCMJob *jobs, int n)
+{
+#if CLICK_ESPCRYPTO_AESNI
+    for (int i = 0; i < n; i++)
+	gcm_ghash(jobs[i]);
+    gcm_ctr(jobs, n);
+    for (int i = 0; i < n; i++)
+	gcm_finish_tag(jobs[i]);
+#else
+    (void) jobs, (void) n;
+    assert(0 && "AES-GCM not compiled in");
+#endif
+}
+
+}
+
+CLICK_ENDDECLS
+ELEMENT_PROVIDES(IPsecCrypto)
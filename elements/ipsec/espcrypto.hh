@@ -0,0 +1,79 @@
+#ifndef CLICK_ESPCRYPTO_HH
+#define CLICK_ESPCRYPTO_HH
+#include <click/glue.hh>
+CLICK_DECLS
+
+/*
+ * espcrypto.hh -- batched ESP cipher kernels using AES-NI, PCLMULQDQ and the
+ * SHA extensions
+ *
+ * AES-128-GCM (RFC 4106) encrypts and authenticates a batch of jobs at
+ * once. The counter blocks of all jobs are fed to AES eight at a time, so
+ * the latency of the AES rounds is hidden even for packets of a few blocks.
+ * GHASH folds four blocks per reduction. Jobs may use different keys.
+ *
+ * HMAC-SHA1 keeps the inner and outer states of a key, so a digest costs
+ * the blocks of the message plus two. It uses the SHA extensions when the
+ * CPU has them, and portable code otherwise.
+ */
+
+#if defined(__AES__) && defined(__PCLMUL__) && defined(__SSSE3__) && defined(__SSE4_1__)
+# define CLICK_ESPCRYPTO_AESNI 1
+#endif
+#if defined(__SHA__) && defined(__SSSE3__) && defined(__SSE4_1__)
+# define CLICK_ESPCRYPTO_SHANI 1
+#endif
+
+namespace ESPCrypto {
+
+/** @brief Return true iff AES-128-GCM is available: compiled in, and
+ * supported by this CPU. */
+bool have_aesgcm();
+/** @brief Return true iff HMAC-SHA1 uses the SHA extensions. */
+bool have_shani();
+
+struct GCMKey {
+    uint8_t rk[11][16];		// AES-128 encryption schedule
+    uint8_t hpow[4][16];	// H^1..H^4, byte-reflected
+} CLICK_ALIGNED(16);
+
+struct GCMJob {
+    const GCMKey *key;
+    uint8_t nonce[12];		// salt and explicit IV
+    const uint8_t *aad;
+    uint32_t aad_len;
+    uint8_t *data;		// en/decrypted in place
+    uint32_t len;
+    uint8_t tag[16];		// computed tag
+    uint8_t ekj0[16];		// internal
+};
+
+/** @brief Expand the 16-byte @a key. Requires have_aesgcm(). */
+void gcm_init(GCMKey &k, const uint8_t *key);
+
+/** @brief Encrypt the data of @a n jobs and compute their tags. */
+void gcm_encrypt(GCMJob *jobs, int n);
+
+/** @brief Compute the tags of @a n jobs, then decrypt their data.
+ *
+ * The caller compares each job's tag with the received one. */
+void gcm_decrypt(GCMJob *jobs, int n);
+
+struct HMACSHA1Key {
+    uint32_t istate[5];
+    uint32_t ostate[5];
+};
+
+/** @brief Precompute the inner and outer states of an HMAC-SHA1 key. */
+void hmac_sha1_init(HMACSHA1Key &k, const uint8_t *key, uint32_t key_len);
+
+/** @brief Compute the 20-byte HMAC-SHA1 of @a len bytes at @a data. */
+void hmac_sha1(const HMACSHA1Key &k, const uint8_t *data, uint32_t len, uint8_t *digest);
+
+/** @brief Compute the 20-byte SHA1 of @a len bytes at @a data. */
+void sha1(const uint8_t *data, uint32_t len, uint8_t *digest);
+
+}
+
+CLICK_ENDDECLS
+#endif
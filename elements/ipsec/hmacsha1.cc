@@ -34,7 +34,6 @@
 CLICK_DECLS
 
 #define SHA_DIGEST_LEN 20
-#define KEY_SIZE 16
 
 IPsecAuthHMACSHA1::IPsecAuthHMACSHA1()
 {
@@ -58,17 +57,27 @@ IPsecAuthHMACSHA1::initialize(ErrorHandler *)
 }
 
 
+inline const ESPCrypto::HMACSHA1Key &
+IPsecAuthHMACSHA1::key(const SADataTuple *sa)
+{
+  KeyCache::Entry &e = _keys->e[((uintptr_t) sa >> 4) % KeyCache::SIZE];
+  if (unlikely(e.sa != sa || memcmp(e.key, sa->Authentication_key, KEY_SIZE) != 0)) {
+    e.sa = sa;
+    memcpy(e.key, sa->Authentication_key, KEY_SIZE);
+    ESPCrypto::hmac_sha1_init(e.hmac, e.key, KEY_SIZE);
+  }
+  return e.hmac;
+}
+
 Packet *
 IPsecAuthHMACSHA1::simple_action(Packet *p)
 {
   SADataTuple * sa_data=(SADataTuple *)IPSEC_SA_DATA_REFERENCE_ANNO(p);
-  unsigned int len;
-  // compute HMAC
-  len = SHA_DIGEST_LEN;
+  const ESPCrypto::HMACSHA1Key &k = key(sa_data);
 
   if (_op == COMPUTE_AUTH) {
     unsigned char digest [SHA_DIGEST_LEN];
-    HMAC(sa_data->Authentication_key,KEY_SIZE,(u_char*) p->data(),p->length(),digest,&len);
+    ESPCrypto::hmac_sha1(k, p->data(), p->length(), digest);
     WritablePacket *q = p->put(12);
     u_char *ah = ((u_char*)q->data())+q->length()-12;
     memmove(ah, digest, 12);
@@ -78,7 +87,7 @@ IPsecAuthHMACSHA1::simple_action(Packet *p)
     const u_char *ah = p->data()+p->length()-12;
     unsigned char digest [SHA_DIGEST_LEN];
 
-    HMAC(sa_data->Authentication_key,KEY_SIZE,(u_char*) p->data(),p->length()-12,digest,&len);
+    ESPCrypto::hmac_sha1(k, p->data(), p->length() - 12, digest);
     if (memcmp(ah, digest, 12)) {
       if (_drops == 0)
 	click_chatter("Invalid SHA1 authentication digest");
@@ -112,5 +121,6 @@ IPsecAuthHMACSHA1::add_handlers()
 #include "hmac.cc"
 
 CLICK_ENDDECLS
+ELEMENT_REQUIRES(IPsecCrypto)
 EXPORT_ELEMENT(IPsecAuthHMACSHA1)
 ELEMENT_MT_SAFE(IPsecAuthHMACSHA1)
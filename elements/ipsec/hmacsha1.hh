@@ -3,6 +3,9 @@
 #include <click/element.hh>
 #include <click/atomic.hh>
 #include <click/glue.hh>
+#include <click/sync.hh>
+#include "espcrypto.hh"
+#include "sadatatuple.hh"
 CLICK_DECLS
 
 /*
@@ -16,6 +19,9 @@ CLICK_DECLS
  * per RFC 2404, 2406. If first argument is 1, verify SHA1 digest and remove
  * authentication bits.
  *
+ * The inner and outer HMAC states of recently used keys are cached per
+ * thread, and SHA1 uses the SHA extensions when the CPU has them.
+ *
  * =a IPsecESPEncap, IPsecDES
  */
 
@@ -38,8 +44,23 @@ public:
 
 private:
 
+  struct KeyCache {
+    enum { SIZE = 8 };
+    struct Entry {
+      const SADataTuple *sa;
+      uint8_t key[KEY_SIZE];
+      ESPCrypto::HMACSHA1Key hmac;
+    } e[SIZE];
+    KeyCache() {
+      memset(e, 0, sizeof(e));
+    }
+  };
+
   int _op;
   atomic_uint32_t _drops;
+  per_thread<KeyCache> _keys;
+
+  inline const ESPCrypto::HMACSHA1Key &key(const SADataTuple *sa);
 
   enum { COMPUTE_AUTH = 0, VERIFY_AUTH = 1 };
 };
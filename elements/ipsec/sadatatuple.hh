@@ -5,6 +5,7 @@
 #include <click/etheraddress.hh>
 #include <click/bighashmap.hh>
 #include <click/glue.hh>
+#include <click/atomic.hh>
 CLICK_DECLS
 
 /*
@@ -80,6 +81,10 @@ class SADataTuple {
     uint8_t  ooowin;	/* out-of-order window size */
     uint32_t bitmap;	/* Support out-of-order receive support */
     uint32_t lastseq;	/* in host order */
+    /* AES-GCM needs a unique IV per packet: a counter, starting from a
+       random high word so that a restart with static keys does not reuse
+       the low values */
+    atomic_uint64_t gcm_iv;
 
     SADataTuple() {
 	memset(this, 0, sizeof(*this));
@@ -94,6 +99,7 @@ class SADataTuple {
 		ooowin = o_oowin;
 	        bitmap=0;
 		lastseq=cur_rpl=counter;
+		gcm_iv = (uint64_t) click_random() << 32;
      }
 
      operator bool() const
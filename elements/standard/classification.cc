@@ -23,6 +23,18 @@
 #include <click/error.hh>
 #include <click/straccum.hh>
 #include <click/standard/alignmentinfo.hh>
+#if CLICK_USERLEVEL && defined(__x86_64__) && defined(ALLOW_MMAP)
+# include <sys/mman.h>
+# include <unistd.h>
+# define CLICK_CLASSIFICATION_JIT 1
+# ifndef MAP_ANONYMOUS
+#  define MAP_ANONYMOUS MAP_ANON
+# endif
+#endif
+#if HAVE_AVX2 && !defined(CLICK_TOOL)
+# include <immintrin.h>
+# define CLICK_CLASSIFICATION_SIMD 1
+#endif
 CLICK_DECLS
 namespace Classification {
 namespace Wordwise {
@@ -1138,6 +1150,251 @@ CompressedProgram::unparse() const
 }
 
 
+//
+// JIT COMPILATION
+//
+
+#if CLICK_CLASSIFICATION_JIT
+namespace {
+
+// x86-64 emitter for JITProgram::compile. The generated function follows
+// the System V calling convention: base0, base1 and base2 arrive in %rdi,
+// %rsi and %rdx, the output port is returned in %eax, and no other register
+// or stack memory is touched.
+class JITAssembler { public:
+
+    enum {
+	BINARY_MIN = 8		// use a comparison tree from this many values
+    };
+
+    JITAssembler(const CompressedProgram &zprog, int offset1, int offset2)
+	: _z(zprog.begin()), _nz(zprog.end() - zprog.begin()),
+	  _offset1(offset1), _offset2(offset2), _label(_nz, -1) {
+    }
+
+    void assemble();
+    const Vector<unsigned char> &code() const {
+	return _code;
+    }
+
+  private:
+
+    struct Fixup {
+	int pos;		// position of the rel32 in _code
+	int32_t target;		// > 0: word of zprog, <= 0: negated output
+    };
+
+    const uint32_t *_z;
+    int _nz;
+    int _offset1;
+    int _offset2;
+    Vector<int> _label;		// code position of each zprog test
+    Vector<Fixup> _fixups;
+    Vector<unsigned char> _code;
+
+    void byte(unsigned char c) {
+	_code.push_back(c);
+    }
+    void word(uint32_t x) {
+	for (int i = 0; i < 4; ++i, x >>= 8)
+	    _code.push_back(x & 0xFF);
+    }
+    void patch(int pos, uint32_t x) {
+	for (int i = 0; i < 4; ++i, x >>= 8)
+	    _code[pos + i] = x & 0xFF;
+    }
+    int jcc(unsigned char cc) {	// 0x84 je, 0x82 jb
+	byte(0x0F);
+	byte(cc);
+	word(0);
+	return _code.size() - 4;
+    }
+    void jump(unsigned char cc, int32_t target) {
+	Fixup f;
+	if (cc) {
+	    f.pos = jcc(cc);
+	} else {
+	    byte(0xE9);
+	    word(0);
+	    f.pos = _code.size() - 4;
+	}
+	f.target = target;
+	_fixups.push_back(f);
+    }
+    void compare(const uint32_t *v, int lo, int hi, int32_t yes, int32_t no, bool fallthrough);
+
+};
+
+void
+JITAssembler::compare(const uint32_t *v, int lo, int hi,
+		      int32_t yes, int32_t no, bool fallthrough)
+{
+    if (hi - lo < BINARY_MIN) {
+	for (int k = lo; k < hi; ++k) {
+	    if (v[k] == 0) {
+		byte(0x85);	// test %eax, %eax
+		byte(0xC0);
+	    } else {
+		byte(0x3D);	// cmp $v, %eax
+		word(v[k]);
+	    }
+	    jump(0x84, yes);
+	}
+	if (!fallthrough)
+	    jump(0, no);
+    } else {
+	int mid = lo + (hi - lo) / 2;
+	byte(0x3D);
+	word(v[mid]);
+	jump(0x84, yes);
+	int below = jcc(0x82);
+	compare(v, mid + 1, hi, yes, no, false);
+	patch(below, _code.size() - (below + 4));
+	compare(v, lo, mid, yes, no, fallthrough);
+    }
+}
+
+void
+JITAssembler::assemble()
+{
+    Vector<uint32_t> values;
+    for (int i = 0; i < _nz; ) {
+	int nval = _z[i] >> 17;
+	int next = i + 4 + nval;
+	int offset = (uint16_t) _z[i];
+	int32_t no = _z[i + 1], yes = _z[i + 2];
+	uint32_t mask = _z[i + 3];
+	if (no > 0)
+	    no += i;
+	if (yes > 0)
+	    yes += i;
+	_label[i] = _code.size();
+
+	// mov disp32(%base), %eax
+	byte(0x8B);
+	if (offset >= _offset2) {
+	    byte(0x82);
+	    word(offset - _offset2);
+	} else if (offset >= _offset1) {
+	    byte(0x86);
+	    word(offset - _offset1);
+	} else {
+	    byte(0x87);
+	    word(offset);
+	}
+	if (mask != 0xFFFFFFFFU) {
+	    byte(0x25);		// and $mask, %eax
+	    word(mask);
+	}
+
+	values.clear();
+	for (int k = i + 4; k < next; ++k)
+	    values.push_back(_z[k]);
+	click_qsort(values.begin(), values.size());
+	int nv = 0;
+	for (int k = 0; k < values.size(); ++k)
+	    if (k == 0 || values[k] != values[nv - 1])
+		values[nv++] = values[k];
+	compare(values.begin(), 0, nv, yes, no, no == next && next < _nz);
+	i = next;
+    }
+
+    // One "mov $output, %eax; ret" per output
+    Vector<int32_t> outputs;
+    Vector<int> output_label;
+    for (Fixup *f = _fixups.begin(); f != _fixups.end(); ++f) {
+	int dst;
+	if (f->target > 0) {
+	    assert(f->target < _nz && _label[f->target] >= 0);
+	    dst = _label[f->target];
+	} else {
+	    int k = 0;
+	    while (k < outputs.size() && outputs[k] != f->target)
+		++k;
+	    if (k == outputs.size()) {
+		outputs.push_back(f->target);
+		output_label.push_back(_code.size());
+		byte(0xB8);
+		word(-f->target);
+		byte(0xC3);
+	    }
+	    dst = output_label[k];
+	}
+	patch(f->pos, dst - (f->pos + 4));
+    }
+}
+
+}
+#endif
+
+bool
+JITProgram::available()
+{
+#if CLICK_CLASSIFICATION_JIT
+    return true;
+#else
+    return false;
+#endif
+}
+
+int
+JITProgram::compile(const CompressedProgram &zprog, int offset1, int offset2)
+{
+    clear();
+#if CLICK_CLASSIFICATION_JIT
+    if (zprog.begin() == zprog.end())
+	return -1;
+    JITAssembler a(zprog, offset1, offset2);
+    a.assemble();
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t size = (a.code().size() + page - 1) & ~(page - 1);
+    void *mem = mmap(0, size, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+	return -1;
+    memcpy(mem, a.code().begin(), a.code().size());
+    if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+	munmap(mem, size);
+	return -1;
+    }
+    _code = mem;
+    _code_size = size;
+    _f = reinterpret_cast<function_type>(mem);
+    return 0;
+#else
+    (void) zprog, (void) offset1, (void) offset2;
+    return -1;
+#endif
+}
+
+void
+JITProgram::clear()
+{
+#if CLICK_CLASSIFICATION_JIT
+    if (_code)
+	munmap(_code, _code_size);
+#endif
+    _f = 0;
+    _code = 0;
+    _code_size = 0;
+}
+
+void
+JITProgram::swap(JITProgram &x)
+{
+    function_type f = _f;
+    void *code = _code;
+    size_t code_size = _code_size;
+    _f = x._f;
+    _code = x._code;
+    _code_size = x._code_size;
+    x._f = f;
+    x._code = code;
+    x._code_size = code_size;
+}
+
+
 //
 // RUNNING
 //
@@ -1176,6 +1433,104 @@ Program::length_checked_match(const Packet *p)
     return -pos;
 }
 
+void
+Program::match_batch(Packet * const *p, int n, int *out)
+{
+    if (_output_everything >= 0) {
+	for (int i = 0; i < n; ++i)
+	    out[i] = _output_everything;
+	return;
+    }
+#if CLICK_CLASSIFICATION_SIMD
+    // An Insn is five 32-bit words: offset, mask, value, j[0], j[1]
+    static_assert(sizeof(Insn) == 20, "unexpected Insn layout");
+    const int *insn = reinterpret_cast<const int *>(_insn.begin());
+    enum { lanes = match_batch_lanes };
+
+    // Lane state; pos and active are also kept in vectors during the walk
+    int32_t pos[lanes] __attribute__((aligned(32)));
+    int32_t active[lanes] __attribute__((aligned(32)));
+    int64_t addr[lanes] __attribute__((aligned(32)));
+    int index[lanes];
+    int next = 0;
+
+    for (int l = 0; l < lanes; ++l) {
+	pos[l] = active[l] = 0;
+	addr[l] = 0;
+    }
+
+    // Start the next long enough packet in lane l
+#define CLASSIFICATION_REFILL(l)					\
+    while (next < n) {							\
+	const Packet *q = p[next++];					\
+	if (q->length() < _safe_length) {				\
+	    out[next - 1] = length_checked_match(q);			\
+	    continue;							\
+	}								\
+	addr[l] = (intptr_t) (q->data() - _align_offset);		\
+	index[l] = next - 1;						\
+	pos[l] = 0;							\
+	active[l] = -1;							\
+	break;								\
+    }
+
+    for (int l = 0; l < lanes; ++l) {
+	CLASSIFICATION_REFILL(l);
+    }
+
+    const __m256i five = _mm256_set1_epi32(5);
+    const __m256i low16 = _mm256_set1_epi32(0xFFFF);
+    const __m256i one = _mm256_set1_epi32(1);
+    __m256i vpos = _mm256_load_si256((const __m256i *) pos);
+    __m256i vact = _mm256_load_si256((const __m256i *) active);
+    while (!_mm256_testz_si256(vact, vact)) {
+	__m256i w = _mm256_mullo_epi32(vpos, five);
+	__m256i zero = _mm256_setzero_si256();
+	__m256i off = _mm256_mask_i32gather_epi32(zero, insn, w, vact, 4);
+	__m256i mask = _mm256_mask_i32gather_epi32(zero, insn + 1, w, vact, 4);
+	__m256i value = _mm256_mask_i32gather_epi32(zero, insn + 2, w, vact, 4);
+	__m256i no = _mm256_mask_i32gather_epi32(zero, insn + 3, w, vact, 4);
+	__m256i yes = _mm256_mask_i32gather_epi32(zero, insn + 4, w, vact, 4);
+
+	// Packet words, with 64-bit addresses
+	off = _mm256_and_si256(off, low16);
+	__m256i a0 = _mm256_add_epi64(_mm256_load_si256((const __m256i *) addr),
+				      _mm256_cvtepi32_epi64(_mm256_castsi256_si128(off)));
+	__m256i a1 = _mm256_add_epi64(_mm256_load_si256((const __m256i *) (addr + 4)),
+				      _mm256_cvtepi32_epi64(_mm256_extracti128_si256(off, 1)));
+	__m128i d0 = _mm256_mask_i64gather_epi32(_mm_setzero_si128(), (const int *) 0, a0,
+						 _mm256_castsi256_si128(vact), 1);
+	__m128i d1 = _mm256_mask_i64gather_epi32(_mm_setzero_si128(), (const int *) 0, a1,
+						 _mm256_extracti128_si256(vact, 1), 1);
+	__m256i data = _mm256_inserti128_si256(_mm256_castsi128_si256(d0), d1, 1);
+
+	__m256i eq = _mm256_cmpeq_epi32(_mm256_and_si256(data, mask), value);
+	__m256i npos = _mm256_blendv_epi8(no, yes, eq);
+	vpos = _mm256_blendv_epi8(vpos, npos, vact);
+	__m256i done = _mm256_and_si256(vact, _mm256_cmpgt_epi32(one, npos));
+	vact = _mm256_andnot_si256(done, vact);
+
+	int done_lanes = _mm256_movemask_ps(_mm256_castsi256_ps(done));
+	if (done_lanes) {
+	    _mm256_store_si256((__m256i *) pos, vpos);
+	    _mm256_store_si256((__m256i *) active, vact);
+	    do {
+		int l = __builtin_ctz(done_lanes);
+		done_lanes &= done_lanes - 1;
+		out[index[l]] = -pos[l];
+		CLASSIFICATION_REFILL(l);
+	    } while (done_lanes);
+	    vpos = _mm256_load_si256((const __m256i *) pos);
+	    vact = _mm256_load_si256((const __m256i *) active);
+	}
+    }
+#undef CLASSIFICATION_REFILL
+#else
+    for (int i = 0; i < n; ++i)
+	out[i] = match(p[i]);
+#endif
+}
+
 }}
 CLICK_ENDDECLS
 ELEMENT_PROVIDES(Classification)
@@ -215,6 +215,17 @@ class Program { public:
 
     int match(const Packet *p);
 
+    /** @brief Classify @a n packets, storing the output of @a p[i] in
+     * @a out[i].
+     *
+     * With AVX2, the program is walked for match_batch_lanes packets at
+     * once: each step gathers the current instruction and packet word of
+     * every lane, and a lane that reaches an output is refilled with the
+     * next packet. Packets shorter than safe_length() are matched one at a
+     * time. Without AVX2, this is a loop over match(). */
+    void match_batch(Packet * const *p, int n, int *out);
+    enum { match_batch_lanes = 8 };
+
     String unparse() const;
 
   private:
@@ -276,6 +287,71 @@ class CompressedProgram { public:
 };
 
 
+/** @brief Native code equivalent of a CompressedProgram.
+ *
+ * compile() translates each test of a CompressedProgram into a load, a mask,
+ * and compare-and-branch instructions; tests with many values become a
+ * binary tree of comparisons. The generated function only implements the
+ * common case: the caller must check that the packet is at least
+ * safe_length() long, and use the interpreter otherwise.
+ *
+ * The function takes up to three base pointers. A test reads offset O
+ * relative to base0, or relative to base1 (base2) if O is at least
+ * offset1 (offset2), after subtracting offset1 (offset2).
+ *
+ * Only x86-64 user-level builds have a JIT; elsewhere compile() fails and
+ * elements keep interpreting their program. */
+class JITProgram { public:
+
+    typedef int (*function_type)(const unsigned char *base0,
+				 const unsigned char *base1,
+				 const unsigned char *base2);
+
+    JITProgram()
+	: _f(0), _code(0), _code_size(0) {
+    }
+    ~JITProgram() {
+	clear();
+    }
+
+    static bool available();
+
+    /** @brief Compile @a zprog, replacing any previous code.
+     * @return 0 on success, -1 if the JIT is unavailable or failed */
+    int compile(const CompressedProgram &zprog,
+		int offset1 = offset_max, int offset2 = offset_max);
+    void clear();
+    /** @brief Exchange the code of *this and @a x.
+     *
+     * The function pointer is replaced with a single store, so a concurrent
+     * caller runs either the old or the new code. */
+    void swap(JITProgram &x);
+
+    bool compiled() const {
+	return _f;
+    }
+    size_t code_size() const {
+	return _code_size;
+    }
+
+    int match(const unsigned char *base0,
+	      const unsigned char *base1 = 0,
+	      const unsigned char *base2 = 0) const {
+	return _f(base0, base1, base2);
+    }
+
+  private:
+
+    function_type _f;
+    void *_code;
+    size_t _code_size;
+
+    JITProgram(const JITProgram &);
+    JITProgram &operator=(const JITProgram &);
+
+};
+
+
 class DominatorOptimizer { public:
 
     DominatorOptimizer(Program *p);
@@ -22,6 +22,7 @@
 #include "classifier.hh"
 #include <click/glue.hh>
 #include <click/error.hh>
+#include <click/args.hh>
 #include <click/confparse.hh>
 #include <click/straccum.hh>
 #if !HAVE_INDIFFERENT_ALIGNMENT
@@ -31,6 +32,7 @@
 CLICK_DECLS
 
 Classifier::Classifier()
+    : _jit(true), _simd(false)
 {
 }
 
@@ -222,6 +224,12 @@ Classifier::parse_program(Classification::Wordwise::Program &prog,
 int
 Classifier::configure(Vector<String> &conf, ErrorHandler *errh)
 {
+    if (Args(this, errh).bind(conf)
+	.read("JIT", _jit)
+	.read("SIMD", _simd)
+	.consume() < 0)
+	return -1;
+
     if (conf.size() != noutputs())
 	return errh->error("need %d arguments, one per output port", noutputs());
 
@@ -230,7 +238,17 @@ Classifier::configure(Vector<String> &conf, ErrorHandler *errh)
 
     if (!errh->nerrors()) {
 	prog.warn_unused_outputs(noutputs(), errh);
+	Classification::Wordwise::JITProgram jitprog;
+	if (_jit && prog.output_everything() < 0) {
+	    Classification::Wordwise::CompressedProgram zprog;
+	    zprog.compile(prog, false, 0);
+	    jitprog.compile(zprog);
+	}
 	_prog = prog;
+	// Pushing threads may still run the previous code: keep it until
+	// the next reconfiguration
+	_jitprog.swap(jitprog);
+	_jit_retired.swap(jitprog);
 	return 0;
     } else
 	return -1;
@@ -243,18 +261,65 @@ Classifier::program_string(Element *element, void *)
     return c->_prog.unparse();
 }
 
+String
+Classifier::jit_string(Element *element, void *)
+{
+    Classifier *c = static_cast<Classifier *>(element);
+    return String(c->_jitprog.compiled());
+}
+
 void
 Classifier::add_handlers()
 {
     add_read_handler("program", Classifier::program_string, 0, Handler::CALM);
+    add_read_handler("jit", Classifier::jit_string, 0);
 }
 
 #if HAVE_BATCH
+void
+Classifier::push_batch_simd(PacketBatch *batch)
+{
+    enum { chunk = 64 };
+    Packet *p[chunk];
+    int o[chunk];
+    int nb = noutputs() + 1;
+    PacketBatch *out[nb];
+    bzero(out, sizeof(PacketBatch *) * nb);
+
+    Packet *next = batch;
+    while (next) {
+	int n = 0;
+	for (; next && n < chunk; next = next->next())
+	    p[n++] = next;
+	_prog.match_batch(p, n, o);
+	for (int i = 0; i < n; ++i) {
+	    int port = (unsigned) o[i] < (unsigned) nb ? o[i] : nb - 1;
+	    if (out[port])
+		out[port]->append_packet(p[i]);
+	    else {
+		out[port] = PacketBatch::start_head(p[i]);
+		out[port]->set_tail(p[i]);
+		out[port]->set_count(1);
+	    }
+	}
+    }
+
+    for (int port = 0; port < nb; ++port)
+	if (out[port]) {
+	    out[port]->tail()->set_next(0);
+	    checked_output_push_batch(port, out[port]);
+	}
+}
+
 void
 Classifier::push_batch(int, PacketBatch * batch)
 {
+	if (_simd) {
+	    push_batch_simd(batch);
+	    return;
+	}
 	CLASSIFY_EACH_PACKET(	(noutputs() + 1),
-							_prog.match,
+							match,
 							batch,
 							checked_output_push_batch);
 
@@ -264,7 +329,7 @@ Classifier::push_batch(int, PacketBatch * batch)
 inline void
 Classifier::push(int, Packet *p)
 {
-    checked_output_push(_prog.match(p), p);
+    checked_output_push(match(p), p);
 }
 
 CLICK_ENDDECLS
@@ -38,6 +38,29 @@ CLICK_DECLS
  * could ever match a pattern. Usually, this is because an earlier pattern is
  * more general, or because your pattern is contradictory (`12/0806 12/0800').
  *
+ * Keyword arguments are:
+ *
+ * =over 8
+ *
+ * =item JIT
+ *
+ * Boolean. If true, compile the program into native code when the
+ * configuration is read, and at every live reconfiguration. Packets shorter
+ * than the program's safe length are still interpreted. Only available on
+ * x86-64 user-level builds; elsewhere Classifier silently interprets its
+ * program. Default is true.
+ *
+ * =item SIMD
+ *
+ * Boolean. If true, batches are classified by walking the program for
+ * several packets at once with AVX2 gathers, instead of one packet at a
+ * time. This pays off for long programs with unpredictable branches;
+ * short programs run faster one packet at a time. Takes precedence over JIT
+ * for batches. Without AVX2, packets are classified one at a time. Default
+ * is false.
+ *
+ * =back
+ *
  * =n
  *
  * The IPClassifier and IPFilter elements have a friendlier syntax if you are
@@ -56,6 +79,9 @@ CLICK_DECLS
  * ARP requests are sent to output 0, ARP replies are sent to
  * output 1, IP packets to output 2, and all others to output 3.
  *
+ * =h jit read-only
+ * Returns true if the program is compiled into native code.
+ *
  * =h program read-only
  * Returns a human-readable definition of the program the Classifier element
  * is using to classify packets. At each step in the program, four bytes
@@ -91,6 +117,10 @@ class Classifier : public BatchElement { public:
     void push_batch(int, PacketBatch *);
 #endif
     void push(int, Packet *);
+    inline int match(Packet *p);
+#if HAVE_BATCH
+    void push_batch_simd(PacketBatch *);
+#endif
 
     Classification::Wordwise::Program empty_program(ErrorHandler *errh) const;
     static void parse_program(Classification::Wordwise::Program &prog,
@@ -99,10 +129,23 @@ class Classifier : public BatchElement { public:
   protected:
 
     Classification::Wordwise::Program _prog;
+    bool _jit;
+    bool _simd;
+    Classification::Wordwise::JITProgram _jitprog;
+    Classification::Wordwise::JITProgram _jit_retired;
 
     static String program_string(Element *, void *);
+    static String jit_string(Element *, void *);
 
 };
 
+inline int
+Classifier::match(Packet *p)
+{
+    if (_jitprog.compiled() && p->length() >= _prog.safe_length())
+	return _jitprog.match(p->data() - _prog.align_offset());
+    return _prog.match(p);
+}
+
 CLICK_ENDDECLS
 #endif
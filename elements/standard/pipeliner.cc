@@ -14,6 +14,8 @@ CLICK_DECLS
 
 
 #define PS_MIN_THRESHOLD 2048
+// Ring entries taken at once by run_task
+#define PIPELINER_BULK 32
 //#define PS_BATCH_SIZE 1024
 
 Pipeliner::Pipeliner()
@@ -218,33 +220,39 @@ Pipeliner::run_task(Task* t)
         PacketBatch* out = NULL;
 #endif
         int n = 0;
-        while (!s.is_empty() && n < _burst) {
+        while (n < _burst) {
+            Packet* objs[PIPELINER_BULK];
+            unsigned k = s.extract_bulk(objs, _burst - n < PIPELINER_BULK ? _burst - n : PIPELINER_BULK);
+            if (k == 0)
+                break;
+            for (unsigned j = 0; j < k; j++) {
 #if HAVE_BATCH
-            PacketBatch* b = static_cast<PacketBatch*>(s.extract());
-            if (unlikely(!receives_batch)) {
-                if (out == NULL) {
-                    b->set_tail(b);
-                    b->set_count(1);
-                    out = b;
+                PacketBatch* b = static_cast<PacketBatch*>(objs[j]);
+                if (unlikely(!receives_batch)) {
+                    if (out == NULL) {
+                        b->set_tail(b);
+                        b->set_count(1);
+                        out = b;
+                    } else {
+                        out->append_packet(b);
+                    }
+                    n+=1;
                 } else {
-                    out->append_packet(b);
+                    n+=b->length();
+                    if (out == NULL) {
+                        out = b;
+                    } else {
+                        out->append_batch(b);
+                    }
                 }
-                n+=1;
-            } else {
-                n+=b->length();
-                if (out == NULL) {
-                    out = b;
-                } else {
-                    out->append_batch(b);
-                }
-            }
-            //WritablePacket::pool_hint(b->count(),storage.get_mapping(i));
+                //WritablePacket::pool_hint(b->count(),storage.get_mapping(i));
 #else
-            Packet* p = s.extract();
-            output(0).push(p);
-            //WritablePacket::pool_hint(HINT_THRESHOLD,storage.get_mapping(i));
-            r = true;
+                output(0).push(objs[j]);
+                n++;
+                //WritablePacket::pool_hint(HINT_THRESHOLD,storage.get_mapping(i));
+                r = true;
 #endif
+            }
         }
         if (s.count() > _highwater)
             _highwater = s.count();
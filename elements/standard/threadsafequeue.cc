@@ -102,15 +102,87 @@ ThreadSafeQueue::pull(int)
 }
 
 #if HAVE_BATCH
-void ThreadSafeQueue::push_batch(int port, PacketBatch* batch) {
-    FOR_EACH_PACKET_SAFE(batch,p) {
-        ThreadSafeQueue::push(port,p);
+void ThreadSafeQueue::push_batch(int, PacketBatch* batch) {
+    // Reserve room for as much of the batch as possible with a single
+    // increment of _xtail, then publish it with a single update of _tail
+    Storage::index_type h, t, nt;
+    int n;
+    do {
+	t = tail();
+	h = head();
+	n = capacity() - size(h, t);
+	if (n > (int) batch->count())
+	    n = batch->count();
+	nt = t + n;
+	if (nt > (Storage::index_type) capacity())
+	    nt -= capacity() + 1;
+    } while (_xtail.compare_swap(t, nt) != t);
+
+    Packet* p = batch->first();
+    for (int i = 0; i < n; i++) {
+	Packet* next = p->next();
+	_q[t] = p;
+	t = next_i(t);
+	p = next;
+    }
+
+    if (n > 0) {
+	set_tail(nt);
+
+	int s = size(h, nt);
+	if (s > _highwater_length)
+	    _highwater_length = s;
+
+	_empty_note.wake();
+
+	if (s == capacity()) {
+	    _full_note.sleep();
+	    if (size() < capacity())
+		_full_note.wake();
+	}
+    }
+
+    while (p) {
+	Packet* next = p->next();
+	p->set_next(0);
+	push_failure(p);
+	p = next;
     }
 }
 
-PacketBatch* ThreadSafeQueue::pull_batch(int port, unsigned max) {
-    PacketBatch* batch;
-    MAKE_BATCH(ThreadSafeQueue::pull(port),batch,max);
+PacketBatch* ThreadSafeQueue::pull_batch(int, unsigned max) {
+    // Reserve up to max packets with a single increment of _xhead
+    Storage::index_type h, t, nh;
+    unsigned n;
+    if (max == 0)
+	max = BATCH_MAX_PULL;
+    do {
+	h = head();
+	t = tail();
+	n = size(h, t);
+	if (n > max)
+	    n = max;
+	nh = h + n;
+	if (nh > (Storage::index_type) capacity())
+	    nh -= capacity() + 1;
+    } while (_xhead.compare_swap(h, nh) != h);
+
+    if (n == 0)
+	return static_cast<PacketBatch*>(pull_failure());
+
+    PacketBatch* batch = PacketBatch::start_head(_q[h]);
+    Packet* last = batch;
+    for (unsigned i = 1; i < n; i++) {
+	h = next_i(h);
+	Packet* p = _q[h];
+	last->set_next(p);
+	last = p;
+    }
+    batch->make_tail(last, n);
+
+    set_head(nh);
+    _sleepiness = 0;
+    _full_note.wake();
     return batch;
 }
 #endif
@@ -23,6 +23,7 @@
 #include "checktcpheader.hh"
 #include <clicknet/ip.h>
 #include <clicknet/tcp.h>
+#include <click/ipchecksum.hh>
 #include <click/glue.hh>
 #include <click/args.hh>
 #include <click/error.hh>
@@ -53,16 +54,19 @@ CheckTCPHeader::configure(Vector<String> &conf, ErrorHandler *errh)
     bool verbose = false;
     bool details = false;
     bool checksum = true;
+    bool rx_checksum = false;
 
     if (Args(conf, this, errh)
         .read("VERBOSE", verbose)
         .read("DETAILS", details)
         .read("CHECKSUM", checksum)
+        .read("RX_CHECKSUM", rx_checksum)
         .complete() < 0)
         return -1;
 
     _verbose = verbose;
     _checksum = checksum;
+    _rx_checksum = rx_checksum;
     if (details) {
         _reason_drops = new atomic_uint64_t[NREASONS];
         memset(_reason_drops, 0, NREASONS * sizeof(atomic_uint64_t));
@@ -111,8 +115,13 @@ CheckTCPHeader::simple_action(Packet *p)
     }
 
     if (_checksum) {
-        unsigned csum = click_in_cksum((unsigned char *)tcph, len);
-        if (click_in_cksum_pseudohdr(csum, iph, len) != 0) {
+        int status = _rx_checksum ? IPChecksum::rx_l4_status(p, iph) : IPChecksum::UNKNOWN;
+        if (status == IPChecksum::UNKNOWN) {
+            unsigned csum = click_in_cksum((unsigned char *)tcph, len);
+            if (click_in_cksum_pseudohdr(csum, iph, len) != 0)
+                status = IPChecksum::BAD;
+        }
+        if (status == IPChecksum::BAD) {
             return drop(BAD_CHECKSUM, p);
         }
     }
@@ -23,6 +23,7 @@
 #include "checkudpheader.hh"
 #include <clicknet/ip.h>
 #include <clicknet/udp.h>
+#include <click/ipchecksum.hh>
 #include <click/glue.hh>
 #include <click/args.hh>
 #include <click/error.hh>
@@ -52,16 +53,19 @@ CheckUDPHeader::configure(Vector<String> &conf, ErrorHandler *errh)
     bool verbose = false;
     bool details = false;
     bool checksum = true;
+    bool rx_checksum = false;
 
     if (Args(conf, this, errh)
         .read("VERBOSE", verbose)
         .read("DETAILS", details)
         .read("CHECKSUM", checksum)
+        .read("RX_CHECKSUM", rx_checksum)
         .complete() < 0)
         return -1;
 
     _verbose = verbose;
     _checksum = checksum;
+    _rx_checksum = rx_checksum;
     if (details) {
         _reason_drops = new atomic_uint64_t[NREASONS];
         memset(_reason_drops, 0, NREASONS * sizeof(atomic_uint64_t));
@@ -110,8 +114,13 @@ CheckUDPHeader::simple_action(Packet *p)
 
     if (udph->uh_sum != 0) {
         if (_checksum) {
-            unsigned csum = click_in_cksum((unsigned char *)udph, len);
-            if (click_in_cksum_pseudohdr(csum, iph, len) != 0) {
+            int status = _rx_checksum ? IPChecksum::rx_l4_status(p, iph) : IPChecksum::UNKNOWN;
+            if (status == IPChecksum::UNKNOWN) {
+                unsigned csum = click_in_cksum((unsigned char *)udph, len);
+                if (click_in_cksum_pseudohdr(csum, iph, len) != 0)
+                    status = IPChecksum::BAD;
+            }
+            if (status == IPChecksum::BAD) {
                 return drop(BAD_CHECKSUM, p);
             }
         }
@@ -41,6 +41,14 @@ C<drop_details> handler. False by default.
 
 Boolean. If it is true, the UDP checksum is validated. True by default.
 
+=item RX_CHECKSUM
+
+Boolean. If it is true, trust the verdict of the NIC on the UDP checksum of
+packets received by a FromDPDKDevice with RX_CHECKSUM, instead of computing
+it. The verdict is only used while the IP header is where the NIC found it,
+but it is about the packet as received: only set RX_CHECKSUM if no element
+between the device and CheckUDPHeader modifies the packet. False by default.
+
 =back
 
 =h count read-only
@@ -76,6 +84,7 @@ class CheckUDPHeader : public SimpleElement<CheckUDPHeader> {
     private:
         bool _verbose : 1;
         bool _checksum : 1;
+        bool _rx_checksum : 1;
         atomic_uint64_t _count;
         atomic_uint64_t _drops;
         atomic_uint64_t *_reason_drops;
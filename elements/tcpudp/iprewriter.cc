@@ -150,23 +150,38 @@ IPRewriter::process(int port, Packet *p_in)
         click_chatter("[%s] [Core %d]: UDP Map is NULL", class_name(), click_current_cpu_id());
     }
     //No lock access because we are the only writer
-    IPRewriterEntry *m = map->get(flowid);
+    int mapid = (iph->ip_p == IP_PROTO_TCP ?
+        0 : IPRewriterInput::mapid_iprewriter_udp);
+    int shard;
+    IPRewriterEntry *m = lookup_flow(flowid, iph->ip_p, *map, mapid, shard);
 
     if (!m) {			// create new mapping
 	IPRewriterInput &is = _input_specs.unchecked_at(port);
 	IPFlowID rewritten_flowid = IPFlowID::uninitialized_t();
-	int result = is.rewrite_flowid(flowid, rewritten_flowid, p, iph->ip_p == IP_PROTO_TCP ?
-             0 : IPRewriterInput::mapid_iprewriter_udp);
+	int result = is.rewrite_flowid(flowid, rewritten_flowid, p, mapid);
 	if (result == rw_addmap)
 	    m = IPRewriter::add_flow(iph->ip_p, flowid, rewritten_flowid, port);
-	if (!m) {
+	if (!m)
 	    return result;
-	} else if (_annos & 2)
+	shard = lock_new_flow();
+	if (_annos & 2)
 	    m->flow()->set_reply_anno(p->anno_u8(_annos >> 2));
     }
 
-    click_jiffies_t now_j = click_jiffies();
     IPRewriterFlow *mf = m->flow();
+    if (unlikely(remote_shard(shard))) {
+	if (iph->ip_p == IP_PROTO_TCP)
+	    static_cast<TCPFlow *>(mf)->apply(p, m->direction(), _annos);
+	else
+	    static_cast<UDPFlow *>(mf)->apply(p, m->direction(), _annos);
+	if (_set_aggregate)
+	    SET_AGGREGATE_ANNO(p,mf->agg());
+	int output = m->output();
+	release_flow(m, shard);
+	return output;
+    }
+
+    click_jiffies_t now_j = click_jiffies();
     if (iph->ip_p == IP_PROTO_TCP) {
 	TCPFlow *tcpmf = static_cast<TCPFlow *>(mf);
 	tcpmf->apply(p, m->direction(), _annos);
@@ -186,7 +201,9 @@ IPRewriter::process(int port, Packet *p_in)
         SET_AGGREGATE_ANNO(p,mf->agg());
     }
 
-    return m->output();
+    int output = m->output();
+    release_flow(m, shard);
+    return output;
 }
 
 void
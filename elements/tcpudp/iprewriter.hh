@@ -164,6 +164,16 @@ Set the maximum number of mappings this rewriter can hold to I<capacity>.
 I<Capacity> can either be an integer or the name of another rewriter-like
 element, in which case this element will share the other element's capacity.
 
+=item SHARDED
+
+Boolean. If true, each thread keeps the flows it creates in its own table
+and allocates ports from its own slice of every pattern's range, so threads
+never contend on a shared table. A packet of a flow created by another
+thread, such as a reply arriving on another queue, is rewritten using that
+thread's table, found through a directory hashed by flow. Each thread's
+flows are updated under a per-thread lock, uncontended unless another thread
+uses them. Replies must be handled by this element. Default is false.
+
 =item DST_ANNO
 
 Boolean. If true, then set the destination IP address annotation on passing
@@ -186,6 +196,11 @@ IPRewriter is full.
 Returns the number of flows in the flow set.  This is generally the same as
 'table_size', but can be more when several rewriters share a flow set.
 
+=h remote_hits r
+
+With SHARDED, returns the number of packets rewritten using the table of
+another thread.
+
 =h capacity rw
 
 Return or set the capacity of the flow set.  The returned value is two
@@ -237,6 +252,11 @@ class IPRewriter : public TCPRewriter { public:
 	else
 	    return 0;
     }
+    HashContainer<IPRewriterEntry> *get_shard_map(int mapid, unsigned shard) {
+	if (mapid == IPRewriterInput::mapid_iprewriter_udp)
+	    return &_state.get_value_for_thread(shard)._udp_map;
+	return TCPRewriter::get_shard_map(mapid, shard);
+    }
     IPRewriterEntry *add_flow(int ip_p, const IPFlowID &flowid,
 			      const IPFlowID &rewritten_flowid, int input);
     void destroy_flow(IPRewriterFlow *flow);
@@ -331,7 +331,10 @@ TCPRewriter::process(int port, Packet *p_in)
     }
 
     IPFlowID flowid(p);
-    IPRewriterEntry *m = _map[click_current_cpu_id()].get(flowid);
+    int shard;
+    IPRewriterEntry *m = lookup_flow(flowid, IP_PROTO_TCP,
+				     _map[click_current_cpu_id()],
+				     IPRewriterInput::mapid_default, shard);
 
     if (!m) {			// create new mapping
 	IPRewriterInput &is = _input_specs.unchecked_at(port);
@@ -344,7 +347,9 @@ TCPRewriter::process(int port, Packet *p_in)
 
 	if (!m) {
 	    return result;
-	} else if (_annos & 2) {
+	}
+	shard = lock_new_flow();
+	if (_annos & 2) {
 	    m->flow()->set_reply_anno(p->anno_u8(_annos >> 2));
         }
     }
@@ -352,13 +357,21 @@ TCPRewriter::process(int port, Packet *p_in)
     TCPFlow *mf = static_cast<TCPFlow *>(m->flow());
     mf->apply(p, m->direction(), _annos);
 
+    if (unlikely(remote_shard(shard))) {
+	int output = m->output();
+	release_flow(m, shard);
+	return output;
+    }
+
     click_jiffies_t now_j = click_jiffies();
     if (_timeouts[click_current_cpu_id()][1])
 	mf->change_expiry(_heap[click_current_cpu_id()], true, now_j + _timeouts[click_current_cpu_id()][1]);
     else
 	mf->change_expiry(_heap[click_current_cpu_id()], false, now_j + tcp_flow_timeout(mf));
 
-    return m->output();
+    int output = m->output();
+    release_flow(m, shard);
+    return output;
 }
 
 void
@@ -388,10 +401,12 @@ TCPRewriter::tcp_mappings_handler(Element *e, void *)
     TCPRewriter *rw = (TCPRewriter *)e;
     click_jiffies_t now = click_jiffies();
     StringAccum sa;
-    for (Map::iterator iter = rw->_map[click_current_cpu_id()].begin(); iter.live(); ++iter) {
-	TCPFlow *f = static_cast<TCPFlow *>(iter->flow());
-	f->unparse(sa, iter->direction(), now);
-	sa << '\n';
+    for (unsigned i = 0; i < rw->_mem_units_no; i++) {
+	for (Map::iterator iter = rw->_map[i].begin(); iter.live(); ++iter) {
+	    TCPFlow *f = static_cast<TCPFlow *>(iter->flow());
+	    f->unparse(sa, iter->direction(), now);
+	    sa << '\n';
+	}
     }
     return sa.take_string();
 }
@@ -68,6 +68,16 @@ Set the maximum number of mappings this rewriter can hold to I<capacity>.
 I<Capacity> can either be an integer or the name of another rewriter-like
 element, in which case this element will share the other element's capacity.
 
+=item SHARDED
+
+Boolean. If true, each thread keeps the flows it creates in its own table
+and allocates ports from its own slice of every pattern's range, so threads
+never contend on a shared table. A packet of a flow created by another
+thread, such as a reply arriving on another queue, is rewritten using that
+thread's table, found through a directory hashed by flow. Each thread's
+flows are updated under a per-thread lock, uncontended unless another thread
+uses them. Replies must be handled by this element. Default is false.
+
 =item DST_ANNO
 
 Boolean. If true, then set the destination IP address annotation on passing
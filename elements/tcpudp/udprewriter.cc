@@ -165,7 +165,10 @@ UDPRewriter::process(int port, Packet *p_in)
     }
 
     IPFlowID flowid(p);
-    IPRewriterEntry *m = _map[click_current_cpu_id()].get(flowid);
+    int shard;
+    IPRewriterEntry *m = lookup_flow(flowid, ip_p,
+				     _map[click_current_cpu_id()],
+				     IPRewriterInput::mapid_default, shard);
 
     if (!m) {			// create new mapping
         IPRewriterInput &is = _input_specs.unchecked_at(port);
@@ -178,7 +181,9 @@ UDPRewriter::process(int port, Packet *p_in)
 
         if (!m) {
             return result;
-        } else if (_annos & 2) {
+        }
+        shard = lock_new_flow();
+        if (_annos & 2) {
             m->flow()->set_reply_anno(p->anno_u8(_annos >> 2));
         }
     }
@@ -186,13 +191,21 @@ UDPRewriter::process(int port, Packet *p_in)
     UDPFlow *mf = static_cast<UDPFlow *>(m->flow());
     mf->apply(p, m->direction(), _annos);
 
+    if (unlikely(remote_shard(shard))) {
+	int output = m->output();
+	release_flow(m, shard);
+	return output;
+    }
+
     click_jiffies_t now_j = click_jiffies();
     if (_timeouts[click_current_cpu_id()][1])
 	mf->change_expiry(_heap[click_current_cpu_id()], true, now_j + _timeouts[click_current_cpu_id()][1]);
     else
 	mf->change_expiry(_heap[click_current_cpu_id()], false, now_j + udp_flow_timeout(mf));
 
-    return m->output();
+    int output = m->output();
+    release_flow(m, shard);
+    return output;
 }
 
 void
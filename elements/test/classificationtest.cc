@@ -0,0 +1,116 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * classificationtest.{cc,hh} -- regression test and benchmark element for
+ * Classifier programs
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "classificationtest.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/timestamp.hh>
+#include "elements/standard/classifier.hh"
+CLICK_DECLS
+
+ClassificationTest::ClassificationTest()
+    : _n(4096), _length(64), _bench(0)
+{
+}
+
+int
+ClassificationTest::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    if (Args(this, errh).bind(conf)
+	.read("N", _n)
+	.read("LENGTH", _length)
+	.read("BENCH", _bench)
+	.consume() < 0)
+	return -1;
+    if (_n <= 0 || _length < 42)
+	return errh->error("N must be positive and LENGTH at least 42");
+    _patterns = conf;
+    return 0;
+}
+
+#define CHECK(x) if (!(x)) { errh->error("%s:%d: test `%s' failed", __FILE__, __LINE__, #x); goto out; }
+
+int
+ClassificationTest::initialize(ErrorHandler *errh)
+{
+    using Classification::Wordwise::Program;
+    static const unsigned char header[] = {
+	0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 2, 0x08, 0x00,
+	0x45, 0, 0, 50, 0, 0, 0, 0, 64, 6, 0, 0, 10, 0, 0, 1, 10, 0, 0, 2,
+	0x04, 0x00, 0x00, 0x50
+    };
+    static const uint8_t protos[] = { 1, 6, 17, 6 };
+
+    Program prog(0);
+    Vector<String> conf(_patterns);
+    Classifier::parse_program(prog, conf, errh);
+    if (errh->nerrors())
+	return -1;
+
+    Vector<Packet *> p(_n, 0);
+    Vector<int> out(_n, -1);
+    int r = -1;
+    for (int i = 0; i < _n; ++i) {
+	WritablePacket *q = Packet::make(_length);
+	memset(q->data(), 0, _length);
+	memcpy(q->data(), header, sizeof(header));
+	q->data()[23] = protos[click_random(0, 3)];
+	q->data()[27] = click_random(0, 127);
+	q->data()[28] = click_random(0, 3);
+	q->data()[29] = click_random(0, 255);
+	p[i] = q;
+    }
+
+    // Batches of every size up to 3 full sets of lanes
+    for (int i = 0, n = 1; i < _n; i += n, n = n % (3 * Program::match_batch_lanes) + 1)
+	prog.match_batch(p.begin() + i, n < _n - i ? n : _n - i, out.begin() + i);
+    for (int i = 0; i < _n; ++i)
+	CHECK(out[i] == prog.match(p[i]));
+
+    errh->message("All tests pass!");
+
+    if (_bench) {
+	enum { batch = 32 };
+	int sum = 0;
+	Timestamp t0 = Timestamp::now_steady();
+	for (int round = 0; round < _bench; ++round)
+	    for (int i = 0; i < _n; ++i)
+		sum += prog.match(p[i]);
+	Timestamp t1 = Timestamp::now_steady();
+	for (int round = 0; round < _bench; ++round)
+	    for (int i = 0; i < _n; i += batch) {
+		int n = _n - i < batch ? _n - i : batch;
+		prog.match_batch(p.begin() + i, n, out.begin() + i);
+		sum -= out[i];
+	    }
+	Timestamp t2 = Timestamp::now_steady();
+	double npackets = (double) _n * _bench;
+	errh->message("scalar %.2f Mpps, batch %.2f Mpps (%d)",
+		      npackets / (t1 - t0).doubleval() / 1e6,
+		      npackets / (t2 - t1).doubleval() / 1e6, sum & 1);
+    }
+    r = 0;
+
+  out:
+    for (int i = 0; i < _n; ++i)
+	p[i]->kill();
+    return r;
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel Classifier)
+EXPORT_ELEMENT(ClassificationTest)
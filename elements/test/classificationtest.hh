@@ -0,0 +1,67 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_CLASSIFICATIONTEST_HH
+#define CLICK_CLASSIFICATIONTEST_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+ClassificationTest([I<keywords>,] PATTERN_1, ..., PATTERN_N)
+
+=s test
+
+runs regression tests and a benchmark for Classifier programs
+
+=d
+
+ClassificationTest compiles its Classifier patterns, then classifies N
+generated packets of LENGTH bytes with Program::match_batch() and with
+Program::match(), and checks that both agree. It does not route packets.
+
+The packets are IPv4/TCP frames whose IP protocol and source address are
+drawn at random, so that they take different paths through the program.
+
+Keyword arguments are:
+
+=over 8
+
+=item N
+
+Integer. Number of packets. Default is 4096.
+
+=item LENGTH
+
+Integer. Packet length. Default is 64.
+
+=item BENCH
+
+Integer. If nonzero, also classify the packets BENCH times with each method
+and report the classification rate of each. Default is 0.
+
+=back
+
+=a Classifier
+
+*/
+
+class ClassificationTest : public Element { public:
+
+    ClassificationTest() CLICK_COLD;
+
+    const char *class_name() const		{ return "ClassificationTest"; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+
+  private:
+
+    Vector<String> _patterns;
+    int _n;
+    int _length;
+    int _bench;
+
+};
+
+CLICK_ENDDECLS
+#endif
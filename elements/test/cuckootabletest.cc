@@ -0,0 +1,116 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * cuckootabletest.{cc,hh} -- regression test element for CuckooTable<K>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "cuckootabletest.hh"
+#include <click/cuckootable.hh>
+#include <click/error.hh>
+#include <click/ipflowid.hh>
+CLICK_DECLS
+
+CuckooTableTest::CuckooTableTest()
+{
+}
+
+#define CHECK(x) if (!(x)) return errh->error("%s:%d: test `%s' failed", __FILE__, __LINE__, #x);
+
+static IPFlowID
+make_flow(uint32_t i)
+{
+    return IPFlowID(IPAddress(htonl(0x0a000000 + i)), htons(i & 0xffff),
+                    IPAddress(htonl(0x0b000000 + (i >> 4))), htons(80));
+}
+
+int
+CuckooTableTest::initialize(ErrorHandler *errh)
+{
+    const uint32_t capacity = 4096;
+    CuckooTable<IPFlowID> table;
+    CHECK(table.initialize(capacity, 40) == 0);
+    CHECK(table.capacity() == capacity);
+    CHECK(table.count() == 0);
+    CHECK(table.stride() % CLICK_CACHE_LINE_SIZE == 0);
+
+    // Fill the table completely
+    Vector<int> pos(capacity, -1);
+    for (uint32_t i = 0; i < capacity; i++) {
+        bool is_new;
+        pos[i] = table.insert(make_flow(i), is_new);
+        CHECK(pos[i] >= 0);
+        CHECK(is_new);
+        *(uint32_t*)table.value(pos[i]) = i;
+    }
+    CHECK(table.count() == capacity);
+
+    // No room left
+    bool is_new;
+    CHECK(table.insert(make_flow(capacity), is_new) < 0);
+
+    // Inserting again returns the same position
+    CHECK(table.insert(make_flow(7), is_new) == pos[7]);
+    CHECK(!is_new);
+
+    // Positions do not change when keys are displaced
+    for (uint32_t i = 0; i < capacity; i++) {
+        CHECK(table.find(make_flow(i)) == pos[i]);
+        CHECK(*(uint32_t*)table.value(pos[i]) == i);
+        CHECK(table.key(pos[i]) == make_flow(i));
+    }
+    CHECK(table.find(make_flow(capacity + 1)) < 0);
+
+    // Bulk lookup, with some misses
+    IPFlowID flows[CuckooTable<IPFlowID>::BULK_MAX];
+    const IPFlowID* keys[CuckooTable<IPFlowID>::BULK_MAX];
+    int32_t ret[CuckooTable<IPFlowID>::BULK_MAX];
+    for (int i = 0; i < CuckooTable<IPFlowID>::BULK_MAX; i++) {
+        flows[i] = make_flow(i % 3 == 0 ? capacity + i : (i * 97) % capacity);
+        keys[i] = &flows[i];
+    }
+    table.find_bulk(keys, CuckooTable<IPFlowID>::BULK_MAX, ret);
+    for (int i = 0; i < CuckooTable<IPFlowID>::BULK_MAX; i++) {
+        if (i % 3 == 0) {
+            CHECK(ret[i] < 0);
+        } else {
+            CHECK(ret[i] == pos[(i * 97) % capacity]);
+        }
+    }
+
+    // Remove half of the keys
+    for (uint32_t i = 0; i < capacity; i += 2)
+        table.remove_position(pos[i]);
+    CHECK(table.count() == capacity / 2);
+    for (uint32_t i = 0; i < capacity; i++) {
+        if (i % 2) {
+            CHECK(table.find(make_flow(i)) == pos[i]);
+        } else {
+            CHECK(table.find(make_flow(i)) < 0);
+        }
+    }
+
+    // Freed positions are reused
+    for (uint32_t i = 0; i < capacity / 2; i++) {
+        int p = table.insert(make_flow(capacity + i), is_new);
+        CHECK(p >= 0);
+        CHECK(is_new);
+    }
+    CHECK(table.count() == capacity);
+    CHECK(table.insert(make_flow(2 * capacity), is_new) < 0);
+
+    errh->message("All tests pass!");
+    return 0;
+}
+
+EXPORT_ELEMENT(CuckooTableTest)
+CLICK_ENDDECLS
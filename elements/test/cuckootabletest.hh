@@ -0,0 +1,34 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_CUCKOOTABLETEST_HH
+#define CLICK_CUCKOOTABLETEST_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+CuckooTableTest()
+
+=s test
+
+runs regression tests for CuckooTable<K>
+
+=d
+
+CuckooTableTest runs CuckooTable regression tests at initialization time. It
+does not route packets.
+
+*/
+
+class CuckooTableTest : public Element { public:
+
+    CuckooTableTest() CLICK_COLD;
+
+    const char *class_name() const		{ return "CuckooTableTest"; }
+
+    int initialize(ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
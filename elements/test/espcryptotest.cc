@@ -0,0 +1,303 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * espcryptotest.{cc,hh} -- regression test and benchmark element for the
+ * ESP cipher kernels
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "espcryptotest.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/timestamp.hh>
+#include <click/vector.hh>
+#include "elements/ipsec/espcrypto.hh"
+#include "elements/ipsec/hmac.hh"
+CLICK_DECLS
+
+ESPCryptoTest::ESPCryptoTest()
+    : _length(64), _bench(0)
+{
+}
+
+int
+ESPCryptoTest::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    if (Args(conf, this, errh)
+	.read("LENGTH", _length)
+	.read("BENCH", _bench)
+	.complete() < 0)
+	return -1;
+    if (_length < 0 || _length > 9000)
+	return errh->error("LENGTH must be between 0 and 9000");
+    return 0;
+}
+
+#define CHECK(x) if (!(x)) return errh->error("%s:%d: test `%s' failed", __FILE__, __LINE__, #x);
+
+static Vector<uint8_t>
+unhex(const char *s)
+{
+    Vector<uint8_t> v;
+    for (; s[0] && s[1]; s += 2) {
+	int hi = s[0] <= '9' ? s[0] - '0' : (s[0] | 0x20) - 'a' + 10;
+	int lo = s[1] <= '9' ? s[1] - '0' : (s[1] | 0x20) - 'a' + 10;
+	v.push_back(hi * 16 + lo);
+    }
+    return v;
+}
+
+static bool
+same(const uint8_t *a, const Vector<uint8_t> &b)
+{
+    return memcmp(a, b.begin(), b.size()) == 0;
+}
+
+namespace {
+struct GCMVector {
+    const char *key, *iv, *aad, *pt, *ct, *tag;
+};
+}
+
+// Test cases 2, 3 and 4 of McGrew and Viega, "The Galois/Counter Mode of
+// Operation (GCM)".
+static const GCMVector gcm_vectors[] = {
+    { "00000000000000000000000000000000", "000000000000000000000000", "",
+      "00000000000000000000000000000000",
+      "0388dace60b6a392f328c2b971b2fe78",
+      "ab6e47d42cec13bdf53a67b21257bddf" },
+    { "feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888", "",
+      "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+      "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b391aafd255",
+      "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e"
+      "21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091473f5985",
+      "4d5c2af327cd64a62cf35abd2ba6fab4" },
+    { "feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888",
+      "feedfacedeadbeeffeedfacedeadbeefabaddad2",
+      "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+      "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39",
+      "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e"
+      "21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091",
+      "5bc94fbc3221a5db94fae95ae7121a47" }
+};
+
+int
+ESPCryptoTest::check_gcm(ErrorHandler *errh)
+{
+    using namespace ESPCrypto;
+    enum { nv = sizeof(gcm_vectors) / sizeof(gcm_vectors[0]) };
+    GCMKey keys[nv];
+    GCMJob jobs[nv];
+    Vector<uint8_t> aad[nv], data[nv];
+
+    // All vectors in one call, so that lanes mix keys and lengths
+    for (int i = 0; i < nv; i++) {
+	const GCMVector &v = gcm_vectors[i];
+	gcm_init(keys[i], unhex(v.key).begin());
+	aad[i] = unhex(v.aad);
+	data[i] = unhex(v.pt);
+	jobs[i].key = &keys[i];
+	memcpy(jobs[i].nonce, unhex(v.iv).begin(), 12);
+	jobs[i].aad = aad[i].begin();
+	jobs[i].aad_len = aad[i].size();
+	jobs[i].data = data[i].begin();
+	jobs[i].len = data[i].size();
+    }
+    gcm_encrypt(jobs, nv);
+    for (int i = 0; i < nv; i++) {
+	CHECK(same(jobs[i].data, unhex(gcm_vectors[i].ct)));
+	CHECK(same(jobs[i].tag, unhex(gcm_vectors[i].tag)));
+    }
+    gcm_decrypt(jobs, nv);
+    for (int i = 0; i < nv; i++) {
+	CHECK(same(jobs[i].data, unhex(gcm_vectors[i].pt)));
+	CHECK(same(jobs[i].tag, unhex(gcm_vectors[i].tag)));
+    }
+
+    // Many jobs at once give the same results as one job at a time
+    enum { n = 32 };
+    GCMKey rkeys[4];
+    for (int k = 0; k < 4; k++) {
+	uint8_t key[16];
+	for (int b = 0; b < 16; b++)
+	    key[b] = click_random(0, 255);
+	gcm_init(rkeys[k], key);
+    }
+    GCMJob a[n], b[n];
+    Vector<uint8_t> abuf[n], bbuf[n];
+    uint8_t hdr[8];
+    for (int b = 0; b < 8; b++)
+	hdr[b] = click_random(0, 255);
+    for (int i = 0; i < n; i++) {
+	int len = click_random(0, 300);
+	abuf[i].resize(len);
+	for (int j = 0; j < len; j++)
+	    abuf[i][j] = click_random(0, 255);
+	bbuf[i] = abuf[i];
+	a[i].key = &rkeys[click_random(0, 3)];
+	for (int j = 0; j < 12; j++)
+	    a[i].nonce[j] = click_random(0, 255);
+	a[i].aad = hdr;
+	a[i].aad_len = sizeof(hdr);
+	a[i].data = abuf[i].begin();
+	a[i].len = len;
+	b[i] = a[i];
+	b[i].data = bbuf[i].begin();
+    }
+    gcm_encrypt(a, n);
+    for (int i = 0; i < n; i++) {
+	gcm_encrypt(&b[i], 1);
+	CHECK(memcmp(a[i].data, b[i].data, a[i].len) == 0);
+	CHECK(memcmp(a[i].tag, b[i].tag, 16) == 0);
+    }
+    gcm_decrypt(a, n);
+    for (int i = 0; i < n; i++) {
+	CHECK(memcmp(a[i].tag, b[i].tag, 16) == 0);
+	gcm_decrypt(&b[i], 1);
+	CHECK(memcmp(a[i].data, b[i].data, a[i].len) == 0);
+    }
+    return 0;
+}
+
+int
+ESPCryptoTest::check_sha1(ErrorHandler *errh)
+{
+    using namespace ESPCrypto;
+    uint8_t digest[20];
+
+    // FIPS 180-2 examples
+    sha1((const uint8_t *) "abc", 3, digest);
+    CHECK(same(digest, unhex("a9993e364706816aba3e25717850c26c9cd0d89d")));
+    sha1((const uint8_t *) "", 0, digest);
+    CHECK(same(digest, unhex("da39a3ee5e6b4b0d3255bfef95601890afd80709")));
+    const char *s = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    sha1((const uint8_t *) s, strlen(s), digest);
+    CHECK(same(digest, unhex("84983e441c3bd26ebaae4aa1f95129e5e54670f1")));
+
+    // RFC 2202 test cases 1, 2 and 6
+    HMACSHA1Key k;
+    uint8_t key[80];
+    memset(key, 0x0b, 20);
+    hmac_sha1_init(k, key, 20);
+    hmac_sha1(k, (const uint8_t *) "Hi There", 8, digest);
+    CHECK(same(digest, unhex("b617318655057264e28bc0b6fb378c8ef146be00")));
+    hmac_sha1_init(k, (const uint8_t *) "Jefe", 4);
+    s = "what do ya want for nothing?";
+    hmac_sha1(k, (const uint8_t *) s, strlen(s), digest);
+    CHECK(same(digest, unhex("effcdf6ae5eb2fa2d27416d5f184df9c259a7c79")));
+    memset(key, 0xaa, 80);
+    hmac_sha1_init(k, key, 80);
+    s = "Test Using Larger Than Block-Size Key - Hash Key First";
+    hmac_sha1(k, (const uint8_t *) s, strlen(s), digest);
+    CHECK(same(digest, unhex("aa4ae5e15272d00e95705637ce8a3b55ed402112")));
+
+    // Agreement with the original implementation, across block boundaries
+    uint8_t data[300], old[20];
+    for (int j = 0; j < 300; j++)
+	data[j] = click_random(0, 255);
+    for (int len = 0; len < 300; len += 1 + len / 16) {
+	for (int b = 0; b < 16; b++)
+	    key[b] = click_random(0, 255);
+	hmac_sha1_init(k, key, 16);
+	hmac_sha1(k, data, len, digest);
+	unsigned olen = sizeof(old);
+	HMAC(key, 16, data, len, old, &olen);
+	CHECK(memcmp(digest, old, 20) == 0);
+    }
+    return 0;
+}
+
+void
+ESPCryptoTest::bench(ErrorHandler *errh)
+{
+    using namespace ESPCrypto;
+    enum { npayloads = 4096, batch = 32 };
+    Vector<uint8_t> buf(npayloads * (_length + 16), 0);
+    uint8_t key[16], hdr[8], digest[20];
+    for (int b = 0; b < 16; b++)
+	key[b] = b;
+    memset(hdr, 0, sizeof(hdr));
+    double nbytes = (double) npayloads * _bench * _length;
+    double npackets = (double) npayloads * _bench;
+
+    if (have_aesgcm()) {
+	GCMKey k;
+	gcm_init(k, key);
+	GCMJob jobs[batch];
+	for (int i = 0; i < batch; i++) {
+	    jobs[i].key = &k;
+	    memset(jobs[i].nonce, i, 12);
+	    jobs[i].aad = hdr;
+	    jobs[i].aad_len = sizeof(hdr);
+	    jobs[i].len = _length;
+	}
+	Timestamp t0 = Timestamp::now_steady();
+	for (int round = 0; round < _bench; ++round)
+	    for (int i = 0; i < npayloads; i += batch) {
+		for (int j = 0; j < batch; j++)
+		    jobs[j].data = buf.begin() + (i + j) * (_length + 16);
+		gcm_encrypt(jobs, batch);
+	    }
+	Timestamp t1 = Timestamp::now_steady();
+	for (int round = 0; round < _bench; ++round)
+	    for (int i = 0; i < npayloads; i++) {
+		jobs[0].data = buf.begin() + i * (_length + 16);
+		gcm_encrypt(jobs, 1);
+	    }
+	Timestamp t2 = Timestamp::now_steady();
+	errh->message("AES-GCM %d bytes: batch %.2f Mpps %.2f Gbps, single %.2f Mpps %.2f Gbps",
+		      _length,
+		      npackets / (t1 - t0).doubleval() / 1e6,
+		      nbytes * 8 / (t1 - t0).doubleval() / 1e9,
+		      npackets / (t2 - t1).doubleval() / 1e6,
+		      nbytes * 8 / (t2 - t1).doubleval() / 1e9);
+    }
+
+    HMACSHA1Key hk;
+    hmac_sha1_init(hk, key, 16);
+    Timestamp t0 = Timestamp::now_steady();
+    for (int round = 0; round < _bench; ++round)
+	for (int i = 0; i < npayloads; i++)
+	    hmac_sha1(hk, buf.begin() + i * (_length + 16), _length, digest);
+    Timestamp t1 = Timestamp::now_steady();
+    for (int round = 0; round < _bench; ++round)
+	for (int i = 0; i < npayloads; i++) {
+	    unsigned len = sizeof(digest);
+	    HMAC(key, 16, buf.begin() + i * (_length + 16), _length, digest, &len);
+	}
+    Timestamp t2 = Timestamp::now_steady();
+    errh->message("HMAC-SHA1 %d bytes: cached key%s %.2f Mpps, original %.2f Mpps",
+		  _length, have_shani() ? " with SHA-NI" : "",
+		  npackets / (t1 - t0).doubleval() / 1e6,
+		  npackets / (t2 - t1).doubleval() / 1e6);
+}
+
+int
+ESPCryptoTest::initialize(ErrorHandler *errh)
+{
+    if (ESPCrypto::have_aesgcm()) {
+	if (check_gcm(errh) < 0)
+	    return -1;
+    } else
+	errh->message("AES-GCM not available, skipping its tests");
+    if (check_sha1(errh) < 0)
+	return -1;
+    errh->message("All tests pass!");
+
+    if (_bench)
+	bench(errh);
+    return 0;
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel IPsecCrypto)
+EXPORT_ELEMENT(ESPCryptoTest)
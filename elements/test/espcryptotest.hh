@@ -0,0 +1,69 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_ESPCRYPTOTEST_HH
+#define CLICK_ESPCRYPTOTEST_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+ESPCryptoTest([I<keywords>])
+
+=s test
+
+runs regression tests and a benchmark for the ESP cipher kernels
+
+=d
+
+ESPCryptoTest checks the AES-128-GCM, SHA1 and HMAC-SHA1 kernels used by
+IPsecAESGCM and IPsecAuthHMACSHA1 against known answers from the GCM
+specification, FIPS 180 and RFC 2202. It then checks that encrypting many
+jobs of random lengths and keys at once gives the same results as
+encrypting them one by one, and that HMAC-SHA1 agrees with the original
+implementation. It does not route packets.
+
+The GCM tests are skipped, with a message, if AES-NI is not available.
+
+Keyword arguments are:
+
+=over 8
+
+=item LENGTH
+
+Integer. Payload length for the benchmark. Default is 64.
+
+=item BENCH
+
+Integer. If nonzero, encrypt BENCH times 4096 payloads of LENGTH bytes
+with AES-GCM, 32 jobs at a time and one at a time, and authenticate them
+with the cached-key HMAC-SHA1 and with the original HMAC, then report the
+rate of each. Default is 0.
+
+=back
+
+=a IPsecAESGCM, IPsecAuthHMACSHA1
+
+*/
+
+class ESPCryptoTest : public Element { public:
+
+    ESPCryptoTest() CLICK_COLD;
+
+    const char *class_name() const		{ return "ESPCryptoTest"; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+
+  private:
+
+    int _length;
+    int _bench;
+
+    int check_gcm(ErrorHandler *errh);
+    int check_sha1(ErrorHandler *errh);
+    void bench(ErrorHandler *errh);
+
+};
+
+CLICK_ENDDECLS
+#endif
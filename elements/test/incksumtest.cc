@@ -0,0 +1,247 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * incksumtest.{cc,hh} -- regression test and benchmark element for the
+ * Internet checksum kernels
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "incksumtest.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/timestamp.hh>
+#include <click/vector.hh>
+#include <click/ipchecksum.hh>
+CLICK_DECLS
+
+static const char * const kernels[] = { "avx2", "avx512", "neon", "generic" };
+
+InCksumTest::InCksumTest()
+    : _bench(0)
+{
+}
+
+int
+InCksumTest::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    return Args(conf, this, errh).read("BENCH", _bench).complete();
+}
+
+#define CHECK(x) if (!(x)) return errh->error("%s:%d: test `%s' failed", __FILE__, __LINE__, #x);
+
+// RFC 1071, one 16-bit word at a time
+static uint16_t
+reference_cksum(const unsigned char *addr, int len)
+{
+    uint32_t sum = 0;
+    for (; len > 1; addr += 2, len -= 2) {
+	uint16_t w;
+	memcpy(&w, addr, 2);
+	sum += w;
+    }
+    if (len == 1) {
+	uint16_t w = 0;
+	*(unsigned char *) &w = *addr;
+	sum += w;
+    }
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return ~sum & 0xFFFF;
+}
+
+int
+InCksumTest::check_kernels(ErrorHandler *errh)
+{
+    enum { MAXLEN = 9000 };
+    Vector<unsigned char> random(MAXLEN + 8, 0), ones(MAXLEN + 8, 0xFF);
+    for (int i = 0; i < random.size(); i++)
+	random[i] = click_random(0, 255);
+
+    const char *dflt = click_in_cksum_impl();
+    StringAccum tested;
+    for (const char * const *k = kernels; k != kernels + sizeof(kernels) / sizeof(kernels[0]); ++k) {
+	if (click_in_cksum_set_impl(*k) < 0)
+	    continue;
+	tested << (tested ? ", " : "") << *k;
+	for (int off = 0; off < 4; off += (off ? 2 : 1))
+	    for (int len = 0; len <= MAXLEN; len++) {
+		const unsigned char *r = random.begin() + off;
+		if (click_in_cksum(r, len) != reference_cksum(r, len)) {
+		    click_in_cksum_set_impl(dflt);
+		    return errh->error("%s: wrong checksum, offset %d, length %d", *k, off, len);
+		}
+	    }
+	// all ones stresses carries
+	for (int len = 0; len <= MAXLEN; len += 7) {
+	    const unsigned char *o = ones.begin() + (len & 3);
+	    CHECK(click_in_cksum(o, len) == reference_cksum(o, len));
+	}
+    }
+    click_in_cksum_set_impl(dflt);
+    CHECK(strcmp(click_in_cksum_impl(), dflt) == 0);
+    CHECK(click_in_cksum_set_impl("nonexistent") < 0);
+    errh->message("Checked kernels %s; default %s", tested.c_str(), dflt);
+    return 0;
+}
+
+static WritablePacket *
+make_packet(int proto, int payload)
+{
+    int tlen = (proto == IP_PROTO_TCP ? sizeof(click_tcp) : sizeof(click_udp));
+    int len = sizeof(click_ip) + tlen + payload;
+    WritablePacket *p = Packet::make(16, 0, len, 0);
+    if (!p)
+	return 0;
+    for (unsigned char *d = p->data(); d != p->end_data(); ++d)
+	*d = click_random(0, 255);
+    click_ip *iph = reinterpret_cast<click_ip *>(p->data());
+    iph->ip_v = 4;
+    iph->ip_hl = sizeof(click_ip) >> 2;
+    iph->ip_len = htons(len);
+    iph->ip_off = 0;
+    iph->ip_p = proto;
+    p->set_ip_header(iph, sizeof(click_ip));
+    if (proto == IP_PROTO_TCP)
+	p->tcp_header()->th_off = sizeof(click_tcp) >> 2;
+    else
+	p->udp_header()->uh_ulen = htons(tlen + payload);
+    return p;
+}
+
+int
+InCksumTest::check_packets(ErrorHandler *errh)
+{
+    for (int i = 0; i < 200; i++) {
+	int proto = (i & 1 ? IP_PROTO_UDP : IP_PROTO_TCP);
+	WritablePacket *p = make_packet(proto, click_random(0, 1500));
+	CHECK(p);
+	IPChecksum::set_ip(p);
+	IPChecksum::set_transport(p);
+	const click_ip *iph = p->ip_header();
+	CHECK(reference_cksum(p->data(), sizeof(click_ip)) == 0);
+	CHECK(IPChecksum::header_sum(iph, sizeof(click_ip)) == 0);
+	CHECK(IPChecksum::ip_ok(p));
+	CHECK(IPChecksum::transport_ok(p));
+	if (proto == IP_PROTO_UDP)
+	    CHECK(p->udp_header()->uh_sum != 0);
+	p->transport_header()[click_random(0, p->transport_length() - 1)] ^= 0x10;
+	CHECK(!IPChecksum::transport_ok(p));
+	// Without a NIC verdict, asking for one falls back to the data
+	CHECK(IPChecksum::rx_l4_status(p, iph) == IPChecksum::UNKNOWN);
+	CHECK(!IPChecksum::transport_ok(p, true));
+	p->data()[click_random(0, sizeof(click_ip) - 1)] ^= 0x01;
+	CHECK(IPChecksum::rx_ip_status(p, iph) == IPChecksum::UNKNOWN);
+	CHECK(!IPChecksum::ip_ok(p));
+	CHECK(!IPChecksum::ip_ok(p, true));
+	p->kill();
+    }
+
+#if HAVE_BATCH
+    PacketBatch *batch = 0;
+    for (int i = 0; i < 32; i++) {
+	WritablePacket *p = make_packet(IP_PROTO_UDP, i * 40);
+	CHECK(p);
+	if (batch)
+	    batch->append_packet(p);
+	else
+	    batch = PacketBatch::make_from_packet(p);
+    }
+    IPChecksum::set_ip(batch);
+    IPChecksum::set_transport(batch);
+    int i = 0, nbad = 0;
+    FOR_EACH_PACKET(batch, p) {
+	if (i % 3 == 0)
+	    static_cast<WritablePacket *>(p)->ip_header()->ip_ttl ^= 1;
+	if (i % 4 == 0)
+	    static_cast<WritablePacket *>(p)->udp_header()->uh_sport ^= 1;
+	++i;
+    }
+    batch = IPChecksum::check_ip(batch, [&nbad](Packet *p) { ++nbad; p->kill(); });
+    CHECK(nbad == 11 && batch && batch->count() == 21);
+    nbad = 0;
+    batch = IPChecksum::check_transport(batch, [&nbad](Packet *p) { ++nbad; p->kill(); });
+    CHECK(nbad == 5 && batch && batch->count() == 16);
+    batch->kill();
+#endif
+    return 0;
+}
+
+void
+InCksumTest::bench(ErrorHandler *errh)
+{
+    static const int lengths[] = { 20, 64, 256, 1500, 9000 };
+    enum { BUFSIZE = 1 << 20 };
+    Vector<unsigned char> buf(BUFSIZE + 9000, 0);
+    for (int i = 0; i < buf.size(); i++)
+	buf[i] = click_random(0, 255);
+
+    const char *dflt = click_in_cksum_impl();
+    uint32_t sink = 0;
+    for (const char * const *k = kernels; k != kernels + sizeof(kernels) / sizeof(kernels[0]); ++k) {
+	if (click_in_cksum_set_impl(*k) < 0)
+	    continue;
+	StringAccum sa;
+	sa << *k << ':';
+	for (const int *l = lengths; l != lengths + sizeof(lengths) / sizeof(lengths[0]); ++l) {
+	    int n = BUFSIZE / *l;
+	    Timestamp t0 = Timestamp::now_steady();
+	    for (int round = 0; round < _bench; ++round)
+		for (int i = 0; i < n; i++)
+		    sink += click_in_cksum(buf.begin() + i * *l, *l);
+	    double t = (Timestamp::now_steady() - t0).doubleval();
+	    sa.snprintf(64, " %dB %.1f Gbps", *l, (double) n * *l * _bench * 8 / t / 1e9);
+	}
+	errh->message("%s", sa.c_str());
+    }
+    click_in_cksum_set_impl(dflt);
+
+#if HAVE_BATCH
+    PacketBatch *batch = 0;
+    for (int i = 0; i < 32; i++) {
+	WritablePacket *p = make_packet(IP_PROTO_UDP, 64 - sizeof(click_ip) - sizeof(click_udp));
+	if (batch)
+	    batch->append_packet(p);
+	else
+	    batch = PacketBatch::make_from_packet(p);
+    }
+    int rounds = _bench * 16384;
+    Timestamp t0 = Timestamp::now_steady();
+    for (int round = 0; round < rounds; ++round) {
+	IPChecksum::set_ip(batch);
+	IPChecksum::set_transport(batch);
+    }
+    double t = (Timestamp::now_steady() - t0).doubleval();
+    sink += batch->first()->ip_header()->ip_sum;
+    batch->kill();
+    errh->message("IPChecksum batch of 32 64B UDP packets: %.2f Mpps",
+		  (double) rounds * 32 / t / 1e6);
+#endif
+    if (sink == 0x12345678)
+	errh->message("%u", sink);
+}
+
+int
+InCksumTest::initialize(ErrorHandler *errh)
+{
+    if (check_kernels(errh) < 0 || check_packets(errh) < 0)
+	return -1;
+    errh->message("All tests pass!");
+
+    if (_bench)
+	bench(errh);
+    return 0;
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel)
+EXPORT_ELEMENT(InCksumTest)
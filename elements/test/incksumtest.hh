@@ -0,0 +1,59 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_INCKSUMTEST_HH
+#define CLICK_INCKSUMTEST_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+InCksumTest([I<keywords>])
+
+=s test
+
+runs regression tests and a benchmark for the Internet checksum kernels
+
+=d
+
+InCksumTest checks every click_in_cksum() kernel this CPU supports against
+a plain 16-bit reference sum, for every length from 0 to 9000 bytes at
+several alignments, and checks the IPChecksum helpers on generated TCP and
+UDP packets. It does not route packets.
+
+Keyword arguments are:
+
+=over 8
+
+=item BENCH
+
+Integer. If nonzero, checksum BENCH times 1 MB of payloads of 20, 64, 256,
+1500 and 9000 bytes with each kernel, then set the checksums of a batch of
+64-byte UDP packets, and report the rates. Default is 0.
+
+=back
+
+=a SetIPChecksum, CheckIPHeader, SetUDPChecksum, CheckUDPHeader
+
+*/
+
+class InCksumTest : public Element { public:
+
+    InCksumTest() CLICK_COLD;
+
+    const char *class_name() const		{ return "InCksumTest"; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+
+  private:
+
+    int _bench;
+
+    int check_kernels(ErrorHandler *errh);
+    int check_packets(ErrorHandler *errh);
+    void bench(ErrorHandler *errh);
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,260 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * ringtest.{cc,hh} -- regression test and benchmark element for rings
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "ringtest.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/master.hh>
+#include <click/router.hh>
+CLICK_DECLS
+
+RingTest::RingTest()
+    : _bench(false), _mpmc(false), _stop(false), _bulk(32), _capacity(1024),
+      _n(10000000), _ptask(this), _ctask(this),
+      _produced(0), _consumed(0), _errors(0), _done(false)
+{
+}
+
+int
+RingTest::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String type = "spsc";
+    if (Args(conf, this, errh)
+        .read("BENCH", _bench)
+        .read("TYPE", WordArg(), type)
+        .read("BULK", _bulk)
+        .read("CAPACITY", _capacity)
+        .read("N", _n)
+        .read("STOP", _stop)
+        .complete() < 0)
+        return -1;
+    if (type == "spsc")
+        _mpmc = false;
+    else if (type == "mpmc")
+        _mpmc = true;
+    else
+        return errh->error("bad TYPE %<%s%>", type.c_str());
+    if (_bulk == 0 || _bulk > BULK_MAX)
+        return errh->error("BULK must be between 1 and %d", BULK_MAX);
+    if (_capacity < 2)
+        return errh->error("CAPACITY too small");
+    return 0;
+}
+
+#define CHECK(x) if (!(x)) return errh->error("%s:%d: test `%s' failed", __FILE__, __LINE__, #x);
+
+static inline void *
+obj(uintptr_t i)
+{
+    return (void *) (i + 1);
+}
+
+template <typename R>
+static int
+check_ring(R &r, unsigned size, ErrorHandler *errh)
+{
+    void *in[32], *out[32];
+    for (unsigned i = 0; i < 32; i++)
+        in[i] = obj(i);
+
+    CHECK(r.extract() == 0);
+    CHECK(r.extract_bulk(out, 4) == 0);
+
+    // Fill with single inserts, then with a bulk insert that does not fit
+    CHECK(r.insert(in[0]));
+    CHECK(r.insert_bulk(in + 1, 32) == size - 1);
+    CHECK(r.count() == size);
+    CHECK(!r.insert(in[0]));
+    CHECK(r.insert_bulk(in, 1) == 0);
+
+    // Partial bulk extraction, then single extractions
+    CHECK(r.extract_bulk(out, 3) == 3);
+    for (unsigned i = 0; i < 3; i++)
+        CHECK(out[i] == in[i]);
+    for (unsigned i = 3; i < size; i++)
+        CHECK(r.extract() == in[i]);
+    CHECK(r.extract() == 0);
+    CHECK(r.count() == 0);
+
+    // Objects keep their order when bulk operations wrap around the ring
+    unsigned next_in = 0, next_out = 0;
+    for (unsigned round = 0; round < 4 * size; round++) {
+        unsigned n = 1 + round % size;
+        void *objs[32];
+        for (unsigned i = 0; i < n; i++)
+            objs[i] = obj(next_in + i);
+        unsigned k = r.insert_bulk(objs, n);
+        CHECK(k <= n);
+        next_in += k;
+        n = r.extract_bulk(objs, 1 + (round * 7) % size);
+        for (unsigned i = 0; i < n; i++)
+            CHECK(objs[i] == obj(next_out + i));
+        next_out += n;
+        CHECK(r.count() == next_in - next_out);
+    }
+    while (void *o = r.extract()) {
+        CHECK(o == obj(next_out));
+        next_out++;
+    }
+    CHECK(next_in == next_out);
+    return 0;
+}
+
+int
+RingTest::initialize(ErrorHandler *errh)
+{
+    // SPSCDynamicRing holds one object less than its size
+    {
+        SPSCDynamicRing<void*> r;
+        r.initialize(9);
+        if (check_ring(r, 8, errh) < 0)
+            return -1;
+    }
+#if !HAVE_DPDK
+    {
+        MPMCDynamicRing<void*> r;
+        r.initialize(9);
+        if (check_ring(r, 8, errh) < 0)
+            return -1;
+    }
+#endif
+    {
+        Ring<void*, 8> r;
+        if (check_ring(r, 8, errh) < 0)
+            return -1;
+    }
+    {
+        MPMCRing<void*, 8> r;
+        if (check_ring(r, 8, errh) < 0)
+            return -1;
+    }
+    errh->message("All tests pass!");
+
+    if (_bench) {
+        if (_mpmc)
+            _mpmc_ring.initialize(_capacity,
+                                  ("RingTest" + String(eindex())).c_str());
+        else
+            _spsc.initialize(_capacity);
+        _ptask.initialize(this, false);
+        _ctask.initialize(this, false);
+        _ptask.move_thread(0);
+        _ctask.move_thread(master()->nthreads() > 1 ? 1 : 0);
+        _ptask.reschedule();
+        _ctask.reschedule();
+    }
+    return 0;
+}
+
+template <typename R> bool
+RingTest::produce(R &ring)
+{
+    void *objs[BULK_MAX];
+    for (int round = 0; round < ROUNDS && _produced < _n; round++) {
+        unsigned n = _bulk;
+        if (_n - _produced < n)
+            n = _n - _produced;
+        for (unsigned i = 0; i < n; i++)
+            objs[i] = obj(_produced + i);
+        if (_bulk == 1)
+            n = ring.insert(objs[0]) ? 1 : 0;
+        else
+            n = ring.insert_bulk(objs, n);
+        _produced += n;
+    }
+    return _produced < _n;
+}
+
+template <typename R> bool
+RingTest::consume(R &ring)
+{
+    void *objs[BULK_MAX];
+    for (int round = 0; round < ROUNDS; round++) {
+        unsigned n;
+        if (_bulk == 1) {
+            objs[0] = ring.extract();
+            n = objs[0] ? 1 : 0;
+        } else
+            n = ring.extract_bulk(objs, _bulk);
+        for (unsigned i = 0; i < n; i++)
+            if (objs[i] != obj(_consumed + i))
+                _errors++;
+        _consumed += n;
+        if (_consumed >= _n) {
+            _end = Timestamp::now_steady();
+            _done = true;
+            if (_stop)
+                router()->please_stop_driver();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+RingTest::run_task(Task *t)
+{
+    bool more;
+    if (t == &_ptask) {
+        if (!_start)
+            _start = Timestamp::now_steady();
+        more = _mpmc ? produce(_mpmc_ring) : produce(_spsc);
+    } else
+        more = _mpmc ? consume(_mpmc_ring) : consume(_spsc);
+    if (more)
+        t->fast_reschedule();
+    return true;
+}
+
+String
+RingTest::read_handler(Element *e, void *thunk)
+{
+    RingTest *rt = static_cast<RingTest *>(e);
+    switch ((intptr_t) thunk) {
+    case h_done:
+        return String(rt->_done);
+    case h_count:
+        return String(rt->_consumed);
+    case h_errors:
+        return String(rt->_errors);
+    case h_time:
+        if (!rt->_done)
+            return String();
+        return (rt->_end - rt->_start).unparse();
+    case h_rate: {
+        if (!rt->_done)
+            return String();
+        double s = (rt->_end - rt->_start).doubleval();
+        return String(s > 0 ? rt->_consumed / s : 0.);
+    }
+    default:
+        return String();
+    }
+}
+
+void
+RingTest::add_handlers()
+{
+    add_read_handler("done", read_handler, h_done);
+    add_read_handler("count", read_handler, h_count);
+    add_read_handler("errors", read_handler, h_errors);
+    add_read_handler("time", read_handler, h_time);
+    add_read_handler("rate", read_handler, h_rate);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel)
+EXPORT_ELEMENT(RingTest)
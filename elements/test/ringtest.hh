@@ -0,0 +1,131 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_RINGTEST_HH
+#define CLICK_RINGTEST_HH
+#include <click/element.hh>
+#include <click/task.hh>
+#include <click/timestamp.hh>
+#include <click/ring.hh>
+CLICK_DECLS
+
+/*
+=c
+
+RingTest([I<keywords>])
+
+=s test
+
+runs regression tests and a throughput benchmark for rings
+
+=d
+
+RingTest runs regression tests for the rings of <click/ring.hh>, including
+their bulk operations, at initialization time. It does not route packets.
+
+If BENCH is true, RingTest then measures the throughput of a ring shared by a
+producer task on thread 0 and a consumer task on thread 1 (or on thread 0 if
+Click runs with a single thread). The producer inserts N objects, BULK at a
+time, and the consumer extracts them BULK at a time, checking their order.
+
+Keyword arguments are:
+
+=over 8
+
+=item BENCH
+
+Boolean. Run the benchmark. Default is false.
+
+=item TYPE
+
+Ring to benchmark, C<spsc> (SPSCDynamicRing) or C<mpmc> (MPMCDynamicRing).
+Default is C<spsc>.
+
+=item BULK
+
+Integer. Number of objects moved per ring operation. 1 uses insert() and
+extract(), more uses insert_bulk() and extract_bulk(). Default is 32.
+
+=item CAPACITY
+
+Integer. Ring size. Default is 1024.
+
+=item N
+
+Integer. Number of objects to move. Default is 10000000.
+
+=item STOP
+
+Boolean. Stop the driver when the benchmark completes. Default is false.
+
+=back
+
+=h done read-only
+
+Returns true when the benchmark completed.
+
+=h count read-only
+
+Returns the number of objects received by the consumer.
+
+=h errors read-only
+
+Returns the number of objects received out of order.
+
+=h time read-only
+
+Returns the duration of the benchmark, in seconds.
+
+=h rate read-only
+
+Returns the number of objects moved per second.
+
+*/
+
+class RingTest : public Element { public:
+
+    RingTest() CLICK_COLD;
+
+    const char *class_name() const		{ return "RingTest"; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    bool run_task(Task *t);
+
+  private:
+
+    enum { BULK_MAX = 256, ROUNDS = 64 };
+    enum { h_done, h_count, h_errors, h_time, h_rate };
+
+    bool _bench;
+    bool _mpmc;
+    bool _stop;
+    unsigned _bulk;
+    unsigned _capacity;
+    uint64_t _n;
+
+    SPSCDynamicRing<void*> _spsc;
+    MPMCDynamicRing<void*> _mpmc_ring;
+
+    Task _ptask;
+    Task _ctask;
+    Timestamp _start;
+    Timestamp _end;
+
+    // Written by the producer
+    uint64_t _produced CLICK_CACHE_ALIGN;
+
+    // Written by the consumer
+    uint64_t _consumed CLICK_CACHE_ALIGN;
+    uint64_t _errors;
+    volatile bool _done;
+
+    template <typename R> bool produce(R &ring);
+    template <typename R> bool consume(R &ring);
+
+    static String read_handler(Element *e, void *thunk) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
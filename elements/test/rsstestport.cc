@@ -0,0 +1,151 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * rsstestport.{cc,hh} -- stand-in multi-queue port with an RSS table, for
+ * testing RSSRebalancer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "rsstestport.hh"
+#include <click/args.hh>
+#include <click/confparse.hh>
+#include <click/error.hh>
+#include <click/router.hh>
+#include <click/packet_anno.hh>
+CLICK_DECLS
+
+RSSTestPort::RSSTestPort()
+    : _nqueues(4), _reta_size(16)
+{
+    in_batch_mode = BATCH_MODE_YES;
+}
+
+void *
+RSSTestPort::cast(const char *name)
+{
+    if (strcmp(name, "RSSTable") == 0)
+	return static_cast<RSSTable *>(this);
+    return BatchElement::cast(name);
+}
+
+int
+RSSTestPort::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String load;
+    if (Args(conf, this, errh)
+	.read_mp("LOAD", AnyArg(), load)
+	.read("QUEUES", _nqueues)
+	.read("RETA_SIZE", _reta_size)
+	.complete() < 0)
+	return -1;
+    Vector<String> words;
+    cp_spacevec(cp_unquote(load), words);
+    if (words.size() > (int) _reta_size)
+	return errh->error("LOAD has more than RETA_SIZE buckets");
+    _load.assign(_reta_size, 0);
+    for (int i = 0; i < words.size(); i++)
+	if (!IntArg().parse(words[i], _load[i]))
+	    return errh->error("LOAD should be a list of integers");
+    return 0;
+}
+
+int
+RSSTestPort::initialize(ErrorHandler *errh)
+{
+    // Like a NIC, start round-robin
+    _device_reta.resize(_reta_size);
+    for (unsigned i = 0; i < _reta_size; i++)
+	_device_reta[i] = i % _nqueues;
+    if (rss_enabled())
+	return rss_initialize(_reta_size, _nqueues, errh);
+    return 0;
+}
+
+int
+RSSTestPort::read_reta(Vector<unsigned> &reta, ErrorHandler *)
+{
+    reta = _device_reta;
+    return 0;
+}
+
+int
+RSSTestPort::write_reta(const Vector<unsigned> &reta, ErrorHandler *)
+{
+    _device_reta = reta;
+    return 0;
+}
+
+int
+RSSTestPort::rss_queue_thread(int)
+{
+    return router()->home_thread_id(this);
+}
+
+void
+RSSTestPort::receive()
+{
+    for (unsigned q = 0; q < _nqueues; q++) {
+	Packet *head = 0, *tail = 0;
+	unsigned n = 0;
+	if (rss_enabled())
+	    n = rss_poll_begin(q, head, tail);
+	for (unsigned b = 0; b < _reta_size; b++) {
+	    if (_device_reta[b] != q)
+		continue;
+	    for (unsigned i = 0; i < _load[b]; i++) {
+		WritablePacket *p = Packet::make(64);
+		if (!p)
+		    continue;
+		SET_AGGREGATE_ANNO(p, b);
+		SET_PAINT_ANNO(p, q);
+		if (rss_enabled() && rss_count(b, q)) {
+		    rss_hold(q, p);
+		    continue;
+		}
+		p->set_next(0);
+		if (tail)
+		    tail->set_next(p);
+		else
+		    head = p;
+		tail = p;
+		n++;
+	    }
+	}
+	if (n)
+	    output_push_batch(0, PacketBatch::make_from_simple_list(head, tail, n));
+	// The simulated queue is always emptied
+	if (rss_enabled())
+	    rss_poll_end(q, true);
+    }
+}
+
+int
+RSSTestPort::write_handler(const String &str, Element *e, void *, ErrorHandler *errh)
+{
+    int rounds;
+    if (!IntArg().parse(str, rounds) || rounds < 0)
+	return errh->error("expected number of rounds");
+    RSSTestPort *tp = static_cast<RSSTestPort *>(e);
+    for (int i = 0; i < rounds; i++)
+	tp->receive();
+    return 0;
+}
+
+void
+RSSTestPort::add_handlers()
+{
+    add_write_handler("run", write_handler, 0);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel batch RSSTable)
+EXPORT_ELEMENT(RSSTestPort)
@@ -0,0 +1,85 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_RSSTESTPORT_HH
+#define CLICK_RSSTESTPORT_HH
+#include <click/batchelement.hh>
+#include "elements/userlevel/rsstable.hh"
+CLICK_DECLS
+
+/*
+=c
+
+RSSTestPort(LOAD [, I<keywords>])
+
+=s test
+
+stands in for a multi-queue port with an RSS table
+
+=d
+
+RSSTestPort simulates a port spreading packets among QUEUES receive queues
+by an RSS indirection table of RETA_SIZE buckets, so that RSSRebalancer can
+be tested without a NIC. Each time the run handler is written, it receives
+LOAD[i] packets with RSS hash i for each bucket i, queue by queue, and pushes
+the packets of each queue as a batch. Each packet has the bucket in its
+aggregate annotation and the queue in its paint annotation.
+
+All queues are polled by the element's home thread.
+
+Keyword arguments are:
+
+=over 8
+
+=item LOAD
+
+Space-separated list of integers. Packets received by each bucket per
+round. Buckets past the end of the list receive none.
+
+=item QUEUES
+
+Integer. Number of queues. Default is 4.
+
+=item RETA_SIZE
+
+Integer. Number of buckets, a power of two. Default is 16.
+
+=back
+
+=h run write-only
+
+Receive the given number of rounds of packets.
+
+=a RSSRebalancer
+
+*/
+
+class RSSTestPort : public BatchElement, public RSSTable { public:
+
+    RSSTestPort() CLICK_COLD;
+
+    const char *class_name() const override	{ return "RSSTestPort"; }
+    const char *port_count() const override	{ return PORTS_0_1; }
+    const char *processing() const override	{ return PUSH; }
+    void *cast(const char *name) override;
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) override CLICK_COLD;
+    int initialize(ErrorHandler *errh) override CLICK_COLD;
+    void add_handlers() override CLICK_COLD;
+
+    int read_reta(Vector<unsigned> &reta, ErrorHandler *errh) override;
+    int write_reta(const Vector<unsigned> &reta, ErrorHandler *errh) override;
+    int rss_queue_thread(int queue) override;
+
+  private:
+
+    Vector<unsigned> _load;
+    Vector<unsigned> _device_reta;
+    unsigned _nqueues;
+    unsigned _reta_size;
+
+    void receive();
+    static int write_handler(const String &str, Element *e, void *, ErrorHandler *errh) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -22,6 +22,7 @@
 #include <click/error.hh>
 #include <click/args.hh>
 #include <click/master.hh>
+#include <click/timerset.hh>
 CLICK_DECLS
 
 TimerTest::TimerTest()
@@ -60,15 +61,13 @@ TimerTest::initialize(ErrorHandler *)
 	click_chatter("Initializing explicit_do_nothing_timer");
 	explicit_do_nothing_timer.initialize(this);
     } else {
-	Timestamp now = Timestamp::now_steady();
 	Timer *ts = new Timer[_benchmark];
 	for (int i = 0; i < _benchmark; ++i) {
 	    ts[i].assign();
 	    ts[i].initialize(this);
 	}
-	benchmark_schedules(ts, _benchmark, now);
-	benchmark_changes(ts, _benchmark, now);
-	benchmark_fires(ts, _benchmark, now);
+	benchmark(ts, _benchmark, false);
+	benchmark(ts, _benchmark, true);
 	delete[] ts;
     }
 
@@ -81,6 +80,30 @@ TimerTest::run_timer(Timer *t)
     click_chatter("%p{timestamp}: %p{element} fired", &t->expiry_steady(), this);
 }
 
+void
+TimerTest::benchmark(Timer *ts, int nts, bool wheel)
+{
+    TimerSet &timer_set = ts->thread()->timer_set();
+    bool old_wheel = timer_set.wheel();
+    timer_set.set_wheel(wheel);
+
+    Timestamp now = Timestamp::now_steady();
+    Timestamp t0 = Timestamp::now();
+    benchmark_schedules(ts, nts, now);
+    Timestamp t1 = Timestamp::now();
+    benchmark_changes(ts, nts, now);
+    Timestamp t2 = Timestamp::now();
+    benchmark_fires(ts, nts, now);
+    Timestamp t3 = Timestamp::now();
+
+    timer_set.set_wheel(old_wheel);
+    click_chatter("%p{element}: %s: %.1f ns/schedule, %.1f ns/change, %.1f ns/fire",
+		  this, wheel ? "wheel" : "heap",
+		  (t1 - t0).doubleval() * 1e9 / nts,
+		  (t2 - t1).doubleval() * 1e9 / (6 * nts),
+		  (t3 - t2).doubleval() * 1e9 / nts);
+}
+
 void
 TimerTest::benchmark_schedules(Timer *ts, int nts, const Timestamp &now)
 {
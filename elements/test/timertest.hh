@@ -39,7 +39,10 @@ is printed to standard error.
 
 Integer.  If set to a positive number, then TimerTest runs a timer
 manipulation benchmark at installation time involving BENCHMARK total
-timers.  Default is 0 (don't benchmark).
+timers, once with the timer heap and once with the timing wheel, and
+prints the time taken per schedule, per change and per fire for each.
+Timers are set to expire within 10 seconds.  Default is 0 (don't
+benchmark).
 
 =back
 
@@ -78,6 +81,7 @@ class TimerTest : public Element { public:
     Timer _timer;
     int _benchmark;
 
+    void benchmark(Timer *ts, int nts, bool wheel);
     void benchmark_schedules(Timer *ts, int nts, const Timestamp &now);
     void benchmark_changes(Timer *ts, int nts, const Timestamp &now);
     void benchmark_fires(Timer *ts, int nts, const Timestamp &now);
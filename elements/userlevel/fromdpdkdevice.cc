@@ -36,13 +36,17 @@
 #if RTE_VERSION >= RTE_VERSION_NUM(20,2,0,0)
     #include <click/flowrulemanager.hh>
 #endif
+#if RTE_VERSION >= RTE_VERSION_NUM(17,5,0,0)
+    #include <rte_pause.h>
+#endif
 
 CLICK_DECLS
 
 #define LOAD_UNIT 10
 
 FromDPDKDevice::FromDPDKDevice() :
-    _dev(0)
+    _dev(0), _receive(receive_functions[0]), _burst_adaptive(false),
+    _burst_min(4), _idle_streak(0), _idle_pause_max(1024)
 #if HAVE_DPDK_INTERRUPT
     ,_rx_intr(-1)
 #endif
@@ -70,6 +74,8 @@ int FromDPDKDevice::configure(Vector<String> &conf, ErrorHandler *errh)
     bool has_mac = false;
     bool has_mtu = false;
     bool set_timestamp = false;
+    bool rx_checksum = false;
+    bool rss_symmetric = false;
     FlowControlMode fc_mode(FC_UNSET);
     String mode = "";
     int num_pools = 0;
@@ -105,11 +111,20 @@ int FromDPDKDevice::configure(Vector<String> &conf, ErrorHandler *errh)
         .read("RX_INTR", _rx_intr)
 #endif
         .read("MAX_RSS", max_rss).read_status(has_rss)
+        .read("RSS_SYMMETRIC", rss_symmetric)
         .read("TIMESTAMP", set_timestamp)
+        .read("RX_CHECKSUM", rx_checksum)
         .read("PAUSE", fc_mode)
+        .read("BURST_ADAPTIVE", _burst_adaptive)
+        .read("BURST_MIN", _burst_min)
+        .read("IDLE_STREAK", _idle_streak)
+        .read("IDLE_PAUSE_MAX", _idle_pause_max)
         .complete() < 0)
         return -1;
 
+    if (_burst_min < 1 || _burst_min > (unsigned) _burst)
+        return errh->error("BURST_MIN must be between 1 and BURST");
+
     if (!DPDKDeviceArg::parse(dev, _dev)) {
         if (allow_nonexistent)
             return 0;
@@ -161,9 +176,22 @@ int FromDPDKDevice::configure(Vector<String> &conf, ErrorHandler *errh)
         _set_timestamp = false;
     }
 
+    if (rx_checksum) {
+#if RTE_VERSION >= RTE_VERSION_NUM(18,02,0,0)
+        _dev->set_rx_offload(DEV_RX_OFFLOAD_IPV4_CKSUM
+                             | DEV_RX_OFFLOAD_UDP_CKSUM
+                             | DEV_RX_OFFLOAD_TCP_CKSUM);
+#else
+        errh->error("Hardware checksum verification is not supported before DPDK 18.02");
+#endif
+    }
+
     if (has_rss)
         _dev->set_init_rss_max(max_rss);
 
+    if (rss_symmetric)
+        _dev->set_rss_symmetric(true);
+
 #if RTE_VERSION >= RTE_VERSION_NUM(20,2,0,0)
     if ((mode == FlowRuleManager::DISPATCHING_MODE) && (flow_rules_filename.empty())) {
         errh->warning(
@@ -206,6 +234,8 @@ void* FromDPDKDevice::cast(const char* name) {
     if (String(name) == "UserClockSource")
         return &dpdk_clock;
 #endif
+    if (String(name) == "RSSTable")
+        return static_cast<RSSTable*>(this);
     return RXQueueDevice::cast(name);
 }
 
@@ -241,6 +271,16 @@ int FromDPDKDevice::initialize(ErrorHandler *errh)
         if (ret != 0) return ret;
     }
 
+    if (rss_enabled()) {
+        if (firstqueue != 0 || lastqueue + 1 != _dev->nb_rx_queues())
+            return errh->error("RSS rebalancing needs a single FromDPDKDevice serving all queues of the device");
+        ret = rss_initialize(_dev->get_reta_size(), n_queues, errh);
+        if (ret != 0) return ret;
+    }
+
+    _receive = receive_functions[(rss_enabled() << 3) | (_set_rss_aggregate << 2)
+                                 | (_set_paint_anno << 1) | _set_timestamp];
+
     if (_set_timestamp) {
 #if HAVE_DPDK_READ_CLOCK
         uint64_t t;
@@ -280,21 +320,67 @@ void FromDPDKDevice::cleanup(CleanupStage)
     cleanup_tasks();
 }
 
-bool FromDPDKDevice::run_task(Task *t)
+/*
+ * Receive one burst per queue and push it as a single batch, return the size
+ * of the largest burst. Annotations are
+ * template parameters, so each combination compiles to a loop without
+ * per-packet tests. The mbuf of packet i + 2 * PREFETCH_AHEAD and the data of
+ * packet i + PREFETCH_AHEAD are prefetched while packet i is converted, so
+ * neither the conversion nor the next element waits for memory.
+ *
+ * With balance, packets are counted per RSS bucket, packets of buckets
+ * moving to this queue are held, and held packets released by RSSTable go
+ * first.
+ */
+template <bool rss_aggregate, bool paint, bool timestamp, bool balance>
+unsigned FromDPDKDevice::receive(unsigned burst)
 {
-    struct rte_mbuf *pkts[_burst];
-    int ret = 0;
+    struct rte_mbuf *pkts[burst];
+    unsigned ret = 0;
 
     for (int iqueue = queue_for_thisthread_begin();
             iqueue<=queue_for_thisthread_end(); iqueue++) {
+        Packet* held = 0;
+        Packet* held_tail = 0;
+        unsigned nheld = 0;
+        if (balance)
+            nheld = rss_poll_begin(iqueue, held, held_tail);
+
+        unsigned n = rte_eth_rx_burst(_dev->port_id, iqueue, pkts, burst);
+        if (n == 0 && likely(nheld == 0)) {
+            if (balance)
+                rss_poll_end(iqueue, true);
+            continue;
+        }
+
+        for (unsigned i = 0; i < n && i < PREFETCH_AHEAD; ++i)
+            rte_prefetch0(rte_pktmbuf_mtod(pkts[i], void *));
+        for (unsigned i = PREFETCH_AHEAD; i < n && i < 2 * PREFETCH_AHEAD; ++i)
+            rte_prefetch0(pkts[i]);
+
 #if HAVE_BATCH
-         PacketBatch* head = 0;
-         WritablePacket *last;
+        PacketBatch* head = 0;
+        Packet* last = 0;
+        unsigned count = nheld;
+        if (balance && nheld) {
+            head = PacketBatch::start_head(held);
+            last = held_tail;
+        }
+#else
+        while (balance && held) {
+            Packet* next = held->next();
+            held->set_next(0);
+            output(0).push(held);
+            held = next;
+        }
 #endif
-        unsigned n = rte_eth_rx_burst(_dev->port_id, iqueue, pkts, _burst);
         for (unsigned i = 0; i < n; ++i) {
+            if (i + 2 * PREFETCH_AHEAD < n)
+                rte_prefetch0(pkts[i + 2 * PREFETCH_AHEAD]);
+            if (i + PREFETCH_AHEAD < n)
+                rte_prefetch0(rte_pktmbuf_mtod(pkts[i + PREFETCH_AHEAD], void *));
+
             unsigned char* data = rte_pktmbuf_mtod(pkts[i], unsigned char *);
-            rte_prefetch0(data);
 #if CLICK_PACKET_USE_DPDK
             WritablePacket *p = static_cast<WritablePacket*>(Packet::make(pkts[i]));
 #elif HAVE_ZEROCOPY
@@ -308,50 +394,130 @@ bool FromDPDKDevice::run_task(Task *t)
 #else
             WritablePacket *p = Packet::make(data,
                                      (uint32_t)rte_pktmbuf_pkt_len(pkts[i]));
-            rte_pktmbuf_free(pkts[i]);
             data = p->data();
 #endif
             p->set_packet_type_anno(Packet::HOST);
             p->set_mac_header(data);
-            if (_set_rss_aggregate)
 #if RTE_VERSION > RTE_VERSION_NUM(1,7,0,0)
-                SET_AGGREGATE_ANNO(p,pkts[i]->hash.rss);
+            uint32_t hash = pkts[i]->hash.rss;
 #else
-                SET_AGGREGATE_ANNO(p,pkts[i]->pkt.hash.rss);
+            uint32_t hash = pkts[i]->pkt.hash.rss;
 #endif
-            if (_set_paint_anno) {
+            if (rss_aggregate)
+                SET_AGGREGATE_ANNO(p,hash);
+            if (paint)
                 SET_PAINT_ANNO(p, iqueue);
-            }
-
 #if RTE_VERSION >= RTE_VERSION_NUM(18,02,0,0)
-            if (_set_timestamp && (pkts[i]->ol_flags & PKT_RX_TIMESTAMP)) {
+            if (timestamp && (pkts[i]->ol_flags & PKT_RX_TIMESTAMP))
                 p->timestamp_anno().assignlong(pkts[i]->timestamp);
-            }
 #endif
+#if !CLICK_PACKET_USE_DPDK && !HAVE_ZEROCOPY
+            rte_pktmbuf_free(pkts[i]);
+#endif
+            if (balance && rss_count(hash, iqueue)) {
+                rss_hold(iqueue, p);
+                continue;
+            }
 #if HAVE_BATCH
-            if (head == NULL)
-                head = PacketBatch::start_head(p);
-            else
+            if (last)
                 last->set_next(p);
+            else
+                head = PacketBatch::start_head(p);
             last = p;
+            count++;
 #else
             output(0).push(p);
 #endif
         }
 #if HAVE_BATCH
         if (head) {
-            head->make_tail(last,n);
-            output_push_batch(0,head);
+            head->make_tail(last, count);
+            output_push_batch(0, head);
         }
 #endif
-        if (n) {
-            add_count(n);
-            ret = 1;
-        }
+        add_count(n);
+        if (n > ret)
+            ret = n;
+        // The queue was emptied once all it had is processed
+        if (balance)
+            rss_poll_end(iqueue, n < burst);
+    }
+    return ret;
+}
+
+/*
+ * Indexed by balance << 3 | rss_aggregate << 2 | paint << 1 | timestamp.
+ */
+const FromDPDKDevice::receive_function FromDPDKDevice::receive_functions[16] = {
+    &FromDPDKDevice::receive<false, false, false, false>,
+    &FromDPDKDevice::receive<false, false, true, false>,
+    &FromDPDKDevice::receive<false, true, false, false>,
+    &FromDPDKDevice::receive<false, true, true, false>,
+    &FromDPDKDevice::receive<true, false, false, false>,
+    &FromDPDKDevice::receive<true, false, true, false>,
+    &FromDPDKDevice::receive<true, true, false, false>,
+    &FromDPDKDevice::receive<true, true, true, false>,
+    &FromDPDKDevice::receive<false, false, false, true>,
+    &FromDPDKDevice::receive<false, false, true, true>,
+    &FromDPDKDevice::receive<false, true, false, true>,
+    &FromDPDKDevice::receive<false, true, true, true>,
+    &FromDPDKDevice::receive<true, false, false, true>,
+    &FromDPDKDevice::receive<true, false, true, true>,
+    &FromDPDKDevice::receive<true, true, false, true>,
+    &FromDPDKDevice::receive<true, true, true, true>
+};
+
+int FromDPDKDevice::read_reta(Vector<unsigned> &reta, ErrorHandler *errh)
+{
+    int err = _dev->get_reta(reta);
+    if (err != 0)
+        return errh->error("Could not read the RSS table of port %u: error %d", _dev->port_id, err);
+    return 0;
+}
+
+int FromDPDKDevice::write_reta(const Vector<unsigned> &reta, ErrorHandler *errh)
+{
+    int err = _dev->set_reta(reta);
+    if (err != 0)
+        return errh->error("Could not update the RSS table of port %u: error %d", _dev->port_id, err);
+    return 0;
+}
+
+int FromDPDKDevice::rss_queue_thread(int queue)
+{
+    return thread_for_queue(queue);
+}
+
+bool FromDPDKDevice::run_task(Task *t)
+{
+    RxState &rx = *_rx_state;
+    rx.polled = true;
+    unsigned burst = _burst;
+    if (_burst_adaptive && rx.burst && rx.burst < burst)
+        burst = rx.burst;
+
+    unsigned n = (this->*_receive)(burst);
+    int ret = n > 0;
+
+    // Recent share of empty polls, 16.16 fixed point, over about 256 polls
+    rx.idle_avg += ((ret ? 0 : 1 << 16) - (int32_t) rx.idle_avg) >> 8;
+    if (_burst_adaptive) {
+        // Grow while bursts come full, shrink when they are mostly empty
+        if (n == burst)
+            rx.burst = burst * 2 < (unsigned) _burst ? burst * 2 : _burst;
+        else if (n < burst / 4)
+            rx.burst = burst / 2 > _burst_min ? burst / 2 : _burst_min;
+        else
+            rx.burst = burst;
     }
+    if (ret) {
+        rx.idle = 0;
+        rx.backoff = 1;
+    } else
+        rx.idle++;
 
 #if HAVE_DPDK_INTERRUPT
-     if (ret == 0 && _rx_intr >= 0) {
+     if (ret == 0 && _rx_intr >= 0 && rx.idle > _idle_streak) {
            for (int iqueue = queue_for_thisthread_begin();
                 iqueue<=queue_for_thisthread_end(); iqueue++) {
                if (rte_eth_dev_rx_intr_enable(_dev->port_id, iqueue) != 0) {
@@ -371,9 +537,20 @@ bool FromDPDKDevice::run_task(Task *t)
                    assert(port_id == _dev->port_id);
            }
            this->selected(0, SELECT_READ);
+           t->fast_reschedule();
+           return ret;
     }
 #endif
 
+    // After a streak of empty polls, wait a growing number of pause
+    // instructions between polls
+    if (ret == 0 && _idle_streak && rx.idle > _idle_streak) {
+        for (unsigned i = 0; i < rx.backoff; i++)
+            rte_pause();
+        if (rx.backoff < _idle_pause_max)
+            rx.backoff <<= 1;
+    }
+
     t->fast_reschedule();
     return ret;
 }
@@ -402,6 +579,7 @@ enum {
     h_mac, h_add_mac, h_remove_mac, h_vf_mac,
     h_mtu,
     h_device,
+    h_burst_current, h_idle_ratio,
 #if RTE_VERSION >= RTE_VERSION_NUM(20,2,0,0)
     h_rule_add, h_rules_del, h_rules_isolate, h_rules_flush,
     h_rules_list, h_rules_list_with_hits, h_rules_ids_global, h_rules_ids_internal,
@@ -431,6 +609,33 @@ String FromDPDKDevice::read_handler(Element *e, void * thunk)
             return String(fd->_dev->nb_tx_queues());
         case h_nb_vf_pools:
             return String(fd->_dev->nb_vf_pools());
+        case h_burst_current: {
+            // Mean over the threads polling this device
+            unsigned long total = 0, nthreads = 0;
+            for (unsigned i = 0; i < fd->_rx_state.weight(); i++) {
+                const RxState &rx = fd->_rx_state.get_value(i);
+                if (rx.burst) {
+                    total += rx.burst;
+                    nthreads++;
+                }
+            }
+            if (!fd->_burst_adaptive || nthreads == 0)
+                return String(fd->_burst);
+            return String((total + nthreads / 2) / nthreads);
+        }
+        case h_idle_ratio: {
+            uint64_t total = 0, nthreads = 0;
+            for (unsigned i = 0; i < fd->_rx_state.weight(); i++) {
+                const RxState &rx = fd->_rx_state.get_value(i);
+                if (rx.polled) {
+                    total += rx.idle_avg;
+                    nthreads++;
+                }
+            }
+            if (nthreads == 0)
+                return String(1.0);
+            return String((double) total / nthreads / (1 << 16));
+        }
         case h_mtu: {
             uint16_t mtu;
             if (rte_eth_dev_get_mtu(fd->_dev->port_id, &mtu) != 0)
@@ -888,10 +1093,12 @@ void FromDPDKDevice::add_handlers()
 
     add_read_handler("mtu",read_handler, h_mtu);
     add_data_handlers("burst", Handler::h_read | Handler::h_write, &_burst);
+    add_read_handler("burst_current", read_handler, h_burst_current);
+    add_read_handler("idle_ratio", read_handler, h_idle_ratio);
 }
 
 CLICK_ENDDECLS
 
-ELEMENT_REQUIRES(userlevel dpdk QueueDevice)
+ELEMENT_REQUIRES(userlevel dpdk QueueDevice RSSTable)
 EXPORT_ELEMENT(FromDPDKDevice)
 ELEMENT_MT_SAFE(FromDPDKDevice)
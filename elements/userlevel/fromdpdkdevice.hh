@@ -6,6 +6,7 @@
 #include <click/task.hh>
 #include <click/dpdkdevice.hh>
 #include "queuedevice.hh"
+#include "rsstable.hh"
 
 CLICK_DECLS
 
@@ -63,6 +64,31 @@ true. The default is false.
 Integer. Maximal number of packets that will be processed before rescheduling.
 The default is 32.
 
+=item BURST_ADAPTIVE
+
+Boolean. If true, each thread adapts the number of packets it asks for to the
+recent queue occupancy: the burst doubles while full bursts are received, up
+to BURST, and halves while bursts are less than a quarter full, down to
+BURST_MIN. Defaults to false.
+
+=item BURST_MIN
+
+Integer. Smallest adaptive burst. Defaults to 4.
+
+=item IDLE_STREAK
+
+Integer. Number of consecutive empty polls after which a thread backs off.
+With RX_INTR, the thread then sleeps until an Rx interrupt; otherwise it
+executes a number of pause instructions before each further poll, doubling
+with each empty poll up to IDLE_PAUSE_MAX. The first received packet resets
+the backoff. Defaults to 0, which never backs off without RX_INTR and sleeps
+after the first empty poll with it.
+
+=item IDLE_PAUSE_MAX
+
+Integer. Largest number of pause instructions between two polls. Defaults to
+1024.
+
 =item MAXTHREADS
 
 Integer. Maximal number of threads that this element will take to read packets from
@@ -133,6 +159,12 @@ will never run and this element will behave like Idle.
 Boolean. If True, sets the RSS hash into the aggregate annotation
 field of each packet. Defaults to False.
 
+=item RSS_SYMMETRIC
+
+Boolean. If True, program the device with a symmetric RSS key, so both
+directions of a connection are received by the same queue, and therefore the
+same thread. Defaults to False.
+
 =item PAINT_QUEUE
 
 Boolean. If True, sets the hardware queue number into the paint annotation
@@ -160,6 +192,13 @@ Scaling is disabled by default.
 
 Boolean. Enables hardware timestamping. Defaults to false.
 
+=item RX_CHECKSUM
+
+Boolean. Makes the device verify the IPv4, TCP and UDP checksums of
+received packets. CheckIPHeader, CheckTCPHeader and CheckUDPHeader given
+RX_CHECKSUM true then use the device's verdict instead of reading the packet,
+as long as the headers were not moved. Defaults to false.
+
 =item VLAN_FILTER
 
 Boolean. Per queue ability to filter received VLAN packets by the hardware. Defaults to false.
@@ -194,6 +233,10 @@ the stdout. Defaults to False.
 
 =back
 
+When an RSSRebalancer is attached, FromDPDKDevice counts the packets of
+each bucket of the RSS table and holds the packets of moving buckets, as
+RSSRebalancer describes. It must then serve all the queues of its device.
+
 This element is only available at user level, when compiled with DPDK
 support.
 
@@ -294,6 +337,16 @@ Returns the number of Virtual Function pools of this device.
 
 Returns the number of Rx descriptors of this device.
 
+=h burst_current read-only
+
+Returns the mean burst size currently asked for by the polling threads. Equal
+to BURST unless BURST_ADAPTIVE is set.
+
+=h idle_ratio read-only
+
+Returns the share of the last few hundred polls which received no packet,
+averaged over the polling threads.
+
 =h mac read-only
 
 Returns the Ethernet address of this device.
@@ -393,11 +446,11 @@ Returns the number of flow rules being installed.
 
 =h
 
-=a DPDKInfo, ToDPDKDevice */
+=a DPDKInfo, ToDPDKDevice, RSSRebalancer */
 
 class ToDPDKDevice;
 
-class FromDPDKDevice : public RXQueueDevice {
+class FromDPDKDevice : public RXQueueDevice, public RSSTable {
 public:
 
     FromDPDKDevice() CLICK_COLD;
@@ -426,6 +479,10 @@ public:
         return _dev;
     }
 
+    int read_reta(Vector<unsigned> &reta, ErrorHandler *errh) override;
+    int write_reta(const Vector<unsigned> &reta, ErrorHandler *errh) override;
+    int rss_queue_thread(int queue) override;
+
 #if HAVE_DPDK_READ_CLOCK
     static uint64_t read_clock(void* thunk);
 #endif
@@ -449,6 +506,27 @@ private:
                               const Handler *handler, ErrorHandler *errh);
     DPDKDevice* _dev;
 
+    enum { PREFETCH_AHEAD = 4 };
+    template <bool rss_aggregate, bool paint, bool timestamp, bool balance>
+    unsigned receive(unsigned burst);
+    typedef unsigned (FromDPDKDevice::*receive_function)(unsigned);
+    static const receive_function receive_functions[16];
+    receive_function _receive;
+
+    struct RxState {
+        RxState() : burst(0), idle(0), backoff(1), idle_avg(0), polled(false) { }
+        unsigned burst;         // current burst size, if adaptive
+        unsigned idle;          // consecutive empty polls
+        unsigned backoff;       // pauses before the next poll
+        uint32_t idle_avg;      // recent share of empty polls, 16.16
+        bool polled;
+    };
+    per_thread<RxState> _rx_state;
+    bool _burst_adaptive;
+    unsigned _burst_min;
+    unsigned _idle_streak;
+    unsigned _idle_pause_max;
+
 #if HAVE_DPDK_INTERRUPT
     int _rx_intr;
     class FDState { public:
@@ -0,0 +1,556 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * fromdumpstream.{cc,hh} -- element streams packets from a tcpdump file
+ * on several threads
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "fromdumpstream.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/glue.hh>
+#include <click/master.hh>
+#include <click/router.hh>
+#include <click/packet_anno.hh>
+#include <clicknet/ether.h>
+#include <clicknet/ip.h>
+#include <clicknet/ip6.h>
+#include "fakepcap.hh"
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+CLICK_DECLS
+
+#define SWAPLONG(y) \
+	((((y)&0xff)<<24) | (((y)&0xff00)<<8) | (((y)&0xff0000)>>8) | (((y)>>24)&0xff))
+
+#define FAKE_PCAPNG_SPB		0x00000003	/* Simple Packet */
+
+FromDumpStream::FromDumpStream()
+    : _fd(-1), _format(FORMAT_PCAP), _swapped(false), _nano(false),
+      _pkthdr_size(sizeof(fake_pcap_pkthdr)),
+      _linktype(FAKE_DLT_NONE), _data_start(0), _nshards(1), _burst(32),
+      _chunk_size(4 << 20), _nchunks(8), _loop(1), _stop(false),
+      _chunks(0), _shards(0), _reader_running(false), _stopping(false),
+      _eof(false)
+{
+#if HAVE_BATCH
+    in_batch_mode = BATCH_MODE_YES;
+#endif
+}
+
+FromDumpStream::~FromDumpStream()
+{
+}
+
+int
+FromDumpStream::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    uint32_t chunk_size = _chunk_size;
+    if (Args(conf, this, errh)
+	.read_mp("FILENAME", FilenameArg(), _filename)
+	.read("SHARDS", _nshards)
+	.read("BURST", _burst)
+	.read("CHUNK", chunk_size)
+	.read("CHUNKS", _nchunks)
+	.read("LOOP", _loop)
+	.read("STOP", _stop)
+	.complete() < 0)
+	return -1;
+    if (_nshards < 1)
+	return errh->error("SHARDS must be at least 1");
+    if (_nshards > master()->nthreads())
+	errh->warning("%d shards on %d threads", _nshards, master()->nthreads());
+    if (_burst < 1)
+	return errh->error("BURST must be at least 1");
+    if (chunk_size < 65536 || chunk_size > (1U << 30))
+	return errh->error("CHUNK must be between 64 KB and 1 GB");
+    if (_nchunks < 2)
+	return errh->error("CHUNKS must be at least 2");
+    if (_loop < 0)
+	return errh->error("LOOP must be positive");
+    _chunk_size = chunk_size;
+    return 0;
+}
+
+bool
+FromDumpStream::get_spawning_threads(Bitvector &b, bool, int)
+{
+    int home = router()->home_thread_id(this);
+    for (int i = 0; i < _nshards; i++)
+	b[(home + i) % master()->nthreads()] = 1;
+    return true;
+}
+
+int
+FromDumpStream::read_header(ErrorHandler *errh)
+{
+    unsigned char buf[4096];
+    ssize_t r = pread(_fd, buf, sizeof(buf), 0);
+    if (r < 0)
+	return errh->error("%s: %s", _filename.c_str(), strerror(errno));
+    if (r < (ssize_t) sizeof(fake_pcap_file_header))
+	return errh->error("%s: not a tcpdump file (too short)", _filename.c_str());
+
+    uint32_t magic = *reinterpret_cast<const uint32_t *>(buf);
+    if (magic == FAKE_PCAPNG_SHB) {
+	_format = FORMAT_PCAPNG;
+	if (*reinterpret_cast<const uint32_t *>(buf + 8) != FAKE_PCAPNG_BYTE_ORDER_MAGIC)
+	    return errh->error("%s: pcapng files of the other byte order are not supported", _filename.c_str());
+	_data_start = 0;
+	// The link type is the first interface's
+	size_t pos = 0;
+	while (pos + 12 <= (size_t) r) {
+	    uint32_t type = *reinterpret_cast<const uint32_t *>(buf + pos);
+	    uint32_t blen = *reinterpret_cast<const uint32_t *>(buf + pos + 4);
+	    if (blen < 12 || (blen & 3))
+		break;
+	    if (type == FAKE_PCAPNG_IDB) {
+		_linktype = fake_pcap_canonical_dlt(*reinterpret_cast<const uint16_t *>(buf + pos + 8), true);
+		return 0;
+	    }
+	    pos += blen;
+	}
+	return errh->error("%s: no interface description block", _filename.c_str());
+    }
+
+    fake_pcap_file_header fh = *reinterpret_cast<const fake_pcap_file_header *>(buf);
+    _swapped = (magic != FAKE_PCAP_MAGIC && magic != FAKE_PCAP_MAGIC_NANO
+		&& magic != FAKE_MODIFIED_PCAP_MAGIC);
+    if (_swapped) {
+	fh.magic = SWAPLONG(fh.magic);
+	fh.version_major = (fh.version_major >> 8) | (fh.version_major << 8);
+	fh.linktype = SWAPLONG(fh.linktype);
+    }
+    if (fh.magic != FAKE_PCAP_MAGIC && fh.magic != FAKE_PCAP_MAGIC_NANO
+	&& fh.magic != FAKE_MODIFIED_PCAP_MAGIC)
+	return errh->error("%s: not a tcpdump file (bad magic number)", _filename.c_str());
+    if (fh.version_major != FAKE_PCAP_VERSION_MAJOR)
+	return errh->error("%s: unknown major version %d", _filename.c_str(), fh.version_major);
+    _nano = fh.magic == FAKE_PCAP_MAGIC_NANO;
+    _pkthdr_size = fh.magic == FAKE_MODIFIED_PCAP_MAGIC ? sizeof(fake_modified_pcap_pkthdr) : sizeof(fake_pcap_pkthdr);
+    _linktype = fake_pcap_canonical_dlt(fh.linktype, true);
+    _data_start = sizeof(fake_pcap_file_header);
+    return 0;
+}
+
+int
+FromDumpStream::initialize(ErrorHandler *errh)
+{
+    _fd = open(_filename.c_str(), O_RDONLY);
+    if (_fd < 0)
+	return errh->error("%s: %s", _filename.c_str(), strerror(errno));
+    if (read_header(errh) < 0)
+	return -1;
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    _free.initialize(_nchunks + 1, ("FromDumpStream" + String(eindex())).c_str());
+    _chunks = new Chunk[_nchunks];
+    for (int i = 0; i < _nchunks; i++) {
+	Chunk &c = _chunks[i];
+	c.data = (unsigned char *) CLICK_LALLOC(_chunk_size);
+	if (!c.data)
+	    return errh->error("out of memory");
+	c.length = 0;
+	c.records.resize(_nshards);
+	_free.insert(&c);
+    }
+
+    _shards = new Shard[_nshards];
+    _nactive = _nshards;
+    int home = router()->home_thread_id(this);
+    for (int i = 0; i < _nshards; i++) {
+	Shard &s = _shards[i];
+	s.ring.initialize(_nchunks + 1);
+	s.chunk = 0;
+	s.pos = 0;
+	s.count = 0;
+	s.done = false;
+	s.task = new Task(this);
+	s.task->initialize(this, true);
+	s.task->move_thread((home + i) % master()->nthreads());
+    }
+
+    if (pthread_create(&_reader, 0, reader_thread, this) != 0)
+	return errh->error("cannot create reader thread");
+    _reader_running = true;
+    return 0;
+}
+
+void
+FromDumpStream::cleanup(CleanupStage)
+{
+    _stopping = true;
+    if (_reader_running)
+	pthread_join(_reader, 0);
+    _reader_running = false;
+    if (_shards) {
+	for (int i = 0; i < _nshards; i++)
+	    delete _shards[i].task;
+	delete[] _shards;
+	_shards = 0;
+    }
+    if (_chunks) {
+	for (int i = 0; i < _nchunks; i++)
+	    if (_chunks[i].data)
+		CLICK_LFREE(_chunks[i].data, _chunk_size);
+	delete[] _chunks;
+	_chunks = 0;
+    }
+    if (_fd >= 0)
+	close(_fd);
+    _fd = -1;
+}
+
+void *
+FromDumpStream::reader_thread(void *arg)
+{
+    static_cast<FromDumpStream *>(arg)->read_file();
+    return 0;
+}
+
+/** @brief Return the shard of a packet, from a symmetric hash of its flow. */
+inline int
+FromDumpStream::shard_of(const unsigned char *data, uint32_t caplen) const
+{
+    if (_nshards == 1)
+	return 0;
+    const unsigned char *end = data + caplen;
+    if (_linktype == FAKE_DLT_EN10MB) {
+	if (caplen < sizeof(click_ether))
+	    return 0;
+	uint16_t type = reinterpret_cast<const click_ether *>(data)->ether_type;
+	data += sizeof(click_ether);
+	while ((type == htons(ETHERTYPE_8021Q) || type == htons(0x88A8))
+	       && data + 4 <= end) {
+	    type = *reinterpret_cast<const uint16_t *>(data + 2);
+	    data += 4;
+	}
+	if (type != htons(ETHERTYPE_IP) && type != htons(ETHERTYPE_IP6))
+	    return 0;
+    } else if (_linktype != FAKE_DLT_RAW)
+	return 0;
+
+    uint32_t h;
+    int proto;
+    const unsigned char *l4;
+    if (data + sizeof(click_ip) <= end && (data[0] >> 4) == 4) {
+	const click_ip *iph = reinterpret_cast<const click_ip *>(data);
+	h = iph->ip_src.s_addr + iph->ip_dst.s_addr;
+	proto = iph->ip_p;
+	l4 = IP_FIRSTFRAG(iph) ? data + (iph->ip_hl << 2) : end;
+    } else if (data + sizeof(click_ip6) <= end && (data[0] >> 4) == 6) {
+	const uint32_t *a = reinterpret_cast<const uint32_t *>(data + 8);
+	h = 0;
+	for (int i = 0; i < 8; i++)
+	    h += a[i];
+	proto = data[6];
+	l4 = data + sizeof(click_ip6);
+    } else
+	return 0;
+    if ((proto == IP_PROTO_TCP || proto == IP_PROTO_UDP || proto == IP_PROTO_SCTP)
+	&& l4 + 4 <= end)
+	h += (uint32_t) *reinterpret_cast<const uint16_t *>(l4)
+	    + *reinterpret_cast<const uint16_t *>(l4 + 2);
+    h = (h ^ proto) * 0x9E3779B1U;
+    h ^= h >> 16;
+    return ((uint64_t) h * _nshards) >> 32;
+}
+
+/** @brief Decode the complete records of @a c into its per-shard lists.
+ *
+ * Returns the number of bytes used; the rest of the chunk is the beginning
+ * of a record continued in the next chunk. */
+size_t
+FromDumpStream::parse_chunk(Chunk *c)
+{
+    const unsigned char *data = c->data;
+    size_t pos = 0, len = c->length;
+    Record r;
+    if (_format == FORMAT_PCAP) {
+	while (pos + _pkthdr_size <= len) {
+	    fake_pcap_pkthdr ph = *reinterpret_cast<const fake_pcap_pkthdr *>(data + pos);
+	    if (_swapped) {
+		ph.ts.tv.tv_sec = SWAPLONG(ph.ts.tv.tv_sec);
+		ph.ts.tv.tv_usec = SWAPLONG(ph.ts.tv.tv_usec);
+		ph.caplen = SWAPLONG(ph.caplen);
+		ph.len = SWAPLONG(ph.len);
+	    }
+	    if (pos + _pkthdr_size + ph.caplen > len)
+		break;
+	    r.offset = pos + _pkthdr_size;
+	    r.caplen = ph.caplen;
+	    r.len = ph.len > ph.caplen ? ph.len : ph.caplen;
+	    r.iface = 0;
+	    if (_nano)
+		r.ts = Timestamp::make_nsec(ph.ts.tv.tv_sec, ph.ts.tv.tv_usec);
+	    else
+		r.ts = Timestamp::make_usec(ph.ts.tv.tv_sec, ph.ts.tv.tv_usec);
+	    c->records[shard_of(data + r.offset, r.caplen)].push_back(r);
+	    pos = r.offset + r.caplen;
+	}
+	return pos;
+    }
+
+    while (pos + 12 <= len) {
+	const uint32_t *b = reinterpret_cast<const uint32_t *>(data + pos);
+	uint32_t blen = b[1];
+	if (blen < 12 || (blen & 3)) {
+	    // Corrupt block: drop the rest of the file
+	    click_chatter("%p{element}: bad pcapng block length %u", this, blen);
+	    return len;
+	}
+	if (pos + blen > len)
+	    break;
+	if (b[0] == FAKE_PCAPNG_SHB)
+	    _iface_units.clear();
+	else if (b[0] == FAKE_PCAPNG_IDB && blen >= 20) {
+	    uint64_t units = 1000000;
+	    const unsigned char *o = data + pos + 16, *oend = data + pos + blen - 4;
+	    while (o + 4 <= oend) {
+		uint16_t code = *reinterpret_cast<const uint16_t *>(o);
+		uint16_t olen = *reinterpret_cast<const uint16_t *>(o + 2);
+		if (code == FAKE_PCAPNG_OPT_ENDOFOPT)
+		    break;
+		if (code == FAKE_PCAPNG_OPT_IF_TSRESOL && olen >= 1 && o + 5 <= oend) {
+		    uint8_t v = o[4];
+		    if (v & 0x80)
+			units = (uint64_t) 1 << ((v & 0x7F) < 63 ? v & 0x7F : 63);
+		    else
+			for (units = 1; v > 0 && units < 1000000000000000000ULL; --v)
+			    units *= 10;
+		}
+		o += 4 + ((olen + 3) & ~3);
+	    }
+	    _iface_units.push_back(units);
+	} else if ((b[0] == FAKE_PCAPNG_EPB && blen >= 32)
+		   || (b[0] == FAKE_PCAPNG_SPB && blen >= 16)) {
+	    uint32_t room;
+	    if (b[0] == FAKE_PCAPNG_EPB) {
+		r.iface = b[2];
+		r.offset = pos + 28;
+		r.caplen = b[5];
+		r.len = b[6];
+		room = blen - 32;
+		uint64_t t = ((uint64_t) b[3] << 32) | b[4];
+		uint64_t units = r.iface < (uint32_t) _iface_units.size() ? _iface_units[r.iface] : 1000000;
+		uint64_t frac = t % units;
+		uint32_t nsec;
+		if (units <= 1000000000)
+		    nsec = frac * (1000000000 / units);
+		else
+		    nsec = (uint32_t) ((double) frac * 1e9 / units);
+		r.ts = Timestamp::make_nsec(t / units, nsec);
+	    } else {
+		r.iface = 0;
+		r.offset = pos + 12;
+		r.len = b[2];
+		room = blen - 16;
+		r.caplen = r.len;
+		r.ts = Timestamp();
+	    }
+	    if (r.caplen > room)
+		r.caplen = room;
+	    if (r.len < r.caplen)
+		r.len = r.caplen;
+	    c->records[shard_of(data + r.offset, r.caplen)].push_back(r);
+	}
+	pos += blen;
+    }
+    return pos;
+}
+
+void
+FromDumpStream::read_file()
+{
+    Chunk *prev = 0;
+    size_t carry = 0;
+    int pass = 0;
+    if (lseek(_fd, _data_start, SEEK_SET) == (off_t) -1) {
+	click_chatter("%p{element}: %s: %s", this, _filename.c_str(), strerror(errno));
+	goto done;
+    }
+
+    while (!_stopping) {
+	Chunk *c = _free.extract();
+	if (!c) {
+	    usleep(50);
+	    continue;
+	}
+	// Only this thread writes to chunks, so the tail of the previous one
+	// is intact even if the shards already released it
+	if (carry)
+	    memmove(c->data, prev->data + prev->length - carry, carry);
+	size_t length = carry;
+	bool at_eof = false;
+	while (length < _chunk_size) {
+	    ssize_t r = read(_fd, c->data + length, _chunk_size - length);
+	    if (r > 0)
+		length += r;
+	    else if (r < 0 && errno == EINTR)
+		continue;
+	    else {
+		if (r < 0)
+		    click_chatter("%p{element}: %s: %s", this, _filename.c_str(), strerror(errno));
+		at_eof = true;
+		break;
+	    }
+	}
+	c->length = length;
+	for (int i = 0; i < _nshards; i++)
+	    c->records[i].clear();
+	size_t used = parse_chunk(c);
+	carry = length - used;
+	prev = c;
+
+	int nshards = 0;
+	for (int i = 0; i < _nshards; i++)
+	    if (c->records[i].size())
+		nshards++;
+	if (nshards) {
+	    c->refcnt = nshards;
+	    for (int i = 0; i < _nshards; i++)
+		if (c->records[i].size())
+		    _shards[i].ring.insert(c);
+	} else
+	    _free.insert(c);
+
+	if (at_eof) {
+	    if (carry)
+		click_chatter("%p{element}: %s: truncated record at end of file", this, _filename.c_str());
+	    carry = 0;
+	    if (++pass == _loop)
+		break;
+	    if (lseek(_fd, _data_start, SEEK_SET) == (off_t) -1)
+		break;
+	    _iface_units.clear();
+	} else if (carry == _chunk_size) {
+	    click_chatter("%p{element}: %s: record larger than CHUNK", this, _filename.c_str());
+	    break;
+	}
+    }
+
+  done:
+    click_write_fence();
+    _eof = true;
+}
+
+void
+FromDumpStream::release(Chunk *c)
+{
+    if (c->refcnt.dec_and_test())
+	_free.insert(c);
+}
+
+bool
+FromDumpStream::run_task(Task *t)
+{
+    int idx = 0;
+    while (_shards[idx].task != t)
+	idx++;
+    Shard &s = _shards[idx];
+    if (s.done)
+	return false;
+
+    bool eof = _eof;
+    click_read_fence();
+#if HAVE_BATCH
+    PacketBatch *head = 0;
+    Packet *last = 0;
+#endif
+    unsigned n = 0;
+    while (n < _burst) {
+	if (!s.chunk) {
+	    s.chunk = s.ring.extract();
+	    s.pos = 0;
+	    if (!s.chunk)
+		break;
+	}
+	const Vector<Record> &rv = s.chunk->records[idx];
+	if (s.pos == rv.size()) {
+	    release(s.chunk);
+	    s.chunk = 0;
+	    continue;
+	}
+	const Record &r = rv[s.pos++];
+	WritablePacket *p = Packet::make(Packet::default_headroom, s.chunk->data + r.offset, r.caplen, 0);
+	if (!p)
+	    continue;
+	p->set_timestamp_anno(r.ts);
+	SET_EXTRA_LENGTH_ANNO(p, r.len - r.caplen);
+	SET_PAINT_ANNO(p, r.iface);
+	if (_linktype == FAKE_DLT_RAW)
+	    p->set_network_header(p->data());
+	else
+	    p->set_mac_header(p->data());
+#if HAVE_BATCH
+	if (!head)
+	    head = PacketBatch::start_head(p);
+	else
+	    last->set_next(p);
+	last = p;
+#else
+	output(0).push(p);
+#endif
+	n++;
+    }
+#if HAVE_BATCH
+    if (n)
+	output_push_batch(0, head->make_tail(last, n));
+#endif
+    s.count += n;
+
+    if (!s.chunk && eof && s.ring.is_empty()) {
+	s.done = true;
+	if (_nactive.dec_and_test() && _stop)
+	    router()->please_stop_driver();
+    } else
+	t->fast_reschedule();
+    return n > 0;
+}
+
+String
+FromDumpStream::read_handler(Element *e, void *)
+{
+    FromDumpStream *fd = static_cast<FromDumpStream *>(e);
+    counter_t count = 0;
+    if (fd->_shards)
+	for (int i = 0; i < fd->_nshards; i++)
+	    count += fd->_shards[i].count;
+    return String(count);
+}
+
+int
+FromDumpStream::write_handler(const String &, Element *e, void *, ErrorHandler *)
+{
+    FromDumpStream *fd = static_cast<FromDumpStream *>(e);
+    if (fd->_shards)
+	for (int i = 0; i < fd->_nshards; i++)
+	    fd->_shards[i].count = 0;
+    return 0;
+}
+
+void
+FromDumpStream::add_handlers()
+{
+    add_read_handler("count", read_handler, 0);
+    add_write_handler("reset_counts", write_handler, 0, Handler::BUTTON);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel FakePcap)
+EXPORT_ELEMENT(FromDumpStream)
+ELEMENT_MT_SAFE(FromDumpStream)
@@ -0,0 +1,176 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_FROMDUMPSTREAM_HH
+#define CLICK_FROMDUMPSTREAM_HH
+#include <click/batchelement.hh>
+#include <click/task.hh>
+#include <click/ring.hh>
+#include <click/atomic.hh>
+#include <click/vector.hh>
+#include <pthread.h>
+CLICK_DECLS
+
+/*
+=c
+
+FromDumpStream(FILENAME [, I<keywords> SHARDS, BURST, CHUNK, CHUNKS, LOOP, STOP])
+
+=s traces
+
+streams packets from a pcap or pcapng file on several threads
+
+=d
+
+Reads packets from a pcap or pcapng file, as written by tcpdump or ToDump, and
+pushes them in batches. Unlike FromDump and Replay, FromDumpStream never holds
+more than a few chunks of the file in memory, so it can replay traces much
+larger than RAM at high rates.
+
+A helper thread reads the file ahead in chunks of CHUNK bytes, and decodes
+the record headers of each chunk. It splits the records among SHARDS shards
+by a symmetric hash of their IPv4 or IPv6 addresses, protocol and ports, so
+that both directions of a flow go to the same shard; other packets go to
+shard 0. Each shard has its own task, running on its own thread starting
+from FromDumpStream's home thread. A task copies its records straight from
+the chunk into packets, BURST at a time. A chunk is reused once every shard
+is done with it.
+
+FromDumpStream sets the timestamp, extra length and, for Ethernet traces, MAC
+header annotations. For raw IP traces it sets the network header. pcapng
+packets from interface I get paint annotation I. Compressed files are not
+supported; use FromDump for them.
+
+Keyword arguments are:
+
+=over 8
+
+=item SHARDS
+
+Integer. Number of shards, and of threads pushing packets. Default is 1.
+
+=item BURST
+
+Integer. Maximum number of packets a task pushes per run. Default is 32.
+
+=item CHUNK
+
+Integer. Size of the chunks, in bytes. Default is 4 MB.
+
+=item CHUNKS
+
+Integer. Number of chunks, which bounds how far the helper thread reads
+ahead. Default is 8.
+
+=item LOOP
+
+Integer. Number of times to read the file. 0 means forever. Default is 1.
+
+=item STOP
+
+Boolean. If true, stop the driver when every shard has pushed all its
+packets. Default is false.
+
+=back
+
+=h count read-only
+
+Returns the number of packets pushed so far, by all shards.
+
+=h reset_counts write-only
+
+Resets "count" to 0.
+
+=a
+
+FromDump, Replay, ToDump */
+
+class FromDumpStream : public BatchElement { public:
+
+    FromDumpStream() CLICK_COLD;
+    ~FromDumpStream() CLICK_COLD;
+
+    const char *class_name() const	{ return "FromDumpStream"; }
+    const char *port_count() const	{ return PORTS_0_1; }
+    const char *processing() const	{ return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+    bool get_spawning_threads(Bitvector &, bool, int) override;
+
+    bool run_task(Task *);
+
+  private:
+
+#if HAVE_INT64_TYPES
+    typedef uint64_t counter_t;
+#else
+    typedef uint32_t counter_t;
+#endif
+
+    struct Record {
+	uint32_t offset;
+	uint32_t caplen;
+	uint32_t len;
+	uint32_t iface;
+	Timestamp ts;
+    };
+
+    struct Chunk {
+	unsigned char *data;
+	size_t length;
+	Vector<Vector<Record> > records;	// one per shard
+	atomic_uint32_t refcnt;
+    };
+
+    struct Shard {
+	Task *task;
+	SPSCDynamicRing<Chunk *> ring;
+	Chunk *chunk;
+	int pos;
+	counter_t count;
+	bool done;
+    } CLICK_CACHE_ALIGN;
+
+    enum { FORMAT_PCAP, FORMAT_PCAPNG };
+
+    String _filename;
+    int _fd;
+    int _format;
+    bool _swapped;
+    bool _nano;
+    size_t _pkthdr_size;
+    int _linktype;
+    off_t _data_start;
+    Vector<uint64_t> _iface_units;	// pcapng timestamp units per second
+
+    int _nshards;
+    unsigned _burst;
+    size_t _chunk_size;
+    int _nchunks;
+    int _loop;
+    bool _stop;
+
+    Chunk *_chunks;
+    Shard *_shards;
+    MPMCDynamicRing<Chunk *> _free;
+    pthread_t _reader;
+    bool _reader_running;
+    volatile bool _stopping;
+    volatile bool _eof;
+    atomic_uint32_t _nactive;
+
+    int read_header(ErrorHandler *);
+    static void *reader_thread(void *);
+    void read_file();
+    size_t parse_chunk(Chunk *c);
+    inline int shard_of(const unsigned char *data, uint32_t caplen) const;
+    void release(Chunk *c);
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,291 @@
+// -*- c-basic-offset: 4; related-file-name: "rssrebalancer.hh" -*-
+/*
+ * rssrebalancer.{cc,hh} -- moves RSS buckets between the queues of a port
+ * to balance their load
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "rssrebalancer.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/router.hh>
+#include <click/routervisitor.hh>
+#include <click/master.hh>
+#include <click/straccum.hh>
+CLICK_DECLS
+
+RSSRebalancer::RSSRebalancer()
+    : _port(0), _table(0), _timer(this), _interval(1000), _drain_timeout(100),
+      _threshold(1.2), _max_moves(8), _verbose(false), _synced(false),
+      _round_forced(false), _imbalance(0), _moves(0), _rounds(0), _forced(0)
+{
+}
+
+RSSRebalancer::~RSSRebalancer()
+{
+}
+
+int
+RSSRebalancer::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    if (Args(conf, this, errh)
+        .read_mp("PORT", _port)
+        .read("INTERVAL", SecondsArg(3), _interval)
+        .read("THRESHOLD", _threshold)
+        .read("MAX_MOVES", _max_moves)
+        .read("DRAIN_TIMEOUT", SecondsArg(3), _drain_timeout)
+        .read("VERBOSE", _verbose)
+        .complete() < 0)
+        return -1;
+
+    if (!(_table = static_cast<RSSTable *>(_port->cast("RSSTable"))))
+        return errh->error("%p{element} does not provide an RSS table", _port);
+    if (_threshold < 1)
+        return errh->error("THRESHOLD must be at least 1");
+    // The port counts packets per bucket only when asked, before it is
+    // initialized
+    _table->rss_enable();
+    return 0;
+}
+
+int
+RSSRebalancer::initialize(ErrorHandler *errh)
+{
+    if (_table->nqueues() == 0)
+        return errh->error("%p{element} has no RSS table", _port);
+
+    ElementCastTracker track(router(), "FlowIPManagerIMP");
+    for (int i = 0; i < _port->noutputs(); i++)
+        router()->visit_downstream(_port, i, &track);
+    if (track.size() > 0)
+        return errh->error("%p{element} keeps per-thread flow tables, which cannot follow moved buckets", track[0]);
+
+    _table->rss_counts(_last);
+    _queue_packets.assign(_table->nqueues(), 0);
+    _timer.initialize(this);
+    if (_interval)
+        _timer.schedule_after_msec(_interval);
+    return 0;
+}
+
+/* Load of one packet of each queue, relative to the others. Without thread
+   load measurements every packet weighs 1. */
+void
+RSSRebalancer::weights(Vector<double> &w)
+{
+    w.assign(_table->nqueues(), 1);
+#if HAVE_CLICK_LOAD
+    int nthreads = master()->nthreads();
+    Vector<uint64_t> thread_packets(nthreads, 0);
+    for (unsigned q = 0; q < _table->nqueues(); q++) {
+        int t = _table->rss_queue_thread(q);
+        if (t < 0 || t >= nthreads)
+            return;
+        thread_packets[t] += _queue_packets[q];
+    }
+    double sum = 0;
+    int n = 0;
+    for (unsigned q = 0; q < _table->nqueues(); q++) {
+        int t = _table->rss_queue_thread(q);
+        if (thread_packets[t] == 0)
+            continue;
+        w[q] = master()->thread(t)->load() / thread_packets[t];
+        sum += w[q];
+        n++;
+    }
+    // Queues without packets cost the mean
+    if (n == 0)
+        return;
+    for (unsigned q = 0; q < _table->nqueues(); q++) {
+        if (thread_packets[_table->rss_queue_thread(q)] == 0)
+            w[q] = sum / n;
+        w[q] /= sum / n;
+    }
+#endif
+}
+
+int
+RSSRebalancer::decide(ErrorHandler *errh)
+{
+    int nq = _table->nqueues();
+    Vector<uint64_t> counts;
+    _table->rss_counts(counts);
+    Vector<uint64_t> delta(counts.size(), 0);
+    for (int b = 0; b < counts.size(); b++)
+        delta[b] = counts[b] - _last[b];
+    _last.swap(counts);
+
+    Vector<unsigned> reta = _table->reta();
+    _queue_packets.assign(nq, 0);
+    for (int b = 0; b < reta.size(); b++)
+        _queue_packets[reta[b]] += delta[b];
+
+    Vector<double> w;
+    weights(w);
+    Vector<double> load(nq, 0);
+    double total = 0;
+    for (int b = 0; b < reta.size(); b++) {
+        load[reta[b]] += delta[b] * w[reta[b]];
+        total += delta[b] * w[reta[b]];
+    }
+    if (total == 0) {
+        _imbalance = 0;
+        return 0;
+    }
+    double mean = total / nq;
+    int qmax = 0;
+    for (int q = 1; q < nq; q++)
+        if (load[q] > load[qmax])
+            qmax = q;
+    _imbalance = load[qmax] / mean;
+    if (_imbalance <= _threshold)
+        return 0;
+
+    Vector<bool> moved(reta.size(), false);
+    int nmoves = 0;
+    while (nmoves < _max_moves) {
+        int qmin = 0;
+        qmax = 0;
+        for (int q = 1; q < nq; q++) {
+            if (load[q] > load[qmax])
+                qmax = q;
+            if (load[q] < load[qmin])
+                qmin = q;
+        }
+        if (load[qmax] <= mean * _threshold)
+            break;
+
+        // The bucket that lowers the larger of the two loads the most
+        int best = -1;
+        double best_max = load[qmax];
+        for (int b = 0; b < reta.size(); b++) {
+            if ((int) reta[b] != qmax || moved[b] || delta[b] == 0)
+                continue;
+            double m = max(load[qmax] - delta[b] * w[qmax], load[qmin] + delta[b] * w[qmin]);
+            if (m < best_max) {
+                best = b;
+                best_max = m;
+            }
+        }
+        if (best < 0)
+            break;
+        if (_verbose)
+            click_chatter("%p{element}: bucket %d (%llu packets) from queue %d to %d",
+                          this, best, (unsigned long long) delta[best], qmax, qmin);
+        load[qmax] -= delta[best] * w[qmax];
+        load[qmin] += delta[best] * w[qmin];
+        reta[best] = qmin;
+        moved[best] = true;
+        nmoves++;
+    }
+    if (nmoves == 0)
+        return 0;
+
+    if (_table->rss_move(reta, errh) < 0)
+        return -1;
+    _moves += nmoves;
+    _rounds++;
+    _round_forced = false;
+    _round_start = Timestamp::now_steady();
+    return nmoves;
+}
+
+int
+RSSRebalancer::step(ErrorHandler *errh)
+{
+    if (!_synced) {
+        if (_table->rss_sync(errh) < 0)
+            return -1;
+        _synced = true;
+    }
+    if (_table->rss_moving()) {
+        bool force = (Timestamp::now_steady() - _round_start).msecval() >= _drain_timeout;
+        if (force && !_round_forced) {
+            _round_forced = true;
+            _forced++;
+        }
+        if (!_table->rss_step(force))
+            return 1;
+        // Packets counted during the move do not reflect the new table
+        _table->rss_counts(_last);
+        return 0;
+    }
+    return decide(errh) > 0;
+}
+
+void
+RSSRebalancer::run_timer(Timer *)
+{
+    int r = step(ErrorHandler::default_handler());
+    // Follow a move closely, it only waits for the queues to be polled
+    if (r > 0)
+        _timer.reschedule_after_msec(1);
+    else
+        _timer.reschedule_after_msec(_interval);
+}
+
+String
+RSSRebalancer::read_handler(Element *e, void *thunk)
+{
+    RSSRebalancer *rb = static_cast<RSSRebalancer *>(e);
+    StringAccum sa;
+    switch ((intptr_t) thunk) {
+    case h_imbalance:
+        sa.snprintf(16, "%.2f", rb->_imbalance);
+        break;
+    case h_queue_packets:
+        for (int q = 0; q < rb->_queue_packets.size(); q++)
+            sa << (q ? " " : "") << rb->_queue_packets[q];
+        break;
+    case h_reta:
+        for (unsigned b = 0; b < rb->_table->size(); b++)
+            sa << (b ? " " : "") << rb->_table->reta()[b];
+        break;
+    case h_moves:
+        sa << rb->_moves;
+        break;
+    case h_rounds:
+        sa << rb->_rounds;
+        break;
+    case h_forced:
+        sa << rb->_forced;
+        break;
+    case h_held:
+        sa << rb->_table->rss_held();
+        break;
+    }
+    return sa.take_string();
+}
+
+int
+RSSRebalancer::write_handler(const String &, Element *e, void *, ErrorHandler *errh)
+{
+    return static_cast<RSSRebalancer *>(e)->step(errh) < 0 ? -1 : 0;
+}
+
+void
+RSSRebalancer::add_handlers()
+{
+    add_read_handler("imbalance", read_handler, h_imbalance);
+    add_read_handler("queue_packets", read_handler, h_queue_packets);
+    add_read_handler("reta", read_handler, h_reta);
+    add_read_handler("moves", read_handler, h_moves);
+    add_read_handler("rounds", read_handler, h_rounds);
+    add_read_handler("forced", read_handler, h_forced);
+    add_read_handler("held", read_handler, h_held);
+    add_write_handler("rebalance", write_handler, 0);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel RSSTable)
+EXPORT_ELEMENT(RSSRebalancer)
@@ -0,0 +1,170 @@
+#ifndef CLICK_RSSREBALANCER_HH
+#define CLICK_RSSREBALANCER_HH
+#include <click/element.hh>
+#include <click/timer.hh>
+#include <click/vector.hh>
+#include "rsstable.hh"
+CLICK_DECLS
+
+/*
+=title RSSRebalancer
+
+=c
+
+RSSRebalancer(PORT [, I<keywords> INTERVAL, THRESHOLD, MAX_MOVES])
+
+=s threads
+
+moves RSS buckets between the queues of a port to balance their load
+
+=d
+
+A NIC using RSS spreads flows among its receive queues according to an
+indirection table (RETA) indexed by the low bits of each packet's RSS hash.
+The table is usually filled round-robin once at startup, so when a few large
+flows hash to buckets of the same queue, its core saturates while the others
+idle.
+
+RSSRebalancer periodically reads the number of packets received by each
+bucket of PORT's table since its last decision. The load of a queue is the
+number of packets of its buckets; when Click measures thread load, each
+packet is weighted by the load of the thread polling its queue divided by
+the packets that thread received, so that expensive packets count more.
+When the most loaded queue exceeds the mean by more than THRESHOLD, buckets
+are moved greedily, each time from the most loaded queue to the least
+loaded one, choosing the bucket that lowers the larger of the two loads the
+most, until the loads are within THRESHOLD or MAX_MOVES buckets were moved.
+
+Buckets are moved without sending a flow to two threads at once: packets of
+a moved bucket received by its new queue are held until the old queue has
+been emptied once, then sent before the new queue's next packets. Flow
+managers that share their table between threads, such as FlowIPManagerMP
+or FlowIPManagerCuckoo with MT, therefore see each flow in order, on one
+thread at a time. Managers with per-thread tables, such as
+FlowIPManagerIMP, cannot find the state of moved flows and are refused
+downstream of PORT.
+
+PORT is a FromDPDKDevice serving all the queues of its device, which then
+counts packets per bucket, or another element providing an RSS table.
+
+Keyword arguments are:
+
+=over 8
+
+=item PORT
+
+Element. The port whose table is rebalanced.
+
+=item INTERVAL
+
+Time. Period of the rebalancing decisions. 0 means only when the rebalance
+handler is written. Default is 1 second.
+
+=item THRESHOLD
+
+Double. Largest tolerated ratio of the most loaded queue's load to the mean
+load. Default is 1.2.
+
+=item MAX_MOVES
+
+Integer. Maximum number of buckets moved at once. Default is 8.
+
+=item DRAIN_TIMEOUT
+
+Time. If an old queue was not found empty after this time, the held packets
+are released anyway. Default is 100 milliseconds.
+
+=item VERBOSE
+
+Boolean. Print each decision. Default is false.
+
+=back
+
+=h imbalance read-only
+
+Ratio of the most loaded queue's load to the mean load, at the last
+decision.
+
+=h queue_packets read-only
+
+Packets received by each queue between the last two decisions.
+
+=h reta read-only
+
+The queue of each bucket.
+
+=h moves read-only
+
+Number of buckets moved.
+
+=h rounds read-only
+
+Number of decisions that moved buckets.
+
+=h forced read-only
+
+Number of rounds whose held packets were released after DRAIN_TIMEOUT.
+
+=h held read-only
+
+Number of packets currently held.
+
+=h rebalance write-only
+
+Make a decision now, or advance the current move.
+
+=e
+
+  fd :: FromDPDKDevice(0, MAXTHREADS 4) -> ...
+  RSSRebalancer(fd, INTERVAL 500ms)
+
+=a FromDPDKDevice, FlowIPManagerMP */
+
+class RSSRebalancer : public Element { public:
+
+    RSSRebalancer() CLICK_COLD;
+    ~RSSRebalancer() CLICK_COLD;
+
+    const char *class_name() const override { return "RSSRebalancer"; }
+    const char *port_count() const override { return PORTS_0_0; }
+
+    int configure_phase() const override { return CONFIGURE_PHASE_LAST; }
+    int configure(Vector<String> &conf, ErrorHandler *errh) override CLICK_COLD;
+    int initialize(ErrorHandler *errh) override CLICK_COLD;
+    void add_handlers() override CLICK_COLD;
+
+    void run_timer(Timer *t) override;
+
+  private:
+
+    Element *_port;
+    RSSTable *_table;
+    Timer _timer;
+    uint32_t _interval;
+    uint32_t _drain_timeout;
+    double _threshold;
+    int _max_moves;
+    bool _verbose;
+
+    bool _synced;
+    bool _round_forced;
+    Timestamp _round_start;
+    Vector<uint64_t> _last;
+    Vector<uint64_t> _queue_packets;
+    double _imbalance;
+    uint64_t _moves;
+    uint64_t _rounds;
+    uint64_t _forced;
+
+    int step(ErrorHandler *errh);
+    int decide(ErrorHandler *errh);
+    void weights(Vector<double> &w);
+
+    enum { h_imbalance, h_queue_packets, h_reta, h_moves, h_rounds, h_forced, h_held };
+    static String read_handler(Element *e, void *thunk) CLICK_COLD;
+    static int write_handler(const String &, Element *e, void *, ErrorHandler *errh) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
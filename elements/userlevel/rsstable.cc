@@ -0,0 +1,172 @@
+// -*- c-basic-offset: 4; related-file-name: "rsstable.hh" -*-
+/*
+ * rsstable.{cc,hh} -- RSS indirection table of a receiving port, with
+ * per-bucket load counters and safe bucket migration
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "rsstable.hh"
+CLICK_DECLS
+
+RSSTable::RSSTable()
+    : _enabled(false), _moving(false), _released(false), _mask(0)
+{
+}
+
+RSSTable::~RSSTable()
+{
+    for (int i = 0; i < _queues.size(); i++)
+        while (Packet *p = _queues[i].held_head) {
+            _queues[i].held_head = p->next();
+            p->kill();
+        }
+}
+
+int
+RSSTable::rss_initialize(unsigned size, unsigned nqueues, ErrorHandler *errh)
+{
+    if (size == 0 || (size & (size - 1)) != 0)
+        return errh->error("RSS table size %u is not a power of two", size);
+    if (nqueues == 0 || nqueues >= NO_QUEUE)
+        return errh->error("bad number of RSS queues %u", nqueues);
+    _mask = size - 1;
+    _reta.resize(size);
+    for (unsigned i = 0; i < size; i++)
+        _reta[i] = i % nqueues;
+    _migrating.assign(size, NO_QUEUE);
+    _queues.resize(nqueues);
+    for (unsigned i = 0; i < _counts.weight(); i++)
+        _counts.get_value(i).assign(size, 0);
+    return 0;
+}
+
+int
+RSSTable::rss_sync(ErrorHandler *errh)
+{
+    Vector<unsigned> reta;
+    if (read_reta(reta, errh) < 0)
+        return -1;
+    if (reta.size() != _reta.size())
+        return errh->error("RSS table has %d buckets, expected %d", reta.size(), _reta.size());
+    for (int i = 0; i < reta.size(); i++)
+        if (reta[i] >= nqueues())
+            return errh->error("RSS bucket %d goes to unknown queue %u", i, reta[i]);
+    _reta = reta;
+    return 0;
+}
+
+void
+RSSTable::rss_counts(Vector<uint64_t> &counts) const
+{
+    counts.assign(_reta.size(), 0);
+    for (unsigned i = 0; i < _counts.weight(); i++) {
+        const Vector<uint64_t> &c = _counts.get_value(i);
+        for (int b = 0; b < c.size(); b++)
+            counts[b] += c[b];
+    }
+}
+
+unsigned
+RSSTable::rss_held() const
+{
+    unsigned n = 0;
+    for (int i = 0; i < _queues.size(); i++)
+        n += _queues[i].held;
+    return n;
+}
+
+int
+RSSTable::rss_move(const Vector<unsigned> &reta, ErrorHandler *errh)
+{
+    if (_moving)
+        return errh->error("RSS buckets are already moving");
+    if (reta.size() != _reta.size())
+        return errh->error("RSS table must have %d buckets", _reta.size());
+    bool any = false;
+    for (int b = 0; b < reta.size(); b++) {
+        if (reta[b] >= nqueues()) {
+            _migrating.assign(_reta.size(), NO_QUEUE);
+            return errh->error("RSS bucket %d goes to unknown queue %u", b, reta[b]);
+        }
+        if (reta[b] != _reta[b]) {
+            _migrating[b] = _reta[b];
+            any = true;
+        }
+    }
+    if (!any)
+        return 0;
+
+    // New queues hold the packets of moving buckets from now on
+    click_fence();
+    if (write_reta(reta, errh) < 0) {
+        _migrating.assign(_reta.size(), NO_QUEUE);
+        return -1;
+    }
+    _reta = reta;
+    click_fence();
+    // Old queues are drained once they are found empty after the update
+    for (int b = 0; b < reta.size(); b++)
+        if (_migrating[b] != NO_QUEUE)
+            _queues[_migrating[b]].drain = true;
+    _moving = true;
+    _released = false;
+    return 0;
+}
+
+bool
+RSSTable::rss_step(bool force)
+{
+    if (!_moving)
+        return true;
+    if (!_released) {
+        for (int i = 0; i < _queues.size(); i++)
+            if (_queues[i].drain && !force)
+                return false;
+        click_fence();
+        for (int b = 0; b < _reta.size(); b++)
+            if (_migrating[b] != NO_QUEUE)
+                _queues[_reta[b]].release = true;
+        _released = true;
+        return false;
+    }
+    // New queues release their packets and end the migration of their
+    // buckets before their next poll
+    for (int i = 0; i < _queues.size(); i++)
+        if (_queues[i].release)
+            return false;
+    for (int i = 0; i < _queues.size(); i++)
+        _queues[i].drain = false;
+    _moving = false;
+    return true;
+}
+
+unsigned
+RSSTable::release(int queue, Packet *&head, Packet *&tail)
+{
+    QueueState &q = _queues[queue];
+    for (int b = 0; b < _reta.size(); b++)
+        if (_migrating[b] != NO_QUEUE && _reta[b] == (unsigned) queue)
+            _migrating[b] = NO_QUEUE;
+    head = q.held_head;
+    tail = q.held_tail;
+    unsigned n = q.held;
+    q.held_head = q.held_tail = 0;
+    q.held = 0;
+    click_compiler_fence();
+    q.release = false;
+    return n;
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel)
+ELEMENT_PROVIDES(RSSTable)
@@ -0,0 +1,153 @@
+#ifndef CLICK_RSSTABLE_HH
+#define CLICK_RSSTABLE_HH
+#include <click/vector.hh>
+#include <click/multithread.hh>
+#include <click/packet.hh>
+#include <click/machine.hh>
+#include <click/error.hh>
+CLICK_DECLS
+
+/**
+ * The RSS indirection table (RETA) of a receiving port, with the packet
+ * counters and migration state needed to move buckets between queues at
+ * run time.
+ *
+ * The NIC sends a packet to queue reta()[hash & (size() - 1)], where hash
+ * is the packet's RSS hash. A port that lets RSSRebalancer move buckets
+ * implements read_reta() and write_reta(), calls rss_count() for each
+ * received packet, and brackets each poll of a queue with rss_poll_begin()
+ * and rss_poll_end(). Each queue must be polled by a single thread.
+ *
+ * Moving a bucket is done in rounds that keep per-flow state safe when it
+ * is shared between threads. From the RETA update until the old queue has
+ * been found empty once, packets of a moved bucket received by the new
+ * queue are held by rss_count(). They are then released in order, before
+ * any other packet of the new queue. A flow is therefore never processed by
+ * two threads at once, and its packets are not reordered.
+ */
+class RSSTable { public:
+
+    RSSTable();
+    virtual ~RSSTable();
+
+    /** @brief Read the RETA of the device into @a reta. */
+    virtual int read_reta(Vector<unsigned> &reta, ErrorHandler *errh) = 0;
+    /** @brief Write @a reta to the device. */
+    virtual int write_reta(const Vector<unsigned> &reta, ErrorHandler *errh) = 0;
+    /** @brief Return the Click thread polling @a queue, or -1. */
+    virtual int rss_queue_thread(int queue) = 0;
+
+    /** @brief Ask the port to count packets per bucket. Must be called
+     * before the port is initialized. */
+    void rss_enable() {
+        _enabled = true;
+    }
+    bool rss_enabled() const {
+        return _enabled;
+    }
+    /** @brief Set up a table of @a size buckets, a power of two, over
+     * @a nqueues queues. */
+    int rss_initialize(unsigned size, unsigned nqueues, ErrorHandler *errh);
+
+    unsigned size() const {
+        return _reta.size();
+    }
+    unsigned nqueues() const {
+        return _queues.size();
+    }
+    /** @brief Return the current table, as last read or written. */
+    const Vector<unsigned> &reta() const {
+        return _reta;
+    }
+    /** @brief Read the table from the device. */
+    int rss_sync(ErrorHandler *errh);
+
+    /** @brief Set @a counts to the number of packets received by each
+     * bucket so far. */
+    void rss_counts(Vector<uint64_t> &counts) const;
+    /** @brief Return the number of packets held by all queues. */
+    unsigned rss_held() const;
+
+    /** @brief Start moving buckets to make the table @a reta. */
+    int rss_move(const Vector<unsigned> &reta, ErrorHandler *errh);
+    /** @brief Advance the current round.
+     * @param force release held packets even if the old queues were not
+     * drained
+     * @return true if no round is in progress */
+    bool rss_step(bool force);
+    bool rss_moving() const {
+        return _moving;
+    }
+
+    /** @brief Count a packet of RSS hash @a hash received by @a queue.
+     * @return true if the packet must be given to rss_hold() */
+    inline bool rss_count(uint32_t hash, int queue) {
+        unsigned b = hash & _mask;
+        (*_counts)[b]++;
+        return unlikely(_migrating[b] != NO_QUEUE) && _migrating[b] != queue;
+    }
+    /** @brief Hold packet @a p of @a queue until its bucket moved. */
+    inline void rss_hold(int queue, Packet *p) {
+        QueueState &q = _queues[queue];
+        p->set_next(0);
+        if (q.held_tail)
+            q.held_tail->set_next(p);
+        else
+            q.held_head = p;
+        q.held_tail = p;
+        q.held++;
+    }
+    /** @brief Called before polling @a queue.
+     * @param[out] head the packets to send before the poll, or null
+     * @param[out] tail the last of those packets
+     * @return the number of those packets */
+    inline unsigned rss_poll_begin(int queue, Packet *&head, Packet *&tail) {
+        QueueState &q = _queues[queue];
+        q.drain_seen = q.drain;
+        if (likely(!q.release)) {
+            return 0;
+        }
+        return release(queue, head, tail);
+    }
+    /** @brief Called after polling @a queue.
+     * @param empty true if the poll emptied the queue */
+    inline void rss_poll_end(int queue, bool empty) {
+        QueueState &q = _queues[queue];
+        if (unlikely(q.drain_seen) && empty) {
+            q.drain_seen = false;
+            click_compiler_fence();
+            q.drain = false;
+        }
+    }
+
+  private:
+
+    enum { NO_QUEUE = 0xFFFF };
+
+    struct QueueState {
+        QueueState() : drain(false), drain_seen(false), release(false),
+                       held_head(0), held_tail(0), held(0) {
+        }
+        volatile bool drain; //Set by the rebalancer, cleared by the queue
+        bool drain_seen;
+        volatile bool release;
+        Packet *held_head;
+        Packet *held_tail;
+        unsigned held;
+    } CLICK_CACHE_ALIGN;
+
+    bool _enabled;
+    bool _moving;
+    bool _released;
+    unsigned _mask;
+    Vector<unsigned> _reta;
+    Vector<uint16_t> _migrating; //Old queue of each moving bucket
+    Vector<QueueState, CLICK_CACHE_LINE_SIZE> _queues;
+    per_thread<Vector<uint64_t> > _counts;
+
+    unsigned release(int queue, Packet *&head, Packet *&tail);
+
+};
+
+CLICK_ENDDECLS
+#endif
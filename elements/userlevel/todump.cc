@@ -28,10 +28,13 @@
 # include <click/master.hh>
 #endif
 #include <click/error.hh>
+#include <click/straccum.hh>
 #include <click/standard/scheduleinfo.hh>
 #include <click/packet_anno.hh>
 #include "fakepcap.hh"
 #include <click/userutils.hh>
+#include <fcntl.h>
+#include <unistd.h>
 #if HAVE_PCAP
 extern "C" {
 # include <pcap.h>
@@ -40,8 +43,11 @@ extern "C" {
 CLICK_DECLS
 
 ToDump::ToDump()
-    : _fp(0), _count(0), _task(this), _use_encap_from(0)
+    : _fp(0), _count(0), _count_base(0), _buffer_size(0), _direct(false),
+      _seekable(false), _fd(-1), _flush_gen(0), _task(this), _use_encap_from(0)
 {
+    for (unsigned i = 0; i < _buffers.weight(); i++)
+        _buffers.get_value(i).data = 0;
 }
 
 ToDump::~ToDump()
@@ -53,6 +59,7 @@ ToDump::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     String encap_type;
     String use_encap_from;
+    String format = "pcap";
     _snaplen = 2000;
     _extra_length = true;
     _unbuffered = false;
@@ -77,12 +84,36 @@ ToDump::configure(Vector<String> &conf, ErrorHandler *errh)
         .read("PER_NODE", per_node)
 #endif
         .read("FORCE_TS", _force_ts)
+        .read("FORMAT", WordArg(), format)
+        .read_or_set("INTERFACES", _interfaces, 1)
+        .read("BUFFER", _buffer_size)
+        .read("DIRECT", _direct)
         .complete() < 0)
             return -1;
 
     if (_snaplen == 0)
         _snaplen = 0xFFFFFFFFU;
 
+    if (format == "pcap")
+        _pcapng = false;
+    else if (format == "pcapng")
+        _pcapng = true;
+    else
+        return errh->error("bad FORMAT %<%s%>", format.c_str());
+    if (_interfaces == 0 || _interfaces > 255)
+        return errh->error("INTERFACES must be between 1 and 255");
+    if (_interfaces > 1 && !_pcapng)
+        return errh->error("INTERFACES requires FORMAT pcapng");
+
+    if (_buffer_size) {
+        if (_buffer_size < 2 * ALIGN)
+            return errh->error("BUFFER must be at least %d bytes", 2 * ALIGN);
+        _buffer_size = (_buffer_size + ALIGN - 1) & ~(ALIGN - 1);
+        if (_unbuffered)
+            return errh->error("BUFFER and UNBUFFERED are incompatible");
+    } else if (_direct)
+        return errh->error("DIRECT requires BUFFER");
+
     if (use_encap_from && encap_type)
         return errh->error("specify at most one of 'ENCAP' and 'USE_ENCAP_FROM'");
     else if (use_encap_from) {
@@ -119,11 +150,56 @@ ToDump::hotswap_element() const
     if (Element *e = Element::hotswap_element())
     if (ToDump *td = (ToDump *)e->cast("ToDump"))
         if (td->_filename == _filename
-        && td->_linktype == _linktype)
+        && td->_linktype == _linktype
+        && td->_pcapng == _pcapng
+        && !td->_buffer_size && !_buffer_size)
         return td;
     return 0;
 }
 
+String
+ToDump::file_header() const
+{
+    if (!_pcapng) {
+        struct fake_pcap_file_header h;
+
+        h.magic = _nano ? FAKE_PCAP_MAGIC_NANO : FAKE_PCAP_MAGIC;
+        h.version_major = FAKE_PCAP_VERSION_MAJOR;
+        h.version_minor = FAKE_PCAP_VERSION_MINOR;
+
+        h.thiszone = 0;        // timestamps are in GMT
+        h.sigfigs = 0;        // XXX accuracy of timestamps?
+        h.snaplen = _snaplen;
+        h.linktype = _linktype;
+        return String((const char *) &h, sizeof(h));
+    }
+
+    StringAccum sa;
+    // Section header block, with an unspecified section length
+    uint32_t shb[7] = { FAKE_PCAPNG_SHB, 28, FAKE_PCAPNG_BYTE_ORDER_MAGIC,
+                        FAKE_PCAPNG_VERSION_MAJOR | (FAKE_PCAPNG_VERSION_MINOR << 16),
+                        0xFFFFFFFFU, 0xFFFFFFFFU, 28 };
+    sa.append((const char *) shb, sizeof(shb));
+    // Interface description blocks; timestamps are in microseconds unless
+    // if_tsresol says otherwise
+    for (unsigned i = 0; i < _interfaces; i++) {
+        uint32_t idb[8];
+        uint32_t len = _nano ? 32 : 20;
+        idb[0] = FAKE_PCAPNG_IDB;
+        idb[1] = len;
+        idb[2] = _linktype & 0xFFFF;
+        idb[3] = _snaplen == 0xFFFFFFFFU ? 0 : _snaplen;
+        if (_nano) {
+            idb[4] = FAKE_PCAPNG_OPT_IF_TSRESOL | (1 << 16);
+            idb[5] = 9;
+            idb[6] = FAKE_PCAPNG_OPT_ENDOFOPT;
+        }
+        idb[len / 4 - 1] = len;
+        sa.append((const char *) idb, len);
+    }
+    return sa.take_string();
+}
+
 int
 ToDump::initialize(ErrorHandler *errh)
 {
@@ -158,8 +234,24 @@ ToDump::initialize(ErrorHandler *errh)
 
     // prepare files
     assert(!_fp);
-    if (_filename != "-") {
-        if (compressed_filename(_filename) > 0)
+    bool compressed = _filename != "-" && compressed_filename(_filename) > 0;
+    if (_buffer_size && !compressed && _filename != "-") {
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+        if (_direct)
+            flags |= O_DIRECT;
+#else
+        if (_direct)
+            return errh->error("DIRECT is not supported on this system");
+#endif
+        _fd = open(_filename.c_str(), flags, 0666);
+        if (_fd < 0)
+            return errh->error("%s: %s", _filename.c_str(), strerror(errno));
+        _seekable = lseek(_fd, 0, SEEK_CUR) == 0;
+    } else if (_direct)
+        return errh->error("DIRECT requires a regular uncompressed file");
+    else if (_filename != "-") {
+        if (compressed)
         _fp = open_compress_pipe(_filename, errh);
         else
         _fp = fopen(_filename.c_str(), "wb");
@@ -173,20 +265,28 @@ ToDump::initialize(ErrorHandler *errh)
     if (_unbuffered)
         setvbuf(_fp, (char *) 0, _IONBF, 0);
 
-    struct fake_pcap_file_header h;
-
-    h.magic = _nano ? FAKE_PCAP_MAGIC_NANO : FAKE_PCAP_MAGIC;
-    h.version_major = FAKE_PCAP_VERSION_MAJOR;
-    h.version_minor = FAKE_PCAP_VERSION_MINOR;
-
-    h.thiszone = 0;        // timestamps are in GMT
-    h.sigfigs = 0;        // XXX accuracy of timestamps?
-    h.snaplen = _snaplen;
-    h.linktype = _linktype;
-
-    size_t wrote_header = fwrite(&h, sizeof(h), 1, _fp);
-    if (wrote_header != 1)
-        return errh->error("%s: unable to write file header", _filename.c_str());
+    String h = file_header();
+    if (_buffer_size) {
+        if (_fd < 0) {
+            fflush(_fp);
+            _fd = fileno(_fp);
+        }
+        if (_direct) {
+            // O_DIRECT writes must stay page-aligned in the file, so the file
+            // header goes through the buffer of the only writing thread
+            if (get_passing_threads().weight() > 1)
+                return errh->error("DIRECT requires a single thread");
+            _direct_header = h;
+            _offset = 0;
+        } else if (!write_all((const unsigned char *) h.data(), h.length(), 0))
+            return errh->error("%s: unable to write file header", _filename.c_str());
+        else
+            _offset = h.length();
+    } else {
+        size_t wrote_header = fwrite(h.data(), h.length(), 1, _fp);
+        if (wrote_header != 1)
+            return errh->error("%s: unable to write file header", _filename.c_str());
+    }
     }
 
     if (input_is_pull(0) && noutputs() == 0) {
@@ -210,39 +310,209 @@ ToDump::take_state(Element *e, ErrorHandler *)
 void
 ToDump::cleanup(CleanupStage)
 {
+    for (unsigned i = 0; i < _buffers.weight(); i++) {
+        Buffer &b = _buffers.get_value(i);
+        if (b.data) {
+            if (_active && _fd >= 0)
+                flush(b, true);
+            free(b.data);
+            b.data = 0;
+        }
+    }
     if (_fp && _fp != stdout)
         fclose(_fp);
+    else if (!_fp && _fd >= 0)
+        close(_fd);
     _fp = 0;
+    _fd = -1;
 }
 
-void
-ToDump::write_packet(Packet *p)
+inline unsigned
+ToDump::packet_header(Packet *p, unsigned char *h, unsigned &caplen) const
 {
-    struct fake_pcap_pkthdr ph;
-
     Timestamp ts = p->timestamp_anno();
     if (!ts && !_force_ts)
         ts = Timestamp::now();
-    ph.ts.tv.tv_sec = ts.sec();
-    ph.ts.tv.tv_usec = _nano ? ts.nsec() : ts.usec();
 
-    unsigned to_write = p->length();
-    ph.len = to_write + (_extra_length ? EXTRA_LENGTH_ANNO(p) : 0);
-    if (_snaplen && to_write > _snaplen)
-        to_write = _snaplen;
-    ph.caplen = to_write;
+    unsigned len = p->length() + (_extra_length ? EXTRA_LENGTH_ANNO(p) : 0);
+    caplen = p->length();
+    if (_snaplen && caplen > _snaplen)
+        caplen = _snaplen;
+
+    if (!_pcapng) {
+        struct fake_pcap_pkthdr *ph = reinterpret_cast<struct fake_pcap_pkthdr *>(h);
+        ph->ts.tv.tv_sec = ts.sec();
+        ph->ts.tv.tv_usec = _nano ? ts.nsec() : ts.usec();
+        ph->caplen = caplen;
+        ph->len = len;
+        return sizeof(struct fake_pcap_pkthdr);
+    }
 
-    if (_mt)
+    uint32_t *epb = reinterpret_cast<uint32_t *>(h);
+    uint64_t t = _nano ? ts.nsecval() : ts.usecval();
+    epb[0] = FAKE_PCAPNG_EPB;
+    epb[1] = 32 + ((caplen + 3) & ~3U);
+    epb[2] = _interfaces > 1 && PAINT_ANNO(p) < _interfaces ? PAINT_ANNO(p) : 0;
+    epb[3] = t >> 32;
+    epb[4] = t;
+    epb[5] = caplen;
+    epb[6] = len;
+    return 28;
+}
+
+inline unsigned
+ToDump::packet_trailer(unsigned char *t, unsigned caplen) const
+{
+    if (!_pcapng)
+        return 0;
+    // Pad the packet data to 32 bits, then repeat the block length
+    unsigned pad = -caplen & 3;
+    uint32_t len = 32 + caplen + pad;
+    memset(t, 0, pad);
+    memcpy(t + pad, &len, 4);
+    return pad + 4;
+}
+
+bool
+ToDump::write_all(const unsigned char *data, size_t n, uint64_t offset)
+{
+    while (n > 0) {
+        ssize_t w = _seekable ? pwrite(_fd, data, n, offset) : write(_fd, data, n);
+        if (w < 0 && (errno == EINTR || errno == EAGAIN))
+            continue;
+        if (w <= 0)
+            return false;
+        data += w;
+        n -= w;
+        offset += w;
+    }
+    return true;
+}
+
+void
+ToDump::flush(Buffer &b, bool final)
+{
+    uint32_t n = b.length;
+#ifdef O_DIRECT
+    if (_direct) {
+        if (!final)
+            n &= ~(ALIGN - 1);
+        else if (n & (ALIGN - 1))
+            fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) & ~O_DIRECT);
+    }
+#endif
+    if (n == 0)
+        return;
+
+    bool ok;
+    if (_seekable) {
+        // Reserve a region of the file, then write it without locking
+        ok = write_all(b.data, n, _offset.fetch_and_add(n));
+    } else {
         _lock.acquire();
+        ok = write_all(b.data, n, 0);
+        _lock.release();
+    }
+    if (!ok) {
+        _active = false;
+        click_chatter("ToDump(%s): %s", _filename.c_str(), strerror(errno));
+    }
+
+    b.length -= n;
+    if (b.length)
+        memmove(b.data, b.data + n, b.length);
+}
+
+bool
+ToDump::allocate_buffer(Buffer &b)
+{
+    if (posix_memalign((void **) &b.data, ALIGN, _buffer_size) != 0) {
+        b.data = 0;
+        _active = false;
+        click_chatter("ToDump(%s): out of memory", _filename.c_str());
+        return false;
+    }
+    b.length = 0;
+    b.count = 0;
+    b.flush_gen = _flush_gen;
+    if (_direct_header) {
+        memcpy(b.data, _direct_header.data(), _direct_header.length());
+        b.length = _direct_header.length();
+        _direct_header = String();
+    }
+    return true;
+}
+
+inline void
+ToDump::buffer_packet(Packet *p)
+{
+    Buffer &b = *_buffers;
+    if (unlikely(!b.data) && !allocate_buffer(b))
+        return;
+    if (unlikely(b.flush_gen != _flush_gen)) {
+        // The flush handler ran on another thread
+        b.flush_gen = _flush_gen;
+        flush(b, false);
+        if (!_active)
+            return;
+    }
+    enum { max_header = 28, max_trailer = 7 };
+    if (b.length + max_header + p->length() + max_trailer > _buffer_size) {
+        flush(b, false);
+        if (!_active)
+            return;
+    }
+
+    unsigned char *h = b.data + b.length;
+    unsigned caplen;
+    unsigned hlen = packet_header(p, h, caplen);
+    unsigned room = _buffer_size - b.length - hlen - max_trailer;
+    if (caplen > room) {
+        // Larger than the buffer: truncate, and fix the header
+        caplen = room;
+        if (_pcapng) {
+            reinterpret_cast<uint32_t *>(h)[1] = 32 + ((caplen + 3) & ~3U);
+            reinterpret_cast<uint32_t *>(h)[5] = caplen;
+        } else
+            reinterpret_cast<struct fake_pcap_pkthdr *>(h)->caplen = caplen;
+    }
+    b.length += hlen;
+    memcpy(b.data + b.length, p->data(), caplen);
+    b.length += caplen;
+    b.length += packet_trailer(b.data + b.length, caplen);
+    b.count++;
+}
+
+inline void
+ToDump::fwrite_packet(Packet *p)
+{
+    unsigned char h[28], t[8];
+    unsigned to_write;
+    unsigned hlen = packet_header(p, h, to_write);
+    unsigned tlen = packet_trailer(t, to_write);
+
     // XXX writing to pipe?
-    if (fwrite(&ph, sizeof(ph), 1, _fp) == 0
-    || (to_write > 0 && fwrite(p->data(), 1, to_write, _fp) == 0)) {
+    if (fwrite(h, hlen, 1, _fp) == 0
+    || (to_write > 0 && fwrite(p->data(), 1, to_write, _fp) == 0)
+    || (tlen > 0 && fwrite(t, tlen, 1, _fp) == 0)) {
         if (errno != EAGAIN) {
             _active = false;
             click_chatter("ToDump(%s): %s", _filename.c_str(), strerror(errno));
         }
     } else
         _count++;
+}
+
+void
+ToDump::write_packet(Packet *p)
+{
+    if (_buffer_size) {
+        buffer_packet(p);
+        return;
+    }
+    if (_mt)
+        _lock.acquire();
+    fwrite_packet(p);
     if (_mt)
         _lock.release();
 }
@@ -252,8 +522,19 @@ void
 ToDump::push_batch(int, PacketBatch *b)
 {
     if (_active) {
-        FOR_EACH_PACKET(b,p) {
-            write_packet(p);
+        if (_buffer_size) {
+            FOR_EACH_PACKET(b,p) {
+                buffer_packet(p);
+            }
+        } else {
+            // One lock per batch
+            if (_mt)
+                _lock.acquire();
+            FOR_EACH_PACKET(b,p) {
+                fwrite_packet(p);
+            }
+            if (_mt)
+                _lock.release();
         }
         checked_output_push_batch(0, b);
     }
@@ -291,7 +572,17 @@ ToDump::run_task(Task *)
     return p != 0;
 }
 
-enum { H_FILENAME = 0, H_COUNT = 1, H_RESET_COUNTS = 2 };
+enum { H_FILENAME = 0, H_COUNT = 1, H_RESET_COUNTS = 2, H_FLUSH = 3 };
+
+ToDump::counter_t
+ToDump::total_count() const
+{
+    counter_t count = _count;
+    for (unsigned i = 0; i < _buffers.weight(); i++)
+        if (_buffers.get_value(i).data)
+            count += _buffers.get_value(i).count;
+    return count;
+}
 
 String
 ToDump::read_handler(Element *e, void *thunk)
@@ -301,17 +592,27 @@ ToDump::read_handler(Element *e, void *thunk)
       case H_FILENAME:
         return td->_filename;
       case H_COUNT:
-        return String(td->_count);
+        return String(td->total_count() - td->_count_base);
       default:
         return "<error>";
     }
 }
 
 int
-ToDump::write_handler(const String &, Element *e, void *, ErrorHandler *)
+ToDump::write_handler(const String &, Element *e, void *thunk, ErrorHandler *)
 {
     ToDump *td = static_cast<ToDump *>(e);
-    td->_count = 0;
+    // Buffers belong to their threads: never write another thread's buffer
+    // or counters from here.
+    if ((uintptr_t) thunk == H_FLUSH) {
+        ++td->_flush_gen;
+        Buffer &b = td->_buffers.get_value_for_thread(click_current_cpu_id());
+        if (b.data && td->_active) {
+            b.flush_gen = td->_flush_gen;
+            td->flush(b, false);
+        }
+    } else
+        td->_count_base = td->total_count();
     return 0;
 }
 
@@ -321,6 +622,7 @@ ToDump::add_handlers()
     add_read_handler("filename", read_handler, H_FILENAME);
     add_read_handler("count", read_handler, H_COUNT);
     add_write_handler("reset_counts", write_handler, H_RESET_COUNTS, Handler::BUTTON);
+    add_write_handler("flush", write_handler, H_FLUSH, Handler::BUTTON);
     if (input_is_pull(0) && noutputs() == 0)
         add_task_handlers(&_task);
 }
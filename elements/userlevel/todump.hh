@@ -6,13 +6,14 @@
 #include <click/task.hh>
 #include <click/notifier.hh>
 #include <click/sync.hh>
+#include <click/multithread.hh>
 #include <stdio.h>
 CLICK_DECLS
 
 /*
 =c
 
-ToDump(FILENAME [, I<keywords> SNAPLEN, ENCAP, USE_ENCAP_FROM, EXTRA_LENGTH, NANO])
+ToDump(FILENAME [, I<keywords> SNAPLEN, ENCAP, USE_ENCAP_FROM, EXTRA_LENGTH, NANO, FORMAT, BUFFER, DIRECT])
 
 =s traces
 
@@ -78,6 +79,36 @@ Boolean. Set to true to force writing a "zero" timestamp. This may be useful to
 write trace with offests relative to the first packet, that will be zero.
 Defaults to False for backward compatibility.
 
+=item FORMAT
+
+C<pcap> or C<pcapng>. With C<pcapng>, ToDump writes a section header, one
+interface description block per interface (see INTERFACES), and an enhanced
+packet block per packet. NANO then sets the interfaces' timestamp resolution.
+Default is C<pcap>.
+
+=item INTERFACES
+
+Integer. Number of pcapng interfaces. If greater than 1, a packet is recorded
+on the interface given by its paint annotation, or on interface 0 if the
+annotation is out of range. Default is 1.
+
+=item BUFFER
+
+Integer. If nonzero, ToDump bypasses stdio and fills one page-aligned buffer
+of BUFFER bytes per thread, copying at most SNAPLEN bytes of each packet
+straight from the packet. A full buffer is written with a single system call;
+on a regular file, threads reserve their own file region and write without
+locking. Buffers are also written when ToDump is cleaned up, and with the
+C<flush> handler. Packets larger than the buffer are truncated. Default is 0
+(write through stdio).
+
+=item DIRECT
+
+Boolean. With BUFFER, open the file with O_DIRECT, bypassing the page cache.
+Only whole pages of the buffer are written until the final flush; BUFFER is
+rounded up to a whole number of pages. Requires a regular uncompressed file
+and a single thread pushing to ToDump. Default is false.
+
 =back
 
 This element is only available at user level.
@@ -94,6 +125,12 @@ Returns the number of packets emitted so far.
 
 Resets "count" to 0.
 
+=h flush write-only
+
+With BUFFER, writes the buffered packets to the file. The buffer of the thread
+running the handler is written at once. Other threads write theirs when they
+next receive a packet; every buffer is also written at cleanup.
+
 =h filename read-only
 
 Returns the filename.
@@ -130,6 +167,21 @@ class ToDump : public BatchElement { public:
     bool _mt;
     Spinlock _lock;
 
+#if HAVE_INT64_TYPES
+    typedef uint64_t counter_t;
+#else
+    typedef uint32_t counter_t;
+#endif
+
+    struct Buffer {
+        unsigned char *data;
+        uint32_t length;
+        counter_t count;
+        uint32_t flush_gen;	// last _flush_gen this buffer was flushed for
+    };
+
+    enum { ALIGN = 4096 };
+
     String _filename;
     FILE *_fp;
     unsigned _snaplen;
@@ -139,13 +191,21 @@ class ToDump : public BatchElement { public:
     bool _unbuffered;
     bool _nano;
     bool _force_ts;
+    bool _pcapng;
+    unsigned _interfaces;
 
-#if HAVE_INT64_TYPES
-    typedef uint64_t counter_t;
-#else
-    typedef uint32_t counter_t;
-#endif
     counter_t _count;
+    counter_t _count_base;	// total count at the last reset_counts
+
+    // BUFFER mode
+    uint32_t _buffer_size;
+    bool _direct;
+    bool _seekable;
+    int _fd;
+    atomic_uint64_t _offset;
+    per_thread<Buffer> _buffers;
+    volatile uint32_t _flush_gen; // bumped by the flush handler
+    String _direct_header;
 
     Task _task;
     NotifierSignal _signal;
@@ -153,7 +213,16 @@ class ToDump : public BatchElement { public:
 
     static String read_handler(Element *, void *) CLICK_COLD;
     static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+    String file_header() const;
+    inline unsigned packet_header(Packet *p, unsigned char *h, unsigned &caplen) const;
+    inline unsigned packet_trailer(unsigned char *t, unsigned caplen) const;
     void write_packet(Packet *);
+    inline void fwrite_packet(Packet *);
+    inline void buffer_packet(Packet *);
+    bool allocate_buffer(Buffer &b);
+    void flush(Buffer &b, bool final);
+    bool write_all(const unsigned char *data, size_t n, uint64_t offset);
+    counter_t total_count() const;
 
 };
 
@@ -0,0 +1,446 @@
+#ifndef CLICK_CUCKOOTABLE_HH
+#define CLICK_CUCKOOTABLE_HH
+#include <click/glue.hh>
+#include <click/hashcode.hh>
+#include <click/integers.hh>
+#include <click/algorithm.hh>
+#include <click/machine.hh>
+#include <click/atomic.hh>
+#include <click/sync.hh>
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+CLICK_DECLS
+
+/** @class CuckooTable
+  @brief Bucketized cuckoo hash table with inline values, MT safe version.
+
+  K is the type of the key. It must provide hashcode() and operator==.
+
+  Every bucket fits in one cache line and holds BUCKET_ENTRIES 16-bit tags
+  and the index of the matching entries. Tags are compared all at once with
+  SSE2 when available, so a lookup touches the bucket line and then only
+  the line of the candidate entry.
+
+  Entries are stored in a separate array, indexed by the position returned
+  by find() and insert(), and never move when the cuckoo displaces a key:
+  only the bucket slot moves. Each entry is the key followed by a value of
+  a size chosen at initialization time (the FCB for the flow managers),
+  padded to a multiple of the cache line. A hit therefore costs one miss for
+  the bucket and one miss for both the key and its value.
+
+  Lookups never take a lock. If the table is set MT, writers (insert and
+  remove) are serialized by a spinlock, and a change counter bumped on every
+  cuckoo displacement lets readers retry a miss that raced with a move.
+*/
+template <typename K>
+class CuckooTable { public:
+
+    enum { BUCKET_ENTRIES = 8, MAX_PATH = 16, BULK_MAX = 64 };
+
+    CuckooTable() : _mask(0), _nbuckets(0), _buckets(0), _entries(0),
+        _capacity(0), _stride(0), _free(0), _free_count(0), _mt(false) {
+        _change_count = 0;
+        _count = 0;
+    }
+
+    ~CuckooTable() {
+        if (_buckets)
+            CLICK_ALIGNED_FREE(_buckets, sizeof(Bucket) * _nbuckets);
+        if (_entries)
+            CLICK_ALIGNED_FREE(_entries, (size_t)_stride * _capacity);
+        if (_free)
+            delete[] _free;
+    }
+
+    /**
+     * @brief Allocate the table
+     * @param capacity Maximal number of keys
+     * @param value_size Size of the value stored inline after each key
+     * @param mt Serialize the writers
+     * @return 0 on success, -1 if memory could not be allocated
+     */
+    int initialize(uint32_t capacity, size_t value_size, bool mt = false) {
+        _mt = mt;
+        _capacity = capacity;
+        // Keep the load under 50%, displacements are then rare
+        _nbuckets = next_pow2((capacity * 2 + BUCKET_ENTRIES - 1) / BUCKET_ENTRIES);
+        if (_nbuckets < 2)
+            _nbuckets = 2;
+        _mask = _nbuckets - 1;
+        _stride = (key_space() + value_size + CLICK_CACHE_LINE_SIZE - 1) & ~(CLICK_CACHE_LINE_SIZE - 1);
+
+        _buckets = (Bucket*)CLICK_ALIGNED_ALLOC(sizeof(Bucket) * _nbuckets);
+        _entries = (uint8_t*)CLICK_ALIGNED_ALLOC((size_t)_stride * _capacity);
+        _free = new uint32_t[_capacity];
+        if (!_buckets || !_entries || !_free)
+            return -1;
+        bzero(_buckets, sizeof(Bucket) * _nbuckets);
+        bzero(_entries, (size_t)_stride * _capacity);
+        for (uint32_t i = 0; i < _capacity; i++)
+            _free[i] = _capacity - i - 1;
+        _free_count = _capacity;
+        return 0;
+    }
+
+    static inline uint32_t hash(const K& key) {
+        //Finalizer of murmur3, the key hashcode() may have weak high bits
+        uint32_t h = key.hashcode();
+        h ^= h >> 16;
+        h *= 0x85ebca6b;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35;
+        h ^= h >> 16;
+        return h;
+    }
+
+    /**
+     * @brief Find the position of a key
+     * @return The position of the key, or -1 if it is not in the table
+     */
+    inline int find(const K& key) const {
+        return find(key, hash(key));
+    }
+
+    inline int find(const K& key, uint32_t h) const {
+        uint16_t tag = make_tag(h);
+        uint32_t b1 = h & _mask;
+        uint32_t b2 = alt_bucket(b1, tag);
+        uint32_t cnt;
+        do {
+            cnt = _change_count;
+            click_read_fence();
+            int r = search(b1, key, tag);
+            if (r >= 0)
+                return r;
+            r = search(b2, key, tag);
+            if (r >= 0)
+                return r;
+            click_read_fence();
+        } while (unlikely(_mt && cnt != _change_count));
+        return -1;
+    }
+
+    /**
+     * @brief Find the position of up to BULK_MAX keys at once
+     * @param keys Pointers to the keys
+     * @param n Number of keys
+     * @param ret Positions of the keys, or -1 for the misses
+     *
+     * The buckets of all the keys are prefetched first, then the tags are
+     * matched and the candidate entries prefetched, and only then keys are
+     * compared. The memory accesses of the different keys thus overlap.
+     */
+    void find_bulk(const K* const* keys, int n, int32_t* ret) const {
+        uint32_t h[BULK_MAX];
+        uint32_t b1[BULK_MAX];
+        uint32_t b2[BULK_MAX];
+        unsigned m1[BULK_MAX];
+        unsigned m2[BULK_MAX];
+        uint32_t cnt = _change_count;
+        click_read_fence();
+        for (int i = 0; i < n; i++) {
+            h[i] = hash(*keys[i]);
+            b1[i] = h[i] & _mask;
+            b2[i] = alt_bucket(b1[i], make_tag(h[i]));
+            __builtin_prefetch(&_buckets[b1[i]]);
+            __builtin_prefetch(&_buckets[b2[i]]);
+        }
+        for (int i = 0; i < n; i++) {
+            uint16_t tag = make_tag(h[i]);
+            m1[i] = match(_buckets[b1[i]], tag);
+            m2[i] = match(_buckets[b2[i]], tag);
+            if (m1[i])
+                __builtin_prefetch(entry(_buckets[b1[i]].idx[ffs_lsb(m1[i]) - 1]));
+            else if (m2[i])
+                __builtin_prefetch(entry(_buckets[b2[i]].idx[ffs_lsb(m2[i]) - 1]));
+        }
+        bool missed = false;
+        for (int i = 0; i < n; i++) {
+            int r = compare(b1[i], m1[i], *keys[i]);
+            if (r < 0)
+                r = compare(b2[i], m2[i], *keys[i]);
+            if (r < 0)
+                missed = true;
+            ret[i] = r;
+        }
+        click_read_fence();
+        if (unlikely(_mt && missed && cnt != _change_count)) {
+            for (int i = 0; i < n; i++)
+                if (ret[i] < 0)
+                    ret[i] = find(*keys[i], h[i]);
+        }
+    }
+
+    /**
+     * @brief Insert a key, or find it if it is already present
+     * @param key The key
+     * @param is_new Set to true if the key was not in the table
+     * @return The position of the key, or -1 if the table is full
+     */
+    int insert(const K& key, bool& is_new) {
+        uint32_t h = hash(key);
+        if (_mt)
+            _writers_lock.acquire();
+        int r = find(key, h);
+        if (r >= 0) {
+            is_new = false;
+        } else {
+            r = do_insert(key, h);
+            is_new = r >= 0;
+        }
+        if (_mt)
+            _writers_lock.release();
+        return r;
+    }
+
+    /**
+     * @brief Remove the key at a given position
+     * @param pos Position returned by find() or insert()
+     */
+    void remove_position(uint32_t pos) {
+        const K& key = *(const K*)entry(pos);
+        uint32_t h = hash(key);
+        uint16_t tag = make_tag(h);
+        uint32_t b1 = h & _mask;
+        if (_mt)
+            _writers_lock.acquire();
+        if (!clear_slot(b1, tag, pos))
+            clear_slot(alt_bucket(b1, tag), tag, pos);
+        _free[_free_count++] = pos;
+        _count--;
+        if (_mt)
+            _writers_lock.release();
+    }
+
+    /**
+     * @brief Remove the keys at up to BULK_MAX positions at once
+     *
+     * The buckets of all keys are prefetched before any is modified, and
+     * the writers lock is taken once.
+     */
+    void remove_positions(const uint32_t* pos, int n) {
+        uint32_t h[BULK_MAX];
+        for (int i = 0; i < n; i++) {
+            h[i] = hash(*(const K*)entry(pos[i]));
+            __builtin_prefetch(&_buckets[h[i] & _mask]);
+        }
+        if (_mt)
+            _writers_lock.acquire();
+        for (int i = 0; i < n; i++) {
+            uint16_t tag = make_tag(h[i]);
+            uint32_t b1 = h[i] & _mask;
+            if (!clear_slot(b1, tag, pos[i]))
+                clear_slot(alt_bucket(b1, tag), tag, pos[i]);
+            _free[_free_count++] = pos[i];
+        }
+        _count -= n;
+        if (_mt)
+            _writers_lock.release();
+    }
+
+    inline const K& key(uint32_t pos) const {
+        return *(const K*)entry(pos);
+    }
+
+    /**
+     * @brief Return the value stored inline after the key at position @a pos
+     */
+    inline void* value(uint32_t pos) const {
+        return (void*)(entry(pos) + key_space());
+    }
+
+    inline uint32_t count() const {
+        return _count;
+    }
+
+    inline uint32_t capacity() const {
+        return _capacity;
+    }
+
+    /**
+     * @brief Space in bytes taken by a key before its value
+     */
+    static inline size_t key_space() {
+        return (sizeof(K) + 7) & ~7;
+    }
+
+    /**
+     * @brief Size in bytes of a key and its value
+     */
+    inline uint32_t stride() const {
+        return _stride;
+    }
+
+  private:
+
+    struct Bucket {
+        uint16_t tags[BUCKET_ENTRIES];
+        uint32_t idx[BUCKET_ENTRIES];
+    } CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+
+    uint32_t _mask;
+    uint32_t _nbuckets;
+    Bucket* _buckets;
+    uint8_t* _entries;
+    uint32_t _capacity;
+    uint32_t _stride;
+
+    uint32_t* _free;
+    uint32_t _free_count;
+
+    volatile uint32_t _change_count;
+    volatile uint32_t _count;
+    bool _mt;
+    SimpleSpinlock _writers_lock;
+
+    static inline uint16_t make_tag(uint32_t h) {
+        //0 marks an empty slot
+        uint16_t tag = h >> 16;
+        return tag ? tag : 1;
+    }
+
+    inline uint32_t alt_bucket(uint32_t b, uint16_t tag) const {
+        //Involution, the alternate of the alternate is the primary bucket
+        return (b ^ (tag * 0x5bd1e995)) & _mask;
+    }
+
+    inline uint8_t* entry(uint32_t pos) const {
+        return _entries + (size_t)pos * _stride;
+    }
+
+    /**
+     * Bitmask of the slots of @a b holding @a tag
+     */
+    static inline unsigned match(const Bucket& b, uint16_t tag) {
+#if defined(__SSE2__)
+        __m128i tags = _mm_load_si128((const __m128i*)b.tags);
+        unsigned m = _mm_movemask_epi8(_mm_cmpeq_epi16(tags, _mm_set1_epi16(tag)));
+        //One bit per slot instead of two
+        m &= 0x5555;
+        m = (m | (m >> 1)) & 0x3333;
+        m = (m | (m >> 2)) & 0x0f0f;
+        m = (m | (m >> 4)) & 0x00ff;
+        return m;
+#else
+        unsigned m = 0;
+        for (int i = 0; i < BUCKET_ENTRIES; i++)
+            if (b.tags[i] == tag)
+                m |= 1 << i;
+        return m;
+#endif
+    }
+
+    inline int compare(uint32_t b, unsigned m, const K& key) const {
+        const Bucket& bucket = _buckets[b];
+        while (m) {
+            int s = ffs_lsb(m) - 1;
+            uint32_t pos = bucket.idx[s];
+            if (likely(*(const K*)entry(pos) == key))
+                return pos;
+            m &= m - 1;
+        }
+        return -1;
+    }
+
+    inline int search(uint32_t b, const K& key, uint16_t tag) const {
+        return compare(b, match(_buckets[b], tag), key);
+    }
+
+    inline void set_slot(Bucket& b, int s, uint16_t tag, uint32_t pos) {
+        b.idx[s] = pos;
+        click_write_fence();
+        *(volatile uint16_t*)&b.tags[s] = tag;
+    }
+
+    inline bool clear_slot(uint32_t b, uint16_t tag, uint32_t pos) {
+        Bucket& bucket = _buckets[b];
+        unsigned m = match(bucket, tag);
+        while (m) {
+            int s = ffs_lsb(m) - 1;
+            if (bucket.idx[s] == pos) {
+                *(volatile uint16_t*)&bucket.tags[s] = 0;
+                return true;
+            }
+            m &= m - 1;
+        }
+        return false;
+    }
+
+    static inline int free_slot(const Bucket& b) {
+        unsigned m = match(b, 0);
+        return m ? ffs_lsb(m) - 1 : -1;
+    }
+
+    int do_insert(const K& key, uint32_t h) {
+        if (unlikely(_free_count == 0))
+            return -1;
+        uint16_t tag = make_tag(h);
+        uint32_t b1 = h & _mask;
+        uint32_t b2 = alt_bucket(b1, tag);
+        uint32_t pos = _free[_free_count - 1];
+        memcpy((void*)entry(pos), &key, sizeof(K));
+
+        int s;
+        if ((s = free_slot(_buckets[b1])) >= 0) {
+            set_slot(_buckets[b1], s, tag, pos);
+        } else if ((s = free_slot(_buckets[b2])) >= 0) {
+            set_slot(_buckets[b2], s, tag, pos);
+        } else if (!make_room(b1, h) && !make_room(b2, h)) {
+            return -1;
+        } else {
+            return do_insert(key, h);
+        }
+        _free_count--;
+        _count++;
+        return pos;
+    }
+
+    /**
+     * Free a slot in bucket @a b by a random walk of displacements of at
+     * most MAX_PATH steps. The chain is then shifted starting from its end,
+     * each key being written to its new slot before it is removed from the
+     * old one, and the change counter is bumped so readers can retry.
+     */
+    bool make_room(uint32_t b, uint32_t seed) {
+        uint32_t path_b[MAX_PATH + 1];
+        int path_s[MAX_PATH];
+        path_b[0] = b;
+        for (int d = 0; d < MAX_PATH; d++) {
+            int s = (seed >> ((d % 8) * 3)) % BUCKET_ENTRIES;
+            int tries = 0;
+            for (int p = 0; p < d; p++) {
+                if (path_b[p] == path_b[d] && path_s[p] == s) { //Cycle
+                    if (++tries == BUCKET_ENTRIES)
+                        return false;
+                    s = (s + 1) % BUCKET_ENTRIES;
+                    p = -1;
+                }
+            }
+            path_s[d] = s;
+            Bucket& cur = _buckets[path_b[d]];
+            uint32_t next = alt_bucket(path_b[d], cur.tags[s]);
+            path_b[d + 1] = next;
+            int f = free_slot(_buckets[next]);
+            if (f < 0)
+                continue;
+            for (int i = d; i >= 0; i--) {
+                Bucket& from = _buckets[path_b[i]];
+                Bucket& to = _buckets[path_b[i + 1]];
+                set_slot(to, f, from.tags[path_s[i]], from.idx[path_s[i]]);
+                click_write_fence();
+                _change_count = _change_count + 1;
+                click_write_fence();
+                *(volatile uint16_t*)&from.tags[path_s[i]] = 0;
+                f = path_s[i];
+            }
+            return true;
+        }
+        return false;
+    }
+
+};
+
+CLICK_ENDDECLS
+#endif
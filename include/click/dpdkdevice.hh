@@ -85,7 +85,7 @@ public:
             num_pools(0), mq_mode((enum rte_eth_rx_mq_mode)-1), mq_mode_str(""),
             promisc(false), flow_isolate(false), rx_offload(0), tx_offload(0),
             vlan_filter(false), vlan_strip(false), vlan_extend(false), vf_vlan(),
-            lro(false), jumbo(false)
+            lro(false), jumbo(false), rss_symmetric(false)
         {
             rx_queues.reserve(128);
             tx_queues.reserve(128);
@@ -146,6 +146,7 @@ public:
         Vector<int> vf_vlan;
         bool lro;
         bool jumbo;
+        bool rss_symmetric;
     };
 
 #if RTE_VERSION >= RTE_VERSION_NUM(20,2,0,0)
@@ -171,6 +172,7 @@ public:
     void set_init_mac(EtherAddress mac);
     void set_init_mtu(uint16_t mtu);
     void set_init_rss_max(int rss_max);
+    void set_rss_symmetric(bool symmetric);
     void set_init_fc_mode(FlowControlMode fc);
     void set_rx_offload(uint64_t offload);
     void set_tx_offload(uint64_t offload);
@@ -184,6 +186,9 @@ public:
     uint16_t get_device_id();
     const char *get_device_driver();
     int set_rss_max(int max);
+    unsigned get_reta_size();
+    int get_reta(Vector<unsigned> &reta);
+    int set_reta(const Vector<unsigned> &reta);
 
     static unsigned int dev_count() {
 #if RTE_VERSION >= RTE_VERSION_NUM(18,05,0,0)
@@ -8,6 +8,7 @@
 #include <click/packetbatch.hh>
 #include <click/handler.hh>
 #include <click/sync.hh>
+#include <click/elementprofile.hh>
 #include <functional>
 
 CLICK_DECLS
@@ -284,6 +285,8 @@ class Element { public:
 
         Element* _e;
         int _port;
+        Element* _owner;                // Whose input or output are we?
+        int _profile_slot;              // Our ElementProfile slot, or -1
         #ifdef HAVE_AUTO_BATCH
         per_thread<PacketBatch*> current_batch;
         #endif
@@ -304,15 +307,20 @@ class Element { public:
 #if CLICK_STATS >= 1
         mutable unsigned _packets;      // How many packets have we moved?
 #endif
-#if CLICK_STATS >= 2
-        Element* _owner;                // Whose input or output are we?
-#endif
 
         inline Port();
         inline void assign(bool isoutput, Element *owner, Element *e, int port);
 
+        void profile_push(Packet *p) const;
+        Packet *profile_pull() const;
+#if HAVE_BATCH
+        void profile_push_batch(PacketBatch *batch) const;
+        PacketBatch *profile_pull_batch(unsigned max) const;
+#endif
+
         friend class Element;
         friend class BatchElement;
+        friend class ElementProfile;
 
     };
 
@@ -345,10 +353,7 @@ class Element { public:
 
 #if CLICK_STATS >= 2
     // STATISTICS
-    unsigned _xfer_calls;       // Push and pull calls into this element.
-    click_cycles_t _xfer_own_cycles;    // Cycles spent in self from push and pull.
-    click_cycles_t _child_cycles;       // Cycles spent in children.
-
+    // Push and pull calls are counted by the router's ElementProfile.
     unsigned _task_calls;       // Calls to tasks owned by this element.
     click_cycles_t _task_own_cycles;    // Cycles spent in self from tasks.
 
@@ -356,8 +361,8 @@ class Element { public:
     click_cycles_t _timer_own_cycles;   // Cycles spent in self from timers.
 
     inline void reset_cycles() {
-        _xfer_calls = _task_calls = _timer_calls = 0;
-        _xfer_own_cycles = _task_own_cycles = _timer_own_cycles = _child_cycles = 0;
+        _task_calls = _timer_calls = 0;
+        _task_own_cycles = _timer_own_cycles = 0;
     }
     static String read_cycles_handler(Element *, void *);
     static int write_cycles_handler(const String &, Element *, void *, ErrorHandler *);
@@ -590,17 +595,15 @@ Element::input_is_push(int port) const
         && !_ports[0][port].active();
 }
 
-#if CLICK_STATS >= 2
+#if CLICK_STATS >= 1
 # define PORT_ASSIGN(o) _packets = 0; _owner = (o)
-#elif CLICK_STATS >= 1
-# define PORT_ASSIGN(o) _packets = 0; (void) (o)
 #else
-# define PORT_ASSIGN(o) (void) (o)
+# define PORT_ASSIGN(o) _owner = (o)
 #endif
 
 inline
 Element::Port::Port()
-    : _e(0), _port(-2)
+    : _e(0), _port(-2), _profile_slot(-1)
 {
     PORT_ASSIGN(0);
 }
@@ -686,7 +689,8 @@ Element::Port::port() const
  * downstream.  To push a copy and keep a copy, see Packet::clone().
  *
  * output(i).push(p) basically behaves like the following code, although it
- * maintains additional statistics depending on how CLICK_STATS is defined:
+ * maintains additional statistics depending on how CLICK_STATS is defined,
+ * and goes through the ElementProfile while profiling is enabled:
  *
  * @code
  * output(i).element()->push(output(i).port(), p);
@@ -717,26 +721,17 @@ Element::Port::push(Packet* p) const
 #endif
 #if CLICK_STATS >= 2
     ++_e->input(_port)._packets;
-    click_cycles_t start_cycles = click_get_cycles(),
-        start_child_cycles = _e->_child_cycles;
-# if HAVE_BOUND_PORT_TRANSFER
+#endif
+    if (unlikely(ElementProfile::current())) {
+        profile_push(p);
+        return;
+    }
+#if HAVE_BOUND_PORT_TRANSFER
     _bound.push(_e, _port, p);
-# else
-    _e->push(_port, p);
-# endif
-    click_cycles_t all_delta = click_get_cycles() - start_cycles,
-        own_delta = all_delta - (_e->_child_cycles - start_child_cycles);
-    _e->_xfer_calls += 1;
-    _e->_xfer_own_cycles += own_delta;
-    _owner->_child_cycles += all_delta;
 #else
-# if HAVE_BOUND_PORT_TRANSFER
-    _bound.push(_e, _port, p);
-# else
     _e->push(_port, p);
-# endif
-    }
 #endif
+    }
 }
 
 /** @brief Pull a packet over this port and return it.
@@ -749,7 +744,8 @@ Element::Port::push(Packet* p) const
  * code like @link Element::input input(i) @endlink .pull().
  *
  * input(i).pull() basically behaves like the following code, although it
- * maintains additional statistics depending on how CLICK_STATS is defined:
+ * maintains additional statistics depending on how CLICK_STATS is defined,
+ * and goes through the ElementProfile while profiling is enabled:
  *
  * @code
  * input(i).element()->pull(input(i).port())
@@ -759,27 +755,18 @@ inline Packet*
 Element::Port::pull() const
 {
     assert(_e);
+    Packet *p;
+    if (unlikely(ElementProfile::current()))
+        p = profile_pull();
+    else
+#if HAVE_BOUND_PORT_TRANSFER
+        p = _bound.pull(_e, _port);
+#else
+        p = _e->pull(_port);
+#endif
 #if CLICK_STATS >= 2
-    click_cycles_t start_cycles = click_get_cycles(),
-        old_child_cycles = _e->_child_cycles;
-# if HAVE_BOUND_PORT_TRANSFER
-    Packet *p = _bound.pull(_e, _port);
-# else
-    Packet *p = _e->pull(_port);
-# endif
     if (p)
         _e->output(_port)._packets += 1;
-    click_cycles_t all_delta = click_get_cycles() - start_cycles,
-        own_delta = all_delta - (_e->_child_cycles - old_child_cycles);
-    _e->_xfer_calls += 1;
-    _e->_xfer_own_cycles += own_delta;
-    _owner->_child_cycles += all_delta;
-#else
-# if HAVE_BOUND_PORT_TRANSFER
-    Packet *p = _bound.pull(_e, _port);
-# else
-    Packet *p = _e->pull(_port);
-# endif
 #endif
 #if CLICK_STATS >= 1
     if (p)
@@ -797,6 +784,10 @@ Element::Port::push_batch(PacketBatch* batch) const {
 #if BATCH_DEBUG
     click_chatter("Pushing batch of %d packets to %p{element}",batch->count(),_e);
 #endif
+    if (unlikely(ElementProfile::current())) {
+        profile_push_batch(batch);
+        return;
+    }
 #if HAVE_BOUND_PORT_TRANSFER
     _bound_batch.push_batch(_e,_port,batch);
 #else
@@ -886,6 +877,8 @@ Element::Port::end_batch() {
 PacketBatch*
 Element::Port::pull_batch(unsigned max) const {
     PacketBatch* batch = NULL;
+    if (unlikely(ElementProfile::current()))
+        return profile_pull_batch(max);
 #if HAVE_BOUND_PORT_TRANSFER
     batch = _bound_batch.pull_batch(_e,_port, max);
 #else
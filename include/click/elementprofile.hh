@@ -0,0 +1,168 @@
+// -*- c-basic-offset: 4; related-file-name: "../../lib/elementprofile.cc" -*-
+#ifndef CLICK_ELEMENTPROFILE_HH
+#define CLICK_ELEMENTPROFILE_HH
+#include <click/glue.hh>
+#include <click/vector.hh>
+#include <click/sync.hh>
+CLICK_DECLS
+class Router;
+class Element;
+class StringAccum;
+
+/** @file <click/elementprofile.hh>
+ * @brief Per-thread profiling of packet transfers between elements.
+ */
+
+/** @class ElementProfile
+ * @brief Counts the calls, packets, batches and cycles of each element port.
+ *
+ * Each router may have one profile, enabled and disabled at run time
+ * through the global @c profiling handler. While no profile is enabled,
+ * Element::Port::push(), pull(), push_batch() and pull_batch() only test
+ * ElementProfile::current(). Otherwise transfers go through the profile,
+ * which counts them in per-thread tables: threads never write to the same
+ * cache lines.
+ *
+ * Calls, packets and batches are always counted. Cycles are only measured
+ * on one call tree out of sample_period(), a call tree being a transfer
+ * from an element that was not itself called through a port (typically a
+ * task or a timer) and all the transfers it causes. The own cycles of an
+ * element exclude the cycles of the elements it calls. Cycles are also
+ * accumulated per call path, for flame graphs.
+ */
+class ElementProfile { public:
+
+    struct Counters {
+        uint64_t calls;
+        uint64_t packets;
+        uint64_t batches;
+        uint64_t sampled;               // calls whose cycles were measured
+        click_cycles_t cycles;          // own cycles of the sampled calls
+
+        Counters() {
+            clear();
+        }
+        void clear() {
+            calls = packets = batches = sampled = 0;
+            cycles = 0;
+        }
+        Counters &operator+=(const Counters &x) {
+            calls += x.calls;
+            packets += x.packets;
+            batches += x.batches;
+            sampled += x.sampled;
+            cycles += x.cycles;
+            return *this;
+        }
+    };
+
+    ElementProfile(Router *router);
+    ~ElementProfile();
+
+    /** @brief Return the enabled profile, or null. */
+    static inline ElementProfile *current() {
+        return _current;
+    }
+
+    Router *router() const {
+        return _router;
+    }
+    bool enabled() const {
+        return _current == this;
+    }
+    /** @brief Enable or disable this profile. Enabling it disables the
+     * profile of any other router. */
+    void set_enabled(bool enabled);
+
+    unsigned sample_period() const {
+        return _sample_period;
+    }
+    /** @brief Measure cycles on one call tree out of @a period per
+     * thread. 0 disables cycle measurements. */
+    void set_sample_period(unsigned period) {
+        _sample_period = period;
+    }
+
+    void reset();
+    void reset_element(const Element *e);
+
+    /** @brief Return the cycles the current thread spent in sampled
+     * transfers called from outside any transfer, or 0 if no profile is
+     * enabled.
+     *
+     * Task and timer statistics subtract it from their own cycles. */
+    static click_cycles_t thread_child_cycles();
+
+    /** @brief Return the counters of input (push) or output (pull) @a port
+     * of @a e, summed over all threads. */
+    Counters port_counters(const Element *e, bool isoutput, int port) const;
+    /** @brief Return the counters of @a e, summed over its ports and over
+     * all threads. */
+    Counters element_counters(const Element *e) const;
+
+    /** @brief Write the profile of the whole graph as JSON. */
+    void unparse_json(StringAccum &sa) const;
+    /** @brief Write the own cycles of every call path, one
+     * "a;b;c cycles" line per path, as read by flame graph tools. */
+    void unparse_folded(StringAccum &sa) const;
+
+    struct Call {
+        int slot;
+        int saved_frame;
+        click_cycles_t start;
+        click_cycles_t saved_child_cycles;
+    };
+
+    /** @brief Start a call from @a owner to port @a slot of @a e.
+     *
+     * Used by Element::Port, with end() once the call returns. */
+    void begin(Call &c, const Element *owner, const Element *e, int slot);
+    void end(Call &c, uint64_t packets, bool batch);
+
+  private:
+
+    enum { MAX_FRAMES = 4096 };
+
+    struct Frame {
+        int eindex;
+        int parent;
+        int first_child;
+        int next_sibling;
+        uint64_t calls;
+        click_cycles_t cycles;
+    };
+
+    struct ThreadState {
+        Vector<Counters> ports;
+        Vector<Frame> frames;
+        int roots;              // first frame without parent, or -1
+        int frame;              // current call path, or -1
+        int depth;
+        bool sampling;
+        unsigned tick;
+        click_cycles_t child_cycles;
+
+        ThreadState()
+            : roots(-1), frame(-1), depth(0), sampling(false), tick(0), child_cycles(0) {
+        }
+    };
+
+    static ElementProfile *_current;
+
+    Router *_router;
+    unsigned _sample_period;
+    Vector<int> _slot_base;     // first slot of each element
+    int _nslots;
+    per_thread<ThreadState> _threads;
+
+    void attach();
+    inline int slot(const Element *e, bool isoutput, int port) const;
+    int find_frame(ThreadState &t, int parent, int eindex);
+
+    ElementProfile(const ElementProfile &);
+    ElementProfile &operator=(const ElementProfile &);
+
+};
+
+CLICK_ENDDECLS
+#endif
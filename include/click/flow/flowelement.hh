@@ -45,6 +45,12 @@ public:
     VirtualFlowSpaceElement() :_flow_data_offset(-1) {
     }
     virtual const size_t flow_data_size() const = 0;
+    /**
+     * Alignment of the per-flow data, honored by the FCB layout solver
+     */
+    virtual const size_t flow_data_align() const {
+        return 1;
+    }
     virtual const int flow_data_index() const {
         return -1;
     }
@@ -218,8 +224,17 @@ private:
  */
 class VirtualFlowManager : public FlowElement { public:
     VirtualFlowManager();
+
+    /**
+     * Return the FCB layout of this manager, one placed element per line,
+     * then the number of bytes used in each cache line
+     */
+    String fcb_layout() const;
+    static String read_fcb_layout(Element *e, void *thunk) CLICK_COLD;
 protected:
     int _reserve;
+    int _reserve_own; //Bytes at the start of the FCB data used by the manager itself
+    int _fcb_line_offset; //Position of the FCB data in its first cache line
 
     typedef Pair<Element*,int> EDPair;
     Vector<EDPair>  _reachable_list;
@@ -244,6 +259,7 @@ public :
     void fcb_set_init_data(FlowControlBlock* fcb, const T data) CLICK_COLD;
 
     virtual const size_t flow_data_size()  const override { return sizeof(T); }
+    virtual const size_t flow_data_align()  const override { return alignof(T); }
 
 
     /**
@@ -291,6 +307,7 @@ public :
     FlowStateElement() CLICK_COLD;
     virtual int solve_initialize(ErrorHandler *errh) CLICK_COLD;
     virtual const size_t flow_data_size()  const { return sizeof(AT); }
+    virtual const size_t flow_data_align()  const { return alignof(AT); }
 
     /**
      * CRTP virtual
@@ -0,0 +1,213 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_HDRHISTOGRAM_HH
+#define CLICK_HDRHISTOGRAM_HH
+#include <click/glue.hh>
+#include <click/integers.hh>
+#include <click/vector.hh>
+CLICK_DECLS
+
+/** @file <click/hdrhistogram.hh>
+ * @brief A bounded-memory histogram with a fixed relative precision.
+ */
+
+/** @class HDRHistogram include/click/hdrhistogram.hh <click/hdrhistogram.hh>
+ * @brief A log-linear histogram of unsigned values.
+ *
+ * Values below 2<sup>precision</sup> each have their own bucket. Above,
+ * every power of two is split into 2<sup>precision-1</sup> buckets, so a
+ * value is known within a relative error of 2<sup>1-precision</sup> (0.8%
+ * for the default precision of 8). Values of max_bits bits or more are
+ * clamped. Memory is fixed at construction: about
+ * (max_bits - precision + 2) * 2<sup>precision-1</sup> counters.
+ *
+ * record() is a few instructions and takes no lock; an HDRHistogram must
+ * only be recorded into by one thread at a time. Use one histogram per
+ * thread and merge() them to read. Count, sum, minimum and maximum are kept
+ * exactly; percentiles are read from the buckets in time proportional to
+ * the number of buckets, independently of the number of values recorded.
+ * subtract() gives the histogram of the values recorded between two copies
+ * of a histogram, which allows interval snapshots without stopping
+ * recording.
+ */
+class HDRHistogram { public:
+
+    /** @brief Construct an empty histogram.
+     * @param precision number of significant bits kept, between 2 and 16
+     * @param max_bits values are clamped to 2<sup>max_bits</sup> - 1 */
+    explicit HDRHistogram(unsigned precision = 8, unsigned max_bits = 40)
+	: _precision(precision), _max_bits(max_bits) {
+	if (_precision < 2)
+	    _precision = 2;
+	else if (_precision > 16)
+	    _precision = 16;
+	if (_max_bits > 64)
+	    _max_bits = 64;
+	if (_max_bits < _precision)
+	    _max_bits = _precision;
+	_max_value = _max_bits == 64 ? ~(uint64_t) 0 : ((uint64_t) 1 << _max_bits) - 1;
+	_counts.resize((_max_bits - _precision + 2) << (_precision - 1), 0);
+	clear();
+    }
+
+    /** @brief Record @a n occurrences of value @a v. */
+    inline void record(uint64_t v, uint64_t n = 1) {
+	if (v > _max_value)
+	    v = _max_value;
+	_counts.unchecked_at(index(v)) += n;
+	_count += n;
+	_sum += v * n;
+	_sum2 += (double) v * (double) v * n;
+	if (v < _min)
+	    _min = v;
+	if (v > _max)
+	    _max = v;
+    }
+
+    /** @brief Remove all values. */
+    void clear() {
+	for (int i = 0; i < _counts.size(); ++i)
+	    _counts[i] = 0;
+	_count = _sum = 0;
+	_sum2 = 0;
+	_min = ~(uint64_t) 0;
+	_max = 0;
+    }
+
+    /** @brief Add the values of @a x, which must have the same geometry. */
+    void merge(const HDRHistogram &x) {
+	assert(x._counts.size() == _counts.size());
+	for (int i = 0; i < _counts.size(); ++i)
+	    _counts[i] += x._counts[i];
+	_count += x._count;
+	_sum += x._sum;
+	_sum2 += x._sum2;
+	if (x._min < _min)
+	    _min = x._min;
+	if (x._max > _max)
+	    _max = x._max;
+    }
+
+    /** @brief Remove the values of @a x, an earlier copy of this histogram.
+     *
+     * The minimum and maximum are then only known within the precision. */
+    void subtract(const HDRHistogram &x) {
+	assert(x._counts.size() == _counts.size());
+	int first = -1, last = -1;
+	for (int i = 0; i < _counts.size(); ++i) {
+	    _counts[i] -= x._counts[i];
+	    if (_counts[i]) {
+		if (first < 0)
+		    first = i;
+		last = i;
+	    }
+	}
+	_count -= x._count;
+	_sum -= x._sum;
+	_sum2 -= x._sum2;
+	if (first >= 0) {
+	    _min = bucket_low(first) > _min ? bucket_low(first) : _min;
+	    _max = bucket_high(last) < _max ? bucket_high(last) : _max;
+	} else {
+	    _min = ~(uint64_t) 0;
+	    _max = 0;
+	}
+    }
+
+    uint64_t count() const {
+	return _count;
+    }
+    uint64_t sum() const {
+	return _sum;
+    }
+    /** @brief Return the smallest value, or 0 if the histogram is empty. */
+    uint64_t min() const {
+	return _count ? _min : 0;
+    }
+    uint64_t max() const {
+	return _max;
+    }
+    double mean() const {
+	return _count ? (double) _sum / _count : 0;
+    }
+    double variance() const {
+	if (_count == 0)
+	    return 0;
+	double m = mean();
+	double var = _sum2 / _count - m * m;
+	return var > 0 ? var : 0;
+    }
+
+    /** @brief Return the value below which @a percent % of the values fall.
+     *
+     * The result is the highest value of the bucket holding that rank,
+     * bounded by max(). */
+    uint64_t percentile(double percent) const {
+	if (_count == 0)
+	    return 0;
+	if (percent <= 0)
+	    return min();
+	uint64_t rank = (uint64_t) (percent * _count / 100 + 0.5);
+	if (rank < 1)
+	    rank = 1;
+	if (rank >= _count)
+	    return _max;
+	uint64_t seen = 0;
+	for (int i = 0; i < _counts.size(); ++i) {
+	    seen += _counts[i];
+	    if (seen >= rank) {
+		uint64_t v = bucket_high(i);
+		return v < _max ? (v > min() ? v : min()) : _max;
+	    }
+	}
+	return _max;
+    }
+
+    /** @brief Return the number of buckets. */
+    int nbuckets() const {
+	return _counts.size();
+    }
+    /** @brief Return the number of values in bucket @a i. */
+    uint64_t bucket_count(int i) const {
+	return _counts[i];
+    }
+    /** @brief Return the lowest value of bucket @a i. */
+    uint64_t bucket_low(int i) const {
+	unsigned half = _precision - 1;
+	if ((unsigned) i < (2U << half))
+	    return i;
+	unsigned h = (i >> half) - 1;
+	return (uint64_t) (i - (h << half)) << h;
+    }
+    /** @brief Return the highest value of bucket @a i. */
+    uint64_t bucket_high(int i) const {
+	unsigned half = _precision - 1;
+	if ((unsigned) i < (2U << half))
+	    return i;
+	unsigned h = (i >> half) - 1;
+	return bucket_low(i) + (((uint64_t) 1 << h) - 1);
+    }
+
+  private:
+
+    Vector<uint64_t> _counts;
+    uint64_t _count;
+    uint64_t _sum;
+    double _sum2;
+    uint64_t _min;
+    uint64_t _max;
+    uint64_t _max_value;
+    unsigned _precision;
+    unsigned _max_bits;
+
+    inline unsigned index(uint64_t v) const {
+	unsigned half = _precision - 1;
+	if (v < ((uint64_t) 2 << half))
+	    return v;
+	unsigned h = 64 - ffs_msb(v) - half;
+	return (h << half) + (unsigned) (v >> h);
+    }
+
+};
+
+CLICK_ENDDECLS
+#endif
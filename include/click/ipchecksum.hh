@@ -0,0 +1,286 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_IPCHECKSUM_HH
+#define CLICK_IPCHECKSUM_HH
+#include <click/packet.hh>
+#include <click/packetbatch.hh>
+#include <clicknet/ip.h>
+#include <clicknet/tcp.h>
+#include <clicknet/udp.h>
+#include <clicknet/ether.h>
+#if HAVE_DPDK && CLICK_USERLEVEL
+# include <click/dpdkdevice.hh>
+# if RTE_VERSION >= RTE_VERSION_NUM(18,02,0,0)
+#  define CLICK_IPCHECKSUM_RX 1
+# endif
+#endif
+CLICK_DECLS
+
+/** @file <click/ipchecksum.hh>
+ * @brief Internet checksums of IPv4, TCP and UDP packets, one at a time or
+ * over a whole PacketBatch.
+ */
+
+/** @class IPChecksum
+ * @brief Compute and verify IPv4, TCP and UDP checksums.
+ *
+ * The packet functions expect the IP header annotation to be set, and
+ * the transport functions also expect an unfragmented TCP or UDP packet
+ * whose IP length is valid. Data sums use click_in_cksum(), which picks
+ * a vector kernel for the CPU on first use.
+ *
+ * When a packet was received by a DPDK device configured to verify
+ * checksums (FromDPDKDevice's RX_CHECKSUM), the checking functions can use
+ * the verdict of the NIC instead of reading the data, if asked to. The
+ * verdict is about the frame as received: it is only used while the IP
+ * header is still where the NIC parsed it, right after the Ethernet header
+ * of a frame that is not a tunnel. It does not follow rewrites, so only
+ * ask for it when nothing upstream changes the headers.
+ */
+class IPChecksum { public:
+
+    enum { BAD = 0, GOOD = 1, UNKNOWN = -1 };
+
+    /** @brief Return the NIC's verdict on the checksum of the IP header
+     * @a iph of @a p: GOOD, BAD or UNKNOWN.
+     *
+     * UNKNOWN unless @a iph is the header the NIC checked. */
+    static inline int rx_ip_status(const Packet *p, const click_ip *iph);
+    /** @brief Return the NIC's verdict on the TCP or UDP checksum of the
+     * packet @a p, whose IP header is @a iph: GOOD, BAD or UNKNOWN.
+     *
+     * UNKNOWN unless @a iph is the header the NIC checked. */
+    static inline int rx_l4_status(const Packet *p, const click_ip *iph);
+
+    /** @brief Return the checksum of an IP header of @a hlen bytes.
+     *
+     * Returns 0 if the header's own checksum is correct. */
+    static inline uint16_t header_sum(const click_ip *iph, unsigned hlen);
+
+    /** @brief Return true if @a p's IP header checksum is correct.
+     *
+     * If @a rx is true, the NIC's verdict is used when there is one. */
+    static inline bool ip_ok(const Packet *p, bool rx = false);
+    /** @brief Return true if @a p's TCP or UDP checksum is correct.
+     *
+     * A UDP checksum of 0 means no checksum, and is correct. If @a rx is
+     * true, the NIC's verdict is used when there is one. */
+    static inline bool transport_ok(const Packet *p, bool rx = false);
+
+    /** @brief Set @a p's IP header checksum. */
+    static inline void set_ip(WritablePacket *p);
+    /** @brief Set @a p's TCP or UDP checksum. Other protocols are left
+     * alone. */
+    static inline void set_transport(WritablePacket *p);
+
+#if HAVE_BATCH
+    /** @brief Set the IP header checksum of every packet of @a batch.
+     *
+     * The packets must be writable. */
+    static inline void set_ip(PacketBatch *batch);
+    /** @brief Set the TCP or UDP checksum of every packet of @a batch.
+     *
+     * The packets must be writable. */
+    static inline void set_transport(PacketBatch *batch);
+
+    /** @brief Remove the packets with a bad IP header checksum from
+     * @a batch, passing each to @a on_bad. @a rx is as for ip_ok().
+     * @return the remaining batch, possibly null */
+    template <typename F>
+    static inline PacketBatch *check_ip(PacketBatch *batch, F on_bad, bool rx = false);
+    /** @brief Remove the packets with a bad TCP or UDP checksum from
+     * @a batch, passing each to @a on_bad. @a rx is as for transport_ok().
+     * @return the remaining batch, possibly null */
+    template <typename F>
+    static inline PacketBatch *check_transport(PacketBatch *batch, F on_bad, bool rx = false);
+#endif
+
+  private:
+
+    static inline uint16_t transport_sum(const Packet *p);
+#if CLICK_IPCHECKSUM_RX
+    static inline const rte_mbuf *rx_mbuf(const Packet *p, const click_ip *iph);
+#endif
+
+};
+
+
+#if CLICK_IPCHECKSUM_RX
+/* Return the mbuf @a p was received in, if @a iph is the IP header the NIC
+   parsed: right after the Ethernet header, at the start of the data the
+   device wrote, in a frame that is not a tunnel. */
+inline const rte_mbuf *
+IPChecksum::rx_mbuf(const Packet *p, const click_ip *iph)
+{
+    const rte_mbuf *mb;
+# if CLICK_PACKET_USE_DPDK
+    mb = p->mb();
+# else
+    Packet *np = const_cast<Packet *>(p);
+    if (DPDKDevice::is_dpdk_packet(np))
+	mb = (const rte_mbuf *) np->destructor_argument();
+    else if (np->data_packet() && DPDKDevice::is_dpdk_packet(np->data_packet()))
+	mb = (const rte_mbuf *) np->data_packet()->destructor_argument();
+    else
+	return 0;
+# endif
+    if (mb->packet_type & RTE_PTYPE_TUNNEL_MASK)
+	return 0;
+    unsigned l2 = sizeof(click_ether);
+    if (!(mb->ol_flags & PKT_RX_VLAN_STRIPPED))
+	switch (mb->packet_type & RTE_PTYPE_L2_MASK) {
+	case RTE_PTYPE_L2_ETHER_VLAN:
+	    l2 += 4;
+	    break;
+	case RTE_PTYPE_L2_ETHER_QINQ:
+	    l2 += 8;
+	    break;
+	}
+    const unsigned char *frame = (const unsigned char *) mb->buf_addr + RTE_PKTMBUF_HEADROOM;
+    if (reinterpret_cast<const unsigned char *>(iph) != frame + l2)
+	return 0;
+    return mb;
+}
+#endif
+
+inline int
+IPChecksum::rx_ip_status(const Packet *p, const click_ip *iph)
+{
+#if CLICK_IPCHECKSUM_RX
+    if (const rte_mbuf *mb = rx_mbuf(p, iph))
+	switch (mb->ol_flags & PKT_RX_IP_CKSUM_MASK) {
+	case PKT_RX_IP_CKSUM_GOOD:
+	    return GOOD;
+	case PKT_RX_IP_CKSUM_BAD:
+	    return BAD;
+	}
+#else
+    (void) p, (void) iph;
+#endif
+    return UNKNOWN;
+}
+
+inline int
+IPChecksum::rx_l4_status(const Packet *p, const click_ip *iph)
+{
+#if CLICK_IPCHECKSUM_RX
+    if (const rte_mbuf *mb = rx_mbuf(p, iph))
+	switch (mb->ol_flags & PKT_RX_L4_CKSUM_MASK) {
+	case PKT_RX_L4_CKSUM_GOOD:
+	    return GOOD;
+	case PKT_RX_L4_CKSUM_BAD:
+	    return BAD;
+	}
+#else
+    (void) p, (void) iph;
+#endif
+    return UNKNOWN;
+}
+
+inline uint16_t
+IPChecksum::header_sum(const click_ip *iph, unsigned hlen)
+{
+    if (likely(hlen == sizeof(click_ip))) {
+	// Five 32-bit words; see click_in_cksum() for why this works.
+	uint32_t w[5];
+	memcpy(w, iph, sizeof(w));
+	uint64_t sum = (uint64_t) w[0] + w[1] + w[2] + w[3] + w[4];
+	sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	return ~sum & 0xFFFF;
+    }
+    return click_in_cksum(reinterpret_cast<const unsigned char *>(iph), hlen);
+}
+
+inline bool
+IPChecksum::ip_ok(const Packet *p, bool rx)
+{
+    int status = rx ? rx_ip_status(p, p->ip_header()) : UNKNOWN;
+    if (status != UNKNOWN)
+	return status == GOOD;
+    return header_sum(p->ip_header(), p->ip_header_length()) == 0;
+}
+
+inline uint16_t
+IPChecksum::transport_sum(const Packet *p)
+{
+    const click_ip *iph = p->ip_header();
+    unsigned len = ntohs(iph->ip_len) - (iph->ip_hl << 2);
+    unsigned csum = click_in_cksum(p->transport_header(), len);
+    return click_in_cksum_pseudohdr(csum, iph, len);
+}
+
+inline bool
+IPChecksum::transport_ok(const Packet *p, bool rx)
+{
+    int status = rx ? rx_l4_status(p, p->ip_header()) : UNKNOWN;
+    if (status != UNKNOWN)
+	return status == GOOD;
+    if (p->ip_header()->ip_p == IP_PROTO_UDP && p->udp_header()->uh_sum == 0)
+	return true;
+    return transport_sum(p) == 0;
+}
+
+inline void
+IPChecksum::set_ip(WritablePacket *p)
+{
+    click_ip *iph = p->ip_header();
+    iph->ip_sum = 0;
+    iph->ip_sum = header_sum(iph, p->ip_header_length());
+}
+
+inline void
+IPChecksum::set_transport(WritablePacket *p)
+{
+    switch (p->ip_header()->ip_p) {
+    case IP_PROTO_TCP:
+	p->tcp_header()->th_sum = 0;
+	p->tcp_header()->th_sum = transport_sum(p);
+	break;
+    case IP_PROTO_UDP: {
+	click_udp *udph = p->udp_header();
+	udph->uh_sum = 0;
+	uint16_t sum = transport_sum(p);
+	// 0 means "no checksum"; its one's complement equivalent is 0xFFFF
+	udph->uh_sum = sum ? sum : 0xFFFF;
+	break;
+    }
+    }
+}
+
+#if HAVE_BATCH
+inline void
+IPChecksum::set_ip(PacketBatch *batch)
+{
+    FOR_EACH_PACKET(batch, p)
+	set_ip(static_cast<WritablePacket *>(p));
+}
+
+inline void
+IPChecksum::set_transport(PacketBatch *batch)
+{
+    FOR_EACH_PACKET(batch, p)
+	set_transport(static_cast<WritablePacket *>(p));
+}
+
+template <typename F> inline PacketBatch *
+IPChecksum::check_ip(PacketBatch *batch, F on_bad, bool rx)
+{
+    auto fnt = [rx](Packet *p) -> Packet * { return ip_ok(p, rx) ? p : 0; };
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE(fnt, batch, on_bad);
+    return batch;
+}
+
+template <typename F> inline PacketBatch *
+IPChecksum::check_transport(PacketBatch *batch, F on_bad, bool rx)
+{
+    auto fnt = [rx](Packet *p) -> Packet * { return transport_ok(p, rx) ? p : 0; };
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE(fnt, batch, on_bad);
+    return batch;
+}
+#endif
+
+#undef CLICK_IPCHECKSUM_RX
+CLICK_ENDDECLS
+#endif
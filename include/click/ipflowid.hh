@@ -214,5 +214,16 @@ protected:
 	uint8_t _proto;
 };
 
+inline bool operator==(const IPFlow5ID &a, const IPFlow5ID &b)
+{
+    return a.proto() == b.proto()
+	&& static_cast<const IPFlowID &>(a) == static_cast<const IPFlowID &>(b);
+}
+
+inline bool operator!=(const IPFlow5ID &a, const IPFlow5ID &b)
+{
+    return !(a == b);
+}
+
 CLICK_ENDDECLS
 #endif
@@ -32,6 +32,10 @@ class Master { public:
     inline RouterThread *thread(int id) const;
     void wake_somebody();
 
+    /** @brief Keep the timers of every thread that expire after the current
+     * millisecond in a timing wheel, or in the heap. */
+    void set_timer_wheel(bool wheel);
+
 #if CLICK_USERLEVEL
     int add_signal_handler(int signo, Router *router, String handler);
     int remove_signal_handler(int signo, Router *router, String handler);
@@ -5,6 +5,7 @@
 #include <click/bitvector.hh>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sched.h>
 
 extern "C" {
 #include <numa.h>
@@ -114,6 +115,18 @@ public:
 		return numa_num_configured_nodes();
 	}
 
+	static bool available() {
+		return numa_available() >= 0;
+	}
+
+	/* Node of the CPU the calling thread runs on, or -1 */
+	static int get_current_node() {
+		int cpu = sched_getcpu();
+		if (cpu < 0)
+			return -1;
+		return numa_node_of_cpu(cpu);
+	}
+
 	static int get_device_node(const char* device) {
 
 		char path[100];
@@ -835,6 +835,9 @@ class Packet { public:
     // User-space and BSD kernel module implementations.
 protected:
     atomic_uint32_t _use_count;
+# if HAVE_CLICK_PACKET_POOL && HAVE_MULTITHREAD
+    uint32_t _home;	/* NUMA socket whose packet pool owns this packet */
+# endif
     Packet *_data_packet;
 private:
     /* mimic Linux sk_buff */
@@ -892,6 +895,9 @@ private:
         unsigned pdcount;           // # buffers in `pd` list
     #  if HAVE_MULTITHREAD
         PacketPool* thread_pool_next; // link to next per-thread pool
+        unsigned socket;            // NUMA socket of this thread
+        struct PacketPoolRemote* remote; // packets to give back to other
+                                    //   sockets, one entry per socket
     #  endif
     };
 #endif
@@ -923,6 +929,8 @@ class WritablePacket : public Packet { public:
 
 # if HAVE_CLICK_PACKET_POOL
     static PacketPool* make_local_packet_pool();
+    static void pool_rehome();
+    static String pool_report();
 # endif
 
     static void pool_transfer(int from, int to);
@@ -982,6 +990,11 @@ class WritablePacket : public Packet { public:
     static WritablePacket *pool_batch_allocate(uint16_t count);
     static void recycle_packet_batch(WritablePacket *head, Packet* tail, unsigned count);
     static void recycle_data_batch(WritablePacket *head, Packet* tail, unsigned count);
+# if HAVE_MULTITHREAD
+    static void recycle_remote(PacketPool &packet_pool, WritablePacket *p, bool data);
+    static WritablePacket *recycle_remote_batch(PacketPool &packet_pool, WritablePacket *head,
+                                                Packet *&tail, unsigned &count, bool data);
+# endif
 #endif
 
     friend class Packet;
@@ -56,6 +56,34 @@ CLICK_DECLS
             return head - tail;
         }
 
+        /**
+         * @brief Insert up to @a n objects with a single update of head
+         * @return the number of objects inserted
+         */
+        inline unsigned insert_bulk(T* objs, unsigned n) {
+            unsigned space = RING_SIZE - (head - tail);
+            if (n > space)
+                n = space;
+            for (unsigned i = 0; i < n; i++)
+                ring[(head + i) % RING_SIZE] = objs[i];
+            head += n;
+            return n;
+        }
+
+        /**
+         * @brief Extract up to @a n objects with a single update of tail
+         * @return the number of objects extracted
+         */
+        inline unsigned extract_bulk(T* objs, unsigned n) {
+            unsigned avail = head - tail;
+            if (n > avail)
+                n = avail;
+            for (unsigned i = 0; i < n; i++)
+                objs[i] = ring[(tail + i) % RING_SIZE];
+            tail += n;
+            return n;
+        }
+
         T ring[RING_SIZE];
         uint32_t head;
         uint32_t tail;
@@ -76,7 +104,12 @@ CLICK_DECLS
 /**
  * Ring with size set at initialization time
  *
- * NOT MT-Safe
+ * Safe for one producer and one consumer running on different threads. The
+ * indexes written by the producer and by the consumer are kept on separate
+ * cache lines, and each side works on a cached copy of the other side's
+ * index, only reading the shared one when the copy says the ring is full
+ * (or empty). Use the bulk operations to move many objects with a single
+ * index update.
  */
 template <typename T> class SPSCDynamicRing {
 
@@ -98,11 +131,18 @@ protected:
 			i++;
 	}
 
+	// Number of objects between tail t and head h
+	inline uint32_t used(uint32_t t, uint32_t h) {
+		return h >= t ? h - t : h + _size - t;
+	}
+
     T* ring;
 public:
     SPSCDynamicRing() : _size(0),ring(0) {
         head = 0;
         tail = 0;
+        _cached_head = 0;
+        _cached_tail = 0;
     }
 
     ~SPSCDynamicRing() {
@@ -112,28 +152,93 @@ public:
 
 
     inline T extract() {
-        if (!is_empty()) {
-            T &v = ring[tail];
-            inc_i(tail);
-            return v;
-        } else
-            return 0;
+        uint32_t t = tail;
+        if (t == _cached_head) {
+            _cached_head = head;
+            if (t == _cached_head)
+                return 0;
+        }
+        click_read_fence();
+        T v = ring[t];
+        inc_i(t);
+        tail = t;
+        return v;
     }
 
     inline bool insert(T batch) {
-        if (!is_full()) {
-            ring[head] = batch;
-            inc_i(head);
-            return true;
-        } else
-            return false;
+        uint32_t h = head;
+        uint32_t nh = next_i(h);
+        if (nh == _cached_tail) {
+            _cached_tail = tail;
+            if (nh == _cached_tail)
+                return false;
+        }
+        ring[h] = batch;
+        click_write_fence();
+        head = nh;
+        return true;
+    }
+
+    /**
+     * @brief Insert up to @a n objects, published with a single update of
+     * head
+     * @return the number of objects inserted
+     *
+     * Must only be called by the producer.
+     */
+    inline unsigned insert_bulk(T* objs, unsigned n) {
+        uint32_t h = head;
+        unsigned space = _size - 1 - used(_cached_tail, h);
+        if (space < n) {
+            _cached_tail = tail;
+            space = _size - 1 - used(_cached_tail, h);
+            if (space < n)
+                n = space;
+        }
+        unsigned first = _size - h;
+        if (first > n)
+            first = n;
+        memcpy(&ring[h], objs, first * sizeof(T));
+        memcpy(&ring[0], objs + first, (n - first) * sizeof(T));
+        h += n;
+        if (h >= _size)
+            h -= _size;
+        click_write_fence();
+        head = h;
+        return n;
+    }
+
+    /**
+     * @brief Extract up to @a n objects, released with a single update of
+     * tail
+     * @return the number of objects extracted
+     *
+     * Must only be called by the consumer.
+     */
+    inline unsigned extract_bulk(T* objs, unsigned n) {
+        uint32_t t = tail;
+        unsigned avail = used(t, _cached_head);
+        if (avail < n) {
+            _cached_head = head;
+            avail = used(t, _cached_head);
+            if (avail < n)
+                n = avail;
+        }
+        click_read_fence();
+        unsigned first = _size - t;
+        if (first > n)
+            first = n;
+        memcpy(objs, &ring[t], first * sizeof(T));
+        memcpy(objs + first, &ring[0], (n - first) * sizeof(T));
+        t += n;
+        if (t >= _size)
+            t -= _size;
+        tail = t;
+        return n;
     }
 
     inline unsigned int count() {
-        int count = (int)head - (int)tail;
-        if (count < 0)
-            count += _size;
-        return count;
+        return used(tail, head);
     }
 
     inline bool is_empty() {
@@ -144,10 +249,6 @@ public:
         return next_i(head) == tail;
     }
 
-
-    uint32_t head;
-    uint32_t tail;
-
     inline bool initialized() {
         return _size > 0;
     }
@@ -156,6 +257,14 @@ public:
         _size = size;
         ring = new T[size];
     }
+
+    // Written by the producer
+    volatile uint32_t head CLICK_CACHE_ALIGN;
+    uint32_t _cached_tail;
+
+    // Written by the consumer
+    volatile uint32_t tail CLICK_CACHE_ALIGN;
+    uint32_t _cached_head;
 };
 
 template <typename T>
@@ -199,6 +308,22 @@ template <typename T> class MPMCDynamicRing {
     }
 
 
+    inline unsigned insert_bulk(T* objs, unsigned n) {
+#if RTE_VERSION >= RTE_VERSION_NUM(17,5,0,0)
+        return rte_ring_mp_enqueue_burst(_ring, (void* const*)objs, n, 0);
+#else
+        return rte_ring_mp_enqueue_burst(_ring, (void* const*)objs, n);
+#endif
+    }
+
+    inline unsigned extract_bulk(T* objs, unsigned n) {
+#if RTE_VERSION >= RTE_VERSION_NUM(17,5,0,0)
+        return rte_ring_mc_dequeue_burst(_ring, (void**)objs, n, 0);
+#else
+        return rte_ring_mc_dequeue_burst(_ring, (void**)objs, n);
+#endif
+    }
+
     inline bool is_empty() {
         return rte_ring_empty(_ring);
     }
@@ -232,6 +357,14 @@ template <typename T> class MPSCDynamicRing : public MPMCDynamicRing<T> {
         else
             return o;
     }
+
+    inline unsigned extract_bulk(T* objs, unsigned n) {
+#if RTE_VERSION >= RTE_VERSION_NUM(17,5,0,0)
+        return rte_ring_sc_dequeue_burst(this->_ring, (void**)objs, n, 0);
+#else
+        return rte_ring_sc_dequeue_burst(this->_ring, (void**)objs, n);
+#endif
+    }
 };
 #else
 /**
@@ -262,6 +395,20 @@ public:
 	return r;
     }
 
+    inline unsigned insert_bulk(T* objs, unsigned n) {
+        _lock.acquire();
+        n = SPSCDynamicRing<T> :: insert_bulk(objs, n);
+        _lock.release();
+        return n;
+    }
+
+    inline unsigned extract_bulk(T* objs, unsigned n) {
+        _lock.acquire();
+        n = SPSCDynamicRing<T> :: extract_bulk(objs, n);
+        _lock.release();
+        return n;
+    }
+
 };
 template <typename T> class MPSCDynamicRing : public MPMCDynamicRing<T> {};
 
@@ -444,6 +591,19 @@ public:
             return 0;
         }
     }
+    inline unsigned insert_bulk(T* objs, unsigned n) {
+        acquire_head();
+        n = SPSCRing<T,RING_SIZE>::insert_bulk(objs, n);
+        release_head();
+        return n;
+    }
+
+    inline unsigned extract_bulk(T* objs, unsigned n) {
+        acquire_tail();
+        n = SPSCRing<T,RING_SIZE>::extract_bulk(objs, n);
+        release_tail();
+        return n;
+    }
 };
 
 template <typename T, size_t RING_SIZE> class SMPMCRing : public SPSCRing<T, RING_SIZE> {
@@ -496,6 +656,22 @@ public:
         }
     }
 
+    inline unsigned insert_bulk(T* objs, unsigned n) {
+        acquire_head();
+        n = SPSCRing<T,RING_SIZE>::insert_bulk(objs, n);
+        release_head();
+        click_compiler_fence();
+        return n;
+    }
+
+    inline unsigned extract_bulk(T* objs, unsigned n) {
+        acquire_tail();
+        n = SPSCRing<T,RING_SIZE>::extract_bulk(objs, n);
+        release_tail();
+        click_compiler_fence();
+        return n;
+    }
+
 };
 
 template <typename T, size_t RING_SIZE> class MPSCRing : public SPSCRing<T, RING_SIZE> {
@@ -522,6 +698,13 @@ public:
             return false;
         }
     }
+
+    inline unsigned insert_bulk(T* objs, unsigned n) {
+        acquire_head();
+        n = SPSCRing<T,RING_SIZE>::insert_bulk(objs, n);
+        release_head();
+        return n;
+    }
 };
 
 CLICK_ENDDECLS
@@ -106,6 +106,11 @@ class Router { public:
     inline bool is_fullpush() const;
     inline void non_fullpush();
 
+    /** @brief Return the router's element profile, or null if none was
+     * created. */
+    ElementProfile* profile() const     { return _profile; }
+    ElementProfile* force_profile();
+
     /** @cond never */
     // Needs to be public for NameInfo, but not useful outside
     inline NameInfo* name_info() const;
@@ -339,6 +344,7 @@ class Router { public:
     ThreadSched* _thread_sched;
     bool _is_fullpush;
     mutable NameInfo* _name_info;
+    ElementProfile* _profile;
     Vector<int> _flow_code_override_eindex;
     Vector<String> _flow_code_override;
 
@@ -0,0 +1,412 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_SKETCH_HH
+#define CLICK_SKETCH_HH
+#include <click/glue.hh>
+#include <click/integers.hh>
+#include <click/vector.hh>
+#include <click/heap.hh>
+#include <click/ipflowid.hh>
+#if !CLICK_LINUXMODULE && !CLICK_BSDMODULE
+# include <math.h>
+#endif
+CLICK_DECLS
+
+/** @file <click/sketch.hh>
+ * @brief Fixed-memory, mergeable streaming sketches.
+ *
+ * The sketches count keys by their 64-bit hash, see sketch_hash(). Their
+ * memory is fixed at construction, whatever the number of keys. Like
+ * HDRHistogram, a sketch must only be updated by one thread at a time: keep
+ * one sketch per thread and merge() them to read.
+ */
+
+/** @brief Return the 64-bit hash of @a flow used by the sketches. */
+inline uint64_t sketch_hash(const IPFlowID &flow)
+{
+    uint64_t h = ((uint64_t) flow.saddr().addr() << 32) | flow.daddr().addr();
+    h ^= ((uint64_t) flow.sport() << 16 | flow.dport()) * 0x9E3779B97F4A7C15ULL;
+    // finalizer of SplitMix64
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    return h ^ (h >> 31);
+}
+
+
+/** @class CountMinSketch include/click/sketch.hh <click/sketch.hh>
+ * @brief Estimates the count of any key.
+ *
+ * The sketch has depth() rows of width() counters. A key adds to one
+ * counter per row, and its estimate is the smallest of them. Estimates are
+ * never below the true count, and exceed it by more than total() * e /
+ * width() with probability at most e<sup>-depth()</sup>.
+ */
+class CountMinSketch { public:
+
+    /** @brief Construct an empty sketch.
+     * @param width counters per row, rounded up to a power of two
+     * @param depth number of rows, between 1 and 16 */
+    explicit CountMinSketch(unsigned width = 4096, unsigned depth = 4)
+	: _depth(depth < 1 ? 1 : (depth > 16 ? 16 : depth)), _total(0) {
+	unsigned w = 1;
+	while (w < width && w < 0x80000000U)
+	    w <<= 1;
+	_mask = w - 1;
+	_counts.assign(w * _depth, 0);
+    }
+
+    unsigned width() const {
+	return _mask + 1;
+    }
+    unsigned depth() const {
+	return _depth;
+    }
+    /** @brief Return the sum of all counts added. */
+    uint64_t total() const {
+	return _total;
+    }
+
+    /** @brief Add @a n to the key of hash @a hash and return its new
+     * estimate. */
+    inline uint64_t add(uint64_t hash, uint64_t n = 1) {
+	uint32_t h1 = hash, h2 = (hash >> 32) | 1;
+	uint64_t *row = _counts.begin(), est = ~(uint64_t) 0;
+	for (unsigned d = 0; d < _depth; ++d, row += _mask + 1) {
+	    uint64_t &c = row[(h1 + d * h2) & _mask];
+	    c += n;
+	    if (c < est)
+		est = c;
+	}
+	_total += n;
+	return est;
+    }
+
+    /** @brief Return the estimated count of the key of hash @a hash. */
+    inline uint64_t estimate(uint64_t hash) const {
+	uint32_t h1 = hash, h2 = (hash >> 32) | 1;
+	const uint64_t *row = _counts.begin();
+	uint64_t est = ~(uint64_t) 0;
+	for (unsigned d = 0; d < _depth; ++d, row += _mask + 1)
+	    if (row[(h1 + d * h2) & _mask] < est)
+		est = row[(h1 + d * h2) & _mask];
+	return est;
+    }
+
+    void clear() {
+	for (uint64_t *c = _counts.begin(); c != _counts.end(); ++c)
+	    *c = 0;
+	_total = 0;
+    }
+
+    /** @brief Add the counts of @a x, which must have the same geometry. */
+    void merge(const CountMinSketch &x) {
+	assert(x._counts.size() == _counts.size());
+	for (int i = 0; i < _counts.size(); ++i)
+	    _counts[i] += x._counts[i];
+	_total += x._total;
+    }
+
+  private:
+
+    unsigned _mask;
+    unsigned _depth;
+    uint64_t _total;
+    Vector<uint64_t> _counts;
+
+};
+
+
+/** @class SpaceSavingSketch include/click/sketch.hh <click/sketch.hh>
+ * @brief Tracks the most frequent keys.
+ *
+ * The sketch keeps capacity() keys with their counts. A key that is not
+ * tracked replaces the key of smallest count once the sketch is full, and
+ * inherits that count as its error. Each count is an overestimate by at most
+ * its error, itself at most total / capacity(); any key of true count above
+ * that bound is tracked. Keys are found in a hash table and the smallest
+ * count at the top of a heap, so add() takes O(1) time when the key is
+ * tracked and O(log capacity()) otherwise.
+ *
+ * merge() follows "Mergeable Summaries" (Agarwal et al., PODS 2012): keys
+ * missing from one sketch are counted as the smallest count of that sketch.
+ */
+class SpaceSavingSketch { public:
+
+    struct Entry {
+	IPFlowID key;
+	uint64_t hash;
+	uint64_t count;
+	uint64_t error;
+	int slot;
+
+	Entry()
+	    : key(), hash(0), count(0), error(0), slot(-1) {
+	}
+    };
+
+    /** @brief Construct an empty sketch tracking up to @a capacity keys. */
+    explicit SpaceSavingSketch(unsigned capacity = 64)
+	: _capacity(capacity ? capacity : 1) {
+	unsigned t = 2;
+	while (t < 2 * _capacity)
+	    t <<= 1;
+	_mask = t - 1;
+	_table.assign(t, -1);
+	_heap.reserve(_capacity);
+    }
+
+    unsigned capacity() const {
+	return _capacity;
+    }
+    int size() const {
+	return _heap.size();
+    }
+    bool full() const {
+	return (unsigned) _heap.size() == _capacity;
+    }
+    /** @brief Return the count a key that is not tracked may have. */
+    uint64_t min_count() const {
+	return full() ? _heap[0].count : 0;
+    }
+    /** @brief Return the entry of smallest count.
+     * @pre size() > 0 */
+    const Entry &min_entry() const {
+	return _heap[0];
+    }
+
+    /** @brief Count @a n occurrences of @a key, of hash @a hash. */
+    inline void add(const IPFlowID &key, uint64_t hash, uint64_t n = 1) {
+	if (Entry *e = find(key, hash))
+	    increase(e, n);
+	else if (!full())
+	    insert(key, hash, n, 0);
+	else {
+	    uint64_t min = _heap[0].count;
+	    replace_min(key, hash, min + n, min);
+	}
+    }
+
+    /** @brief Return the entry of @a key, of hash @a hash, or null. */
+    inline Entry *find(const IPFlowID &key, uint64_t hash) {
+	for (unsigned i = hash & _mask; _table[i] >= 0; i = (i + 1) & _mask) {
+	    Entry &e = _heap[_table[i]];
+	    if (e.hash == hash && e.key == key)
+		return &e;
+	}
+	return 0;
+    }
+    inline const Entry *find(const IPFlowID &key, uint64_t hash) const {
+	return const_cast<SpaceSavingSketch *>(this)->find(key, hash);
+    }
+
+    /** @brief Add @a n to the count of tracked entry @a e. */
+    inline void increase(Entry *e, uint64_t n) {
+	e->count += n;
+	change_heap(_heap.begin(), _heap.end(), e, less(), place(this));
+    }
+
+    /** @brief Track @a key, which is not tracked, with the given count and
+     * error.
+     * @pre !full() */
+    void insert(const IPFlowID &key, uint64_t hash, uint64_t count, uint64_t error) {
+	assert(!full());
+	Entry e;
+	e.key = key;
+	e.hash = hash;
+	e.count = count;
+	e.error = error;
+	e.slot = free_slot(hash);
+	_table[e.slot] = _heap.size();
+	_heap.push_back(e);
+	push_heap(_heap.begin(), _heap.end(), less(), place(this));
+    }
+
+    /** @brief Replace the key of smallest count with @a key, which is not
+     * tracked.
+     * @pre size() > 0 */
+    void replace_min(const IPFlowID &key, uint64_t hash, uint64_t count, uint64_t error) {
+	Entry &e = _heap[0];
+	erase_slot(e.slot);
+	e.key = key;
+	e.hash = hash;
+	e.count = count;
+	e.error = error;
+	e.slot = free_slot(hash);
+	_table[e.slot] = 0;
+	change_heap(_heap.begin(), _heap.end(), _heap.begin(), less(), place(this));
+    }
+
+    void clear() {
+	_heap.clear();
+	_table.assign(_mask + 1, -1);
+    }
+
+    /** @brief Add the keys of @a x, which must have the same capacity. */
+    void merge(const SpaceSavingSketch &x) {
+	uint64_t mine = min_count(), theirs = x.min_count();
+	Vector<Entry> all;
+	for (const Entry *e = _heap.begin(); e != _heap.end(); ++e) {
+	    all.push_back(*e);
+	    if (const Entry *xe = x.find(e->key, e->hash)) {
+		all.back().count += xe->count;
+		all.back().error += xe->error;
+	    } else {
+		all.back().count += theirs;
+		all.back().error += theirs;
+	    }
+	}
+	for (const Entry *xe = x._heap.begin(); xe != x._heap.end(); ++xe)
+	    if (!find(xe->key, xe->hash)) {
+		all.push_back(*xe);
+		all.back().count += mine;
+		all.back().error += mine;
+	    }
+	sort(all);
+	clear();
+	for (int i = 0; i < all.size() && !full(); ++i)
+	    insert(all[i].key, all[i].hash, all[i].count, all[i].error);
+    }
+
+    /** @brief Set @a v to the tracked entries, by decreasing count. */
+    void top(Vector<Entry> &v) const {
+	v = _heap;
+	sort(v);
+    }
+
+    /** @brief Sort @a v by decreasing count. */
+    static void sort(Vector<Entry> &v) {
+	if (v.size())
+	    click_qsort(v.begin(), v.size(), sizeof(Entry), compare_count);
+    }
+
+  private:
+
+    unsigned _capacity;
+    unsigned _mask;
+    Vector<Entry> _heap;	// min-heap of counts
+    Vector<int> _table;		// heap index of each key, or -1
+
+    struct less {
+	inline bool operator()(const Entry &a, const Entry &b) {
+	    return a.count < b.count;
+	}
+    };
+    struct place {
+	SpaceSavingSketch *s;
+	place(SpaceSavingSketch *s_)
+	    : s(s_) {
+	}
+	inline void operator()(Entry *begin, Entry *e) {
+	    s->_table[e->slot] = e - begin;
+	}
+    };
+
+    unsigned free_slot(uint64_t hash) const {
+	unsigned i = hash & _mask;
+	while (_table[i] >= 0)
+	    i = (i + 1) & _mask;
+	return i;
+    }
+
+    // Linear probing deletion: move back the keys that probed past slot i
+    void erase_slot(unsigned i) {
+	for (unsigned j = i; ; ) {
+	    j = (j + 1) & _mask;
+	    int h = _table[j];
+	    if (h < 0)
+		break;
+	    unsigned ideal = _heap[h].hash & _mask;
+	    if (((j - ideal) & _mask) >= ((j - i) & _mask)) {
+		_table[i] = h;
+		_heap[h].slot = i;
+		i = j;
+	    }
+	}
+	_table[i] = -1;
+    }
+
+    static int compare_count(const void *a, const void *b, void *) {
+	uint64_t ca = static_cast<const Entry *>(a)->count,
+	    cb = static_cast<const Entry *>(b)->count;
+	return ca > cb ? -1 : (ca < cb ? 1 : 0);
+    }
+
+};
+
+
+/** @class HyperLogLogSketch include/click/sketch.hh <click/sketch.hh>
+ * @brief Estimates the number of distinct keys.
+ *
+ * The sketch keeps 2<sup>precision</sup> one-byte registers, and its
+ * estimate has a relative standard error of 1.04 /
+ * 2<sup>precision/2</sup>: 1.6% for the default precision of 12, which
+ * takes 4 KB. Small cardinalities are counted by linear counting.
+ */
+class HyperLogLogSketch { public:
+
+    /** @brief Construct an empty sketch.
+     * @param precision between 4 and 18 */
+    explicit HyperLogLogSketch(unsigned precision = 12)
+	: _precision(precision < 4 ? 4 : (precision > 18 ? 18 : precision)) {
+	_registers.assign(1 << _precision, 0);
+    }
+
+    unsigned precision() const {
+	return _precision;
+    }
+
+    /** @brief Count the key of hash @a hash. */
+    inline void add(uint64_t hash) {
+	unsigned j = hash >> (64 - _precision);
+	uint64_t w = hash << _precision;
+	uint8_t rank = w ? ffs_msb(w) : 65 - _precision;
+	if (rank > _registers.unchecked_at(j))
+	    _registers.unchecked_at(j) = rank;
+    }
+
+    void clear() {
+	for (uint8_t *r = _registers.begin(); r != _registers.end(); ++r)
+	    *r = 0;
+    }
+
+    /** @brief Add the keys of @a x, which must have the same precision. */
+    void merge(const HyperLogLogSketch &x) {
+	assert(x._precision == _precision);
+	for (int i = 0; i < _registers.size(); ++i)
+	    if (x._registers[i] > _registers[i])
+		_registers[i] = x._registers[i];
+    }
+
+#if !CLICK_LINUXMODULE && !CLICK_BSDMODULE
+    /** @brief Return the estimated number of distinct keys. */
+    double estimate() const {
+	double m = _registers.size(), sum = 0;
+	int zeros = 0;
+	for (const uint8_t *r = _registers.begin(); r != _registers.end(); ++r) {
+	    sum += ldexp(1.0, -*r);
+	    zeros += (*r == 0);
+	}
+	double alpha;
+	if (_precision == 4)
+	    alpha = 0.673;
+	else if (_precision == 5)
+	    alpha = 0.697;
+	else if (_precision == 6)
+	    alpha = 0.709;
+	else
+	    alpha = 0.7213 / (1 + 1.079 / m);
+	double e = alpha * m * m / sum;
+	if (e <= 2.5 * m && zeros)
+	    e = m * log(m / zeros);
+	return e;
+    }
+#endif
+
+  private:
+
+    unsigned _precision;
+    Vector<uint8_t> _registers;
+
+};
+
+CLICK_ENDDECLS
+#endif
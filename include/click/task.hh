@@ -584,7 +584,7 @@ Task::fire()
 {
 #if CLICK_STATS >= 2
     click_cycles_t start_cycles = click_get_cycles(),
-        start_child_cycles = _owner->_child_cycles;
+        start_child_cycles = ElementProfile::thread_child_cycles();
 #endif
 #if HAVE_TASK_STATS
     _cycle_runs++;
@@ -600,7 +600,7 @@ Task::fire()
 #endif
 #if CLICK_STATS >= 2
     click_cycles_t all_delta = click_get_cycles() - start_cycles,
-        own_delta = all_delta - (_owner->_child_cycles - start_child_cycles);
+        own_delta = all_delta - (ElementProfile::thread_child_cycles() - start_child_cycles);
     _owner->_task_calls += 1;
     _owner->_task_own_cycles += own_delta;
 #endif
@@ -25,6 +25,11 @@ class TimerSet { public:
     unsigned timer_stride() const		{ return _timer_stride; }
     void set_max_timer_stride(unsigned timer_stride);
 
+    /** @brief Return true if timers expiring after the current millisecond
+     * are kept in a hierarchical timing wheel. */
+    bool wheel() const				{ return _wheel.size() != 0; }
+    void set_wheel(bool wheel);
+
     void kill_router(Router *router);
 
     void run_timers(RouterThread *thread, Master *master);
@@ -54,6 +59,18 @@ class TimerSet { public:
 	}
     };
 
+    // The wheel has wheel_levels levels of wheel_slots lists, each slot of
+    // level L covering wheel_slots^L milliseconds, and a last list for
+    // timers beyond the top level. Timers are placed by comparing their
+    // expiry tick with _wheel_tick, and cascade to a lower level when the
+    // wheel enters their slot. Timers expiring up to _wheel_tick are in the
+    // heap, which keeps their precise order.
+    enum {
+	wheel_bits = 8, wheel_slots = 1 << wheel_bits, wheel_levels = 4,
+	wheel_far = wheel_levels * wheel_slots,
+	schedpos_wheel = -0x7FFFFFFF - 1
+    };
+
     // Most likely _timer_expiry now fits in a cache line
     Timestamp _timer_expiry CLICK_ALIGNED(8);
 
@@ -71,16 +88,39 @@ class TimerSet { public:
     Timestamp _timer_check;
     uint32_t _timer_check_reports;
 
+    Vector<Timer *> _wheel;
+    uint64_t _wheel_tick;
+    unsigned _wheel_count;
+    uint64_t _wheel_occupied[wheel_levels][wheel_slots / 64];
+
     inline void run_one_timer(Timer *);
 
     void set_timer_expiry() {
 	if (_timer_heap.size())
 	    _timer_expiry = _timer_heap.unchecked_at(0).expiry_s;
+	else if (_wheel_count)
+	    _timer_expiry = wheel_expiry();
 	else
 	    _timer_expiry = Timestamp();
     }
     void check_timer_expiry(Timer *t);
 
+    inline void heap_insert(Timer *t);
+    inline void heap_remove(Timer *t);
+
+    static inline uint64_t wheel_tick(const Timestamp &t) {
+	return t.msecval();
+    }
+    inline int wheel_next_slot(int level, int from) const;
+    int wheel_next(uint64_t &tick) const;
+    void wheel_insert(Timer *t);
+    void wheel_remove(Timer *t);
+    void wheel_place(Timer *t);
+    void wheel_cascade(int slot);
+    bool wheel_schedule(Timer *t);
+    void wheel_advance(const Timestamp &now);
+    Timestamp wheel_expiry() const;
+
     inline void lock_timers();
     inline bool attempt_lock_timers();
     inline void unlock_timers();
@@ -153,7 +193,14 @@ inline Timer *
 TimerSet::next_timer()
 {
     lock_timers();
-    Timer *t = _timer_heap.empty() ? 0 : _timer_heap.unchecked_at(0).t;
+    Timer *t;
+    if (!_timer_heap.empty())
+	t = _timer_heap.unchecked_at(0).t;
+    else if (_wheel_count) {
+	uint64_t tick;
+	t = _wheel[wheel_next(tick)];
+    } else
+	t = 0;
     unlock_timers();
     return t;
 }
@@ -8,9 +8,11 @@ CLICK_DECLS
 template <typename T>
 class TimerWheel {
     public:
-        TimerWheel() : _index(0) {
+        TimerWheel() : _index(0), _pending(0) {
         }
 
+        enum { EXPIRE_BATCH = 32 };
+
         void initialize(int max) {
             max = next_pow2(max + 2);
             _mask = max - 1;
@@ -49,9 +51,53 @@ class TimerWheel {
             _index++;
         }
 
+        /**
+         * Expire the current bucket by chunks of up to EXPIRE_BATCH objects.
+         *
+         * The bucket is detached and the wheel moves on at once, so objects
+         * rescheduled by @a expire are never put back in the bucket being
+         * walked. @a next(obj) must return the object linked after obj,
+         * @a expire(objs, n) is called with each chunk, after all of its
+         * objects were unlinked and while the first object of the next
+         * chunk is prefetched; it may reschedule them. If it returns false,
+         * the walk stops and the rest of the bucket is kept for the next
+         * call, which resumes it before detaching another bucket.
+         *
+         * @return true if part of the bucket is left for the next call
+         *
+         * Must be called by one thread only!
+         */
+        template <typename N, typename E>
+        inline bool run_timers_batch(N next, E expire) {
+            if (!_pending) {
+                _writers_lock.acquire();
+                unsigned id = _index & _mask;
+                _pending = _buckets.unchecked_at(id);
+                _buckets.unchecked_at(id) = 0;
+                _index++;
+                _writers_lock.release();
+            }
+            while (_pending) {
+                T* objs[EXPIRE_BATCH];
+                int n = 0;
+                T* f = _pending;
+                do {
+                    objs[n++] = f;
+                    f = next(f);
+                } while (f && n < EXPIRE_BATCH);
+                _pending = f;
+                if (f)
+                    __builtin_prefetch(f);
+                if (!expire(objs, n) && _pending)
+                    return true;
+            }
+            return false;
+        }
+
     private:
         uint32_t _mask;
         uint32_t _index;
+        T* _pending;
         Vector<T*> _buckets;
         Spinlock _writers_lock;
 };
@@ -133,6 +133,8 @@ struct click_ip {
  * @a x must be two-byte aligned. */
 uint16_t click_in_cksum(const unsigned char *x, int len);
 uint16_t click_in_cksum_pseudohdr_raw(uint32_t csum, uint32_t src, uint32_t dst, int proto, int packet_len);
+const char *click_in_cksum_impl(void);
+int click_in_cksum_set_impl(const char *name);
 #else
 # define click_in_cksum(addr, len) \
 		ip_compute_csum((unsigned char *)(addr), (len))
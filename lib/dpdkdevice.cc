@@ -71,27 +71,56 @@ const char *DPDKDevice::get_device_driver()
 
 int DPDKDevice::set_rss_max(int max)
 {
-    struct rte_eth_rss_reta_entry64 reta_conf[RETA_CONF_SIZE];
-    struct rte_eth_dev_info dev_info;
+    Vector<unsigned> reta(get_reta_size(), 0);
+    for (int i = 0; i < reta.size(); i++)
+        reta[i] = i % max;
+    return set_reta(reta);
+}
 
+unsigned DPDKDevice::get_reta_size()
+{
+    struct rte_eth_dev_info dev_info;
     rte_eth_dev_info_get(port_id, &dev_info);
-    uint16_t reta_size = dev_info.reta_size;
-    uint32_t i;
-    int status;
+    return dev_info.reta_size;
+}
+
+/**
+ * Read the RSS redirection table of the device: the queue of each bucket.
+ */
+int DPDKDevice::get_reta(Vector<unsigned> &reta)
+{
+    struct rte_eth_rss_reta_entry64 reta_conf[RETA_CONF_SIZE];
+    unsigned reta_size = get_reta_size();
+    if (reta_size > ETH_RSS_RETA_SIZE_512)
+        return -EINVAL;
+
+    memset(reta_conf, 0, sizeof(reta_conf));
+    for (unsigned i = 0; i < reta_size; i++)
+        reta_conf[i / RTE_RETA_GROUP_SIZE].mask = UINT64_MAX;
+    int status = rte_eth_dev_rss_reta_query(port_id, reta_conf, reta_size);
+    if (status != 0)
+        return status;
+    reta.resize(reta_size);
+    for (unsigned i = 0; i < reta_size; i++)
+        reta[i] = reta_conf[i / RTE_RETA_GROUP_SIZE].reta[i % RTE_RETA_GROUP_SIZE];
+    return 0;
+}
+
+int DPDKDevice::set_reta(const Vector<unsigned> &reta)
+{
+    struct rte_eth_rss_reta_entry64 reta_conf[RETA_CONF_SIZE];
+    uint16_t reta_size = reta.size();
+    if (reta_size > ETH_RSS_RETA_SIZE_512)
+        return -EINVAL;
+
     /* RETA setting */
     memset(reta_conf, 0, sizeof(reta_conf));
-    for (i = 0; i < reta_size; i++) {
+    for (unsigned i = 0; i < reta_size; i++) {
         reta_conf[i / RTE_RETA_GROUP_SIZE].mask = UINT64_MAX;
-    }
-    for (i = 0; i < reta_size; i++) {
-        uint32_t reta_id = i / RTE_RETA_GROUP_SIZE;
-        uint32_t reta_pos = i % RTE_RETA_GROUP_SIZE;
-        uint32_t core_id = i % max;
-        reta_conf[reta_id].reta[reta_pos] = core_id;
+        reta_conf[i / RTE_RETA_GROUP_SIZE].reta[i % RTE_RETA_GROUP_SIZE] = reta[i];
     }
     /* RETA update */
-    status = rte_eth_dev_rss_reta_update(port_id, reta_conf, reta_size);
-    return status;
+    return rte_eth_dev_rss_reta_update(port_id, reta_conf, reta_size);
 }
 
 #if RTE_VERSION >= RTE_VERSION_NUM(20,2,0,0)
@@ -483,8 +512,21 @@ int DPDKDevice::initialize_device(ErrorHandler *errh)
         }
     }
 
+    // Repeating 16-bit pattern, the Toeplitz hash of a flow and of its reverse
+    // are then the same
+    static uint8_t symmetric_rss_key[40] = {
+        0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+        0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+        0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+        0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a
+    };
+
     if (info.mq_mode & ETH_MQ_RX_RSS_FLAG) {
-        dev_conf.rx_adv_conf.rss_conf.rss_key = NULL;
+        if (info.rss_symmetric) {
+            dev_conf.rx_adv_conf.rss_conf.rss_key = symmetric_rss_key;
+            dev_conf.rx_adv_conf.rss_conf.rss_key_len = sizeof(symmetric_rss_key);
+        } else
+            dev_conf.rx_adv_conf.rss_conf.rss_key = NULL;
         dev_conf.rx_adv_conf.rss_conf.rss_hf = ETH_RSS_IP | ETH_RSS_UDP | ETH_RSS_TCP;
         dev_conf.rx_adv_conf.rss_conf.rss_hf &= dev_info.flow_type_rss_offloads;
     }
@@ -497,6 +539,15 @@ int DPDKDevice::initialize_device(ErrorHandler *errh)
             dev_conf.rxmode.offloads |= DEV_RX_OFFLOAD_TIMESTAMP;
         }
     }
+
+    if (info.rx_offload & (DEV_RX_OFFLOAD_IPV4_CKSUM | DEV_RX_OFFLOAD_UDP_CKSUM | DEV_RX_OFFLOAD_TCP_CKSUM)) {
+        uint64_t cksum = DEV_RX_OFFLOAD_IPV4_CKSUM | DEV_RX_OFFLOAD_UDP_CKSUM | DEV_RX_OFFLOAD_TCP_CKSUM;
+        if ((dev_info.rx_offload_capa & cksum) != cksum) {
+            return errh->error("Hardware checksum verification is not supported by this device!");
+        } else {
+            dev_conf.rxmode.offloads |= info.rx_offload & cksum;
+        }
+    }
 #endif
 
 #if RTE_VERSION >= RTE_VERSION_NUM(18,02,0,0)
@@ -859,6 +910,11 @@ void DPDKDevice::set_init_rss_max(int rss_max) {
     info.init_rss = rss_max;
 }
 
+void DPDKDevice::set_rss_symmetric(bool symmetric) {
+    assert(!_is_initialized);
+    info.rss_symmetric = symmetric;
+}
+
 void DPDKDevice::set_init_fc_mode(FlowControlMode fc) {
     assert(!_is_initialized);
     info.init_fc_mode = fc;
@@ -2307,8 +2307,11 @@ Element::read_cycles_handler(Element *e, void *)
 	sa << "tasks " << e->_task_calls << ' ' << e->_task_own_cycles << '\n';
     if (e->_timer_calls)
 	sa << "timers " << e->_timer_calls << ' ' << e->_timer_own_cycles << '\n';
-    if (e->_xfer_calls)
-	sa << "xfer " << e->_xfer_calls << ' ' << e->_xfer_own_cycles << '\n';
+    if (ElementProfile *prof = e->router()->profile()) {
+	ElementProfile::Counters c = prof->element_counters(e);
+	if (c.calls)
+	    sa << "xfer " << c.sampled << ' ' << c.cycles << '\n';
+    }
     return sa.take_string();
 }
 
@@ -2316,6 +2319,8 @@ int
 Element::write_cycles_handler(const String &, Element *e, void *, ErrorHandler *)
 {
     e->reset_cycles();
+    if (ElementProfile *prof = e->router()->profile())
+	prof->reset_element(e);
     return 0;
 }
 #endif
@@ -0,0 +1,361 @@
+// -*- c-basic-offset: 4; related-file-name: "../include/click/elementprofile.hh" -*-
+/*
+ * elementprofile.{cc,hh} -- per-thread profiling of transfers between
+ * elements
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/elementprofile.hh>
+#include <click/element.hh>
+#include <click/router.hh>
+#include <click/straccum.hh>
+#include <click/hashtable.hh>
+CLICK_DECLS
+
+ElementProfile *ElementProfile::_current;
+
+ElementProfile::ElementProfile(Router *router)
+    : _router(router), _sample_period(1), _nslots(0)
+{
+    _slot_base.resize(router->nelements(), 0);
+    for (int ei = 0; ei < router->nelements(); ++ei) {
+        Element *e = router->element(ei);
+        _slot_base[ei] = _nslots;
+        _nslots += e->ninputs() + e->noutputs();
+    }
+    // Pad each table by a cache line so that no two threads write to the
+    // same line
+    int pad = CLICK_CACHE_LINE_SIZE / sizeof(Counters) + 1;
+    for (unsigned i = 0; i < _threads.weight(); i++)
+        _threads.get_value(i).ports.assign(_nslots + pad, Counters());
+    attach();
+}
+
+ElementProfile::~ElementProfile()
+{
+    set_enabled(false);
+}
+
+inline int
+ElementProfile::slot(const Element *e, bool isoutput, int port) const
+{
+    return _slot_base[e->eindex()] + (isoutput ? e->ninputs() : 0) + port;
+}
+
+void
+ElementProfile::attach()
+{
+    for (int ei = 0; ei < _router->nelements(); ++ei) {
+        Element *e = _router->element(ei);
+        for (int i = 0; i < e->noutputs(); ++i)
+            if (e->output_is_push(i)) {
+                Element::Port &p = const_cast<Element::Port &>(e->output(i));
+                p._profile_slot = slot(p._e, false, p._port);
+            }
+        for (int i = 0; i < e->ninputs(); ++i)
+            if (e->input_is_pull(i)) {
+                Element::Port &p = const_cast<Element::Port &>(e->input(i));
+                p._profile_slot = slot(p._e, true, p._port);
+            }
+    }
+}
+
+void
+ElementProfile::set_enabled(bool enabled)
+{
+    if (enabled)
+        _current = this;
+    else if (_current == this)
+        _current = 0;
+}
+
+void
+ElementProfile::reset()
+{
+    for (unsigned i = 0; i < _threads.weight(); i++) {
+        ThreadState &t = _threads.get_value(i);
+        for (Counters *k = t.ports.begin(); k != t.ports.end(); ++k)
+            k->clear();
+        // Frames may be in use, keep the call paths
+        for (Frame *f = t.frames.begin(); f != t.frames.end(); ++f) {
+            f->calls = 0;
+            f->cycles = 0;
+        }
+    }
+}
+
+void
+ElementProfile::reset_element(const Element *e)
+{
+    int first = slot(e, false, 0), last = slot(e, true, e->noutputs());
+    for (unsigned i = 0; i < _threads.weight(); i++)
+        for (int s = first; s < last; ++s)
+            _threads.get_value(i).ports[s].clear();
+}
+
+click_cycles_t
+ElementProfile::thread_child_cycles()
+{
+    if (ElementProfile *prof = _current)
+        return prof->_threads->child_cycles;
+    return 0;
+}
+
+ElementProfile::Counters
+ElementProfile::port_counters(const Element *e, bool isoutput, int port) const
+{
+    Counters c;
+    int s = slot(e, isoutput, port);
+    for (unsigned i = 0; i < _threads.weight(); i++)
+        c += _threads.get_value(i).ports[s];
+    return c;
+}
+
+ElementProfile::Counters
+ElementProfile::element_counters(const Element *e) const
+{
+    Counters c;
+    int first = slot(e, false, 0), last = slot(e, true, e->noutputs());
+    for (unsigned i = 0; i < _threads.weight(); i++)
+        for (int s = first; s < last; ++s)
+            c += _threads.get_value(i).ports[s];
+    return c;
+}
+
+int
+ElementProfile::find_frame(ThreadState &t, int parent, int eindex)
+{
+    int *link = (parent < 0 ? &t.roots : &t.frames[parent].first_child);
+    for (int f = *link; f >= 0; f = t.frames[f].next_sibling)
+        if (t.frames[f].eindex == eindex)
+            return f;
+    // Deeper paths are merged into their caller once the tree is full.
+    // Frames never move, so that handlers can read them safely.
+    if (t.frames.capacity() == 0)
+        t.frames.reserve(MAX_FRAMES);
+    if (t.frames.size() == MAX_FRAMES)
+        return parent;
+    Frame f;
+    f.eindex = eindex;
+    f.parent = parent;
+    f.first_child = -1;
+    f.next_sibling = *link;
+    f.calls = 0;
+    f.cycles = 0;
+    t.frames.push_back(f);
+    // push_back did not reallocate, link is still valid
+    *link = t.frames.size() - 1;
+    return *link;
+}
+
+void
+ElementProfile::begin(Call &c, const Element *owner, const Element *e, int slot)
+{
+    ThreadState &t = *_threads;
+    c.slot = slot;
+    if (t.depth++ == 0) {
+        t.sampling = _sample_period && ++t.tick >= _sample_period;
+        if (t.sampling) {
+            t.tick = 0;
+            t.frame = find_frame(t, -1, owner->eindex());
+        }
+    }
+    if (t.sampling) {
+        c.saved_frame = t.frame;
+        if (t.frame >= 0)
+            t.frame = find_frame(t, t.frame, e->eindex());
+        c.saved_child_cycles = t.child_cycles;
+        t.child_cycles = 0;
+        c.start = click_get_cycles();
+    }
+}
+
+void
+ElementProfile::end(Call &c, uint64_t packets, bool batch)
+{
+    ThreadState &t = *_threads;
+    Counters &k = t.ports[c.slot];
+    k.calls++;
+    k.packets += packets;
+    k.batches += batch;
+    if (t.sampling) {
+        click_cycles_t all = click_get_cycles() - c.start,
+            own = all - t.child_cycles;
+        k.sampled++;
+        k.cycles += own;
+        if (t.frame >= 0) {
+            t.frames[t.frame].calls++;
+            t.frames[t.frame].cycles += own;
+        }
+        t.frame = c.saved_frame;
+        t.child_cycles = c.saved_child_cycles + all;
+    }
+    if (--t.depth == 0)
+        t.frame = -1;
+}
+
+void
+ElementProfile::unparse_json(StringAccum &sa) const
+{
+    sa << "{\"sample_period\": " << _sample_period
+       << ", \"threads\": " << _threads.weight()
+       << ", \"elements\": [";
+    const char *esep = "\n";
+    for (int ei = 0; ei < _router->nelements(); ++ei) {
+        Element *e = _router->element(ei);
+        Counters c = element_counters(e);
+        if (!c.calls)
+            continue;
+        sa << esep << "  {\"name\": \"" << e->name()
+           << "\", \"class\": \"" << e->class_name()
+           << "\", \"calls\": " << c.calls
+           << ", \"packets\": " << c.packets
+           << ", \"batches\": " << c.batches
+           << ", \"sampled\": " << c.sampled
+           << ", \"cycles\": " << c.cycles
+           << ", \"ports\": [";
+        const char *psep = "";
+        for (int io = 0; io < 2; ++io)
+            for (int i = 0; i < (io ? e->noutputs() : e->ninputs()); ++i) {
+                Counters pc = port_counters(e, io, i);
+                if (!pc.calls)
+                    continue;
+                sa << psep << "{\"port\": \"" << (io ? "out" : "in") << i
+                   << "\", \"calls\": " << pc.calls
+                   << ", \"packets\": " << pc.packets
+                   << ", \"batches\": " << pc.batches
+                   << ", \"sampled\": " << pc.sampled
+                   << ", \"cycles\": " << pc.cycles << '}';
+                psep = ", ";
+            }
+        sa << "], \"thread_packets\": [";
+        int first = slot(e, false, 0), last = slot(e, true, e->noutputs());
+        for (unsigned i = 0; i < _threads.weight(); i++) {
+            uint64_t packets = 0;
+            for (int s = first; s < last; ++s)
+                packets += _threads.get_value(i).ports[s].packets;
+            sa << (i ? ", " : "") << packets;
+        }
+        sa << "]}";
+        esep = ",\n";
+    }
+    sa << "\n]}\n";
+}
+
+void
+ElementProfile::unparse_folded(StringAccum &sa) const
+{
+    // Merge the paths of all threads, in order of first appearance
+    HashTable<String, int> index(-1);
+    Vector<String> paths;
+    Vector<click_cycles_t> cycles;
+    Vector<int> stack;
+    for (unsigned i = 0; i < _threads.weight(); i++) {
+        const ThreadState &t = _threads.get_value(i);
+        for (int f = 0; f < t.frames.size(); ++f) {
+            if (!t.frames[f].cycles)
+                continue;
+            stack.clear();
+            for (int x = f; x >= 0; x = t.frames[x].parent)
+                stack.push_back(t.frames[x].eindex);
+            StringAccum path;
+            for (int j = stack.size() - 1; j >= 0; --j)
+                path << _router->ename(stack[j]) << (j ? ";" : "");
+            String key = path.take_string();
+            int &x = index[key];
+            if (x < 0) {
+                x = paths.size();
+                paths.push_back(key);
+                cycles.push_back(0);
+            }
+            cycles[x] += t.frames[f].cycles;
+        }
+    }
+    for (int x = 0; x < paths.size(); ++x)
+        sa << paths[x] << ' ' << cycles[x] << '\n';
+}
+
+void
+Element::Port::profile_push(Packet *p) const
+{
+    ElementProfile *prof = ElementProfile::current();
+    bool profiled = _owner && prof->router() == _owner->router();
+    ElementProfile::Call c;
+    if (profiled)
+        prof->begin(c, _owner, _e, _profile_slot);
+#if HAVE_BOUND_PORT_TRANSFER
+    _bound.push(_e, _port, p);
+#else
+    _e->push(_port, p);
+#endif
+    if (profiled)
+        prof->end(c, 1, false);
+}
+
+Packet *
+Element::Port::profile_pull() const
+{
+    ElementProfile *prof = ElementProfile::current();
+    bool profiled = _owner && prof->router() == _owner->router();
+    ElementProfile::Call c;
+    if (profiled)
+        prof->begin(c, _owner, _e, _profile_slot);
+#if HAVE_BOUND_PORT_TRANSFER
+    Packet *p = _bound.pull(_e, _port);
+#else
+    Packet *p = _e->pull(_port);
+#endif
+    if (profiled)
+        prof->end(c, p != 0, false);
+    return p;
+}
+
+#if HAVE_BATCH
+void
+Element::Port::profile_push_batch(PacketBatch *batch) const
+{
+    ElementProfile *prof = ElementProfile::current();
+    bool profiled = _owner && prof->router() == _owner->router();
+    ElementProfile::Call c;
+    unsigned count = batch->count();
+    if (profiled)
+        prof->begin(c, _owner, _e, _profile_slot);
+# if HAVE_BOUND_PORT_TRANSFER
+    _bound_batch.push_batch(_e, _port, batch);
+# else
+    _e->push_batch(_port, batch);
+# endif
+    if (profiled)
+        prof->end(c, count, true);
+}
+
+PacketBatch *
+Element::Port::profile_pull_batch(unsigned max) const
+{
+    ElementProfile *prof = ElementProfile::current();
+    bool profiled = _owner && prof->router() == _owner->router();
+    ElementProfile::Call c;
+    if (profiled)
+        prof->begin(c, _owner, _e, _profile_slot);
+# if HAVE_BOUND_PORT_TRANSFER
+    PacketBatch *batch = _bound_batch.pull_batch(_e, _port, max);
+# else
+    PacketBatch *batch = _e->pull_batch(_port, max);
+# endif
+    if (profiled)
+        prof->end(c, batch ? batch->count() : 0, true);
+    return batch;
+}
+#endif
+
+CLICK_ENDDECLS
@@ -18,6 +18,8 @@
 #include <click/config.h>
 #include <click/glue.hh>
 #include <click/hashtable.hh>
+#include <click/bitvector.hh>
+#include <click/straccum.hh>
 #include <click/flow/flowelement.hh>
 #include <algorithm>
 #include <set>
@@ -153,10 +155,37 @@ ElementDistanceCastTracker::visit(Element *e, bool, int, Element *, int, int dis
 
 bool cmp(el a, el b)
 {
-    return a.count > b.count || (a.count==b.count &&  a.distance < b.distance);
+    return a.count > b.count || (a.count==b.count && (a.distance < b.distance || (a.distance == b.distance && a.id < b.id)));
+}
+
+/**
+ * Return the first offset from @a place where @a size bytes aligned to
+ * @a align do not collide with the @a taken ranges, and do not straddle a
+ * cache line if they fit in one. The FCB data starts at @a line_offset in
+ * its first cache line.
+ */
+static int
+find_place(const Vector<Pair<int,int> > &taken, int place, int size, int align, int line_offset)
+{
+    const int line = CLICK_CACHE_LINE_SIZE;
+    if (align < 1)
+        align = 1;
+  again:
+    place = (line_offset + place + align - 1) / align * align - line_offset;
+    if (size <= line && (line_offset + place) / line != (line_offset + place + size - 1) / line) {
+        place = ((line_offset + place) / line + 1) * line - line_offset;
+        goto again;
+    }
+    for (int i = 0; i < taken.size(); i++)
+        if (place < taken[i].second && taken[i].first < place + size) {
+            place = taken[i].second;
+            goto again;
+        }
+    return place;
 }
 
 VirtualFlowManager::VirtualFlowManager()
+    : _reserve(0), _reserve_own(0), _fcb_line_offset(sizeof(FlowControlBlock) % CLICK_CACHE_LINE_SIZE)
 {
     _fcb_builded_init_future.add();
 }
@@ -182,7 +211,7 @@ void VirtualFlowManager::find_children(int verbose)
 
 void VirtualFlowManager::build_fcb()
 {
-    _build_fcb(1,true);
+    _build_fcb(1,false);
 }
 
 Vector<VirtualFlowManager*> VirtualFlowManager::_entries;
@@ -225,6 +254,11 @@ element_can_reach(Router* router, Element* a, Element* b) {
 
 /**
  * This function builds the layout of the FCB by going through the graph starting from each entry elements
+ *
+ * If ordered, each element is placed after the space of all elements that may precede it.
+ * Otherwise, each element is placed at the first offset that respects its alignment, is not used
+ * by an element on the same path, and does not make it straddle a cache line boundary. Space is
+ * then shared between parallel branches, and the flow data spans as few cache lines as possible.
  */
 void VirtualFlowManager::_build_fcb(int verbose, bool _ordered) {
     typedef Pair<int,int> CountDistancePair;
@@ -255,7 +289,7 @@ void VirtualFlowManager::_build_fcb(int verbose, bool _ordered) {
         elements.push_back(el{it->first,it->second.first, it->second.second});
     }
 
-    // Sorting the element, so we place the most shared first, then the minimal distance first. With the current version of the algo, this is not needed anymore
+    // Sorting the elements, so the hottest are placed first, at the lowest offsets: the most shared first, then the minimal distance first
     std::sort(elements.begin(), elements.end(),cmp);
 
     // We now place all elements
@@ -266,6 +300,7 @@ void VirtualFlowManager::_build_fcb(int verbose, bool _ordered) {
             click_chatter("Placing %p{element} : in %d sets, distance %d", e, it->count, it->distance);
         int my_place;
         int min_place = 0;
+        int line_offset = 0;
 
         //We need to verify the reserved space for all possible FlowManager
         for (int i = 0; i < _entries.size(); i++) {
@@ -273,8 +308,10 @@ void VirtualFlowManager::_build_fcb(int verbose, bool _ordered) {
             //If this flow manager can reach the element, then we need to have enough reserved space
             for (int j = 0; j < _entries[i]->_reachable_list.size(); j++) {
                 if (_entries[i]->_reachable_list[j].first->eindex() == it->id) {
-                    if (fc->_reserve > min_place)
+                    if (fc->_reserve >= min_place) {
                         min_place = fc->_reserve;
+                        line_offset = fc->_fcb_line_offset;
+                    }
 
                     break;
                 }
@@ -285,19 +322,14 @@ void VirtualFlowManager::_build_fcb(int verbose, bool _ordered) {
             my_place = min_place + it->distance;
         else
             my_place = min_place;
-        Bitvector v(false);
 
-        /**
-        * THe followoing is for verification purpose
-        */
-        // For each already placed element that are reachable from this one, we set the assigned bits in the vector
+        // The space of already placed elements that are reachable from this one
+        Vector<Pair<int,int> > taken;
         for (auto ai = already_placed.begin(); ai != already_placed.end(); ai++) {
             int aid = *ai;
             VirtualFlowSpaceElement* ae = dynamic_cast<VirtualFlowSpaceElement*>(router->element(aid));
             if (element_can_reach(router, e,ae)) {
-                if (v.size() < ae->flow_data_offset() + ae->flow_data_size())
-                    v.resize(ae->flow_data_offset() + ae->flow_data_size());
-                v.set_range(ae->flow_data_offset(), ae->flow_data_size(), true);
+                taken.push_back(Pair<int,int>(ae->flow_data_offset(), ae->flow_data_offset() + ae->flow_data_size()));
                 if (_ordered && !(ae->flow_data_offset() + ae->flow_data_size() <= my_place || ae->flow_data_offset() >= my_place + e->flow_data_size())) {
                     click_chatter("FATAL ERROR : Cannot place  %p{element} at [%d-%d] because it collides with %p{element}",e,my_place,my_place + e->flow_data_size() -1, ae);
                     assert(false);
@@ -305,9 +337,8 @@ void VirtualFlowManager::_build_fcb(int verbose, bool _ordered) {
             }
         }
 
-        while (!_ordered && v.range(my_place,e->flow_data_size())) {
-            my_place++;
-        }
+        if (!_ordered)
+            my_place = find_place(taken, my_place, e->flow_data_size(), e->flow_data_align(), line_offset);
 
         if (verbose > 0)
             click_chatter("Placing  %p{element} at [%d-%d]",e,my_place,my_place + e->flow_data_size() -1 );
@@ -319,7 +350,7 @@ void VirtualFlowManager::_build_fcb(int verbose, bool _ordered) {
     //Set pool data size for classifiers
     for (int i = 0; i < _entries.size(); i++) {
         VirtualFlowManager* fc = _entries[i];
-//        fc->_reserve = min_place;
+        fc->_reserve_own = fc->_reserve;
         for (int j = 0; j < fc->_reachable_list.size(); j++) {
             VirtualFlowSpaceElement* vfe = dynamic_cast<VirtualFlowSpaceElement*>(fc->_reachable_list[j].first);
             int tot = vfe->flow_data_offset() + vfe->flow_data_size();
@@ -329,5 +360,49 @@ void VirtualFlowManager::_build_fcb(int verbose, bool _ordered) {
     }
 }
 
+String
+VirtualFlowManager::fcb_layout() const
+{
+    const int line = CLICK_CACHE_LINE_SIZE;
+    Vector<Pair<int,VirtualFlowSpaceElement*> > placed;
+    for (int j = 0; j < _reachable_list.size(); j++) {
+        VirtualFlowSpaceElement* vfe = dynamic_cast<VirtualFlowSpaceElement*>(_reachable_list[j].first);
+        placed.push_back(Pair<int,VirtualFlowSpaceElement*>(vfe->flow_data_offset(), vfe));
+    }
+    std::sort(placed.begin(), placed.end(), [](const Pair<int,VirtualFlowSpaceElement*> &a, const Pair<int,VirtualFlowSpaceElement*> &b) {
+        return a.first < b.first || (a.first == b.first && a.second->eindex() < b.second->eindex());
+    });
+
+    StringAccum sa;
+    Bitvector used(_reserve, false);
+    int nlines = _reserve ? (_fcb_line_offset + _reserve - 1) / line + 1 : 0;
+    sa << "flow data: " << _reserve << " bytes, " << nlines << " cache lines\n";
+    if (_reserve_own > 0) {
+        sa << "0-" << _reserve_own - 1 << " " << name() << "\n";
+        used.set_range(0, _reserve_own, true);
+    }
+    for (int i = 0; i < placed.size(); i++) {
+        VirtualFlowSpaceElement* vfe = placed[i].second;
+        int size = vfe->flow_data_size();
+        sa << placed[i].first << "-" << placed[i].first + size - 1 << " " << vfe->name()
+           << " (" << size << " bytes, align " << vfe->flow_data_align() << ")\n";
+        used.set_range(placed[i].first, size, true);
+    }
+    for (int l = 0; l < nlines; l++) {
+        int n = 0;
+        for (int b = l * line - _fcb_line_offset; b < (l + 1) * line - _fcb_line_offset; b++)
+            if (b >= 0 && b < _reserve && used[b])
+                n++;
+        sa << "line " << l << ": " << n << "/" << line << " bytes\n";
+    }
+    return sa.take_string();
+}
+
+String
+VirtualFlowManager::read_fcb_layout(Element* e, void*)
+{
+    return static_cast<VirtualFlowManager*>(e)->fcb_layout();
+}
+
 #endif
 CLICK_ENDDECLS
@@ -17,37 +17,253 @@
 #endif
 
 #if !CLICK_LINUXMODULE
-uint16_t
-click_in_cksum(const unsigned char *addr, int len)
+# if CLICK_USERLEVEL && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && (__GNUC__ >= 5 || defined(__clang__))
+#  define CLICK_CKSUM_X86 1
+#  include <immintrin.h>
+# elif CLICK_USERLEVEL && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#  define CLICK_CKSUM_NEON 1
+#  include <arm_neon.h>
+# endif
+
+/*
+ * The kernels below return the plain sum of the data taken as 32-bit words
+ * (and a final 16-bit word and byte), in a 64-bit accumulator. Since
+ * 2^16 == 1 modulo 2^16 - 1, folding that sum gives the same one's
+ * complement sum as adding 16-bit words, in either byte order.
+ */
+
+/* Buffers shorter than this, like IP headers, use the scalar loop: the
+   vector setup would cost more than it saves. */
+#define CKSUM_VECTOR_MIN	64
+
+static inline uint64_t
+cksum_scalar(const unsigned char *addr, int len, uint64_t sum)
 {
-    int nleft = len;
-    const uint16_t *w = (const uint16_t *)addr;
-    uint32_t sum = 0;
-    uint16_t answer = 0;
-
-    /*
-     * Our algorithm is simple, using a 32 bit accumulator (sum), we add
-     * sequential 16 bit words to it, and at the end, fold back all the
-     * carry bits from the top 16 bits into the lower 16 bits.
-     */
-    while (nleft > 1)  {
-	sum += *w++;
-	nleft -= 2;
-    }
+    uint32_t w[8];
+    uint16_t h;
 
+    while (len >= 32) {
+	memcpy(w, addr, 32);
+	sum += (uint64_t) w[0] + w[1] + w[2] + w[3]
+	    + w[4] + w[5] + w[6] + w[7];
+	addr += 32;
+	len -= 32;
+    }
+    while (len >= 8) {
+	memcpy(w, addr, 8);
+	sum += (uint64_t) w[0] + w[1];
+	addr += 8;
+	len -= 8;
+    }
+    if (len >= 4) {
+	memcpy(w, addr, 4);
+	sum += w[0];
+	addr += 4;
+	len -= 4;
+    }
+    if (len >= 2) {
+	memcpy(&h, addr, 2);
+	sum += h;
+	addr += 2;
+	len -= 2;
+    }
     /* mop up an odd byte, if necessary */
-    if (nleft == 1) {
-	*(unsigned char *)(&answer) = *(const unsigned char *)w ;
-	sum += answer;
+    if (len == 1) {
+	h = 0;
+	*(unsigned char *) &h = *addr;
+	sum += h;
+    }
+    return sum;
+}
+
+static uint64_t
+cksum_generic(const unsigned char *addr, int len)
+{
+    return cksum_scalar(addr, len, 0);
+}
+
+# if CLICK_CKSUM_X86
+__attribute__((target("avx2"))) static uint64_t
+cksum_avx2(const unsigned char *addr, int len)
+{
+    const __m256i lo = _mm256_set1_epi64x(0xFFFFFFFF);
+    __m256i a0 = _mm256_setzero_si256(), a1 = _mm256_setzero_si256();
+    __m128i x;
+    uint64_t sum;
+
+    /* Each 64-bit lane takes the two 32-bit words of its half: no carries
+       are lost before 2^32 iterations. */
+    while (len >= 64) {
+	__m256i v0 = _mm256_loadu_si256((const __m256i *) addr);
+	__m256i v1 = _mm256_loadu_si256((const __m256i *) (addr + 32));
+	a0 = _mm256_add_epi64(a0, _mm256_and_si256(v0, lo));
+	a1 = _mm256_add_epi64(a1, _mm256_srli_epi64(v0, 32));
+	a0 = _mm256_add_epi64(a0, _mm256_and_si256(v1, lo));
+	a1 = _mm256_add_epi64(a1, _mm256_srli_epi64(v1, 32));
+	addr += 64;
+	len -= 64;
+    }
+    if (len >= 32) {
+	__m256i v0 = _mm256_loadu_si256((const __m256i *) addr);
+	a0 = _mm256_add_epi64(a0, _mm256_and_si256(v0, lo));
+	a1 = _mm256_add_epi64(a1, _mm256_srli_epi64(v0, 32));
+	addr += 32;
+	len -= 32;
+    }
+    a0 = _mm256_add_epi64(a0, a1);
+    x = _mm_add_epi64(_mm256_castsi256_si128(a0), _mm256_extracti128_si256(a0, 1));
+    sum = (uint64_t) _mm_cvtsi128_si64(x) + (uint64_t) _mm_extract_epi64(x, 1);
+    /* leave the AVX state clean for SSE code that follows */
+    _mm256_zeroupper();
+    return cksum_scalar(addr, len, sum);
+}
+
+__attribute__((target("avx512f"))) static uint64_t
+cksum_avx512(const unsigned char *addr, int len)
+{
+    const __m512i lo = _mm512_set1_epi64(0xFFFFFFFF);
+    __m512i a0 = _mm512_setzero_si512(), a1 = _mm512_setzero_si512();
+    uint64_t sum;
+
+    while (len >= 128) {
+	__m512i v0 = _mm512_loadu_si512((const void *) addr);
+	__m512i v1 = _mm512_loadu_si512((const void *) (addr + 64));
+	a0 = _mm512_add_epi64(a0, _mm512_and_si512(v0, lo));
+	a1 = _mm512_add_epi64(a1, _mm512_srli_epi64(v0, 32));
+	a0 = _mm512_add_epi64(a0, _mm512_and_si512(v1, lo));
+	a1 = _mm512_add_epi64(a1, _mm512_srli_epi64(v1, 32));
+	addr += 128;
+	len -= 128;
+    }
+    if (len >= 64) {
+	__m512i v0 = _mm512_loadu_si512((const void *) addr);
+	a0 = _mm512_add_epi64(a0, _mm512_and_si512(v0, lo));
+	a1 = _mm512_add_epi64(a1, _mm512_srli_epi64(v0, 32));
+	addr += 64;
+	len -= 64;
+    }
+    sum = _mm512_reduce_add_epi64(_mm512_add_epi64(a0, a1));
+    _mm256_zeroupper();
+    return cksum_scalar(addr, len, sum);
+}
+# endif
+
+# if CLICK_CKSUM_NEON
+static uint64_t
+cksum_neon(const unsigned char *addr, int len)
+{
+    uint64x2_t a0 = vdupq_n_u64(0), a1 = vdupq_n_u64(0);
+    uint64_t sum;
+
+    while (len >= 32) {
+	a0 = vpadalq_u32(a0, vreinterpretq_u32_u8(vld1q_u8(addr)));
+	a1 = vpadalq_u32(a1, vreinterpretq_u32_u8(vld1q_u8(addr + 16)));
+	addr += 32;
+	len -= 32;
     }
+    a0 = vaddq_u64(a0, a1);
+    sum = vgetq_lane_u64(a0, 0) + vgetq_lane_u64(a0, 1);
+    return cksum_scalar(addr, len, sum);
+}
+# endif
+
+typedef uint64_t (*cksum_kernel_t)(const unsigned char *, int);
+
+static const struct cksum_impl {
+    const char *name;
+    cksum_kernel_t kernel;
+} cksum_impls[] = {			/* in order of preference */
+# if CLICK_CKSUM_X86
+    { "avx2", cksum_avx2 },
+    { "avx512", cksum_avx512 },
+# endif
+# if CLICK_CKSUM_NEON
+    { "neon", cksum_neon },
+# endif
+    { "generic", cksum_generic }
+};
+
+static int
+cksum_impl_supported(const struct cksum_impl *impl)
+{
+# if CLICK_CKSUM_X86
+    __builtin_cpu_init();
+    if (impl->kernel == cksum_avx512)
+	return __builtin_cpu_supports("avx512f");
+    if (impl->kernel == cksum_avx2)
+	return __builtin_cpu_supports("avx2");
+# endif
+    (void) impl;
+    return 1;
+}
+
+static uint64_t cksum_resolve(const unsigned char *addr, int len);
+static cksum_kernel_t cksum_kernel = cksum_resolve;
+static const char *cksum_kernel_name;
+
+/* Pick the kernel on first use; every thread that races here picks the
+   same one. AVX-512 comes after AVX2, so it is only used on request: it is
+   no faster on a sum that is bound by loads, and may lower the clock of the
+   whole core. */
+static uint64_t
+cksum_resolve(const unsigned char *addr, int len)
+{
+    const struct cksum_impl *impl = &cksum_impls[0];
+    while (!cksum_impl_supported(impl))
+	++impl;
+    cksum_kernel_name = impl->name;
+    cksum_kernel = impl->kernel;
+    return impl->kernel(addr, len);
+}
+
+/** @brief Return the name of the checksum kernel in use.
+ *
+ * One of "avx512", "avx2", "neon" or "generic". */
+const char *
+click_in_cksum_impl(void)
+{
+    if (cksum_kernel == cksum_resolve)
+	cksum_resolve((const unsigned char *) "", 0);
+    return cksum_kernel_name;
+}
+
+/** @brief Select the checksum kernel by name.
+ * @return 0 on success, -1 if the kernel is unknown or the CPU lacks it
+ *
+ * For tests and benchmarks; the default is the fastest available. */
+int
+click_in_cksum_set_impl(const char *name)
+{
+    unsigned i;
+    for (i = 0; i < sizeof(cksum_impls) / sizeof(cksum_impls[0]); ++i)
+	if (strcmp(cksum_impls[i].name, name) == 0) {
+	    if (!cksum_impl_supported(&cksum_impls[i]))
+		return -1;
+	    cksum_kernel_name = cksum_impls[i].name;
+	    cksum_kernel = cksum_impls[i].kernel;
+	    return 0;
+	}
+    return -1;
+}
+
+uint16_t
+click_in_cksum(const unsigned char *addr, int len)
+{
+    uint64_t sum;
+    if (len >= CKSUM_VECTOR_MIN)
+	sum = cksum_kernel(addr, len);
+    else
+	sum = cksum_scalar(addr, len, 0);
 
-    /* add back carry outs from top 16 bits to low 16 bits */
-    sum = (sum & 0xffff) + (sum >> 16);
-    sum += (sum >> 16);
+    /* add back carry outs from the top bits to the low 16 bits */
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
     /* guaranteed now that the lower 16 bits of sum are correct */
 
-    answer = ~sum;              /* truncate to 16 bits */
-    return answer;
+    return ~sum & 0xFFFF;
 }
 
 uint16_t
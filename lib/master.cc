@@ -144,6 +144,13 @@ Master::unblock_all()
         _threads[i]->unblock_tasks();
 }
 
+void
+Master::set_timer_wheel(bool wheel)
+{
+    for (int i = 0; i < _nthreads; ++i)
+        _threads[i]->timer_set().set_wheel(wheel);
+}
+
 
 // ROUTERS
 
@@ -27,9 +27,13 @@
 #include <click/ring.hh>
 #include <click/vector.hh>
 #include <click/netmapdevice.hh>
+#include <click/straccum.hh>
 #if CLICK_USERLEVEL || CLICK_MINIOS
 # include <unistd.h>
 #endif
+#if HAVE_NUMA && HAVE_MULTITHREAD
+# include <click/numa.hh>
+#endif
 #if HAVE_DPDK
 # include <rte_malloc.h>
 # include <click/dpdkdevice.hh>
@@ -254,6 +258,12 @@ Packet::~Packet()
 // pre-initialized Packet objects, either with or without data, for fast
 // reuse. It can support multithreaded deployments: each thread has its own
 // pool, with a global pool to even out imbalance.
+//
+// On NUMA machines there is one global pool per socket. A packet remembers
+// the socket of the thread that allocated it (its home); a thread refills
+// only from the pool of its own socket, and packets it frees that belong to
+// another socket are gathered and given back to their home pool in batches.
+// Buffers are thus only reused on the socket whose memory they live on.
 
 #if HAVE_DPDK_PACKET_POOL
 #  define CLICK_PACKET_POOL_BUFSIZ		DPDKDevice::MBUF_DATA_SIZE
@@ -269,6 +279,8 @@ Packet::~Packet()
 #else 
 #  define CLICK_GLOBAL_PACKET_DATA_POOL_COUNT	32
 #endif
+#  define CLICK_PACKET_POOL_SOCKETS		8
+#  define CLICK_PACKET_POOL_REMOTE_BATCH	1024
 
 
 #  if HAVE_MULTITHREAD
@@ -277,16 +289,107 @@ static __thread PacketPool *thread_packet_pool;
 typedef MPMCRing<WritablePacket*,CLICK_GLOBAL_PACKET_POOL_COUNT> BatchPRing;
 typedef MPMCRing<WritablePacket*,CLICK_GLOBAL_PACKET_DATA_POOL_COUNT> BatchPDRing;
 
-struct GlobalPacketPool {
+struct SocketPacketPool {
     BatchPRing pbatch;     // batches of free packets, linked by p->prev()
                                 //   p->anno_u32(0) is # packets in batch
     BatchPDRing pdbatch;        // batches of packet with data buffers
+};
+
+struct GlobalPacketPool {
+    SocketPacketPool sockets[CLICK_PACKET_POOL_SOCKETS];
+    unsigned nsockets;          // # sockets in use, set with the first pool
 
     PacketPool* thread_pools;   // all thread packet pools
 
     volatile uint32_t lock;
 };
 static GlobalPacketPool global_packet_pool;
+
+// Packets freed by a thread whose home is another socket
+struct PacketPoolRemote {
+    WritablePacket* p;          // free packets, linked by p->next()
+    unsigned pcount;
+    WritablePacket* pd;         // free data buffers, linked by pd->next()
+    unsigned pdcount;
+    uint64_t packets;           // # packets given back to the socket
+    uint64_t batches;           // # batches given back
+    uint64_t dropped;           // # batches freed because its pool was full
+};
+
+static inline void
+lock_global_packet_pool()
+{
+    while (atomic_uint32_t::swap(global_packet_pool.lock, 1) == 1)
+        /* do nothing */;
+}
+
+static inline void
+unlock_global_packet_pool()
+{
+    click_compiler_fence();
+    global_packet_pool.lock = 0;
+}
+
+static unsigned
+packet_pool_count_sockets()
+{
+#   if HAVE_NUMA
+    if (Numa::available()) {
+        int n = Numa::get_max_numas();
+        if (n > CLICK_PACKET_POOL_SOCKETS)
+            n = CLICK_PACKET_POOL_SOCKETS;
+        if (n > 1)
+            return n;
+    }
+#   endif
+    return 1;
+}
+
+/** @brief Return the socket of the calling thread, as a global pool index. */
+static unsigned
+packet_pool_socket()
+{
+#   if HAVE_NUMA
+    if (global_packet_pool.nsockets > 1) {
+        int node = Numa::get_current_node();
+        if (node > 0)
+            return node % global_packet_pool.nsockets;
+    }
+#   endif
+    return 0;
+}
+
+static void
+pool_free_packets(WritablePacket *p)
+{
+    while (p) {
+        WritablePacket *next = static_cast<WritablePacket *>(p->next());
+        ::operator delete((void *) p);
+        p = next;
+    }
+}
+
+static void
+pool_free_data_packets(WritablePacket *pd)
+{
+    while (pd) {
+        WritablePacket *next = static_cast<WritablePacket *>(pd->next());
+#if HAVE_DPDK_PACKET_POOL
+        rte_pktmbuf_free((struct rte_mbuf*)pd->destructor_argument());
+#else
+# if HAVE_NETMAP_PACKET_POOL
+        if (NetmapBufQ::is_valid_netmap_packet(pd))
+            NetmapBufQ::local_pool()->insert_p(pd->buffer());
+        else
+# endif
+        {
+            ::operator delete[]((unsigned char *) pd->buffer());
+        }
+#endif
+        ::operator delete((void *) pd);
+        pd = next;
+    }
+}
 #else
 static PacketPool global_packet_pool = {0,0,0,0};
 #  endif
@@ -308,13 +411,18 @@ PacketPool* WritablePacket::make_local_packet_pool() {
     PacketPool *pp = thread_packet_pool;
     if (unlikely(!pp && (pp = new PacketPool))) {
 	memset(pp, 0, sizeof(PacketPool));
-	while (atomic_uint32_t::swap(global_packet_pool.lock, 1) == 1)
-	    /* do nothing */;
+	lock_global_packet_pool();
+	if (!global_packet_pool.nsockets)
+	    global_packet_pool.nsockets = packet_pool_count_sockets();
+	if (global_packet_pool.nsockets > 1) {
+	    pp->remote = new PacketPoolRemote[global_packet_pool.nsockets];
+	    memset(pp->remote, 0, sizeof(PacketPoolRemote) * global_packet_pool.nsockets);
+	    pp->socket = packet_pool_socket();
+	}
 	pp->thread_pool_next = global_packet_pool.thread_pools;
 	global_packet_pool.thread_pools = pp;
 	thread_packet_pool = pp;
-	click_compiler_fence();
-	global_packet_pool.lock = 0;
+	unlock_global_packet_pool();
     }
     return pp;
 #  else
@@ -322,6 +430,59 @@ PacketPool* WritablePacket::make_local_packet_pool() {
 #  endif
 }
 
+/** @brief Look up the socket of the calling thread again.
+ *
+ * Call after pinning a thread that may already have allocated packets.
+ * Packets already in the thread's pool keep their home and are given back
+ * to it when freed. */
+void
+WritablePacket::pool_rehome()
+{
+#  if HAVE_MULTITHREAD
+    if (PacketPool *pp = thread_packet_pool)
+        pp->socket = packet_pool_socket();
+#  endif
+}
+
+/** @brief Return a report of the packet pools for the packet_pools handler.
+ *
+ * The first line is "sockets N". Then, for each socket, "socket S threads
+ * T" gives the number of thread pools on socket S, and for each pair of
+ * sockets, "S -> D packets P batches B dropped X" counts the packets that
+ * threads of S freed and gave back to D. */
+String
+WritablePacket::pool_report()
+{
+    StringAccum sa;
+#  if HAVE_MULTITHREAD
+    lock_global_packet_pool();
+    unsigned n = global_packet_pool.nsockets ? global_packet_pool.nsockets : 1;
+    Vector<unsigned> threads(n, 0);
+    Vector<uint64_t> packets(n * n, 0), batches(n * n, 0), dropped(n * n, 0);
+    for (PacketPool *pp = global_packet_pool.thread_pools; pp; pp = pp->thread_pool_next) {
+        ++threads[pp->socket];
+        for (unsigned d = 0; pp->remote && d < n; ++d) {
+            packets[pp->socket * n + d] += pp->remote[d].packets;
+            batches[pp->socket * n + d] += pp->remote[d].batches;
+            dropped[pp->socket * n + d] += pp->remote[d].dropped;
+        }
+    }
+    unlock_global_packet_pool();
+    sa << "sockets " << n << '\n';
+    for (unsigned s = 0; s < n; ++s)
+        sa << "socket " << s << " threads " << threads[s] << '\n';
+    for (unsigned s = 0; s < n; ++s)
+        for (unsigned d = 0; d < n; ++d)
+            if (s != d)
+                sa << s << " -> " << d << " packets " << packets[s * n + d]
+                   << " batches " << batches[s * n + d]
+                   << " dropped " << dropped[s * n + d] << '\n';
+#  else
+    sa << "sockets 1\nsocket 0 threads 1\n";
+#  endif
+    return sa.take_string();
+}
+
 /**
  * Allocate a batch of packets without buffer
  * The returned list is a simple linked list, not a standard PacketBatch
@@ -364,7 +525,7 @@ WritablePacket::pool_allocate()
 
 #  if HAVE_MULTITHREAD
     if (!packet_pool.p) {
-        WritablePacket *pp = global_packet_pool.pbatch.extract();
+        WritablePacket *pp = global_packet_pool.sockets[packet_pool.socket].pbatch.extract();
         if (pp) {
             packet_pool.p = pp;
             packet_pool.pcount = pp->anno_u32(0);
@@ -379,6 +540,9 @@ WritablePacket::pool_allocate()
         --packet_pool.pcount;
         } else {
         p = new WritablePacket;
+#  if HAVE_MULTITHREAD
+        p->_home = packet_pool.socket;
+#  endif
         }
         return p;
 
@@ -394,7 +558,7 @@ WritablePacket::pool_data_allocate()
 
 #  if HAVE_MULTITHREAD
     if (unlikely(!packet_pool.pd)) {
-        WritablePacket *pd = global_packet_pool.pdbatch.extract();
+        WritablePacket *pd = global_packet_pool.sockets[packet_pool.socket].pdbatch.extract();
         if (pd) {
             packet_pool.pd = pd;
             packet_pool.pdcount = pd->anno_u32(0);
@@ -450,12 +614,8 @@ WritablePacket::check_packet_pool_size(PacketPool &packet_pool) {
 #  if HAVE_MULTITHREAD
     if (unlikely(packet_pool.p && packet_pool.pcount >= CLICK_PACKET_POOL_SIZE)) {
         packet_pool.p->set_anno_u32(0, packet_pool.pcount);
-        if (!global_packet_pool.pbatch.insert(packet_pool.p)) { //Si le nombre de batch est au max -> delete
-            while (WritablePacket *p = packet_pool.p) { //On supprime le batch
-                packet_pool.p = static_cast<WritablePacket *>(p->next());
-                ::operator delete((void *) p);
-            }
-        }
+        if (!global_packet_pool.sockets[packet_pool.socket].pbatch.insert(packet_pool.p))
+            pool_free_packets(packet_pool.p);
         packet_pool.p = 0;
         packet_pool.pcount = 0;
     }
@@ -474,24 +634,8 @@ WritablePacket::check_data_pool_size(PacketPool &packet_pool) {
 #  if HAVE_MULTITHREAD
     if (unlikely(packet_pool.pd && packet_pool.pdcount >= CLICK_PACKET_DATA_POOL_SIZE)) {
         packet_pool.pd->set_anno_u32(0, packet_pool.pdcount);
-        if (!global_packet_pool.pdbatch.insert(packet_pool.pd)) {
-            while (WritablePacket *pd = packet_pool.pd) {
-                packet_pool.pd = static_cast<WritablePacket *>(pd->next());
-#if HAVE_DPDK_PACKET_POOL
-                rte_pktmbuf_free((struct rte_mbuf*)pd->destructor_argument());
-#else
-# if HAVE_NETMAP_PACKET_POOL
-                if (NetmapBufQ::is_valid_netmap_packet(pd))
-                    NetmapBufQ::local_pool()->insert_p(pd->buffer());
-                else
-# endif
-                {
-                    ::operator delete[]((unsigned char *) pd->buffer());
-                }
-#endif
-                ::operator delete((void *) pd);
-            }
-        }
+        if (!global_packet_pool.sockets[packet_pool.socket].pdbatch.insert(packet_pool.pd))
+            pool_free_data_packets(packet_pool.pd);
         packet_pool.pd = 0;
         packet_pool.pdcount = 0;
     }
@@ -536,6 +680,15 @@ WritablePacket::recycle(WritablePacket *p)
     PacketPool& packet_pool = *make_local_packet_pool();
     bool data = is_from_data_pool(p);
 
+#  if HAVE_MULTITHREAD
+    if (unlikely(p->_home != packet_pool.socket)) {
+        if (!data)
+            p->~WritablePacket();
+        recycle_remote(packet_pool, p, data);
+        return;
+    }
+#  endif
+
     if (likely(data)) {
         check_data_pool_size(packet_pool);
         ++packet_pool.pdcount;
@@ -571,6 +724,11 @@ WritablePacket::recycle_packet_batch(WritablePacket *head, Packet* tail, unsigne
     for (;p != 0;p=next,next=(p==0?0:p->next())) {
         ((WritablePacket*)p)->~WritablePacket();
     }
+#  if HAVE_MULTITHREAD
+    if (packet_pool.remote
+        && !(head = recycle_remote_batch(packet_pool, head, tail, count, false)))
+        return;
+#  endif
     check_packet_pool_size(packet_pool);
     packet_pool.pcount += count;
     tail->set_next(packet_pool.p);
@@ -584,12 +742,91 @@ void
 WritablePacket::recycle_data_batch(WritablePacket *head, Packet* tail, unsigned count)
 {
     PacketPool& packet_pool = *make_local_packet_pool();
+#  if HAVE_MULTITHREAD
+    if (packet_pool.remote
+        && !(head = recycle_remote_batch(packet_pool, head, tail, count, true)))
+        return;
+#  endif
     check_data_pool_size(packet_pool);
     packet_pool.pdcount += count;
     tail->set_next(packet_pool.pd);
     packet_pool.pd = head;
 }
 
+#  if HAVE_MULTITHREAD
+/**
+ * Give a packet back to the pool of its home socket. Packets are gathered
+ * per socket and handed over CLICK_PACKET_POOL_REMOTE_BATCH at a time, so
+ * the other socket's global pool is touched once per batch.
+ *
+ * @Precond : the packet was destroyed, unless it is from the data pool
+ */
+void
+WritablePacket::recycle_remote(PacketPool &packet_pool, WritablePacket *p, bool data)
+{
+    PacketPoolRemote &r = packet_pool.remote[p->_home];
+    SocketPacketPool &home = global_packet_pool.sockets[p->_home];
+    ++r.packets;
+    if (data) {
+        p->set_next(r.pd);
+        r.pd = p;
+        if (++r.pdcount < CLICK_PACKET_POOL_REMOTE_BATCH)
+            return;
+        r.pd->set_anno_u32(0, r.pdcount);
+        if (!home.pdbatch.insert(r.pd)) {
+            pool_free_data_packets(r.pd);
+            ++r.dropped;
+        }
+        r.pd = 0;
+        r.pdcount = 0;
+    } else {
+        p->set_next(r.p);
+        r.p = p;
+        if (++r.pcount < CLICK_PACKET_POOL_REMOTE_BATCH)
+            return;
+        r.p->set_anno_u32(0, r.pcount);
+        if (!home.pbatch.insert(r.p)) {
+            pool_free_packets(r.p);
+            ++r.dropped;
+        }
+        r.p = 0;
+        r.pcount = 0;
+    }
+    ++r.batches;
+}
+
+/**
+ * Remove the packets of other sockets from a list of @a count packets,
+ * giving them back to their home. Returns the remaining list, with @a tail
+ * and @a count updated, or null if no packet is local.
+ */
+WritablePacket *
+WritablePacket::recycle_remote_batch(PacketPool &packet_pool, WritablePacket *head,
+                                     Packet *&tail, unsigned &count, bool data)
+{
+    WritablePacket *local = 0, *last = 0;
+    WritablePacket *p = head;
+    for (unsigned n = count; n; --n) {
+        WritablePacket *next = static_cast<WritablePacket *>(p->next());
+        if (likely(p->_home == packet_pool.socket)) {
+            if (last)
+                last->set_next(p);
+            else
+                local = p;
+            last = p;
+        } else {
+            recycle_remote(packet_pool, p, data);
+            --count;
+        }
+        p = next;
+    }
+    if (last)
+        last->set_next(0);
+    tail = last;
+    return local;
+}
+#  endif
+
 # endif /* HAVE_CLICK_PACKET_POOL */
 
 inline bool
@@ -921,7 +1158,13 @@ Packet::clone(bool fast)
         Packet* origin = this;
         if (origin->_data_packet)
             origin = origin->_data_packet;
+# if HAVE_CLICK_PACKET_POOL && HAVE_MULTITHREAD
+        uint32_t home = p->_home;
         memcpy(p, this, sizeof(Packet));
+        p->_home = home;
+# else
+        memcpy(p, this, sizeof(Packet));
+# endif
         p->_use_count = 1;
         p->_data_packet = origin;
 	# if CLICK_USERLEVEL || CLICK_MINIOS
@@ -1014,7 +1257,13 @@ Packet::expensive_uniqueify(int32_t extra_headroom, int32_t extra_tailroom,
     void* arg = p->_destructor_argument;
 #endif
     if (_use_count > 1) {
+# if HAVE_CLICK_PACKET_POOL && HAVE_MULTITHREAD
+        uint32_t home = p->_home;
+        memcpy(p, this, sizeof(Packet));
+        p->_home = home;
+# else
         memcpy(p, this, sizeof(Packet));
+# endif
 
         # if CLICK_USERLEVEL || CLICK_MINIOS
             p->_destructor = 0;
@@ -1311,13 +1560,19 @@ Packet::static_cleanup()
 		while (PacketPool* pp = global_packet_pool.thread_pools) {
 		global_packet_pool.thread_pools = pp->thread_pool_next;
 		cleanup_pool(pp, 0);
+		for (unsigned s = 0; pp->remote && s < global_packet_pool.nsockets; ++s) {
+			pool_free_packets(pp->remote[s].p);
+			pool_free_data_packets(pp->remote[s].pd);
+		}
+		delete[] pp->remote;
 		delete pp;
 		}
 
 		PacketPool fake_pool;
+		for (int s = 0; s < CLICK_PACKET_POOL_SOCKETS; ++s)
 		do {
-			fake_pool.p = global_packet_pool.pbatch.extract();
-			fake_pool.pd = global_packet_pool.pdbatch.extract();
+			fake_pool.p = global_packet_pool.sockets[s].pbatch.extract();
+			fake_pool.pd = global_packet_pool.sockets[s].pdbatch.extract();
 			if (!fake_pool.p && !fake_pool.pd) break;
 			cleanup_pool(&fake_pool, 1);
 		} while(true);
@@ -90,7 +90,8 @@ Router::Router(const String &configuration, Master *master)
       _configuration(configuration),
       _notifier_signals(0),
       _arena_factory(new HashMap_ArenaFactory),
-      _hotswap_router(0), _thread_sched(0), _name_info(0), _next_router(0)
+      _hotswap_router(0), _thread_sched(0), _name_info(0), _profile(0),
+      _next_router(0)
 {
     _refcount = 0;
     _runcount = 0;
@@ -113,6 +114,9 @@ Router::~Router()
     if (_hotswap_router)
         _hotswap_router->unuse();
 
+    // Stop profiling before the elements go away
+    delete _profile;
+
     // Delete the ArenaFactory, which detaches the Arenas
     delete _arena_factory;
 
@@ -1458,6 +1462,10 @@ Router::initialize(ErrorHandler *errh)
         }
 
         _state = ROUTER_LIVE;
+#if CLICK_STATS >= 2
+        // Push and pull statistics come from the profile
+        force_profile()->set_enabled(true);
+#endif
 #ifdef CLICK_NAMEDB_CHECK
         NameInfo::check(_root_element, errh);
 #endif
@@ -2206,6 +2214,18 @@ Router::force_name_info()
 }
 /** @endcond never */
 
+/** @brief Return the router's element profile, creating it if necessary.
+ *
+ * The profile is created disabled. Returns null if the router is not
+ * initialized. */
+ElementProfile*
+Router::force_profile()
+{
+    if (!_profile && _state == ROUTER_LIVE)
+        _profile = new ElementProfile(this);
+    return _profile;
+}
+
 
 // PRINTING
 
@@ -2435,12 +2455,15 @@ Router::configuration_string() const
 enum { GH_VERSION, GH_CONFIG, GH_FLATCONFIG, GH_LIST, GH_LOAD, GH_LOAD_CYCLES, GH_USEFUL_CYCLES, GH_REQUIREMENTS,
        GH_DRIVER, GH_ACTIVE_PORTS, GH_ACTIVE_PORT_STATS, GH_STRING_PROFILE,
        GH_STRING_PROFILE_LONG, GH_SCHEDULING_PROFILE, GH_STOP,
-       GH_ELEMENT_CYCLES, GH_CLASS_CYCLES, GH_RESET_CYCLES };
+       GH_ELEMENT_CYCLES, GH_CLASS_CYCLES, GH_RESET_CYCLES,
+       GH_PROFILING, GH_PROFILE_SAMPLE, GH_PROFILE_JSON, GH_PROFILE_FOLDED,
+       GH_RESET_PROFILE, GH_PACKET_POOLS };
 
 #if CLICK_STATS >= 2
 struct stats_info {
     click_cycles_t task_own_cycles, timer_own_cycles, xfer_own_cycles;
-    uint32_t task_calls, timer_calls, xfer_calls, nelements;
+    uint64_t task_calls, timer_calls, xfer_calls;
+    uint32_t nelements;
 };
 #endif
 
@@ -2581,13 +2604,17 @@ Router::router_read_handler(Element *e, void *thunk)
 #endif
 
 #if CLICK_STATS >= 2
-    case GH_ELEMENT_CYCLES:
+    case GH_ELEMENT_CYCLES: {
         if (!r)
             break;
+        ElementProfile *prof = r->profile();
         sa << "name,class,task_calls,task_cycles,cycles_per_task,timer_calls,timer_cycles,cycles_per_timer,xfer_calls,xfer_cycles,cycles_per_xfer,any_cycles,cycles_per_any\n";
         for (int ei = 0; ei < r->nelements(); ++ei) {
             Element *e = r->element(ei);
-            if (!(e->_task_own_cycles || e->_timer_own_cycles || e->_xfer_own_cycles))
+            ElementProfile::Counters xfer;
+            if (prof)
+                xfer = prof->element_counters(e);
+            if (!(e->_task_own_cycles || e->_timer_own_cycles || xfer.cycles))
                 continue;
             sa << r->_element_names[ei] << ','
                << e->class_name() << ','
@@ -2597,24 +2624,29 @@ Router::router_read_handler(Element *e, void *thunk)
                << e->_timer_calls << ','
                << e->_timer_own_cycles << ','
                << int_divide(e->_timer_own_cycles, e->_timer_calls ? e->_timer_calls : 1) << ','
-               << e->_xfer_calls << ','
-               << e->_xfer_own_cycles << ','
-               << int_divide(e->_xfer_own_cycles, e->_xfer_calls ? e->_xfer_calls : 1) << ',';
-            click_cycles_t any_cycles = e->_task_own_cycles + e->_timer_own_cycles + e->_xfer_own_cycles;
-            uint32_t any_calls = e->_task_calls + e->_timer_calls + e->_xfer_calls;
+               << xfer.sampled << ','
+               << xfer.cycles << ','
+               << int_divide(xfer.cycles, xfer.sampled ? xfer.sampled : 1) << ',';
+            click_cycles_t any_cycles = e->_task_own_cycles + e->_timer_own_cycles + xfer.cycles;
+            uint64_t any_calls = e->_task_calls + e->_timer_calls + xfer.sampled;
             sa << any_cycles << ','
                << int_divide(any_cycles, any_calls ? any_calls : 1) << '\n';
         }
         break;
+    }
 
     case GH_CLASS_CYCLES: {
         if (!r)
             break;
+        ElementProfile *prof = r->profile();
         HashTable<String, int> class_map(-1);
+        Vector<ElementProfile::Counters> xfer(r->nelements(), ElementProfile::Counters());
         int nclasses = 0;
         for (int ei = 0; ei < r->nelements(); ++ei) {
             Element *e = r->element(ei);
-            if (!(e->_task_own_cycles || e->_timer_own_cycles || e->_xfer_own_cycles))
+            if (prof)
+                xfer[ei] = prof->element_counters(e);
+            if (!(e->_task_own_cycles || e->_timer_own_cycles || xfer[ei].cycles))
                 continue;
             int &x = class_map[e->class_name()];
             if (x < 0)
@@ -2626,15 +2658,15 @@ Router::router_read_handler(Element *e, void *thunk)
         for (int ei = 0; ei < r->nelements(); ++ei) {
             Element *e = r->element(ei);
             int x = class_map.get(e->class_name());
-            if (!(e->_task_own_cycles || e->_timer_own_cycles || e->_xfer_own_cycles) || x < 0)
+            if (!(e->_task_own_cycles || e->_timer_own_cycles || xfer[ei].cycles) || x < 0)
                 continue;
             stats_info &sii = si[x];
             sii.task_own_cycles += e->_task_own_cycles;
             sii.task_calls += e->_task_calls;
             sii.timer_own_cycles += e->_timer_own_cycles;
             sii.timer_calls += e->_timer_calls;
-            sii.xfer_own_cycles += e->_xfer_own_cycles;
-            sii.xfer_calls += e->_xfer_calls;
+            sii.xfer_own_cycles += xfer[ei].cycles;
+            sii.xfer_calls += xfer[ei].sampled;
             sii.nelements += 1;
         }
 
@@ -2654,7 +2686,7 @@ Router::router_read_handler(Element *e, void *thunk)
                << sii.xfer_own_cycles << ','
                << int_divide(sii.xfer_own_cycles, sii.xfer_calls ? sii.xfer_calls : 1) << ',';
             click_cycles_t any_cycles = sii.task_own_cycles + sii.timer_own_cycles + sii.xfer_own_cycles;
-            uint32_t any_calls = sii.task_calls + sii.timer_calls + sii.xfer_calls;
+            uint64_t any_calls = sii.task_calls + sii.timer_calls + sii.xfer_calls;
             sa << any_cycles << ','
                << int_divide(any_cycles, any_calls ? any_calls : 1) << '\n';
         }
@@ -2664,6 +2696,29 @@ Router::router_read_handler(Element *e, void *thunk)
     }
 #endif
 
+    case GH_PROFILING:
+        return String(r && r->profile() && r->profile()->enabled());
+
+    case GH_PROFILE_SAMPLE:
+        if (r && r->profile())
+            return String(r->profile()->sample_period());
+        return String(1);
+
+    case GH_PROFILE_JSON:
+        if (r && r->profile())
+            r->profile()->unparse_json(sa);
+        break;
+
+    case GH_PROFILE_FOLDED:
+        if (r && r->profile())
+            r->profile()->unparse_folded(sa);
+        break;
+
+#if HAVE_CLICK_PACKET_POOL
+    case GH_PACKET_POOLS:
+        return WritablePacket::pool_report();
+#endif
+
     }
     return sa.take_string();
 }
@@ -2688,8 +2743,32 @@ Router::router_write_handler(const String &s, Element *e, void *thunk, ErrorHand
     case GH_RESET_CYCLES:
         for (int i = 0; i < (r ? r->nelements() : 0); i++)
             r->_elements[i]->reset_cycles();
+        if (r->profile())
+            r->profile()->reset();
         break;
 #endif
+    case GH_PROFILING:
+    case GH_PROFILE_SAMPLE: {
+        ElementProfile *prof = r->force_profile();
+        if (!prof)
+            return errh->error("router not initialized");
+        if ((uintptr_t) thunk == GH_PROFILING) {
+            bool enabled;
+            if (!BoolArg().parse(cp_uncomment(s), enabled))
+                return errh->error("syntax error");
+            prof->set_enabled(enabled);
+        } else {
+            unsigned period;
+            if (!IntArg().parse(cp_uncomment(s), period))
+                return errh->error("syntax error");
+            prof->set_sample_period(period);
+        }
+        break;
+    }
+    case GH_RESET_PROFILE:
+        if (r->profile())
+            r->profile()->reset();
+        break;
     default:
         break;
     }
@@ -2731,6 +2810,16 @@ Router::static_initialize()
         add_read_handler(0, "element_cycles.csv", router_read_handler, (void *)GH_ELEMENT_CYCLES);
         add_read_handler(0, "class_cycles.csv", router_read_handler, (void *)GH_CLASS_CYCLES);
         add_write_handler(0, "reset_cycles", router_write_handler, (void *)GH_RESET_CYCLES);
+#endif
+        add_read_handler(0, "profiling", router_read_handler, (void *)GH_PROFILING);
+        add_write_handler(0, "profiling", router_write_handler, (void *)GH_PROFILING, Handler::f_checkbox);
+        add_read_handler(0, "profile_sample", router_read_handler, (void *)GH_PROFILE_SAMPLE);
+        add_write_handler(0, "profile_sample", router_write_handler, (void *)GH_PROFILE_SAMPLE);
+        add_read_handler(0, "profile.json", router_read_handler, (void *)GH_PROFILE_JSON, Handler::f_expensive);
+        add_read_handler(0, "profile.folded", router_read_handler, (void *)GH_PROFILE_FOLDED, Handler::f_expensive);
+        add_write_handler(0, "reset_profile", router_write_handler, (void *)GH_RESET_PROFILE, Handler::f_button);
+#if HAVE_CLICK_PACKET_POOL
+        add_read_handler(0, "packet_pools", router_read_handler, (void *)GH_PACKET_POOLS);
 #endif
     }
 }
@@ -163,7 +163,13 @@ CLICK_DECLS
 
  The Click core stores timers in a heap, so most timer operations (including
  scheduling and unscheduling) take @e O(log @e n) time and Click can handle
- very large numbers of timers.
+ very large numbers of timers. With many long timers, such as per-flow
+ timeouts, a thread's TimerSet can instead keep the timers that expire after
+ the current millisecond in a hierarchical timing wheel (see
+ Master::set_timer_wheel() and the @c --timer-wheel option of click(1)).
+ Scheduling and unscheduling them then take constant time; each wheel slot
+ moves to the heap when its millisecond arrives, so timers still run in
+ expiration order.
 
  Timers generally run in increasing order by expiration time.  That is, if
  timer @a a's expiry() is less than timer @a b's expiry(), then @a a will
@@ -281,6 +287,12 @@ Timer::schedule_at_steady(const Timestamp &when)
     _expiry_s = when ? when : Timestamp::epsilon();
     ts.check_timer_expiry(this);
 
+    // timers expiring after the current millisecond go to the wheel, if any
+    if (unlikely(ts.wheel()) && ts.wheel_schedule(this)) {
+	ts.unlock_timers();
+	return;
+    }
+
     // manipulate list; this is essentially a "decrease-key" operation
     // any reschedule removes a timer from the runchunk (XXX -- even backwards
     // reschedulings)
@@ -327,6 +339,10 @@ Timer::unschedule()
 	ts._timer_heap.pop_back();
 	if (old_schedpos1 == 1)
 	    ts.set_timer_expiry();
+    } else if (_schedpos1 == TimerSet::schedpos_wheel) {
+	ts.wheel_remove(this);
+	if (ts._timer_heap.empty())
+	    ts.set_timer_expiry();
     } else if (_schedpos1 < 0)
 	ts._timer_runchunk[-_schedpos1 - 1] = 0;
     _schedpos1 = 0;
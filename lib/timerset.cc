@@ -48,6 +48,10 @@ TimerSet::TimerSet()
 #endif
     _timer_check = Timestamp::now_steady();
     _timer_check_reports = 0;
+
+    _wheel_tick = 0;
+    _wheel_count = 0;
+    memset(_wheel_occupied, 0, sizeof(_wheel_occupied));
 }
 
 void
@@ -66,6 +70,14 @@ TimerSet::kill_router(Router *router)
 	    t->_schedpos1 = 0;
 	}
     }
+    for (int i = 0; i < _wheel.size(); ++i)
+	for (Timer *t = _wheel[i], *next; t; t = next) {
+	    next = t->_wheel_next;
+	    if (t->router() == router) {
+		wheel_remove(t);
+		t->_owner = 0;
+	    }
+	}
     set_timer_expiry();
     unlock_timers();
 }
@@ -78,6 +90,227 @@ TimerSet::set_max_timer_stride(unsigned timer_stride)
 	_timer_stride = _max_timer_stride;
 }
 
+inline void
+TimerSet::heap_insert(Timer *t)
+{
+    t->_schedpos1 = _timer_heap.size() + 1;
+    _timer_heap.push_back(heap_element(t));
+    push_heap<4>(_timer_heap.begin(), _timer_heap.end(), heap_less(), heap_place());
+}
+
+inline void
+TimerSet::heap_remove(Timer *t)
+{
+    remove_heap<4>(_timer_heap.begin(), _timer_heap.end(),
+		   _timer_heap.begin() + t->_schedpos1 - 1,
+		   heap_less(), heap_place());
+    _timer_heap.pop_back();
+    t->_schedpos1 = 0;
+}
+
+void
+TimerSet::set_wheel(bool wheel)
+{
+    lock_timers();
+    assert(!_timer_runchunk.size());
+    if (wheel && !this->wheel()) {
+	_wheel.assign(wheel_far + 1, 0);
+	_wheel_tick = wheel_tick(Timestamp::now_steady());
+	// move the timers that no longer belong to the heap
+	Vector<heap_element> heap;
+	heap.swap(_timer_heap);
+	for (heap_element *thp = heap.begin(); thp != heap.end(); ++thp)
+	    wheel_place(thp->t);
+    } else if (!wheel && this->wheel()) {
+	for (int i = 0; i < _wheel.size(); ++i)
+	    for (Timer *t = _wheel[i], *next; t; t = next) {
+		next = t->_wheel_next;
+		heap_insert(t);
+	    }
+	_wheel.clear();
+	_wheel_count = 0;
+	memset(_wheel_occupied, 0, sizeof(_wheel_occupied));
+    }
+    set_timer_expiry();
+    unlock_timers();
+}
+
+inline int
+TimerSet::wheel_next_slot(int level, int from) const
+{
+    const uint64_t *occupied = _wheel_occupied[level];
+    for (int w = from >> 6; w < wheel_slots / 64; ++w) {
+	uint64_t bits = occupied[w];
+	if (w == from >> 6)
+	    bits &= ~(uint64_t) 0 << (from & 63);
+	if (bits)
+	    return w * 64 + ffs_lsb(bits) - 1;
+    }
+    return -1;
+}
+
+/** @brief Return the wheel list whose timers must move next, and set @a
+ * tick to the tick at which they move, or return -1 if the wheel is empty.
+ *
+ * Only slots after the current position of each level are occupied, and
+ * slots of higher levels move when the lower levels wrap around. */
+int
+TimerSet::wheel_next(uint64_t &tick) const
+{
+    for (int level = 0; level < wheel_levels; ++level) {
+	int shift = level * wheel_bits;
+	int slot = wheel_next_slot(level, ((_wheel_tick >> shift) & (wheel_slots - 1)) + 1);
+	if (slot >= 0) {
+	    uint64_t mask = ((uint64_t) wheel_slots << shift) - 1;
+	    tick = (_wheel_tick & ~mask) | ((uint64_t) slot << shift);
+	    return level * wheel_slots + slot;
+	}
+    }
+    if (_wheel[wheel_far]) {
+	tick = (_wheel_tick | 0xFFFFFFFFU) + 1;
+	return wheel_far;
+    }
+    return -1;
+}
+
+Timestamp
+TimerSet::wheel_expiry() const
+{
+    uint64_t tick;
+    if (wheel_next(tick) < 0)
+	return Timestamp();
+    return Timestamp::make_msec(tick);
+}
+
+void
+TimerSet::wheel_insert(Timer *t)
+{
+    uint64_t tick = wheel_tick(t->_expiry_s), diff = tick ^ _wheel_tick;
+    int i;
+    if (diff >> (wheel_levels * wheel_bits))
+	i = wheel_far;
+    else {
+	int level = 0;
+	while (diff >> ((level + 1) * wheel_bits))
+	    ++level;
+	int slot = (tick >> (level * wheel_bits)) & (wheel_slots - 1);
+	_wheel_occupied[level][slot >> 6] |= (uint64_t) 1 << (slot & 63);
+	i = level * wheel_slots + slot;
+    }
+    Timer **head = &_wheel[i];
+    if ((t->_wheel_next = *head))
+	(*head)->_wheel_pprev = &t->_wheel_next;
+    *head = t;
+    t->_wheel_pprev = head;
+    t->_schedpos1 = schedpos_wheel;
+    ++_wheel_count;
+}
+
+void
+TimerSet::wheel_remove(Timer *t)
+{
+    Timer **pprev = t->_wheel_pprev;
+    if ((*pprev = t->_wheel_next))
+	t->_wheel_next->_wheel_pprev = pprev;
+    else if (pprev >= _wheel.begin() && pprev < _wheel.begin() + wheel_far) {
+	// the slot is now empty
+	int i = pprev - _wheel.begin();
+	_wheel_occupied[i / wheel_slots][(i % wheel_slots) >> 6] &= ~((uint64_t) 1 << (i & 63));
+    }
+    t->_schedpos1 = 0;
+    --_wheel_count;
+}
+
+/** @brief Put the unscheduled timer @a t in the heap if it expires by the
+ * current tick, and in the wheel otherwise. */
+void
+TimerSet::wheel_place(Timer *t)
+{
+    if (wheel_tick(t->_expiry_s) <= _wheel_tick)
+	heap_insert(t);
+    else
+	wheel_insert(t);
+}
+
+void
+TimerSet::wheel_cascade(int i)
+{
+    Timer *t = _wheel[i];
+    if (!t)
+	return;
+    _wheel[i] = 0;
+    if (i < wheel_far)
+	_wheel_occupied[i / wheel_slots][(i % wheel_slots) >> 6] &= ~((uint64_t) 1 << (i & 63));
+    while (t) {
+	Timer *next = t->_wheel_next;
+	--_wheel_count;
+	wheel_place(t);
+	t = next;
+    }
+}
+
+/** @brief Schedule @a t, whose expiry was just set, in the wheel if it
+ * expires after the current tick.
+ *
+ * Returns false if @a t must go to the heap instead. The wheel no longer
+ * holds @a t in that case. */
+bool
+TimerSet::wheel_schedule(Timer *t)
+{
+    if (t->_schedpos1 == schedpos_wheel)
+	wheel_remove(t);
+    if (!_wheel_count) {
+	// nothing depends on the current tick, skip the ticks missed while
+	// no timer needed them
+	uint64_t check_tick = wheel_tick(_timer_check);
+	if (check_tick > _wheel_tick)
+	    _wheel_tick = check_tick;
+    }
+    if (wheel_tick(t->_expiry_s) <= _wheel_tick)
+	return false;
+
+    int old_schedpos1 = t->_schedpos1;
+    if (old_schedpos1 > 0)
+	heap_remove(t);
+    else if (old_schedpos1 < 0)
+	_timer_runchunk[-old_schedpos1 - 1] = 0;
+    wheel_insert(t);
+
+    // timers in the heap always run before those in the wheel
+    if (old_schedpos1 == 1 || _timer_heap.empty()) {
+	Timestamp old_expiry = _timer_expiry;
+	set_timer_expiry();
+	if (!old_expiry || _timer_expiry < old_expiry)
+	    t->_thread->wake();
+    }
+    return true;
+}
+
+/** @brief Move the wheel forward to @a now, moving the timers of the
+ * elapsed ticks to the heap. */
+void
+TimerSet::wheel_advance(const Timestamp &now)
+{
+    uint64_t now_tick = wheel_tick(now), tick;
+    while (_wheel_count && wheel_next(tick) >= 0 && tick <= now_tick) {
+	_wheel_tick = tick;
+	// from the top, so that timers cascade down through every level
+	// entered at this tick
+	for (int level = wheel_levels; level >= 0; --level) {
+	    int shift = level * wheel_bits;
+	    if (tick & (((uint64_t) 1 << shift) - 1))
+		continue;
+	    if (level == wheel_levels)
+		wheel_cascade(wheel_far);
+	    else
+		wheel_cascade(level * wheel_slots + ((tick >> shift) & (wheel_slots - 1)));
+	}
+    }
+    if (now_tick > _wheel_tick)
+	_wheel_tick = now_tick;
+    set_timer_expiry();
+}
+
 void
 TimerSet::check_timer_expiry(Timer *t)
 {
@@ -97,14 +330,14 @@ TimerSet::run_one_timer(Timer *t)
 #if CLICK_STATS >= 2
     Element *owner = t->_owner;
     click_cycles_t start_cycles = click_get_cycles(),
-	start_child_cycles = owner->_child_cycles;
+	start_child_cycles = ElementProfile::thread_child_cycles();
 #endif
 
     t->_hook.callback(t, t->_thunk);
 
 #if CLICK_STATS >= 2
     click_cycles_t all_delta = click_get_cycles() - start_cycles,
-	own_delta = all_delta - (owner->_child_cycles - start_child_cycles);
+	own_delta = all_delta - (ElementProfile::thread_child_cycles() - start_child_cycles);
     owner->_timer_calls += 1;
     owner->_timer_own_cycles += own_delta;
 #endif
@@ -115,7 +348,8 @@ TimerSet::run_timers(RouterThread *thread, Master *master)
 {
     if (!_timer_lock.attempt())
 	return;
-    if (!master->paused() && _timer_heap.size() > 0 && !thread->stop_flag()) {
+    if (!master->paused() && (_timer_heap.size() > 0 || _wheel_count)
+	&& !thread->stop_flag()) {
 	thread->set_thread_state(RouterThread::S_RUNTIMER);
 #if CLICK_LINUXMODULE
 	_timer_task = current;
@@ -123,9 +357,11 @@ TimerSet::run_timers(RouterThread *thread, Master *master)
 	_timer_processor = click_current_processor();
 #endif
 	_timer_check = Timestamp::now_steady();
+	if (_wheel_count)
+	    wheel_advance(_timer_check);
 	heap_element *th = _timer_heap.begin();
 
-	if (th->expiry_s <= _timer_check) {
+	if (_timer_heap.size() > 0 && th->expiry_s <= _timer_check) {
 	    // potentially adjust timer stride
 	    Timestamp adj_expiry = th->expiry_s + Timer::adjustment();
 	    if (adj_expiry <= _timer_check) {
@@ -83,6 +83,7 @@ CLICK_USING_DECLS
 #define THREADS_AFF_OPT         319
 #define DPDK_OPT                320
 #define SIMTICK_OPT             321
+#define TIMER_WHEEL_OPT         322
 
 static const Clp_Option options[] = {
     { "allow-reconfigure", 'R', ALLOW_RECONFIG_OPT, 0, Clp_Negate },
@@ -103,6 +104,7 @@ static const Clp_Option options[] = {
     { "cpu", 0, THREADS_AFF_OPT, Clp_ValInt, Clp_Optional | Clp_Negate },
     { "affinity", 'a', THREADS_AFF_OPT, Clp_ValInt, Clp_Optional | Clp_Negate },
     { "time", 't', TIME_OPT, 0, 0 },
+    { "timer-wheel", 0, TIMER_WHEEL_OPT, 0, Clp_Negate },
     { "unix-socket", 'u', UNIX_SOCKET_OPT, Clp_ValString, 0 },
     { "version", 'v', VERSION_OPT, 0, 0 },
     { "warnings", 0, WARNINGS_OPT, 0, Clp_Negate },
@@ -156,6 +158,7 @@ Options:\n\
   -w, --no-warnings             Do not print warnings.\n\
       --simtime                 Run in simulation time.\n\
       --simtick                 Amount of subseconds to add in warp time.\n\
+      --timer-wheel             Keep long timers in a timing wheel.\n\
   -C, --clickpath PATH          Use PATH for CLICKPATH.\n\
       --help                    Print this message and exit.\n\
   -v, --version                 Print version number and exit.\n\
@@ -512,8 +515,19 @@ void do_set_affinity(pthread_t p, int cpu) {
         pthread_setaffinity_np(p, sizeof(cpu_set_t), &set);
     }
 }
+// Threads are created pinned, so that their stack and packet pool are on
+// the right socket from their first allocation.
+void do_set_affinity_attr(pthread_attr_t *attr, int cpu) {
+    if (!dpdk_enabled && click_affinity_offset >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu + click_affinity_offset, &set);
+        pthread_attr_setaffinity_np(attr, sizeof(cpu_set_t), &set);
+    }
+}
 #else
 # define do_set_affinity(p, cpu) /* nothing */
+# define do_set_affinity_attr(attr, cpu) /* nothing */
 #endif
 
 int
@@ -533,6 +547,7 @@ main(int argc, char **argv)
   bool quit_immediately = false;
   bool report_time = false;
   bool allow_reconfigure = false;
+  bool timer_wheel = false;
   Vector<String> handlers;
   String exit_handler;
   Vector<char*> dpdk_arg;
@@ -619,6 +634,10 @@ main(int argc, char **argv)
       report_time = true;
       break;
 
+     case TIMER_WHEEL_OPT:
+      timer_wheel = !clp->negated;
+      break;
+
      case WARNINGS_OPT:
       warnings = !clp->negated;
       break;
@@ -733,6 +752,8 @@ particular purpose.\n");
 
   // parse configuration
   click_master = new Master(click_nthreads);
+  if (timer_wheel)
+      click_master->set_timer_wheel(true);
   click_router = parse_configuration(router_file, file_is_expr, false, errh);
   if (!click_router)
     return cleanup(clp, 1);
@@ -797,11 +818,19 @@ particular purpose.\n");
     {
         for (int t = 1; t < click_nthreads; ++t) {
             pthread_t p;
-            pthread_create(&p, 0, thread_driver, click_master->thread(t));
+            pthread_attr_t attr;
+            pthread_attr_init(&attr);
+            do_set_affinity_attr(&attr, t);
+            if (pthread_create(&p, &attr, thread_driver, click_master->thread(t)) != 0)
+                pthread_create(&p, 0, thread_driver, click_master->thread(t));
+            pthread_attr_destroy(&attr);
             other_threads.push_back(p);
-            do_set_affinity(p, t);
         }
         do_set_affinity(pthread_self(), 0);
+# if HAVE_CLICK_PACKET_POOL
+        // The main thread may have allocated packets before it was pinned
+        WritablePacket::pool_rehome();
+# endif
     }
 #endif
 